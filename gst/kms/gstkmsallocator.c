@@ -27,8 +27,11 @@
 #include "config.h"
 #endif
 
+#include <gst/allocators/gstdmabuf.h>
+
 #include <xf86drm.h>
 #include <xf86drmMode.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -45,6 +48,21 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define GST_KMS_MEMORY_TYPE "KMSMemory"
 
+#ifndef DRM_RDWR
+#define DRM_RDWR O_RDWR
+#endif
+
+/* size classes of the free dumb buffers, from 64 KiB doubling up */
+#define GST_KMS_FREE_BUCKETS 24
+#define DEFAULT_RECYCLE_BUDGET (64 * 1024 * 1024)
+
+typedef struct
+{
+  guint32 fmt, width, height;
+  guint32 pitches[4];
+  guint32 offsets[4];
+} GstKMSFBLayout;
+
 struct kms_bo
 {
   void *ptr;
@@ -53,11 +71,34 @@ struct kms_bo
   size_t pitch;
   unsigned handle;
   unsigned int refs;
+
+  /* arguments of DRM_IOCTL_MODE_CREATE_DUMB */
+  guint32 width, height, bpp;
+
+  /* framebuffer kept while the bo waits in the free list */
+  guint32 fb_id;
+  GstKMSFBLayout layout;
+  guint64 freed;
 };
 
 struct _GstKMSAllocatorPrivate
 {
   int fd;
+  GstAllocator *dmabuf_alloc;   /* wraps the exported buffers */
+
+  /* dumb buffers of the freed memories, most recently freed first */
+  GMutex lock;
+  GQueue free_bos[GST_KMS_FREE_BUCKETS];
+  guint64 free_size;
+  guint64 budget;
+  guint64 free_seq;
+
+  guint64 allocated, recycled, destroyed, fb_reused;
+
+  /* handles of the live dumb buffers, that importing one of our own
+   * dmabufs gives back */
+  GMutex handles_lock;
+  GHashTable *handles;
 };
 
 #define parent_class gst_kms_allocator_parent_class
@@ -69,6 +110,7 @@ G_DEFINE_TYPE_WITH_CODE (GstKMSAllocator, gst_kms_allocator, GST_TYPE_ALLOCATOR,
 enum
 {
   PROP_DRM_FD = 1,
+  PROP_RECYCLE_BUDGET,
   PROP_N,
 };
 
@@ -95,11 +137,39 @@ check_fd (GstKMSAllocator * alloc)
 }
 
 static void
-gst_kms_allocator_memory_reset (GstKMSAllocator * allocator, GstKMSMemory * mem)
+gst_kms_allocator_bo_destroy (GstKMSAllocator * allocator, struct kms_bo *bo)
 {
   int err;
   struct drm_mode_destroy_dumb arg = { 0, };
 
+  if (bo->fb_id) {
+    GST_DEBUG_OBJECT (allocator, "removing fb id %d", bo->fb_id);
+    drmModeRmFB (allocator->priv->fd, bo->fb_id);
+  }
+
+  if (bo->ptr != NULL) {
+    GST_WARNING_OBJECT (allocator, "destroying mapped bo (refcount=%d)",
+        bo->refs);
+    munmap (bo->ptr, bo->size);
+  }
+
+  g_mutex_lock (&allocator->priv->handles_lock);
+  g_hash_table_remove (allocator->priv->handles, GUINT_TO_POINTER (bo->handle));
+  g_mutex_unlock (&allocator->priv->handles_lock);
+
+  arg.handle = bo->handle;
+
+  err = drmIoctl (allocator->priv->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &arg);
+  if (err)
+    GST_WARNING_OBJECT (allocator,
+        "Failed to destroy dumb buffer object: %s %d", strerror (errno), errno);
+
+  g_free (bo);
+}
+
+static void
+gst_kms_allocator_memory_reset (GstKMSAllocator * allocator, GstKMSMemory * mem)
+{
   if (!check_fd (allocator))
     return;
 
@@ -112,22 +182,119 @@ gst_kms_allocator_memory_reset (GstKMSAllocator * allocator, GstKMSMemory * mem)
   if (!mem->bo)
     return;
 
-  if (mem->bo->ptr != NULL) {
-    GST_WARNING_OBJECT (allocator, "destroying mapped bo (refcount=%d)",
-        mem->bo->refs);
-    munmap (mem->bo->ptr, mem->bo->size);
-    mem->bo->ptr = NULL;
+  g_mutex_lock (&allocator->priv->lock);
+  allocator->priv->destroyed++;
+  g_mutex_unlock (&allocator->priv->lock);
+
+  gst_kms_allocator_bo_destroy (allocator, mem->bo);
+  mem->bo = NULL;
+}
+
+static guint
+gst_kms_allocator_bucket (guint64 size)
+{
+  return MIN (g_bit_storage (size >> 16), GST_KMS_FREE_BUCKETS - 1);
+}
+
+/* call with the lock, the oldest free bos go first */
+static void
+gst_kms_allocator_trim (GstKMSAllocator * allocator, guint64 budget)
+{
+  GstKMSAllocatorPrivate *priv = allocator->priv;
+  struct kms_bo *bo, *oldest;
+  guint i, b;
+
+  while (priv->free_size > budget) {
+    oldest = NULL;
+    b = 0;
+    for (i = 0; i < GST_KMS_FREE_BUCKETS; i++) {
+      bo = g_queue_peek_tail (&priv->free_bos[i]);
+      if (bo && (!oldest || bo->freed < oldest->freed)) {
+        oldest = bo;
+        b = i;
+      }
+    }
+
+    g_queue_pop_tail (&priv->free_bos[b]);
+    priv->free_size -= oldest->size;
+    priv->destroyed++;
+
+    GST_DEBUG_OBJECT (allocator, "trimming bo handle %d of %" G_GSIZE_FORMAT
+        " bytes", oldest->handle, oldest->size);
+    gst_kms_allocator_bo_destroy (allocator, oldest);
   }
+}
 
-  arg.handle = mem->bo->handle;
+/* keeps the bo, and its framebuffer, of a freed memory for the next
+ * allocation of a size close to it */
+static gboolean
+gst_kms_allocator_recycle (GstKMSAllocator * allocator, GstKMSMemory * mem)
+{
+  GstKMSAllocatorPrivate *priv = allocator->priv;
+  struct kms_bo *bo = mem->bo;
 
-  err = drmIoctl (allocator->priv->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &arg);
-  if (err)
-    GST_WARNING_OBJECT (allocator,
-        "Failed to destroy dumb buffer object: %s %d", strerror (errno), errno);
+  if (!check_fd (allocator) || bo->ptr != NULL)
+    return FALSE;
+
+  g_mutex_lock (&priv->lock);
+  if (bo->size > priv->budget) {
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
 
-  g_free (mem->bo);
+  bo->fb_id = mem->fb_id;
+  bo->freed = ++priv->free_seq;
+  g_queue_push_head (&priv->free_bos[gst_kms_allocator_bucket (bo->size)],
+      bo);
+  priv->free_size += bo->size;
+  gst_kms_allocator_trim (allocator, priv->budget);
+  g_mutex_unlock (&priv->lock);
+
+  mem->fb_id = 0;
   mem->bo = NULL;
+
+  return TRUE;
+}
+
+/* A free bo fits when it was created at least as large for the same bpp,
+ * and wastes no more than the size it replaces. Single plane framebuffers
+ * take the pitch of the bo, so that one has to match too. */
+static struct kms_bo *
+gst_kms_allocator_take_free_bo (GstKMSAllocator * allocator, guint32 width,
+    guint32 height, guint32 bpp, gboolean same_width)
+{
+  GstKMSAllocatorPrivate *priv = allocator->priv;
+  struct kms_bo *bo;
+  guint64 needed;
+  GList *l;
+  guint b;
+
+  needed = (guint64) width * height * bpp / 8;
+
+  g_mutex_lock (&priv->lock);
+  for (b = gst_kms_allocator_bucket (needed);
+      b <= gst_kms_allocator_bucket (needed * 2); b++) {
+    for (l = priv->free_bos[b].head; l; l = l->next) {
+      bo = l->data;
+
+      if (bo->bpp != bpp || bo->width < width || bo->height < height)
+        continue;
+      if (same_width && bo->width != width)
+        continue;
+      if (bo->size > needed * 2)
+        continue;
+
+      g_queue_delete_link (&priv->free_bos[b], l);
+      priv->free_size -= bo->size;
+      priv->recycled++;
+      g_mutex_unlock (&priv->lock);
+
+      return bo;
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return NULL;
 }
 
 static gboolean
@@ -144,15 +311,23 @@ gst_kms_allocator_memory_create (GstKMSAllocator * allocator,
   if (!check_fd (allocator))
     return FALSE;
 
-  kmsmem->bo = g_malloc0 (sizeof (*kmsmem->bo));
-  if (!kmsmem->bo)
-    return FALSE;
-
   fmt = gst_drm_format_from_video (GST_VIDEO_INFO_FORMAT (vinfo));
   arg.bpp = gst_drm_bpp_from_drm (fmt);
   arg.width = GST_VIDEO_INFO_WIDTH (vinfo);
   arg.height = gst_drm_height_from_drm (fmt, GST_VIDEO_INFO_HEIGHT (vinfo));
 
+  kmsmem->bo = gst_kms_allocator_take_free_bo (allocator, arg.width,
+      arg.height, arg.bpp, GST_VIDEO_INFO_N_PLANES (vinfo) == 1);
+  if (kmsmem->bo) {
+    GST_DEBUG_OBJECT (allocator, "recycling bo handle %d of %" G_GSIZE_FORMAT
+        " bytes", kmsmem->bo->handle, kmsmem->bo->size);
+    return TRUE;
+  }
+
+  kmsmem->bo = g_malloc0 (sizeof (*kmsmem->bo));
+  if (!kmsmem->bo)
+    return FALSE;
+
   ret = drmIoctl (allocator->priv->fd, DRM_IOCTL_MODE_CREATE_DUMB, &arg);
   if (ret)
     goto create_failed;
@@ -160,6 +335,17 @@ gst_kms_allocator_memory_create (GstKMSAllocator * allocator,
   kmsmem->bo->handle = arg.handle;
   kmsmem->bo->size = arg.size;
   kmsmem->bo->pitch = arg.pitch;
+  kmsmem->bo->width = arg.width;
+  kmsmem->bo->height = arg.height;
+  kmsmem->bo->bpp = arg.bpp;
+
+  g_mutex_lock (&allocator->priv->handles_lock);
+  g_hash_table_add (allocator->priv->handles, GUINT_TO_POINTER (arg.handle));
+  g_mutex_unlock (&allocator->priv->handles_lock);
+
+  g_mutex_lock (&allocator->priv->lock);
+  allocator->priv->allocated++;
+  g_mutex_unlock (&allocator->priv->lock);
 
   return TRUE;
 
@@ -183,7 +369,8 @@ gst_kms_allocator_free (GstAllocator * allocator, GstMemory * mem)
   alloc = GST_KMS_ALLOCATOR (allocator);
   kmsmem = (GstKMSMemory *) mem;
 
-  gst_kms_allocator_memory_reset (alloc, kmsmem);
+  if (!kmsmem->bo || !gst_kms_allocator_recycle (alloc, kmsmem))
+    gst_kms_allocator_memory_reset (alloc, kmsmem);
   g_slice_free (GstKMSMemory, kmsmem);
 }
 
@@ -202,6 +389,13 @@ gst_kms_allocator_set_property (GObject * object, guint prop_id,
         alloc->priv->fd = dup (fd);
       break;
     }
+    case PROP_RECYCLE_BUDGET:
+      g_mutex_lock (&alloc->priv->lock);
+      alloc->priv->budget = g_value_get_uint64 (value);
+      if (check_fd (alloc))
+        gst_kms_allocator_trim (alloc, alloc->priv->budget);
+      g_mutex_unlock (&alloc->priv->lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -220,6 +414,9 @@ gst_kms_allocator_get_property (GObject * object, guint prop_id,
     case PROP_DRM_FD:
       g_value_set_int (value, alloc->priv->fd);
       break;
+    case PROP_RECYCLE_BUDGET:
+      g_value_set_uint64 (value, alloc->priv->budget);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -233,8 +430,16 @@ gst_kms_allocator_finalize (GObject * obj)
 
   alloc = GST_KMS_ALLOCATOR (obj);
 
-  if (check_fd (alloc))
+  if (check_fd (alloc)) {
+    gst_kms_allocator_trim (alloc, 0);
     close (alloc->priv->fd);
+  }
+  g_mutex_clear (&alloc->priv->lock);
+  g_hash_table_unref (alloc->priv->handles);
+  g_mutex_clear (&alloc->priv->handles_lock);
+
+  if (alloc->priv->dmabuf_alloc)
+    gst_object_unref (alloc->priv->dmabuf_alloc);
 
   G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -258,6 +463,11 @@ gst_kms_allocator_class_init (GstKMSAllocatorClass * klass)
       "DRM file descriptor", -1, G_MAXINT, -1,
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
 
+  g_props[PROP_RECYCLE_BUDGET] = g_param_spec_uint64 ("recycle-budget",
+      "Recycle budget", "Bytes of freed dumb buffers kept for reuse",
+      0, G_MAXUINT64, DEFAULT_RECYCLE_BUDGET,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT);
+
   g_object_class_install_properties (gobject_class, PROP_N, g_props);
 }
 
@@ -329,11 +539,17 @@ static void
 gst_kms_allocator_init (GstKMSAllocator * allocator)
 {
   GstAllocator *alloc;
+  guint i;
 
   alloc = GST_ALLOCATOR_CAST (allocator);
 
   allocator->priv = gst_kms_allocator_get_instance_private (allocator);
   allocator->priv->fd = -1;
+  g_mutex_init (&allocator->priv->lock);
+  for (i = 0; i < GST_KMS_FREE_BUCKETS; i++)
+    g_queue_init (&allocator->priv->free_bos[i]);
+  g_mutex_init (&allocator->priv->handles_lock);
+  allocator->priv->handles = g_hash_table_new (NULL, NULL);
 
   alloc->mem_type = GST_KMS_MEMORY_TYPE;
   alloc->mem_map = gst_kms_memory_map;
@@ -361,6 +577,7 @@ gst_kms_allocator_add_fb (GstKMSAllocator * alloc, GstKMSMemory * kmsmem,
   guint32 w, h, fmt, pitch = 0, bo_handles[4] = { 0, };
   guint32 offsets[4] = { 0, };
   guint32 pitches[4] = { 0, };
+  GstKMSFBLayout layout;
 
   if (kmsmem->fb_id)
     return TRUE;
@@ -397,10 +614,34 @@ gst_kms_allocator_add_fb (GstKMSAllocator * alloc, GstKMSMemory * kmsmem,
     GST_DEBUG_OBJECT (alloc, "Create FB plane %i with stride %u and offset %u",
         i, pitches[i], offsets[i]);
 
-    if (w >= 3840)
+    if (w >= GST_KMS_MAX_FETCH_WIDTH)
       pitches[i] *= 2;
   }
 
+  /* a recycled bo brings the framebuffer it had, if the layout is the same */
+  memset (&layout, 0, sizeof (layout));
+  layout.fmt = fmt;
+  layout.width = w;
+  layout.height = h;
+  memcpy (layout.pitches, pitches, sizeof (pitches));
+  memcpy (layout.offsets, offsets, sizeof (offsets));
+
+  if (kmsmem->bo && kmsmem->bo->fb_id) {
+    if (!memcmp (&layout, &kmsmem->bo->layout, sizeof (layout))) {
+      kmsmem->fb_id = kmsmem->bo->fb_id;
+      kmsmem->bo->fb_id = 0;
+      GST_DEBUG_OBJECT (alloc, "reusing fb id %d", kmsmem->fb_id);
+
+      g_mutex_lock (&alloc->priv->lock);
+      alloc->priv->fb_reused++;
+      g_mutex_unlock (&alloc->priv->lock);
+      return TRUE;
+    }
+
+    drmModeRmFB (alloc->priv->fd, kmsmem->bo->fb_id);
+    kmsmem->bo->fb_id = 0;
+  }
+
   ret = drmModeAddFB2 (alloc->priv->fd, w, h, fmt, bo_handles, pitches,
       offsets, &kmsmem->fb_id, 0);
   if (ret) {
@@ -408,9 +649,55 @@ gst_kms_allocator_add_fb (GstKMSAllocator * alloc, GstKMSMemory * kmsmem,
         strerror (-ret), ret);
     return FALSE;
   }
+
+  if (kmsmem->bo)
+    kmsmem->bo->layout = layout;
+
   return TRUE;
 }
 
+/* the framebuffer holds the imported objects, their handles are only
+ * needed to create it. A dmabuf exported from one of our dumb buffers
+ * imports as the handle of that bo, which stays open. */
+static void
+gst_kms_allocator_close_handles (GstKMSAllocator * alloc,
+    GstKMSMemory * kmsmem)
+{
+  struct drm_gem_close arg = { 0, };
+  gboolean own;
+  gint i, j;
+
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+    if (!kmsmem->gem_handle[i])
+      continue;
+
+    /* the planes of one dmabuf share their handle */
+    for (j = 0; j < i; j++) {
+      if (kmsmem->gem_handle[j] == kmsmem->gem_handle[i])
+        break;
+    }
+    if (j < i)
+      continue;
+
+    g_mutex_lock (&alloc->priv->handles_lock);
+    own = g_hash_table_contains (alloc->priv->handles,
+        GUINT_TO_POINTER (kmsmem->gem_handle[i]));
+    g_mutex_unlock (&alloc->priv->handles_lock);
+    if (own) {
+      GST_DEBUG_OBJECT (alloc, "keeping GEM handle %u of our bo",
+          kmsmem->gem_handle[i]);
+      continue;
+    }
+
+    arg.handle = kmsmem->gem_handle[i];
+    if (drmIoctl (alloc->priv->fd, DRM_IOCTL_GEM_CLOSE, &arg))
+      GST_WARNING_OBJECT (alloc, "Failed to close GEM handle %u: %s %d",
+          arg.handle, strerror (errno), errno);
+  }
+
+  memset (kmsmem->gem_handle, 0, sizeof (kmsmem->gem_handle));
+}
+
 static GstMemory *
 gst_kms_allocator_alloc_empty (GstAllocator * allocator, GstVideoInfo * vinfo)
 {
@@ -481,6 +768,8 @@ gst_kms_allocator_dmabuf_import (GstAllocator * allocator, gint * prime_fds,
   if (!gst_kms_allocator_add_fb (alloc, tmp, offsets, vinfo))
     goto failed;
 
+  gst_kms_allocator_close_handles (alloc, tmp);
+
   return tmp;
 
   /* ERRORS */
@@ -493,7 +782,183 @@ import_fd_failed:
 
 failed:
   {
+    gst_kms_allocator_close_handles (alloc, tmp);
     gst_memory_unref (mem);
     return NULL;
   }
 }
+
+GstMemory *
+gst_kms_allocator_get_cached (GstMemory * mem)
+{
+  return gst_mini_object_get_qdata (GST_MINI_OBJECT (mem),
+      g_quark_from_static_string ("kmsmem"));
+}
+
+/* takes @kmsmem, released with @mem */
+void
+gst_kms_allocator_cache (GstAllocator * allocator, GstMemory * mem,
+    GstMemory * kmsmem)
+{
+  gst_mini_object_set_qdata (GST_MINI_OBJECT (mem),
+      g_quark_from_static_string ("kmsmem"), kmsmem,
+      (GDestroyNotify) gst_memory_unref);
+}
+
+/* A buffer with the framebuffer of the dmabufs of @inbuf, laid out as
+ * @vinfo once updated from its video meta. The framebuffer is found on the
+ * first memory, in @cache for dmabufs wrapped again, or imported when
+ * @prime_import. @cached tells whether it existed already. */
+GstBuffer *
+gst_kms_allocator_import_buffer (GstAllocator * allocator,
+    GstKMSFBCache * cache, GstBuffer * inbuf, GstVideoInfo * vinfo,
+    gboolean prime_import, gboolean * cached)
+{
+  gint prime_fds[GST_VIDEO_MAX_PLANES] = { 0, };
+  gsize mems_skip[GST_VIDEO_MAX_PLANES];
+  GstMemory *mems[GST_VIDEO_MAX_PLANES];
+  GstKMSMemory *kmsmem;
+  GstVideoMeta *meta;
+  GstBuffer *outbuf;
+  guint i, idx, length, n_planes;
+  GstKMSFBKey key;
+  gboolean cacheable;
+
+  *cached = FALSE;
+
+  /* This will eliminate most non-dmabuf out there */
+  if (!gst_is_dmabuf_memory (gst_buffer_peek_memory (inbuf, 0)))
+    return NULL;
+
+  /* We cannot have multiple dmabuf per plane */
+  n_planes = GST_VIDEO_INFO_N_PLANES (vinfo);
+  if (gst_buffer_n_memory (inbuf) > n_planes)
+    return NULL;
+
+  meta = gst_buffer_get_video_meta (inbuf);
+  if (meta) {
+    GST_VIDEO_INFO_WIDTH (vinfo) = meta->width;
+    GST_VIDEO_INFO_HEIGHT (vinfo) = meta->height;
+
+    for (i = 0; i < meta->n_planes; i++) {
+      GST_VIDEO_INFO_PLANE_OFFSET (vinfo, i) = meta->offset[i];
+      GST_VIDEO_INFO_PLANE_STRIDE (vinfo, i) = meta->stride[i];
+    }
+  }
+
+  for (i = 0; i < n_planes; i++) {
+    if (!gst_buffer_find_memory (inbuf, GST_VIDEO_INFO_PLANE_OFFSET (vinfo,
+                i), 1, &idx, &length, &mems_skip[i]))
+      return NULL;
+
+    mems[i] = gst_buffer_peek_memory (inbuf, idx);
+    if (!gst_is_dmabuf_memory (mems[i]))
+      return NULL;
+  }
+
+  /* imported before, or exported by a pool of ours */
+  kmsmem = (GstKMSMemory *) gst_kms_allocator_get_cached (mems[0]);
+  if (kmsmem) {
+    *cached = TRUE;
+    goto wrap_mem;
+  }
+
+  if (!prime_import)
+    return NULL;
+
+  for (i = 0; i < n_planes; i++)
+    prime_fds[i] = gst_dmabuf_memory_get_fd (mems[i]);
+
+  /* the same dmabufs wrapped in new memories, e.g. by a new pool */
+  cacheable = cache && gst_kms_fb_key_init (&key, prime_fds, n_planes,
+      mems_skip, vinfo);
+  if (cacheable) {
+    kmsmem = (GstKMSMemory *) gst_kms_fb_cache_lookup (cache, &key);
+    if (kmsmem) {
+      *cached = TRUE;
+      gst_kms_allocator_cache (allocator, mems[0], GST_MEMORY_CAST (kmsmem));
+      goto wrap_mem;
+    }
+  }
+
+  kmsmem = gst_kms_allocator_dmabuf_import (allocator, prime_fds, n_planes,
+      mems_skip, vinfo);
+  if (!kmsmem)
+    return NULL;
+
+  gst_kms_allocator_cache (allocator, mems[0], GST_MEMORY_CAST (kmsmem));
+  if (cacheable)
+    gst_kms_fb_cache_insert (cache, &key, GST_MEMORY_CAST (kmsmem));
+
+wrap_mem:
+  GST_LOG_OBJECT (allocator, "DMABuf mem %p shown with fb id %d", mems[0],
+      kmsmem->fb_id);
+
+  outbuf = gst_buffer_new ();
+  gst_buffer_append_memory (outbuf, gst_memory_ref (GST_MEMORY_CAST (kmsmem)));
+  gst_buffer_add_parent_buffer_meta (outbuf, inbuf);
+
+  return outbuf;
+}
+
+GstMemory *
+gst_kms_allocator_dmabuf_export (GstAllocator * allocator, GstMemory * mem)
+{
+  GstKMSAllocator *alloc;
+  GstKMSMemory *kmsmem;
+  GstMemory *dmamem;
+  gint ret, prime_fd;
+
+  alloc = GST_KMS_ALLOCATOR (allocator);
+  kmsmem = (GstKMSMemory *) mem;
+
+  /* only dumb buffers are ours to export */
+  g_return_val_if_fail (kmsmem->bo, NULL);
+
+  /* writers map the dmabuf, which needs linux 4.6 for a writable export */
+  ret = drmPrimeHandleToFD (alloc->priv->fd, kmsmem->bo->handle,
+      DRM_CLOEXEC | DRM_RDWR, &prime_fd);
+  if (ret)
+    goto export_failed;
+
+  if (!alloc->priv->dmabuf_alloc)
+    alloc->priv->dmabuf_alloc = gst_dmabuf_allocator_new ();
+
+  dmamem = gst_dmabuf_allocator_alloc (alloc->priv->dmabuf_alloc, prime_fd,
+      gst_memory_get_sizes (mem, NULL, NULL));
+  if (!dmamem) {
+    close (prime_fd);
+    return NULL;
+  }
+
+  /* the sink finds the framebuffer back when the dmabuf comes to it */
+  gst_kms_allocator_cache (allocator, dmamem, mem);
+
+  GST_DEBUG_OBJECT (alloc, "exported bo handle %d as fd %d with fb id %d",
+      kmsmem->bo->handle, prime_fd, kmsmem->fb_id);
+
+  return dmamem;
+
+  /* ERRORS */
+export_failed:
+  {
+    GST_WARNING_OBJECT (alloc, "Failed to export bo handle %d: %s (%d)",
+        kmsmem->bo->handle, strerror (errno), errno);
+    return NULL;
+  }
+}
+
+void
+gst_kms_allocator_add_stats (GstAllocator * allocator, GstStructure * s)
+{
+  GstKMSAllocatorPrivate *priv = GST_KMS_ALLOCATOR (allocator)->priv;
+
+  g_mutex_lock (&priv->lock);
+  gst_structure_set (s,
+      "dumb-allocated", G_TYPE_UINT64, priv->allocated,
+      "dumb-recycled", G_TYPE_UINT64, priv->recycled,
+      "dumb-destroyed", G_TYPE_UINT64, priv->destroyed,
+      "fb-reused", G_TYPE_UINT64, priv->fb_reused,
+      "dumb-free-bytes", G_TYPE_UINT64, priv->free_size, NULL);
+  g_mutex_unlock (&priv->lock);
+}
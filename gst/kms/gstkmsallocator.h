@@ -29,6 +29,8 @@
 #include <gst/gst.h>
 #include <gst/video/video.h>
 
+#include "gstkmsfbcache.h"
+
 G_BEGIN_DECLS
 #define GST_TYPE_KMS_ALLOCATOR	\
    (gst_kms_allocator_get_type())
@@ -47,6 +49,10 @@ typedef struct _GstKMSAllocatorClass GstKMSAllocatorClass;
 typedef struct _GstKMSAllocatorPrivate GstKMSAllocatorPrivate;
 typedef struct _GstKMSMemory GstKMSMemory;
 
+/* the VOP fetches frames of that width or wider every other line, their
+ * framebuffers are added with twice the pitches and half the lines shown */
+#define GST_KMS_MAX_FETCH_WIDTH 3840
+
 struct kms_bo;
 
 struct _GstKMSMemory
@@ -85,5 +91,20 @@ gst_kms_allocator_get_type (void)
     gint * prime_fds,
     gint n_planes, gsize offsets[GST_VIDEO_MAX_PLANES], GstVideoInfo * vinfo);
 
+     GstMemory *gst_kms_allocator_dmabuf_export (GstAllocator * allocator,
+    GstMemory * kmsmem);
+
+     GstMemory *gst_kms_allocator_get_cached (GstMemory * mem);
+
+     void gst_kms_allocator_cache (GstAllocator * allocator, GstMemory * mem,
+    GstMemory * kmsmem);
+
+     GstBuffer *gst_kms_allocator_import_buffer (GstAllocator * allocator,
+    GstKMSFBCache * cache, GstBuffer * inbuf, GstVideoInfo * vinfo,
+    gboolean prime_import, gboolean * cached);
+
+     void gst_kms_allocator_add_stats (GstAllocator * allocator,
+    GstStructure * s);
+
 G_END_DECLS
 #endif /* __GST_KMS_ALLOCATOR_H__ */
@@ -41,6 +41,7 @@ struct _GstKMSBufferPoolPrivate
   GstVideoInfo vinfo;
   GstAllocator *allocator;
   gboolean add_videometa;
+  gboolean has_prime_export;
 };
 
 #define parent_class gst_kms_buffer_pool_parent_class
@@ -53,7 +54,8 @@ static const gchar **
 gst_kms_buffer_pool_get_options (GstBufferPool * pool)
 {
   static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META,
-    GST_BUFFER_POOL_OPTION_KMS_BUFFER, NULL
+    GST_BUFFER_POOL_OPTION_KMS_BUFFER, GST_BUFFER_POOL_OPTION_KMS_PRIME_EXPORT,
+    NULL
   };
   return options;
 }
@@ -100,6 +102,9 @@ gst_kms_buffer_pool_set_config (GstBufferPool * pool, GstStructure * config)
   priv->add_videometa = gst_buffer_pool_config_has_option (config,
       GST_BUFFER_POOL_OPTION_VIDEO_META);
 
+  priv->has_prime_export = gst_buffer_pool_config_has_option (config,
+      GST_BUFFER_POOL_OPTION_KMS_PRIME_EXPORT);
+
   return GST_BUFFER_POOL_CLASS (parent_class)->set_config (pool, config);
 
   /* ERRORS */
@@ -126,6 +131,36 @@ no_allocator:
   }
 }
 
+static gboolean
+gst_kms_buffer_pool_start (GstBufferPool * pool)
+{
+  GstKMSBufferPool *vpool;
+  GstKMSBufferPoolPrivate *priv;
+  GstMemory *mem, *dmamem;
+
+  vpool = GST_KMS_BUFFER_POOL_CAST (pool);
+  priv = vpool->priv;
+
+  /* decide for the whole pool, before any buffer is allocated */
+  if (priv->has_prime_export) {
+    mem = gst_kms_allocator_bo_alloc (priv->allocator, &priv->vinfo);
+    dmamem = mem ? gst_kms_allocator_dmabuf_export (priv->allocator, mem) :
+        NULL;
+
+    if (dmamem) {
+      gst_memory_unref (dmamem);
+    } else {
+      GST_WARNING_OBJECT (pool, "can't export buffers, allocating dumb "
+          "buffers only");
+      priv->has_prime_export = FALSE;
+      if (mem)
+        gst_memory_unref (mem);
+    }
+  }
+
+  return GST_BUFFER_POOL_CLASS (parent_class)->start (pool);
+}
+
 static GstFlowReturn
 gst_kms_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
     GstBufferPoolAcquireParams * params)
@@ -133,7 +168,7 @@ gst_kms_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
   GstKMSBufferPool *vpool;
   GstKMSBufferPoolPrivate *priv;
   GstVideoInfo *info;
-  GstMemory *mem;
+  GstMemory *mem, *dmamem;
 
   vpool = GST_KMS_BUFFER_POOL_CAST (pool);
   priv = vpool->priv;
@@ -147,6 +182,18 @@ gst_kms_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
     gst_buffer_unref (*buffer);
     goto no_memory;
   }
+
+  /* upstream imports the dmabuf, the sink finds the framebuffer in it.
+   * start () checked the export works, every buffer is exported or none */
+  if (priv->has_prime_export) {
+    dmamem = gst_kms_allocator_dmabuf_export (priv->allocator, mem);
+    if (!dmamem) {
+      gst_memory_unref (mem);
+      gst_buffer_unref (*buffer);
+      goto no_memory;
+    }
+    mem = dmamem;
+  }
   gst_buffer_append_memory (*buffer, mem);
 
   if (priv->add_videometa) {
@@ -203,6 +250,7 @@ gst_kms_buffer_pool_class_init (GstKMSBufferPoolClass * klass)
 
   gstbufferpool_class->get_options = gst_kms_buffer_pool_get_options;
   gstbufferpool_class->set_config = gst_kms_buffer_pool_set_config;
+  gstbufferpool_class->start = gst_kms_buffer_pool_start;
   gstbufferpool_class->alloc_buffer = gst_kms_buffer_pool_alloc_buffer;
 }
 
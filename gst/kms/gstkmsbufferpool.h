@@ -39,6 +39,14 @@ G_BEGIN_DECLS
  * buffers.
  */
 #define GST_BUFFER_POOL_OPTION_KMS_BUFFER "GstBufferPoolOptionKMSBuffer"
+
+/**
+ * GST_BUFFER_POOL_OPTION_KMS_PRIME_EXPORT:
+ *
+ * An option that can be activated on buffer pool to have the KMS buffers
+ * exported as dmabufs.
+ */
+#define GST_BUFFER_POOL_OPTION_KMS_PRIME_EXPORT "GstBufferPoolOptionKMSPrimeExport"
 /* video bufferpool */
 typedef struct _GstKMSBufferPool GstKMSBufferPool;
 typedef struct _GstKMSBufferPoolClass GstKMSBufferPoolClass;
@@ -0,0 +1,1483 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/**
+ * SECTION:element-kmscompositorsink
+ *
+ * Shows several video streams on one crtc. Every sink pad is put on a
+ * hardware plane of its own, from the bottom up in increasing zorder, and
+ * the plane updates of a frame go to the display in a single atomic
+ * commit. When the planes run out, or can't show the format of a stream,
+ * the bottom streams are scaled into a canvas on the lowest plane instead.
+ * A layout the driver rejects in a test commit gets one plane less until
+ * it is accepted.
+ *
+ * The crtc is used with the mode it has, and the element needs the atomic
+ * API. It doesn't preroll: it goes to PAUSED at once and holds the first
+ * frame until PLAYING.
+ *
+ * vkms, loaded with enable_overlay=1, has overlay planes to try the plane
+ * allocation without the hardware.
+ *
+ * <refsect2>
+ * |[
+ * gst-launch-1.0 kmscompositorsink name=c sink_1::xpos=960 \
+ *     v4l2src device=/dev/video0 ! c. \
+ *     v4l2src device=/dev/video1 ! c.
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gstkmscompositor.h"
+#include "gstkmsallocator.h"
+#include "gstkmsbufferpool.h"
+#include "gstkmscopy.h"
+#include "gstkmsfbcache.h"
+#include "gstkmsplanes.h"
+#include "gstkmsutils.h"
+
+#define DEFAULT_PAD_XPOS 0
+#define DEFAULT_PAD_YPOS 0
+#define DEFAULT_PAD_WIDTH 0
+#define DEFAULT_PAD_HEIGHT 0
+
+#define DEFAULT_SYNC TRUE
+
+/* the streams that don't get a plane are composed in this format */
+#define GST_KMS_COMPOSITOR_CANVAS_FORMAT GST_VIDEO_FORMAT_xRGB
+
+/* buffers being filled, waiting for their flip and on screen */
+#define GST_KMS_COMPOSITOR_MIN_BUFFERS 3
+
+/* framebuffers of dmabufs wrapped again kept, as kmssink's fb-cache-size */
+#define GST_KMS_COMPOSITOR_FB_CACHE_SIZE 32
+
+/* bits of used_planes */
+#define GST_KMS_COMPOSITOR_MAX_PLANES 64
+
+GST_DEBUG_CATEGORY_STATIC (gst_kms_compositor_debug);
+#define GST_CAT_DEFAULT gst_kms_compositor_debug
+
+/*
+ * GstKMSCompositorPad
+ */
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ZORDER,
+  PROP_PAD_PLANE_ID,
+};
+
+G_DEFINE_TYPE (GstKMSCompositorPad, gst_kms_compositor_pad, GST_TYPE_PAD);
+
+static gint
+gst_kms_compositor_pad_compare (gconstpointer a, gconstpointer b)
+{
+  const GstKMSCompositorPad *pad1 = a;
+  const GstKMSCompositorPad *pad2 = b;
+
+  return (gint) pad1->zorder - (gint) pad2->zorder;
+}
+
+static void
+gst_kms_compositor_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstKMSCompositorPad *pad = GST_KMS_COMPOSITOR_PAD (object);
+  GstKMSCompositor *self =
+      GST_KMS_COMPOSITOR (gst_pad_get_parent (GST_PAD (pad)));
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      pad->xpos = g_value_get_int (value);
+      break;
+    case PROP_PAD_YPOS:
+      pad->ypos = g_value_get_int (value);
+      break;
+    case PROP_PAD_WIDTH:
+      pad->width = g_value_get_int (value);
+      break;
+    case PROP_PAD_HEIGHT:
+      pad->height = g_value_get_int (value);
+      break;
+    case PROP_PAD_ZORDER:
+      pad->zorder = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+
+  /* a new size may not fit the scalers of the planes any more */
+  if (self) {
+    GST_OBJECT_LOCK (self);
+    self->sinkpads = g_list_sort (self->sinkpads,
+        gst_kms_compositor_pad_compare);
+    self->layout_changed = TRUE;
+    self->max_planes = G_MAXUINT;
+    GST_OBJECT_UNLOCK (self);
+    gst_object_unref (self);
+  }
+}
+
+static void
+gst_kms_compositor_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstKMSCompositorPad *pad = GST_KMS_COMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      g_value_set_int (value, pad->xpos);
+      break;
+    case PROP_PAD_YPOS:
+      g_value_set_int (value, pad->ypos);
+      break;
+    case PROP_PAD_WIDTH:
+      g_value_set_int (value, pad->width);
+      break;
+    case PROP_PAD_HEIGHT:
+      g_value_set_int (value, pad->height);
+      break;
+    case PROP_PAD_ZORDER:
+      g_value_set_uint (value, pad->zorder);
+      break;
+    case PROP_PAD_PLANE_ID:
+      g_value_set_uint (value, pad->plane_id);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+gst_kms_compositor_pad_reset (GstKMSCompositorPad * pad)
+{
+  if (pad->pool) {
+    gst_buffer_pool_set_active (pad->pool, FALSE);
+    gst_object_unref (pad->pool);
+    pad->pool = NULL;
+  }
+
+  g_clear_pointer (&pad->convert, gst_video_converter_free);
+}
+
+static void
+gst_kms_compositor_pad_finalize (GObject * object)
+{
+  GstKMSCompositorPad *pad = GST_KMS_COMPOSITOR_PAD (object);
+
+  gst_kms_compositor_pad_reset (pad);
+  gst_caps_replace (&pad->caps, NULL);
+
+  G_OBJECT_CLASS (gst_kms_compositor_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_kms_compositor_pad_init (GstKMSCompositorPad * pad)
+{
+  pad->xpos = DEFAULT_PAD_XPOS;
+  pad->ypos = DEFAULT_PAD_YPOS;
+  pad->width = DEFAULT_PAD_WIDTH;
+  pad->height = DEFAULT_PAD_HEIGHT;
+  pad->plane = -1;
+}
+
+static void
+gst_kms_compositor_pad_class_init (GstKMSCompositorPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_kms_compositor_pad_set_property;
+  gobject_class->get_property = gst_kms_compositor_pad_get_property;
+  gobject_class->finalize = gst_kms_compositor_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+      g_param_spec_int ("xpos", "X Position", "X position of the picture",
+          0, G_MAXINT, DEFAULT_PAD_XPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+      g_param_spec_int ("ypos", "Y Position", "Y position of the picture",
+          0, G_MAXINT, DEFAULT_PAD_YPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Width of the picture, 0 to use the input width",
+          0, G_MAXINT, DEFAULT_PAD_WIDTH,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Height of the picture, 0 to use the input height",
+          0, G_MAXINT, DEFAULT_PAD_HEIGHT,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
+      g_param_spec_uint ("zorder", "Z-Order", "Z order of the picture",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_PLANE_ID,
+      g_param_spec_uint ("plane-id", "Plane ID",
+          "Plane the picture is shown on, 0 when composed in the canvas",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+/*
+ * GstKMSCompositor
+ */
+
+enum
+{
+  PROP_0,
+  PROP_DRIVER_NAME,
+  PROP_CONNECTOR_ID,
+  PROP_SYNC,
+};
+
+#define gst_kms_compositor_parent_class parent_class
+G_DEFINE_TYPE (GstKMSCompositor, gst_kms_compositor, GST_TYPE_ELEMENT);
+
+static void
+add_plane_props (GstKMSCompositor * self, drmModeAtomicReq * req,
+    GstKMSPlane * plane, guint32 fb_id, GstVideoRectangle * src,
+    GstVideoRectangle * dst)
+{
+  GstKMSPlaneProps *props;
+  guint32 id;
+
+  props = &plane->props;
+  id = plane->plane_id;
+
+  drmModeAtomicAddProperty (req, id, props->fb_id, fb_id);
+  drmModeAtomicAddProperty (req, id, props->crtc_id, fb_id ? self->crtc_id : 0);
+  if (!fb_id)
+    return;
+
+  /* source/cropping coordinates are given in Q16 */
+  drmModeAtomicAddProperty (req, id, props->src_x, (guint64) src->x << 16);
+  drmModeAtomicAddProperty (req, id, props->src_y, (guint64) src->y << 16);
+  drmModeAtomicAddProperty (req, id, props->src_w, (guint64) src->w << 16);
+  drmModeAtomicAddProperty (req, id, props->src_h, (guint64) src->h << 16);
+  drmModeAtomicAddProperty (req, id, props->crtc_x, dst->x);
+  drmModeAtomicAddProperty (req, id, props->crtc_y, dst->y);
+  drmModeAtomicAddProperty (req, id, props->crtc_w, dst->w);
+  drmModeAtomicAddProperty (req, id, props->crtc_h, dst->h);
+}
+
+static void
+flip_handler (gint fd, guint frame, guint sec, guint usec, gpointer data)
+{
+  GstKMSCompositor *self = data;
+
+  /* the committed frame is on screen, the previous one can be reused */
+  self->flip_pending = FALSE;
+  g_clear_pointer (&self->shown_buffers, g_ptr_array_unref);
+  self->shown_buffers = self->pending_buffers;
+  self->pending_buffers = NULL;
+}
+
+static gboolean
+gst_kms_compositor_wait_flip (GstKMSCompositor * self)
+{
+  gint ret;
+  drmEventContext evctxt = {
+    .version = DRM_EVENT_CONTEXT_VERSION,
+    .page_flip_handler = flip_handler,
+  };
+
+  while (self->flip_pending) {
+    do {
+      ret = gst_poll_wait (self->poll, 3 * GST_SECOND);
+    } while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+    if (ret == 0)
+      goto timeout;
+
+    ret = drmHandleEvent (self->fd, &evctxt);
+    if (ret)
+      goto event_failed;
+  }
+
+  return TRUE;
+
+  /* ERRORS */
+timeout:
+  {
+    /* the frame is taken as shown, its buffers go back to their pools */
+    GST_WARNING_OBJECT (self, "no page flip event for the last commit");
+    flip_handler (self->fd, 0, 0, 0, self);
+    return FALSE;
+  }
+event_failed:
+  {
+    GST_ERROR_OBJECT (self, "drmHandleEvent failed: %s (%d)", strerror (-ret),
+        ret);
+    return FALSE;
+  }
+}
+
+static GstBufferPool *
+gst_kms_compositor_create_pool (GstKMSCompositor * self, GstCaps * caps,
+    gsize size)
+{
+  GstBufferPool *pool;
+  GstStructure *config;
+
+  pool = gst_kms_buffer_pool_new ();
+  if (!pool)
+    goto pool_failed;
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size,
+      GST_KMS_COMPOSITOR_MIN_BUFFERS, 0);
+  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_buffer_pool_config_set_allocator (config, self->allocator, NULL);
+
+  if (!gst_buffer_pool_set_config (pool, config))
+    goto config_failed;
+
+  if (!gst_buffer_pool_set_active (pool, TRUE))
+    goto activate_failed;
+
+  return pool;
+
+  /* ERRORS */
+pool_failed:
+  {
+    GST_ERROR_OBJECT (self, "failed to create buffer pool");
+    return NULL;
+  }
+config_failed:
+  {
+    GST_ERROR_OBJECT (self, "failed to set config");
+    gst_object_unref (pool);
+    return NULL;
+  }
+activate_failed:
+  {
+    GST_ERROR_OBJECT (self, "failed to activate buffer pool");
+    gst_object_unref (pool);
+    return NULL;
+  }
+}
+
+/* what of the frame is shown where, cut to the display */
+static gboolean
+gst_kms_compositor_pad_get_rects (GstKMSCompositor * self,
+    GstKMSCompositorPad * pad, GstBuffer * inbuf, GstVideoRectangle * src,
+    GstVideoRectangle * dst)
+{
+  GstVideoCropMeta *crop;
+  gint w, h;
+
+  crop = gst_buffer_get_video_crop_meta (inbuf);
+  if (crop) {
+    src->x = crop->x;
+    src->y = crop->y;
+    src->w = crop->width;
+    src->h = crop->height;
+  } else {
+    src->x = src->y = 0;
+    src->w = GST_VIDEO_INFO_WIDTH (&pad->info);
+    src->h = GST_VIDEO_INFO_HEIGHT (&pad->info);
+  }
+
+  GST_OBJECT_LOCK (pad);
+  dst->x = pad->xpos;
+  dst->y = pad->ypos;
+  dst->w = pad->width > 0 ? pad->width : src->w;
+  dst->h = pad->height > 0 ? pad->height : src->h;
+  GST_OBJECT_UNLOCK (pad);
+
+  if (dst->x >= self->hdisplay || dst->y >= self->vdisplay || src->w <= 0
+      || src->h <= 0)
+    return FALSE;
+
+  w = MIN (dst->w, self->hdisplay - dst->x);
+  h = MIN (dst->h, self->vdisplay - dst->y);
+  src->w = gst_util_uint64_scale_int (src->w, w, dst->w);
+  src->h = gst_util_uint64_scale_int (src->h, h, dst->h);
+  dst->w = w;
+  dst->h = h;
+
+  /* the allocator doubled the pitches of such framebuffers */
+  if (GST_VIDEO_INFO_WIDTH (&pad->info) >= GST_KMS_MAX_FETCH_WIDTH) {
+    src->y /= 2;
+    src->h /= 2;
+  }
+
+  return src->w > 0 && src->h > 0;
+}
+
+/* a buffer with a framebuffer, for a stream on a plane of its own */
+static GstBuffer *
+gst_kms_compositor_pad_upload (GstKMSCompositor * self,
+    GstKMSCompositorPad * pad, GstBuffer * inbuf)
+{
+  GstVideoFrame inframe, outframe;
+  GstVideoInfo vinfo;
+  GstBuffer *buf;
+  gboolean success, cached;
+
+  if (gst_is_kms_memory (gst_buffer_peek_memory (inbuf, 0)))
+    return gst_buffer_ref (inbuf);
+
+  /* the same cache as kmssink, shared with the pools of the allocator */
+  vinfo = pad->info;
+  buf = gst_kms_allocator_import_buffer (self->allocator, self->fb_cache,
+      inbuf, &vinfo, self->has_prime_import, &cached);
+  if (buf)
+    return buf;
+
+  GST_LOG_OBJECT (pad, "frame copy");
+
+  if (!pad->pool) {
+    pad->pool = gst_kms_compositor_create_pool (self, pad->caps,
+        GST_VIDEO_INFO_SIZE (&pad->info));
+    if (!pad->pool)
+      return NULL;
+  }
+
+  if (gst_buffer_pool_acquire_buffer (pad->pool, &buf, NULL) != GST_FLOW_OK)
+    return NULL;
+
+  if (!gst_video_frame_map (&inframe, &pad->info, inbuf, GST_MAP_READ))
+    goto map_failed;
+
+  if (!gst_video_frame_map (&outframe, &pad->info, buf, GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&inframe);
+    goto map_failed;
+  }
+
+  success = gst_kms_copier_copy (self->copier, &outframe, &inframe);
+  gst_video_frame_unmap (&outframe);
+  gst_video_frame_unmap (&inframe);
+  if (!success)
+    goto map_failed;
+
+  return buf;
+
+map_failed:
+  {
+    GST_WARNING_OBJECT (pad, "failed to upload buffer");
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+}
+
+static GstBuffer *
+gst_kms_compositor_acquire_canvas (GstKMSCompositor * self,
+    GstVideoFrame * frame)
+{
+  GstBuffer *buf;
+  GstCaps *caps;
+
+  if (!self->canvas_pool) {
+    caps = gst_video_info_to_caps (&self->canvas_info);
+    self->canvas_pool = gst_kms_compositor_create_pool (self, caps,
+        GST_VIDEO_INFO_SIZE (&self->canvas_info));
+    gst_caps_unref (caps);
+    if (!self->canvas_pool)
+      return NULL;
+  }
+
+  if (gst_buffer_pool_acquire_buffer (self->canvas_pool, &buf,
+          NULL) != GST_FLOW_OK)
+    return NULL;
+
+  if (!gst_video_frame_map (frame, &self->canvas_info, buf, GST_MAP_WRITE)) {
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+
+  /* black where nothing is composed */
+  memset (GST_VIDEO_FRAME_PLANE_DATA (frame, 0), 0,
+      GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0) * GST_VIDEO_FRAME_HEIGHT (frame));
+
+  return buf;
+}
+
+static gboolean
+gst_kms_compositor_pad_draw (GstKMSCompositor * self,
+    GstKMSCompositorPad * pad, GstBuffer * inbuf, GstVideoRectangle * src,
+    GstVideoRectangle * dst, GstVideoFrame * canvas)
+{
+  GstVideoFrame frame;
+
+  if (pad->convert && (memcmp (src, &pad->convert_src, sizeof (*src)) ||
+          memcmp (dst, &pad->convert_dst, sizeof (*dst))))
+    g_clear_pointer (&pad->convert, gst_video_converter_free);
+
+  /* the other streams are composed around, no border */
+  if (!pad->convert) {
+    pad->convert = gst_video_converter_new (&pad->info, &self->canvas_info,
+        gst_structure_new ("GstVideoConverter",
+            GST_VIDEO_CONVERTER_OPT_SRC_X, G_TYPE_INT, src->x,
+            GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, src->y,
+            GST_VIDEO_CONVERTER_OPT_SRC_WIDTH, G_TYPE_INT, src->w,
+            GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, src->h,
+            GST_VIDEO_CONVERTER_OPT_DEST_X, G_TYPE_INT, dst->x,
+            GST_VIDEO_CONVERTER_OPT_DEST_Y, G_TYPE_INT, dst->y,
+            GST_VIDEO_CONVERTER_OPT_DEST_WIDTH, G_TYPE_INT, dst->w,
+            GST_VIDEO_CONVERTER_OPT_DEST_HEIGHT, G_TYPE_INT, dst->h,
+            GST_VIDEO_CONVERTER_OPT_FILL_BORDER, G_TYPE_BOOLEAN, FALSE,
+            NULL));
+    if (!pad->convert)
+      return FALSE;
+
+    pad->convert_src = *src;
+    pad->convert_dst = *dst;
+  }
+
+  if (!gst_video_frame_map (&frame, &pad->info, inbuf, GST_MAP_READ))
+    return FALSE;
+
+  gst_video_converter_frame (pad->convert, &frame, canvas);
+  gst_video_frame_unmap (&frame);
+
+  return TRUE;
+}
+
+/* picks the plane of every stream, from the bottom up */
+static gboolean
+gst_kms_compositor_assign (GstKMSCompositor * self, GList * sinkpads)
+{
+  GstKMSCompositorPad **pads;
+  GstKMSPlane *plane;
+  guint32 *fourccs;
+  gint *assignment;
+  guint i, n;
+  gboolean ret;
+  GList *l;
+
+  n = g_list_length (sinkpads);
+  pads = g_new0 (GstKMSCompositorPad *, n);
+  fourccs = g_new0 (guint32, n);
+  assignment = g_new0 (gint, n);
+  ret = TRUE;
+
+  n = 0;
+  for (l = sinkpads; l; l = l->next) {
+    GstKMSCompositorPad *pad = l->data;
+
+    if (!pad->caps)
+      continue;
+
+    pads[n] = pad;
+    fourccs[n++] =
+        gst_drm_format_from_video (GST_VIDEO_INFO_FORMAT (&pad->info));
+  }
+
+  self->n_direct = gst_kms_planes_assign (self->planes, fourccs, n,
+      self->max_planes,
+      gst_drm_format_from_video (GST_VIDEO_INFO_FORMAT (&self->canvas_info)),
+      assignment, &self->canvas);
+  if (self->n_direct < n && self->canvas < 0)
+    goto no_canvas;
+
+  for (i = 0; i < n; i++) {
+    plane = assignment[i] >= 0 ?
+        g_ptr_array_index (self->planes, assignment[i]) : NULL;
+
+    GST_OBJECT_LOCK (pads[i]);
+    pads[i]->plane = assignment[i];
+    pads[i]->plane_id = plane ? plane->plane_id : 0;
+    GST_OBJECT_UNLOCK (pads[i]);
+
+    GST_DEBUG_OBJECT (pads[i], "shown on plane %u", plane ?
+        plane->plane_id : ((GstKMSPlane *) g_ptr_array_index (self->planes,
+                self->canvas))->plane_id);
+  }
+
+  GST_INFO_OBJECT (self, "%u of %u streams on planes of their own",
+      self->n_direct, n);
+
+  self->layout_changed = FALSE;
+
+done:
+  g_free (pads);
+  g_free (fourccs);
+  g_free (assignment);
+
+  return ret;
+
+  /* ERRORS */
+no_canvas:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Could not find a plane to compose the streams on"), (NULL));
+    ret = FALSE;
+    goto done;
+  }
+}
+
+static GstFlowReturn
+gst_kms_compositor_render (GstKMSCompositor * self, GList * sinkpads,
+    GstBuffer ** inbufs)
+{
+  GstVideoRectangle src, dst, full;
+  GstVideoFrame canvas_frame;
+  GstBuffer *canvas, *buf;
+  GPtrArray *buffers;
+  drmModeAtomicReq *req;
+  GstKMSPlane *plane;
+  guint32 canvas_fourcc;
+  guint64 used, bit;
+  gint canvas_plane;
+  gboolean test;
+  GList *l;
+  guint i;
+  gint ret;
+
+  canvas_fourcc =
+      gst_drm_format_from_video (GST_VIDEO_INFO_FORMAT (&self->canvas_info));
+
+retry:
+  test = self->layout_changed;
+  if (self->layout_changed && !gst_kms_compositor_assign (self, sinkpads))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  req = drmModeAtomicAlloc ();
+  if (!req)
+    return GST_FLOW_ERROR;
+
+  buffers = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  canvas = NULL;
+  canvas_plane = -1;
+  used = 0;
+
+  for (l = sinkpads, i = 0; l; l = l->next, i++) {
+    GstKMSCompositorPad *pad = l->data;
+
+    if (!inbufs[i] || !pad->caps ||
+        !gst_kms_compositor_pad_get_rects (self, pad, inbufs[i], &src, &dst))
+      continue;
+
+    if (pad->plane < 0) {
+      if (!canvas) {
+        canvas = gst_kms_compositor_acquire_canvas (self, &canvas_frame);
+        if (!canvas)
+          goto canvas_failed;
+        canvas_plane = self->canvas;
+      }
+
+      if (!gst_kms_compositor_pad_draw (self, pad, inbufs[i], &src, &dst,
+              &canvas_frame))
+        GST_WARNING_OBJECT (pad, "failed to compose frame");
+      continue;
+    }
+
+    buf = gst_kms_compositor_pad_upload (self, pad, inbufs[i]);
+    if (!buf)
+      goto upload_failed;
+
+    g_ptr_array_add (buffers, buf);
+    add_plane_props (self, req, g_ptr_array_index (self->planes, pad->plane),
+        gst_kms_memory_get_fb_id (gst_buffer_peek_memory (buf, 0)), &src,
+        &dst);
+    used |= G_GUINT64_CONSTANT (1) << pad->plane;
+  }
+
+  /* planes left from the previous frame are switched off, but some drivers
+   * won't run a crtc without its primary plane: it gets an empty canvas */
+  for (i = 0; i < self->planes->len; i++) {
+    plane = g_ptr_array_index (self->planes, i);
+    bit = G_GUINT64_CONSTANT (1) << i;
+
+    if (!(self->used_planes & bit) || (used & bit) || (gint) i == canvas_plane)
+      continue;
+
+    if (plane->type == DRM_PLANE_TYPE_PRIMARY && !canvas &&
+        gst_kms_plane_has_format (plane, canvas_fourcc)) {
+      canvas = gst_kms_compositor_acquire_canvas (self, &canvas_frame);
+      if (!canvas)
+        goto canvas_failed;
+      canvas_plane = i;
+      continue;
+    }
+
+    add_plane_props (self, req, plane, 0, NULL, NULL);
+  }
+
+  if (canvas) {
+    gst_video_frame_unmap (&canvas_frame);
+
+    full.x = full.y = 0;
+    full.w = self->hdisplay;
+    full.h = self->vdisplay;
+    add_plane_props (self, req, g_ptr_array_index (self->planes, canvas_plane),
+        gst_kms_memory_get_fb_id (gst_buffer_peek_memory (canvas, 0)), &full,
+        &full);
+    used |= G_GUINT64_CONSTANT (1) << canvas_plane;
+    g_ptr_array_add (buffers, canvas);
+  }
+
+  /* nothing on the display, and nothing to take off */
+  if (drmModeAtomicGetCursor (req) == 0) {
+    drmModeAtomicFree (req);
+    g_ptr_array_unref (buffers);
+    return GST_FLOW_OK;
+  }
+
+  /* a new layout may ask more of the planes than they can do together */
+  if (test && self->n_direct > 0) {
+    ret = drmModeAtomicCommit (self->fd, req, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+    if (ret) {
+      GST_INFO_OBJECT (self, "layout with %u planes rejected: %s (%d)",
+          self->n_direct, strerror (-ret), ret);
+      drmModeAtomicFree (req);
+      g_ptr_array_unref (buffers);
+      self->max_planes = self->n_direct - 1;
+      self->layout_changed = TRUE;
+      goto retry;
+    }
+  }
+
+  /* only waits when the previous frame is not on screen yet */
+  if (!gst_kms_compositor_wait_flip (self))
+    goto flip_failed;
+
+  ret = drmModeAtomicCommit (self->fd, req,
+      DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, self);
+  drmModeAtomicFree (req);
+  if (ret)
+    goto commit_failed;
+
+  self->flip_pending = TRUE;
+  self->pending_buffers = buffers;
+  self->used_planes = used;
+
+  return GST_FLOW_OK;
+
+  /* ERRORS */
+canvas_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED, ("failed to get a canvas"),
+        (NULL));
+    goto bail;
+  }
+upload_failed:
+  {
+    if (canvas)
+      gst_video_frame_unmap (&canvas_frame);
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("failed to upload a frame"),
+        (NULL));
+    goto bail;
+  }
+flip_failed:
+  {
+    drmModeAtomicFree (req);
+    g_ptr_array_unref (buffers);
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        (NULL), ("the display didn't complete the previous commit"));
+    return GST_FLOW_ERROR;
+  }
+commit_failed:
+  {
+    g_ptr_array_unref (buffers);
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        (NULL), ("drmModeAtomicCommit failed: %s (%d)", strerror (-ret), ret));
+    return GST_FLOW_ERROR;
+  }
+bail:
+  {
+    if (canvas)
+      gst_buffer_unref (canvas);
+    drmModeAtomicFree (req);
+    g_ptr_array_unref (buffers);
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* no preroll: frames are held while paused, then for their running time */
+static gboolean
+gst_kms_compositor_wait_clock (GstKMSCompositor * self,
+    GstClockTime running_time)
+{
+  GstClockReturn ret;
+  GstClockTime base_time;
+  GstClock *clock;
+  gboolean res;
+
+  g_mutex_lock (&self->lock);
+  for (;;) {
+    while (!self->playing && !self->flushing)
+      g_cond_wait (&self->cond, &self->lock);
+
+    if (self->flushing)
+      break;
+
+    if (!self->sync || !GST_CLOCK_TIME_IS_VALID (running_time))
+      break;
+
+    clock = gst_element_get_clock (GST_ELEMENT_CAST (self));
+    if (!clock)
+      break;
+
+    base_time = gst_element_get_base_time (GST_ELEMENT_CAST (self));
+    self->clock_id = gst_clock_new_single_shot_id (clock,
+        base_time + running_time + self->latency);
+    gst_object_unref (clock);
+    g_mutex_unlock (&self->lock);
+
+    ret = gst_clock_id_wait (self->clock_id, NULL);
+
+    g_mutex_lock (&self->lock);
+    gst_clock_id_unref (self->clock_id);
+    self->clock_id = NULL;
+
+    /* unscheduled when paused or flushing */
+    if (ret != GST_CLOCK_UNSCHEDULED)
+      break;
+  }
+  res = !self->flushing;
+  g_mutex_unlock (&self->lock);
+
+  return res;
+}
+
+static void
+gst_kms_compositor_set_flushing (GstKMSCompositor * self, gboolean flushing)
+{
+  g_mutex_lock (&self->lock);
+  self->flushing = flushing;
+  if (flushing && self->clock_id)
+    gst_clock_id_unschedule (self->clock_id);
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_kms_compositor_set_playing (GstKMSCompositor * self, gboolean playing)
+{
+  g_mutex_lock (&self->lock);
+  self->playing = playing;
+  if (!playing && self->clock_id)
+    gst_clock_id_unschedule (self->clock_id);
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+}
+
+static GstFlowReturn
+gst_kms_compositor_collected (GstCollectPads * collect,
+    GstKMSCompositor * self)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+  GList *sinkpads, *l;
+  GstBuffer **inbufs;
+  gboolean eos = TRUE;
+  guint i, n;
+
+  GST_OBJECT_LOCK (self);
+  sinkpads = g_list_copy_deep (self->sinkpads, (GCopyFunc) gst_object_ref,
+      NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  n = g_list_length (sinkpads);
+  inbufs = g_new0 (GstBuffer *, n);
+
+  /* one frame from every pad, shown at the earliest running time */
+  for (l = sinkpads, i = 0; l; l = l->next, i++) {
+    GstKMSCompositorPad *pad = l->data;
+    GstClockTime ts;
+
+    inbufs[i] = gst_collect_pads_pop (collect, pad->cdata);
+    if (!inbufs[i])
+      continue;
+
+    eos = FALSE;
+    ts = gst_segment_to_running_time (&pad->cdata->segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (inbufs[i]));
+    if (GST_CLOCK_TIME_IS_VALID (ts)
+        && (!GST_CLOCK_TIME_IS_VALID (running_time) || ts < running_time))
+      running_time = ts;
+
+    if (pad->reconfigure) {
+      pad->reconfigure = FALSE;
+      gst_kms_compositor_pad_reset (pad);
+    }
+  }
+
+  if (eos) {
+    GST_DEBUG_OBJECT (self, "all pads are EOS");
+    gst_element_post_message (GST_ELEMENT_CAST (self),
+        gst_message_new_eos (GST_OBJECT_CAST (self)));
+    ret = GST_FLOW_EOS;
+    goto done;
+  }
+
+  if (!gst_kms_compositor_wait_clock (self, running_time)) {
+    ret = GST_FLOW_FLUSHING;
+    goto done;
+  }
+
+  ret = gst_kms_compositor_render (self, sinkpads, inbufs);
+
+done:
+  for (i = 0; i < n; i++)
+    if (inbufs[i])
+      gst_buffer_unref (inbufs[i]);
+  g_free (inbufs);
+  g_list_free_full (sinkpads, gst_object_unref);
+
+  return ret;
+}
+
+static gboolean
+gst_kms_compositor_sink_event (GstCollectPads * collect,
+    GstCollectData * cdata, GstEvent * event, GstKMSCompositor * self)
+{
+  GstKMSCompositorPad *pad = GST_KMS_COMPOSITOR_PAD (cdata->pad);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      GstVideoInfo info;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&info, caps)) {
+        GST_ERROR_OBJECT (pad, "invalid caps %" GST_PTR_FORMAT, caps);
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      GST_OBJECT_LOCK (self);
+      gst_caps_replace (&pad->caps, caps);
+      pad->info = info;
+      pad->reconfigure = TRUE;
+      self->layout_changed = TRUE;
+      self->max_planes = G_MAXUINT;
+      GST_OBJECT_UNLOCK (self);
+
+      gst_event_unref (event);
+      return TRUE;
+    }
+    case GST_EVENT_FLUSH_START:
+      gst_kms_compositor_set_flushing (self, TRUE);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_kms_compositor_set_flushing (self, FALSE);
+      break;
+    default:
+      break;
+  }
+
+  /* nothing downstream */
+  return gst_collect_pads_event_default (collect, cdata, event, TRUE);
+}
+
+static gboolean
+gst_kms_compositor_sink_query (GstCollectPads * collect,
+    GstCollectData * cdata, GstQuery * query, GstKMSCompositor * self)
+{
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ALLOCATION:
+      /* strides, offsets and crops are shown as they are */
+      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+      gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+          NULL);
+      return TRUE;
+    default:
+      break;
+  }
+
+  return gst_collect_pads_query_default (collect, cdata, query, FALSE);
+}
+
+static GstPad *
+gst_kms_compositor_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * req_name, const GstCaps * caps)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (element);
+  GstKMSCompositorPad *pad;
+  gchar *name;
+  guint serial;
+
+  GST_OBJECT_LOCK (self);
+  if (req_name && sscanf (req_name, "sink_%u", &serial) == 1) {
+    if (serial >= self->next_pad_id)
+      self->next_pad_id = serial + 1;
+  } else {
+    serial = self->next_pad_id++;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  name = g_strdup_printf ("sink_%u", serial);
+  pad = g_object_new (GST_TYPE_KMS_COMPOSITOR_PAD, "name", name,
+      "direction", templ->direction, "template", templ, NULL);
+  g_free (name);
+
+  pad->zorder = serial;
+
+  pad->cdata = gst_collect_pads_add_pad (self->collect, GST_PAD (pad),
+      sizeof (GstCollectData), NULL, TRUE);
+
+  GST_OBJECT_LOCK (self);
+  self->sinkpads = g_list_insert_sorted (self->sinkpads, pad,
+      gst_kms_compositor_pad_compare);
+  self->layout_changed = TRUE;
+  self->max_planes = G_MAXUINT;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_element_add_pad (element, GST_PAD (pad));
+
+  GST_DEBUG_OBJECT (self, "created pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  return GST_PAD (pad);
+}
+
+static void
+gst_kms_compositor_release_pad (GstElement * element, GstPad * gpad)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (element);
+  GstKMSCompositorPad *pad = GST_KMS_COMPOSITOR_PAD (gpad);
+
+  GST_DEBUG_OBJECT (self, "release pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  GST_OBJECT_LOCK (self);
+  self->sinkpads = g_list_remove (self->sinkpads, pad);
+  self->layout_changed = TRUE;
+  self->max_planes = G_MAXUINT;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_collect_pads_remove_pad (self->collect, gpad);
+
+  /* its plane is switched off with the next frame */
+  GST_COLLECT_PADS_STREAM_LOCK (self->collect);
+  gst_kms_compositor_pad_reset (pad);
+  GST_COLLECT_PADS_STREAM_UNLOCK (self->collect);
+
+  gst_element_remove_pad (element, gpad);
+}
+
+static gboolean
+gst_kms_compositor_send_event (GstElement * element, GstEvent * event)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (element);
+  GstClockTime latency;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_LATENCY) {
+    gst_event_parse_latency (event, &latency);
+
+    g_mutex_lock (&self->lock);
+    self->latency = latency;
+    g_mutex_unlock (&self->lock);
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->send_event (element, event);
+}
+
+static gboolean
+gst_kms_compositor_open (GstKMSCompositor * self)
+{
+  drmModeRes *res;
+  drmModeConnector *conn;
+  drmModeCrtc *crtc;
+  guint64 has_prime;
+  gboolean ret;
+
+  ret = FALSE;
+  res = NULL;
+  conn = NULL;
+  crtc = NULL;
+
+  if (self->devname)
+    self->fd = drmOpen (self->devname, NULL);
+  else
+    self->fd = open ("/dev/dri/card0", O_RDWR | O_CLOEXEC);
+  if (self->fd < 0)
+    goto open_failed;
+
+  /* all the plane updates of a frame go in one commit */
+  if (drmSetClientCap (self->fd, DRM_CLIENT_CAP_ATOMIC, 1))
+    goto no_atomic;
+
+  has_prime = 0;
+  drmGetCap (self->fd, DRM_CAP_PRIME, &has_prime);
+  self->has_prime_import = (gboolean) (has_prime & DRM_PRIME_CAP_IMPORT);
+
+  res = drmModeGetResources (self->fd);
+  if (!res)
+    goto resources_failed;
+
+  if (self->conn_id == -1)
+    conn = gst_kms_find_main_monitor (self->fd, res);
+  else
+    conn = drmModeGetConnector (self->fd, self->conn_id);
+  if (!conn)
+    goto connector_failed;
+
+  crtc = gst_kms_find_crtc_for_connector (self->fd, res, conn, &self->pipe);
+  if (!crtc || !crtc->mode_valid)
+    goto crtc_failed;
+
+  self->crtc_id = crtc->crtc_id;
+  self->hdisplay = crtc->mode.hdisplay;
+  self->vdisplay = crtc->mode.vdisplay;
+
+  self->planes = gst_kms_planes_probe (self->fd, self->pipe);
+  if (self->planes->len == 0)
+    goto plane_failed;
+  if (self->planes->len > GST_KMS_COMPOSITOR_MAX_PLANES)
+    g_ptr_array_set_size (self->planes, GST_KMS_COMPOSITOR_MAX_PLANES);
+
+  GST_INFO_OBJECT (self, "connector id = %d / crtc id = %d / %u planes / "
+      "display size = %dx%d", conn->connector_id, self->crtc_id,
+      self->planes->len, self->hdisplay, self->vdisplay);
+
+  gst_video_info_set_format (&self->canvas_info,
+      GST_KMS_COMPOSITOR_CANVAS_FORMAT, self->hdisplay, self->vdisplay);
+
+  self->allocator = gst_kms_allocator_new (self->fd);
+  self->fb_cache = gst_kms_fb_cache_new (GST_KMS_COMPOSITOR_FB_CACHE_SIZE);
+  self->copier = gst_kms_copier_new (GST_ELEMENT (self), 0);
+
+  self->pollfd.fd = self->fd;
+  gst_poll_add_fd (self->poll, &self->pollfd);
+  gst_poll_fd_ctl_read (self->poll, &self->pollfd, TRUE);
+
+  ret = TRUE;
+
+bail:
+  if (crtc)
+    drmModeFreeCrtc (crtc);
+  if (conn)
+    drmModeFreeConnector (conn);
+  if (res)
+    drmModeFreeResources (res);
+
+  if (!ret) {
+    g_clear_pointer (&self->planes, g_ptr_array_unref);
+    if (self->fd >= 0) {
+      drmClose (self->fd);
+      self->fd = -1;
+    }
+  }
+
+  return ret;
+
+  /* ERRORS */
+open_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+        ("Could not open DRM module %s", GST_STR_NULL (self->devname)),
+        ("reason: %s (%d)", strerror (errno), errno));
+    return FALSE;
+  }
+no_atomic:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("The driver has no atomic modesetting"), (NULL));
+    goto bail;
+  }
+resources_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("drmModeGetResources failed"),
+        ("reason: %s (%d)", strerror (errno), errno));
+    goto bail;
+  }
+connector_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Could not find a valid monitor connector"), (NULL));
+    goto bail;
+  }
+crtc_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Could not find an active crtc for connector"), (NULL));
+    goto bail;
+  }
+plane_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Could not find a plane for crtc"), (NULL));
+    goto bail;
+  }
+}
+
+static void
+gst_kms_compositor_close (GstKMSCompositor * self)
+{
+  g_clear_pointer (&self->copier, gst_kms_copier_free);
+  g_clear_pointer (&self->fb_cache, gst_kms_fb_cache_free);
+  gst_object_replace ((GstObject **) & self->allocator, NULL);
+  g_clear_pointer (&self->planes, g_ptr_array_unref);
+
+  gst_poll_remove_fd (self->poll, &self->pollfd);
+  gst_poll_restart (self->poll);
+  gst_poll_fd_init (&self->pollfd);
+
+  if (self->fd >= 0) {
+    drmClose (self->fd);
+    self->fd = -1;
+  }
+}
+
+/* takes every plane off the display and drops the buffers */
+static void
+gst_kms_compositor_reset (GstKMSCompositor * self)
+{
+  drmModeAtomicReq *req;
+  GList *l;
+  guint i;
+
+  if (self->fd >= 0 && self->used_planes) {
+    gst_kms_compositor_wait_flip (self);
+
+    req = drmModeAtomicAlloc ();
+    if (req) {
+      for (i = 0; i < self->planes->len; i++) {
+        if (self->used_planes & (G_GUINT64_CONSTANT (1) << i))
+          add_plane_props (self, req, g_ptr_array_index (self->planes, i), 0,
+              NULL, NULL);
+      }
+
+      if (drmModeAtomicCommit (self->fd, req, 0, NULL))
+        GST_WARNING_OBJECT (self, "failed to switch the planes off");
+      drmModeAtomicFree (req);
+    }
+  }
+
+  self->used_planes = 0;
+  self->flip_pending = FALSE;
+  g_clear_pointer (&self->pending_buffers, g_ptr_array_unref);
+  g_clear_pointer (&self->shown_buffers, g_ptr_array_unref);
+
+  if (self->canvas_pool) {
+    gst_buffer_pool_set_active (self->canvas_pool, FALSE);
+    gst_object_unref (self->canvas_pool);
+    self->canvas_pool = NULL;
+  }
+
+  GST_OBJECT_LOCK (self);
+  for (l = self->sinkpads; l; l = l->next)
+    gst_kms_compositor_pad_reset (GST_KMS_COMPOSITOR_PAD (l->data));
+  self->layout_changed = TRUE;
+  self->max_planes = G_MAXUINT;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstStateChangeReturn
+gst_kms_compositor_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!gst_kms_compositor_open (self))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_kms_compositor_set_flushing (self, FALSE);
+      gst_collect_pads_start (self->collect);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      gst_kms_compositor_set_playing (self, TRUE);
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      gst_kms_compositor_set_playing (self, FALSE);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_kms_compositor_set_flushing (self, TRUE);
+      gst_collect_pads_stop (self->collect);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_kms_compositor_reset (self);
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      gst_kms_compositor_close (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_kms_compositor_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_DRIVER_NAME:
+      g_free (self->devname);
+      self->devname = g_value_dup_string (value);
+      break;
+    case PROP_CONNECTOR_ID:
+      self->conn_id = g_value_get_int (value);
+      break;
+    case PROP_SYNC:
+      g_mutex_lock (&self->lock);
+      self->sync = g_value_get_boolean (value);
+      g_mutex_unlock (&self->lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_kms_compositor_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_DRIVER_NAME:
+      g_value_set_string (value, self->devname);
+      break;
+    case PROP_CONNECTOR_ID:
+      g_value_set_int (value, self->conn_id);
+      break;
+    case PROP_SYNC:
+      g_value_set_boolean (value, self->sync);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_kms_compositor_finalize (GObject * object)
+{
+  GstKMSCompositor *self = GST_KMS_COMPOSITOR (object);
+
+  gst_object_unref (self->collect);
+  gst_poll_free (self->poll);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+  g_free (self->devname);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_kms_compositor_init (GstKMSCompositor * self)
+{
+  self->fd = -1;
+  self->conn_id = -1;
+  self->sync = DEFAULT_SYNC;
+  self->canvas = -1;
+  self->max_planes = G_MAXUINT;
+  self->layout_changed = TRUE;
+
+  gst_poll_fd_init (&self->pollfd);
+  self->poll = gst_poll_new (TRUE);
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+
+  GST_OBJECT_FLAG_SET (self, GST_ELEMENT_FLAG_SINK);
+
+  self->collect = gst_collect_pads_new ();
+  gst_collect_pads_set_function (self->collect,
+      (GstCollectPadsFunction) gst_kms_compositor_collected, self);
+  gst_collect_pads_set_event_function (self->collect,
+      (GstCollectPadsEventFunction) gst_kms_compositor_sink_event, self);
+  gst_collect_pads_set_query_function (self->collect,
+      (GstCollectPadsQueryFunction) gst_kms_compositor_sink_query, self);
+}
+
+static void
+gst_kms_compositor_class_init (GstKMSCompositorClass * klass)
+{
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstCaps *caps;
+
+  caps = gst_kms_sink_caps_template_fill ();
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST, caps));
+  gst_caps_unref (caps);
+
+  GST_DEBUG_CATEGORY_INIT (gst_kms_compositor_debug, "kmscompositorsink", 0,
+      "KMS Compositor Sink");
+
+  gst_element_class_set_static_metadata (element_class,
+      "KMS Compositor Sink",
+      "Sink/Video/Compositor",
+      "Shows several video streams on the planes of one crtc", " ");
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_kms_compositor_finalize);
+  gobject_class->set_property =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_set_property);
+  gobject_class->get_property =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_get_property);
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_change_state);
+  element_class->send_event =
+      GST_DEBUG_FUNCPTR (gst_kms_compositor_send_event);
+
+  g_object_class_install_property (gobject_class, PROP_DRIVER_NAME,
+      g_param_spec_string ("driver-name", "device name",
+          "DRM device driver name", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
+  g_object_class_install_property (gobject_class, PROP_CONNECTOR_ID,
+      g_param_spec_int ("connector-id", "Connector ID",
+          "DRM connector id", -1, G_MAXINT32, -1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
+  g_object_class_install_property (gobject_class, PROP_SYNC,
+      g_param_spec_boolean ("sync", "Sync",
+          "Show the frames at their running time", DEFAULT_SYNC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_ref (GST_TYPE_KMS_COMPOSITOR_PAD);
+}
@@ -0,0 +1,146 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GST_KMS_COMPOSITOR_H__
+#define __GST_KMS_COMPOSITOR_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstcollectpads.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+#define GST_TYPE_KMS_COMPOSITOR_PAD \
+  (gst_kms_compositor_pad_get_type())
+#define GST_KMS_COMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_KMS_COMPOSITOR_PAD,GstKMSCompositorPad))
+#define GST_IS_KMS_COMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_KMS_COMPOSITOR_PAD))
+#define GST_TYPE_KMS_COMPOSITOR \
+  (gst_kms_compositor_get_type())
+#define GST_KMS_COMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_KMS_COMPOSITOR,GstKMSCompositor))
+#define GST_IS_KMS_COMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_KMS_COMPOSITOR))
+typedef struct _GstKMSCompositorPad GstKMSCompositorPad;
+typedef struct _GstKMSCompositorPadClass GstKMSCompositorPadClass;
+typedef struct _GstKMSCompositor GstKMSCompositor;
+typedef struct _GstKMSCompositorClass GstKMSCompositorClass;
+
+/**
+ * GstKMSCompositorPad:
+ *
+ * Each sink pad is shown on a plane of its own when there is one left,
+ * otherwise it is composed into the canvas.
+ */
+struct _GstKMSCompositorPad
+{
+  GstPad parent;
+
+  GstCollectData *cdata;
+
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  /* properties */
+  gint xpos;
+  gint ypos;
+  gint width;
+  gint height;
+  guint zorder;
+
+  gboolean reconfigure;         /* caps changed */
+
+  gint plane;                   /* index in the planes, -1 in the canvas */
+  guint32 plane_id;
+
+  /* dumb buffers for input that can't be imported */
+  GstBufferPool *pool;
+
+  /* into the canvas */
+  GstVideoConverter *convert;
+  GstVideoRectangle convert_src, convert_dst;
+};
+
+struct _GstKMSCompositorPadClass
+{
+  GstPadClass parent_class;
+};
+
+struct _GstKMSCompositor
+{
+  GstElement parent;
+
+  /* < private > */
+  GstCollectPads *collect;
+
+  GList *sinkpads;              /* sorted by zorder */
+  guint next_pad_id;
+
+  gchar *devname;
+  gint conn_id;
+  gboolean sync;
+
+  gint fd;
+  guint32 crtc_id;
+  guint pipe;
+  guint16 hdisplay, vdisplay;
+  gboolean has_prime_import;
+  GstAllocator *allocator;
+  struct _GstKMSFBCache *fb_cache;
+  struct _GstKMSCopier *copier;       /* frames that can't be imported */
+
+  /* planes of the crtc and what they show */
+  GPtrArray *planes;
+  gboolean layout_changed;
+  guint max_planes;             /* lowered when a layout fails the test */
+  guint n_direct;
+  gint canvas;
+  guint64 used_planes;
+
+  GstVideoInfo canvas_info;
+  GstBufferPool *canvas_pool;
+
+  /* the buffers of the commit waiting for its flip, and of the one shown */
+  GstPoll *poll;
+  GstPollFD pollfd;
+  gboolean flip_pending;
+  GPtrArray *pending_buffers;
+  GPtrArray *shown_buffers;
+
+  /* clock synchronisation, there is no preroll */
+  GMutex lock;
+  GCond cond;
+  gboolean playing;
+  gboolean flushing;
+  GstClockID clock_id;
+  GstClockTime latency;
+};
+
+struct _GstKMSCompositorClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_kms_compositor_pad_get_type (void);
+GType gst_kms_compositor_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_KMS_COMPOSITOR_H__ */
@@ -0,0 +1,269 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstkmscopy.h"
+
+/* below this, waking a worker costs more than the rows it copies */
+#define GST_KMS_COPY_MIN_BAND_ROWS 64
+
+typedef struct
+{
+  guint index;
+} GstKMSCopyBand;
+
+struct _GstKMSCopier
+{
+  GstElement *element;
+
+  /* every band but the first runs in the pool */
+  GstKMSCopyBand *bands;
+  guint n_threads;
+  guint n_bands;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint pending;
+
+  /* scaling set up for one input and output, by a single converter so the
+   * filter taps cross the whole frame */
+  GstVideoConverter *convert;
+  GstVideoInfo scale_in;
+  GstVideoInfo scale_out;
+  GstVideoRectangle scale_src;
+
+  GstVideoFrame *dest;
+  const GstVideoFrame *src;
+};
+
+/* The mappings of dumb buffers are write-combined: stores are merged into
+ * bursts as long as they stay sequential and nothing is read back. So the
+ * rows are written in order, and a band whose strides match is written in
+ * one go. */
+static void
+gst_kms_copier_copy_plane (GstKMSCopier * copier, guint plane, guint band)
+{
+  const GstVideoFrame *src = copier->src;
+  GstVideoFrame *dest = copier->dest;
+  const guint8 *s;
+  guint8 *d;
+  gint ss, ds, w, h, y0, y1, y;
+
+  ss = GST_VIDEO_FRAME_PLANE_STRIDE (src, plane);
+  ds = GST_VIDEO_FRAME_PLANE_STRIDE (dest, plane);
+
+  /* same assumption as gst_video_frame_copy_plane(): component N is
+   * subsampled like plane N */
+  w = GST_VIDEO_FRAME_COMP_WIDTH (dest, plane) *
+      GST_VIDEO_FRAME_COMP_PSTRIDE (dest, plane);
+  h = GST_VIDEO_FRAME_COMP_HEIGHT (dest, plane);
+
+  y0 = (gint64) h * band / copier->n_bands;
+  y1 = (gint64) h * (band + 1) / copier->n_bands;
+  if (y1 <= y0)
+    return;
+
+  s = (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA (src, plane) + y0 * ss;
+  d = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (dest, plane) + y0 * ds;
+
+  if (ss == ds) {
+    memcpy (d, s, (gsize) (y1 - y0 - 1) * ds + w);
+    return;
+  }
+
+  for (y = y0; y < y1; y++) {
+    memcpy (d, s, w);
+    s += ss;
+    d += ds;
+  }
+}
+
+static void
+gst_kms_copier_run_band (GstKMSCopyBand * band, GstKMSCopier * copier)
+{
+  guint i;
+
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (copier->dest); i++)
+    gst_kms_copier_copy_plane (copier, i, band->index);
+
+  g_mutex_lock (&copier->lock);
+  if (--copier->pending == 0)
+    g_cond_signal (&copier->cond);
+  g_mutex_unlock (&copier->lock);
+}
+
+GstKMSCopier *
+gst_kms_copier_new (GstElement * element, guint n_threads)
+{
+  GstKMSCopier *copier;
+  guint i;
+
+  copier = g_new0 (GstKMSCopier, 1);
+  copier->element = element;
+  g_mutex_init (&copier->lock);
+  g_cond_init (&copier->cond);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+  copier->n_threads = MAX (n_threads, 1);
+
+  copier->bands = g_new0 (GstKMSCopyBand, copier->n_threads);
+  for (i = 0; i < copier->n_threads; i++)
+    copier->bands[i].index = i;
+
+  if (copier->n_threads > 1) {
+    copier->pool = g_thread_pool_new ((GFunc) gst_kms_copier_run_band,
+        copier, copier->n_threads - 1, FALSE, NULL);
+    if (!copier->pool)
+      copier->n_threads = 1;
+  }
+
+  GST_INFO_OBJECT (element, "copying frames with %u threads",
+      copier->n_threads);
+
+  return copier;
+}
+
+void
+gst_kms_copier_free (GstKMSCopier * copier)
+{
+  if (copier->pool)
+    g_thread_pool_free (copier->pool, FALSE, TRUE);
+
+  g_clear_pointer (&copier->convert, gst_video_converter_free);
+  g_free (copier->bands);
+  g_mutex_clear (&copier->lock);
+  g_cond_clear (&copier->cond);
+
+  g_free (copier);
+}
+
+static void
+gst_kms_copier_run (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src, guint n)
+{
+  guint i;
+
+  copier->dest = dest;
+  copier->src = src;
+  copier->n_bands = n;
+  copier->pending = n;
+
+  for (i = 1; i < n; i++)
+    g_thread_pool_push (copier->pool, &copier->bands[i], NULL);
+  gst_kms_copier_run_band (&copier->bands[0], copier);
+
+  g_mutex_lock (&copier->lock);
+  while (copier->pending > 0)
+    g_cond_wait (&copier->cond, &copier->lock);
+  g_mutex_unlock (&copier->lock);
+
+  copier->dest = NULL;
+  copier->src = NULL;
+}
+
+gboolean
+gst_kms_copier_copy (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src)
+{
+  const GstVideoFormatInfo *finfo = dest->info.finfo;
+  guint n;
+
+  g_return_val_if_fail (GST_VIDEO_FRAME_FORMAT (src) ==
+      GST_VIDEO_FRAME_FORMAT (dest), FALSE);
+
+  /* tiles and packed groups of pixels don't split into rows */
+  if (GST_VIDEO_FORMAT_INFO_IS_TILED (finfo)
+      || GST_VIDEO_FORMAT_INFO_IS_COMPLEX (finfo)
+      || GST_VIDEO_FORMAT_INFO_PSTRIDE (finfo, 0) == 0)
+    return gst_video_frame_copy (dest, src);
+
+  n = GST_VIDEO_FRAME_HEIGHT (dest) / GST_KMS_COPY_MIN_BAND_ROWS;
+  n = CLAMP (n, 1, copier->n_threads);
+
+  gst_kms_copier_run (copier, dest, src, n);
+
+  return TRUE;
+}
+
+gboolean
+gst_kms_copier_set_scale (GstKMSCopier * copier, GstVideoInfo * in,
+    GstVideoInfo * out, GstVideoRectangle * src)
+{
+  GstStructure *config;
+
+  if (copier->convert && gst_video_info_is_equal (in, &copier->scale_in) &&
+      gst_video_info_is_equal (out, &copier->scale_out) &&
+      !memcmp (src, &copier->scale_src, sizeof (*src)))
+    return TRUE;
+
+  g_clear_pointer (&copier->convert, gst_video_converter_free);
+
+  config = gst_structure_new ("GstKMSCopier",
+      GST_VIDEO_CONVERTER_OPT_SRC_X, G_TYPE_INT, src->x,
+      GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, src->y,
+      GST_VIDEO_CONVERTER_OPT_SRC_WIDTH, G_TYPE_INT, src->w,
+      GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, src->h,
+      GST_VIDEO_CONVERTER_OPT_FILL_BORDER, G_TYPE_BOOLEAN, FALSE, NULL);
+#if GST_CHECK_VERSION (1, 14, 0)
+  /* it splits the lines between its threads with the taps they need */
+  gst_structure_set (config, GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT,
+      copier->n_threads, NULL);
+#endif
+
+  copier->convert = gst_video_converter_new (in, out, config);
+  if (!copier->convert)
+    goto no_converter;
+
+  copier->scale_in = *in;
+  copier->scale_out = *out;
+  copier->scale_src = *src;
+
+  GST_INFO_OBJECT (copier->element, "scaling %s %dx%d to %dx%d",
+      GST_VIDEO_INFO_NAME (in), src->w, src->h, GST_VIDEO_INFO_WIDTH (out),
+      GST_VIDEO_INFO_HEIGHT (out));
+
+  return TRUE;
+
+no_converter:
+  {
+    GST_WARNING_OBJECT (copier->element, "can't scale %s",
+        GST_VIDEO_INFO_NAME (in));
+    return FALSE;
+  }
+}
+
+gboolean
+gst_kms_copier_scale (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src)
+{
+  g_return_val_if_fail (copier->convert, FALSE);
+
+  gst_video_converter_frame (copier->convert, src, dest);
+
+  return TRUE;
+}
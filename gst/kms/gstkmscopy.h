@@ -0,0 +1,49 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GST_KMS_COPY_H__
+#define __GST_KMS_COPY_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstKMSCopier GstKMSCopier;
+
+/* copies frames into mapped dumb buffers in bands of rows, with the
+ * streaming thread and up to @n_threads - 1 workers, 0 for one per core */
+GstKMSCopier *gst_kms_copier_new (GstElement * element, guint n_threads);
+void gst_kms_copier_free (GstKMSCopier * copier);
+
+gboolean gst_kms_copier_copy (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src);
+
+/* scales @src of frames of @in to whole frames of @out, with as many
+ * threads where the converter has them. Only sets the converter up again
+ * when the arguments change */
+gboolean gst_kms_copier_set_scale (GstKMSCopier * copier, GstVideoInfo * in,
+    GstVideoInfo * out, GstVideoRectangle * src);
+gboolean gst_kms_copier_scale (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src);
+
+G_END_DECLS
+#endif /* __GST_KMS_COPY_H__ */
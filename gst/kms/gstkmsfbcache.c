@@ -0,0 +1,177 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "gstkmsfbcache.h"
+
+/* dmabufs get an inode of their own since linux 5.3, before they all
+ * share the anonymous inode */
+#ifndef DMA_BUF_MAGIC
+#define DMA_BUF_MAGIC 0x444d4142
+#endif
+
+/* Framebuffers imported from dmabufs, most recently used first. The
+ * imported GEM objects hold their dmabufs, so an inode in the cache can't
+ * be reused by another buffer. */
+struct _GstKMSFBCache
+{
+  GHashTable *entries;
+  GQueue lru;
+  guint max_size;
+};
+
+typedef struct
+{
+  GstKMSFBKey key;
+  GstMemory *kmsmem;
+  GList link;
+} GstKMSFBEntry;
+
+gboolean
+gst_kms_fb_key_init (GstKMSFBKey * key, gint * fds, guint n_planes,
+    gsize offsets[GST_VIDEO_MAX_PLANES], GstVideoInfo * vinfo)
+{
+  struct statfs sfs;
+  struct stat st;
+  guint i;
+
+  /* hashed as bytes */
+  memset (key, 0, sizeof (*key));
+
+  key->format = GST_VIDEO_INFO_FORMAT (vinfo);
+  key->width = GST_VIDEO_INFO_WIDTH (vinfo);
+  key->height = GST_VIDEO_INFO_HEIGHT (vinfo);
+  key->n_planes = n_planes;
+
+  for (i = 0; i < n_planes; i++) {
+    if (fstatfs (fds[i], &sfs) < 0 || sfs.f_type != DMA_BUF_MAGIC)
+      return FALSE;
+    if (fstat (fds[i], &st) < 0)
+      return FALSE;
+
+    key->inode[i] = st.st_ino;
+    key->offset[i] = offsets[i];
+    key->stride[i] = GST_VIDEO_INFO_PLANE_STRIDE (vinfo, i);
+  }
+
+  return TRUE;
+}
+
+static guint
+gst_kms_fb_key_hash (gconstpointer data)
+{
+  const guint8 *p = data;
+  guint hash = 2166136261u;
+  gsize i;
+
+  for (i = 0; i < sizeof (GstKMSFBKey); i++)
+    hash = (hash ^ p[i]) * 16777619u;
+
+  return hash;
+}
+
+static gboolean
+gst_kms_fb_key_equal (gconstpointer a, gconstpointer b)
+{
+  return !memcmp (a, b, sizeof (GstKMSFBKey));
+}
+
+static void
+gst_kms_fb_entry_free (GstKMSFBEntry * entry)
+{
+  gst_memory_unref (entry->kmsmem);
+  g_slice_free (GstKMSFBEntry, entry);
+}
+
+GstKMSFBCache *
+gst_kms_fb_cache_new (guint max_size)
+{
+  GstKMSFBCache *cache;
+
+  cache = g_slice_new0 (GstKMSFBCache);
+  cache->entries = g_hash_table_new_full (gst_kms_fb_key_hash,
+      gst_kms_fb_key_equal, NULL, (GDestroyNotify) gst_kms_fb_entry_free);
+  g_queue_init (&cache->lru);
+  cache->max_size = max_size;
+
+  return cache;
+}
+
+void
+gst_kms_fb_cache_free (GstKMSFBCache * cache)
+{
+  g_hash_table_destroy (cache->entries);
+  g_slice_free (GstKMSFBCache, cache);
+}
+
+GstMemory *
+gst_kms_fb_cache_lookup (GstKMSFBCache * cache, const GstKMSFBKey * key)
+{
+  GstKMSFBEntry *entry;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  if (!entry)
+    return NULL;
+
+  g_queue_unlink (&cache->lru, &entry->link);
+  g_queue_push_head_link (&cache->lru, &entry->link);
+
+  return gst_memory_ref (entry->kmsmem);
+}
+
+void
+gst_kms_fb_cache_insert (GstKMSFBCache * cache, const GstKMSFBKey * key,
+    GstMemory * kmsmem)
+{
+  GstKMSFBEntry *entry;
+  GList *last;
+
+  if (cache->max_size == 0 || g_hash_table_contains (cache->entries, key))
+    return;
+
+  entry = g_slice_new0 (GstKMSFBEntry);
+  entry->key = *key;
+  entry->kmsmem = gst_memory_ref (kmsmem);
+  entry->link.data = entry;
+
+  g_queue_push_head_link (&cache->lru, &entry->link);
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+
+  /* the framebuffers of frames still in use live on in their buffers */
+  while (cache->lru.length > cache->max_size) {
+    last = g_queue_pop_tail_link (&cache->lru);
+    entry = last->data;
+    g_hash_table_remove (cache->entries, &entry->key);
+  }
+}
+
+guint
+gst_kms_fb_cache_get_size (GstKMSFBCache * cache)
+{
+  return cache->lru.length;
+}
@@ -0,0 +1,60 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GST_KMS_FB_CACHE_H__
+#define __GST_KMS_FB_CACHE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstKMSFBCache GstKMSFBCache;
+typedef struct _GstKMSFBKey GstKMSFBKey;
+
+/* identity of an imported framebuffer */
+struct _GstKMSFBKey
+{
+  GstVideoFormat format;
+  gint width, height;
+  guint n_planes;
+  guint64 inode[GST_VIDEO_MAX_PLANES];
+  guint64 offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+};
+
+/* FALSE when the dmabufs have no inode of their own (older kernels) */
+gboolean gst_kms_fb_key_init (GstKMSFBKey * key, gint * fds, guint n_planes,
+    gsize offsets[GST_VIDEO_MAX_PLANES], GstVideoInfo * vinfo);
+
+GstKMSFBCache *gst_kms_fb_cache_new (guint max_size);
+void gst_kms_fb_cache_free (GstKMSFBCache * cache);
+
+/* lookup returns a new reference, insert takes one of its own */
+GstMemory *gst_kms_fb_cache_lookup (GstKMSFBCache * cache,
+    const GstKMSFBKey * key);
+void gst_kms_fb_cache_insert (GstKMSFBCache * cache, const GstKMSFBKey * key,
+    GstMemory * kmsmem);
+
+guint gst_kms_fb_cache_get_size (GstKMSFBCache * cache);
+
+G_END_DECLS
+#endif /* __GST_KMS_FB_CACHE_H__ */
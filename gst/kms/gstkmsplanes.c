@@ -0,0 +1,210 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "gstkmsplanes.h"
+#include "gstkmsutils.h"
+
+gboolean
+gst_kms_plane_get_props (gint fd, guint32 plane_id, GstKMSPlaneProps * props)
+{
+#define GET_PROP(name, id) \
+  gst_kms_get_property (fd, plane_id, DRM_MODE_OBJECT_PLANE, name, id, NULL)
+
+  return GET_PROP ("FB_ID", &props->fb_id) &&
+      GET_PROP ("CRTC_ID", &props->crtc_id) &&
+      GET_PROP ("SRC_X", &props->src_x) &&
+      GET_PROP ("SRC_Y", &props->src_y) &&
+      GET_PROP ("SRC_W", &props->src_w) &&
+      GET_PROP ("SRC_H", &props->src_h) &&
+      GET_PROP ("CRTC_X", &props->crtc_x) &&
+      GET_PROP ("CRTC_Y", &props->crtc_y) &&
+      GET_PROP ("CRTC_W", &props->crtc_w) &&
+      GET_PROP ("CRTC_H", &props->crtc_h);
+
+#undef GET_PROP
+}
+
+gboolean
+gst_kms_plane_has_format (const GstKMSPlane * plane, guint32 fourcc)
+{
+  guint i;
+
+  for (i = 0; i < plane->n_formats; i++) {
+    if (plane->formats[i] == fourcc)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+gst_kms_plane_free (GstKMSPlane * plane)
+{
+  g_free (plane->formats);
+  g_slice_free (GstKMSPlane, plane);
+}
+
+static gint
+gst_kms_plane_compare (gconstpointer a, gconstpointer b)
+{
+  const GstKMSPlane *plane1 = *(const GstKMSPlane **) a;
+  const GstKMSPlane *plane2 = *(const GstKMSPlane **) b;
+
+  if (plane1->zpos != plane2->zpos)
+    return plane1->zpos < plane2->zpos ? -1 : 1;
+
+  return plane1->plane_id < plane2->plane_id ? -1 :
+      plane1->plane_id > plane2->plane_id;
+}
+
+GPtrArray *
+gst_kms_planes_probe (gint fd, guint pipe)
+{
+  drmModePlaneRes *pres;
+  drmModePlane *mplane;
+  GstKMSPlane *plane;
+  GPtrArray *planes;
+  guint i;
+
+  planes = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_kms_plane_free);
+
+  pres = drmModeGetPlaneResources (fd);
+  if (!pres)
+    return planes;
+
+  for (i = 0; i < pres->count_planes; i++) {
+    mplane = drmModeGetPlane (fd, pres->planes[i]);
+    if (!mplane)
+      continue;
+
+    if (!(mplane->possible_crtcs & (1 << pipe)))
+      goto next;
+
+    plane = g_slice_new0 (GstKMSPlane);
+    plane->plane_id = mplane->plane_id;
+
+    if (!gst_kms_get_property (fd, plane->plane_id, DRM_MODE_OBJECT_PLANE,
+            "type", NULL, &plane->type))
+      plane->type = DRM_PLANE_TYPE_OVERLAY;
+
+    if (plane->type == DRM_PLANE_TYPE_CURSOR ||
+        !gst_kms_plane_get_props (fd, plane->plane_id, &plane->props)) {
+      gst_kms_plane_free (plane);
+      goto next;
+    }
+
+    /* without a zpos, primary planes are below the overlays */
+    if (!gst_kms_get_property (fd, plane->plane_id, DRM_MODE_OBJECT_PLANE,
+            "zpos", NULL, &plane->zpos))
+      plane->zpos = plane->type == DRM_PLANE_TYPE_PRIMARY ? 0 : 1;
+
+    plane->formats = g_memdup (mplane->formats,
+        mplane->count_formats * sizeof (guint32));
+    plane->n_formats = mplane->count_formats;
+
+    g_ptr_array_add (planes, plane);
+
+  next:
+    drmModeFreePlane (mplane);
+  }
+
+  drmModeFreePlaneResources (pres);
+
+  g_ptr_array_sort (planes, gst_kms_plane_compare);
+
+  return planes;
+}
+
+/* the lowest plane from @plane up for each stream from @first up, each
+ * above the one of the stream below */
+static gboolean
+gst_kms_planes_assign_from (GPtrArray * planes, const guint32 * fourccs,
+    guint first, guint n_inputs, guint plane, gint * assignment)
+{
+  guint i;
+
+  for (i = first; i < n_inputs; i++) {
+    while (plane < planes->len &&
+        !gst_kms_plane_has_format (g_ptr_array_index (planes, plane),
+            fourccs[i]))
+      plane++;
+
+    if (plane == planes->len)
+      return FALSE;
+
+    assignment[i] = plane++;
+  }
+
+  return TRUE;
+}
+
+guint
+gst_kms_planes_assign (GPtrArray * planes, const guint32 * fourccs,
+    guint n_inputs, guint max_planes, guint32 canvas_fourcc,
+    gint * assignment, gint * canvas)
+{
+  guint i, composed;
+  guint c;
+
+  *canvas = -1;
+
+  /* every stream on a plane of its own */
+  if (n_inputs <= max_planes &&
+      gst_kms_planes_assign_from (planes, fourccs, 0, n_inputs, 0, assignment))
+    return n_inputs;
+
+  for (i = 0; i < n_inputs; i++)
+    assignment[i] = -1;
+
+  /* the canvas is below all the other planes, so it takes the bottom
+   * streams, as few as possible */
+  for (c = 0; c < planes->len; c++) {
+    if (gst_kms_plane_has_format (g_ptr_array_index (planes, c),
+            canvas_fourcc))
+      break;
+  }
+
+  if (c == planes->len)
+    return 0;
+
+  *canvas = c;
+
+  for (composed = 1; composed < n_inputs; composed++) {
+    if (n_inputs - composed > max_planes)
+      continue;
+
+    if (gst_kms_planes_assign_from (planes, fourccs, composed, n_inputs, c + 1,
+            assignment))
+      break;
+
+    for (i = composed; i < n_inputs; i++)
+      assignment[i] = -1;
+  }
+
+  return n_inputs - composed;
+}
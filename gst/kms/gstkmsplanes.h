@@ -0,0 +1,69 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef __GST_KMS_PLANES_H__
+#define __GST_KMS_PLANES_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstKMSPlaneProps GstKMSPlaneProps;
+typedef struct _GstKMSPlane GstKMSPlane;
+
+/* ids of the plane properties of the atomic API */
+struct _GstKMSPlaneProps
+{
+  guint32 fb_id, crtc_id;
+  guint32 src_x, src_y, src_w, src_h;
+  guint32 crtc_x, crtc_y, crtc_w, crtc_h;
+};
+
+struct _GstKMSPlane
+{
+  guint32 plane_id;
+  guint64 type;                 /* DRM_PLANE_TYPE_* */
+  guint64 zpos;
+  guint32 *formats;
+  guint n_formats;
+  GstKMSPlaneProps props;
+};
+
+gboolean gst_kms_plane_get_props (gint fd, guint32 plane_id,
+    GstKMSPlaneProps * props);
+gboolean gst_kms_plane_has_format (const GstKMSPlane * plane, guint32 fourcc);
+
+/* the planes of the atomic API that can show on the crtc at @pipe, from
+ * the bottom up; cursors are left out */
+GPtrArray *gst_kms_planes_probe (gint fd, guint pipe);
+
+/* puts the @n_inputs streams of formats @fourccs, from the bottom up, on
+ * planes of their own, at most @max_planes of them. The streams that don't
+ * get one are composed in a @canvas_fourcc buffer shown on the plane
+ * returned in @canvas, -1 when there is none. @assignment gets the index
+ * of the plane of every stream, -1 for the composed ones. Returns the
+ * number of streams on planes of their own. */
+guint gst_kms_planes_assign (GPtrArray * planes, const guint32 * fourccs,
+    guint n_inputs, guint max_planes, guint32 canvas_fourcc,
+    gint * assignment, gint * canvas);
+
+G_END_DECLS
+#endif /* __GST_KMS_PLANES_H__ */
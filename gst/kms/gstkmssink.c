@@ -30,6 +30,9 @@
  * kmssink is a simple video sink that renders video frames directly
  * in a plane of a DRM device.
  *
+ * When the driver supports atomic modesetting, frames are committed
+ * without waiting for the vblank in the streaming thread.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -57,6 +60,9 @@
 #include "gstkmsutils.h"
 #include "gstkmsbufferpool.h"
 #include "gstkmsallocator.h"
+#include "gstkmsfbcache.h"
+#include "gstkmscopy.h"
+#include "gstkmscompositor.h"
 
 #define GST_PLUGIN_NAME "kmssink"
 #define GST_PLUGIN_DESC "Video sink using the Linux kernel mode setting API"
@@ -92,20 +98,54 @@ enum
   PROP_CONNECTOR_ID,
   PROP_PLANE_ID,
   PROP_FORCE_MODESETTING,
+  PROP_QUEUE_SIZE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_VBLANK_SYNC,
+  PROP_FB_CACHE_SIZE,
+  PROP_COPY_THREADS,
+  PROP_RECYCLE_BUDGET,
+  PROP_MATCH_REFRESH_RATE,
   PROP_N,
   PROP_DISPLAY_RATIO,
 };
 
 static GParamSpec *g_properties[PROP_N] = { NULL, };
 
+#define DEFAULT_FB_CACHE_SIZE 32
+#define DEFAULT_COPY_THREADS 0
+#define DEFAULT_RECYCLE_BUDGET (64 * 1024 * 1024)
+
+/* the VOP planes scale by up to 8 either way */
+#define GST_KMS_MAX_SCALE 8
+
+static const gchar *scale_path_names[] = {
+  "plane", "upstream", "converter", "line-skip"
+};
+
+static guint64
+get_plane_type (int fd, guint32 plane_id)
+{
+  guint64 type;
+
+  if (!gst_kms_get_property (fd, plane_id, DRM_MODE_OBJECT_PLANE, "type",
+          NULL, &type))
+    type = DRM_PLANE_TYPE_OVERLAY;
+
+  return type;
+}
+
+/* with universal planes, @type is tried first, cursors never */
 static drmModePlane *
 find_plane_for_crtc (int fd, drmModeRes * res, drmModePlaneRes * pres,
-    int crtc_id)
+    int crtc_id, guint64 type)
 {
-  drmModePlane *plane;
+  drmModePlane *plane, *fallback;
+  guint64 plane_type;
   int i, pipe;
 
   plane = NULL;
+  fallback = NULL;
   pipe = -1;
   for (i = 0; i < res->count_crtcs; i++) {
     if (crtc_id == res->crtcs[i]) {
@@ -119,202 +159,868 @@ find_plane_for_crtc (int fd, drmModeRes * res, drmModePlaneRes * pres,
 
   for (i = 0; i < pres->count_planes; i++) {
     plane = drmModeGetPlane (fd, pres->planes[i]);
-    if (plane->possible_crtcs & (1 << pipe))
-      return plane;
+    if (!plane)
+      continue;
+
+    if (plane->possible_crtcs & (1 << pipe)) {
+      plane_type = get_plane_type (fd, plane->plane_id);
+      if (plane_type == type) {
+        if (fallback)
+          drmModeFreePlane (fallback);
+        return plane;
+      }
+
+      if (!fallback && plane_type != DRM_PLANE_TYPE_CURSOR) {
+        fallback = plane;
+        continue;
+      }
+    }
     drmModeFreePlane (plane);
   }
 
-  return NULL;
+  return fallback;
 }
 
-static drmModeCrtc *
-find_crtc_for_connector (int fd, drmModeRes * res, drmModeConnector * conn,
-    guint * pipe)
+static void
+log_drm_version (GstKMSSink * self)
 {
-  int i;
-  int crtc_id;
-  drmModeEncoder *enc;
-  drmModeCrtc *crtc;
-  guint32 crtcs_for_connector = 0;
-
-  crtc_id = -1;
-  for (i = 0; i < res->count_encoders; i++) {
-    enc = drmModeGetEncoder (fd, res->encoders[i]);
-    if (enc) {
-      if (enc->encoder_id == conn->encoder_id) {
-        crtc_id = enc->crtc_id;
-        drmModeFreeEncoder (enc);
-        break;
-      }
-      drmModeFreeEncoder (enc);
+#ifndef GST_DISABLE_GST_DEBUG
+  drmVersion *v;
+
+  v = drmGetVersion (self->fd);
+  if (v) {
+    GST_INFO_OBJECT (self, "DRM v%d.%d.%d [%s — %s — %s]", v->version_major,
+        v->version_minor, v->version_patchlevel, GST_STR_NULL (v->name),
+        GST_STR_NULL (v->desc), GST_STR_NULL (v->date));
+    drmFreeVersion (v);
+  } else {
+    GST_WARNING_OBJECT (self, "could not get driver information: %s",
+        GST_STR_NULL (self->devname));
+  }
+#endif
+  return;
+}
+
+static gboolean
+get_drm_caps (GstKMSSink * self)
+{
+  gint ret;
+  guint64 has_dumb_buffer;
+  guint64 has_prime;
+  guint64 has_async_page_flip;
+  guint64 has_monotonic;
+
+  has_dumb_buffer = 0;
+  ret = drmGetCap (self->fd, DRM_CAP_DUMB_BUFFER, &has_dumb_buffer);
+  if (ret)
+    GST_WARNING_OBJECT (self, "could not get dumb buffer capability");
+  if (has_dumb_buffer == 0) {
+    GST_ERROR_OBJECT (self, "driver cannot handle dumb buffers");
+    return FALSE;
+  }
+
+  has_prime = 0;
+  ret = drmGetCap (self->fd, DRM_CAP_PRIME, &has_prime);
+  if (ret)
+    GST_WARNING_OBJECT (self, "could not get prime capability");
+  else {
+    self->has_prime_import = (gboolean) (has_prime & DRM_PRIME_CAP_IMPORT);
+    self->has_prime_export = (gboolean) (has_prime & DRM_PRIME_CAP_EXPORT);
+  }
+
+  has_async_page_flip = 0;
+  ret = drmGetCap (self->fd, DRM_CAP_ASYNC_PAGE_FLIP, &has_async_page_flip);
+  if (ret)
+    GST_WARNING_OBJECT (self, "could not get async page flip capability");
+  else
+    self->has_async_page_flip = (gboolean) has_async_page_flip;
+
+  has_monotonic = 0;
+  drmGetCap (self->fd, DRM_CAP_TIMESTAMP_MONOTONIC, &has_monotonic);
+  self->has_monotonic_timestamp = (gboolean) has_monotonic;
+
+  /* also exposes all the planes */
+  self->has_atomic = !drmSetClientCap (self->fd, DRM_CLIENT_CAP_ATOMIC, 1);
+
+  GST_INFO_OBJECT (self, "prime import (%s) / prime export (%s) / "
+      "async page flip (%s) / atomic (%s)", self->has_prime_import ? "✓" : "✗",
+      self->has_prime_export ? "✓" : "✗",
+      self->has_async_page_flip ? "✓" : "✗", self->has_atomic ? "✓" : "✗");
+
+  return TRUE;
+}
+
+static gboolean
+get_atomic_props (GstKMSSink * self)
+{
+  if (!gst_kms_plane_get_props (self->fd, self->plane_id,
+          &self->plane_props))
+    return FALSE;
+
+  return gst_kms_get_property (self->fd, self->crtc_id, DRM_MODE_OBJECT_CRTC,
+      "MODE_ID", &self->crtc_mode_id, NULL) &&
+      gst_kms_get_property (self->fd, self->crtc_id, DRM_MODE_OBJECT_CRTC,
+      "ACTIVE", &self->crtc_active, NULL) &&
+      gst_kms_get_property (self->fd, self->conn_id,
+      DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", &self->conn_crtc_id, NULL);
+}
+
+static void
+add_plane_props (GstKMSSink * self, drmModeAtomicReq * req, guint32 fb_id,
+    GstVideoRectangle * src, GstVideoRectangle * dst)
+{
+  GstKMSPlaneProps *props;
+  guint32 plane;
+
+  props = &self->plane_props;
+  plane = self->plane_id;
+
+  drmModeAtomicAddProperty (req, plane, props->fb_id, fb_id);
+  drmModeAtomicAddProperty (req, plane, props->crtc_id, self->crtc_id);
+  /* source/cropping coordinates are given in Q16 */
+  drmModeAtomicAddProperty (req, plane, props->src_x, (guint64) src->x << 16);
+  drmModeAtomicAddProperty (req, plane, props->src_y, (guint64) src->y << 16);
+  drmModeAtomicAddProperty (req, plane, props->src_w, (guint64) src->w << 16);
+  drmModeAtomicAddProperty (req, plane, props->src_h, (guint64) src->h << 16);
+  drmModeAtomicAddProperty (req, plane, props->crtc_x, dst->x);
+  drmModeAtomicAddProperty (req, plane, props->crtc_y, dst->y);
+  drmModeAtomicAddProperty (req, plane, props->crtc_w, dst->w);
+  drmModeAtomicAddProperty (req, plane, props->crtc_h, dst->h);
+}
+
+/* a frame to present, copied when it waits in the presentation queue */
+typedef struct
+{
+  GstBuffer *buffer;
+  guint32 fb_id;
+  GstVideoRectangle src, dst;
+  GstClockTime target;          /* running time it is due at */
+} GstKMSFrame;
+
+static GstKMSFrame *
+gst_kms_frame_copy (GstKMSFrame * frame)
+{
+  GstKMSFrame *copy;
+
+  copy = g_slice_dup (GstKMSFrame, frame);
+  gst_buffer_ref (copy->buffer);
+
+  return copy;
+}
+
+static void
+gst_kms_frame_free (GstKMSFrame * frame)
+{
+  gst_buffer_unref (frame->buffer);
+  g_slice_free (GstKMSFrame, frame);
+}
+
+static gboolean gst_kms_sink_present (GstKMSSink * self,
+    GstKMSFrame * frame);
+
+/* time base of the vblank timestamps */
+static GstClockTime
+gst_kms_sink_now (GstKMSSink * self)
+{
+  if (self->has_monotonic_timestamp)
+    return g_get_monotonic_time () * GST_USECOND;
+  return g_get_real_time () * GST_USECOND;
+}
+
+/* from the time base of the vblank timestamps to running time */
+static gboolean
+gst_kms_sink_get_time_offset (GstKMSSink * self, GstClockTimeDiff * offset)
+{
+  GstClock *clock;
+
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (!clock)
+    return FALSE;
+
+  *offset = GST_CLOCK_DIFF (gst_kms_sink_now (self),
+      gst_clock_get_time (clock)) -
+      (GstClockTimeDiff) gst_element_get_base_time (GST_ELEMENT (self));
+  gst_object_unref (clock);
+
+  return TRUE;
+}
+
+static void
+update_timing (GstKMSSink * self, guint frame, GstClockTime ts)
+{
+  GstClockTimeDiff offset;
+  GstClockTime period, latency;
+
+  /* smoothed over the last flips */
+  if (self->last_vblank && frame != self->last_vblank &&
+      GST_CLOCK_TIME_IS_VALID (self->last_vblank_ts) &&
+      ts > self->last_vblank_ts) {
+    period = (ts - self->last_vblank_ts) / (frame - self->last_vblank);
+    if (self->refresh_period)
+      self->refresh_period = (self->refresh_period * 7 + period) / 8;
+    else
+      self->refresh_period = period;
+  }
+  self->last_vblank_ts = ts;
+
+  /* from the commit to the glass */
+  if (GST_CLOCK_TIME_IS_VALID (self->pending_submitted) &&
+      ts > self->pending_submitted) {
+    latency = ts - self->pending_submitted;
+    self->latency_sum += latency;
+    self->latency_max = MAX (self->latency_max, latency);
+    self->latency_count++;
+  }
+
+  if (!gst_kms_sink_get_time_offset (self, &offset))
+    return;
+
+  self->presented_at = ts + offset;
+  if (!GST_CLOCK_TIME_IS_VALID (self->pending_target))
+    return;
+
+  self->lateness = GST_CLOCK_DIFF (self->pending_target, self->presented_at);
+
+  /* shown on a later vblank than the one it was due for, sent upstream
+   * from the streaming thread */
+  if (self->refresh_period && self->lateness > self->refresh_period / 2) {
+    self->qos_pending = TRUE;
+    self->qos_diff = self->lateness;
+    self->qos_timestamp = self->pending_target;
+  }
+}
+
+static void
+gst_kms_sink_flush_queue (GstKMSSink * self)
+{
+  g_queue_foreach (&self->present_queue, (GFunc) gst_kms_frame_free, NULL);
+  g_queue_clear (&self->present_queue);
+}
+
+static void
+flip_handler (gint fd, guint frame, guint sec, guint usec, gpointer data)
+{
+  GstKMSSink *self;
+  GstKMSFrame *next;
+  guint skipped;
+
+  self = data;
+
+  /* vblanks the previous frame stayed on screen for: a chained frame was
+   * ready for the first one, otherwise there was nothing new to show */
+  if (self->last_vblank && frame - self->last_vblank > 1) {
+    skipped = frame - self->last_vblank - 1;
+    if (self->present_chained) {
+      self->missed_vblanks += skipped;
+      GST_CAT_INFO_OBJECT (CAT_PERFORMANCE, self,
+          "frame shown %u vblank(s) late", skipped);
+    } else {
+      self->repeated_vblanks += skipped;
     }
   }
+  update_timing (self, frame, (GstClockTime) sec * GST_SECOND +
+      (GstClockTime) usec * GST_USECOND);
+  self->last_vblank = frame;
+  self->presented++;
+
+  /* the committed frame is on screen, the previous one can be reused */
+  self->flip_pending = FALSE;
+  gst_buffer_replace (&self->last_buffer, self->pending_buffer);
+  gst_buffer_replace (&self->pending_buffer, NULL);
+  g_clear_pointer (&self->tmp_kmsmem, gst_memory_unref);
+
+  /* only fed when there is an event thread. The queued frames can't go
+   * out after a failed one, the streaming thread gets the error */
+  next = g_queue_pop_head (&self->present_queue);
+  if (next) {
+    self->present_chained = gst_kms_sink_present (self, next);
+    gst_kms_frame_free (next);
+    if (!self->present_chained) {
+      GST_WARNING_OBJECT (self, "dropping %u queued frame(s)",
+          self->present_queue.length);
+      gst_kms_sink_flush_queue (self);
+      self->present_failed = TRUE;
+    }
+  }
+
+  g_cond_broadcast (&self->present_cond);
+}
+
+static gboolean
+gst_kms_sink_wait_flip (GstKMSSink * self)
+{
+  gint ret;
+  drmEventContext evctxt = {
+    .version = DRM_EVENT_CONTEXT_VERSION,
+    .page_flip_handler = flip_handler,
+    .vblank_handler = flip_handler,
+  };
+
+  while (self->flip_pending) {
+    do {
+      ret = gst_poll_wait (self->poll, 3 * GST_SECOND);
+    } while (ret == -1 && (errno == EAGAIN || errno == EINTR));
+    if (ret == 0)
+      goto timeout;
+
+    /* the stats are read under the lock */
+    g_mutex_lock (&self->present_lock);
+    ret = drmHandleEvent (self->fd, &evctxt);
+    g_mutex_unlock (&self->present_lock);
+    if (ret)
+      goto event_failed;
+  }
+
+  return TRUE;
+
+  /* ERRORS */
+timeout:
+  {
+    GST_WARNING_OBJECT (self, "no page flip event for the last commit");
+    g_mutex_lock (&self->present_lock);
+    self->flip_pending = FALSE;
+    g_mutex_unlock (&self->present_lock);
+    return FALSE;
+  }
+event_failed:
+  {
+    GST_ERROR_OBJECT (self, "drmHandleEvent failed: %s (%d)", strerror (-ret),
+        ret);
+    return FALSE;
+  }
+}
+
+static gboolean
+gst_kms_sink_commit_plane (GstKMSSink * self, guint32 fb_id,
+    GstVideoRectangle * src, GstVideoRectangle * dst)
+{
+  drmModeAtomicReq *req;
+  gint ret;
+
+  req = drmModeAtomicAlloc ();
+  if (!req)
+    return FALSE;
+
+  add_plane_props (self, req, fb_id, src, dst);
+  ret = drmModeAtomicCommit (self->fd, req,
+      DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, self);
+  drmModeAtomicFree (req);
+  if (ret)
+    goto commit_failed;
+
+  self->flip_pending = TRUE;
+
+  return TRUE;
+
+  /* ERRORS */
+commit_failed:
+  {
+    GST_DEBUG_OBJECT (self, "src = { %d, %d, %d, %d } / "
+        "dst = { %d, %d, %d, %d }", src->x, src->y, src->w, src->h, dst->x,
+        dst->y, dst->w, dst->h);
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        (NULL), ("drmModeAtomicCommit failed: %s (%d)", strerror (-ret), ret));
+    return FALSE;
+  }
+}
+
+/* legacy API: asks for an event at the next vblank, or the flip to
+ * buffer_id */
+static gboolean
+gst_kms_sink_request_event (GstKMSSink * self)
+{
+  gint ret;
+  drmVBlank vbl = {
+    .request = {
+          .type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT,
+          .sequence = 1,
+          .signal = (gulong) self,
+        },
+  };
+
+  if (self->pipe == 1)
+    vbl.request.type |= DRM_VBLANK_SECONDARY;
+  else if (self->pipe > 1)
+    vbl.request.type |= self->pipe << DRM_VBLANK_HIGH_CRTC_SHIFT;
+
+  if (!self->has_async_page_flip && !self->modesetting_enabled) {
+    ret = drmWaitVBlank (self->fd, &vbl);
+    if (ret)
+      goto vblank_failed;
+  } else {
+    ret = drmModePageFlip (self->fd, self->crtc_id, self->buffer_id,
+        DRM_MODE_PAGE_FLIP_EVENT, self);
+    if (ret)
+      goto pageflip_failed;
+  }
+
+  self->flip_pending = TRUE;
+
+  return TRUE;
+
+  /* ERRORS */
+vblank_failed:
+  {
+    GST_WARNING_OBJECT (self, "drmWaitVBlank failed: %s (%d)", strerror (-ret),
+        ret);
+    return FALSE;
+  }
+pageflip_failed:
+  {
+    GST_WARNING_OBJECT (self, "drmModePageFlip failed: %s (%d)",
+        strerror (-ret), ret);
+    return FALSE;
+  }
+}
+
+/* the completion of every presentation goes through flip_handler */
+static gboolean
+gst_kms_sink_present (GstKMSSink * self, GstKMSFrame * frame)
+{
+  GstVideoRectangle *src, *dst;
+  gint ret;
+
+  src = &frame->src;
+  dst = &frame->dst;
+
+  if (self->has_atomic) {
+    if (!gst_kms_sink_commit_plane (self, frame->fb_id, src, dst))
+      return FALSE;
+  } else {
+    if (self->modesetting_enabled) {
+      self->buffer_id = frame->fb_id;
+    } else {
+      ret = drmModeSetPlane (self->fd, self->plane_id, self->crtc_id,
+          frame->fb_id, 0, dst->x, dst->y, dst->w, dst->h,
+          /* source/cropping coordinates are given in Q16 */
+          src->x << 16, src->y << 16, src->w << 16, src->h << 16);
+      if (ret)
+        goto set_plane_failed;
+    }
+
+    if (!gst_kms_sink_request_event (self))
+      return FALSE;
+  }
+
+  gst_buffer_replace (&self->pending_buffer, frame->buffer);
+  self->pending_submitted = gst_kms_sink_now (self);
+  self->pending_target = frame->target;
+
+  return TRUE;
+
+  /* ERRORS */
+set_plane_failed:
+  {
+    GST_DEBUG_OBJECT (self, "src = { %d, %d, %d, %d } / "
+        "dst = { %d, %d, %d, %d }", src->x, src->y, src->w, src->h, dst->x,
+        dst->y, dst->w, dst->h);
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        (NULL), ("drmModeSetPlane failed: %s (%d)", strerror (-ret), ret));
+    return FALSE;
+  }
+}
+
+static GstFlowReturn
+gst_kms_sink_queue_frame (GstKMSSink * self, GstKMSFrame * frame)
+{
+  GstFlowReturn ret;
+  gint64 end_time;
+
+  ret = GST_FLOW_OK;
+  end_time = g_get_monotonic_time () + 3 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&self->present_lock);
+
+  while (!self->present_flushing &&
+      self->present_queue.length >= self->queue_size) {
+    if (!g_cond_wait_until (&self->present_cond, &self->present_lock,
+            end_time))
+      goto stalled;
+  }
+
+  if (self->present_flushing) {
+    ret = GST_FLOW_FLUSHING;
+  } else if (self->present_failed) {
+    self->present_failed = FALSE;
+    ret = GST_FLOW_ERROR;
+  } else if (self->flip_pending || self->present_queue.length) {
+    /* behind the frames already waiting */
+    g_queue_push_tail (&self->present_queue, gst_kms_frame_copy (frame));
+  } else {
+    self->present_chained = FALSE;
+    if (!gst_kms_sink_present (self, frame))
+      ret = GST_FLOW_ERROR;
+  }
+
+done:
+  g_mutex_unlock (&self->present_lock);
+
+  return ret;
+
+  /* ERRORS */
+stalled:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED, (NULL),
+        ("no page flip event for the queued frames"));
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+}
+
+/* waits until everything queued is on screen */
+static void
+gst_kms_sink_drain (GstKMSSink * self)
+{
+  gint64 end_time;
+
+  if (!self->event_thread) {
+    gst_kms_sink_wait_flip (self);
+    return;
+  }
+
+  end_time = g_get_monotonic_time () + 3 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&self->present_lock);
+  while (!self->present_flushing && (self->flip_pending ||
+          self->present_queue.length)) {
+    if (!g_cond_wait_until (&self->present_cond, &self->present_lock,
+            end_time))
+      break;
+  }
+  g_mutex_unlock (&self->present_lock);
+}
+
+static gpointer
+gst_kms_sink_event_thread (gpointer data)
+{
+  GstKMSSink *self;
+  gint ret;
+  drmEventContext evctxt = {
+    .version = DRM_EVENT_CONTEXT_VERSION,
+    .page_flip_handler = flip_handler,
+    .vblank_handler = flip_handler,
+  };
+
+  self = data;
+
+  GST_DEBUG_OBJECT (self, "event thread started");
+
+  while (TRUE) {
+    ret = gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE);
+    if (ret == -1) {
+      if (errno == EAGAIN || errno == EINTR)
+        continue;
+      /* set flushing on stop */
+      break;
+    }
+
+    g_mutex_lock (&self->present_lock);
+    ret = drmHandleEvent (self->fd, &evctxt);
+    g_mutex_unlock (&self->present_lock);
+    if (ret) {
+      GST_ERROR_OBJECT (self, "drmHandleEvent failed: %s (%d)",
+          strerror (-ret), ret);
+      break;
+    }
+  }
+
+  GST_DEBUG_OBJECT (self, "event thread stopped");
+
+  return NULL;
+}
+
+static GstStructure *
+gst_kms_sink_get_stats (GstKMSSink * self)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&self->present_lock);
+  s = gst_structure_new ("GstKMSSinkStats",
+      "presented", G_TYPE_UINT64, self->presented,
+      "missed-vblanks", G_TYPE_UINT64, self->missed_vblanks,
+      "repeated-vblanks", G_TYPE_UINT64, self->repeated_vblanks,
+      "queued", G_TYPE_UINT, self->present_queue.length,
+      "refresh-period", G_TYPE_UINT64, self->refresh_period,
+      "presented-at", G_TYPE_UINT64, self->presented_at,
+      "lateness", G_TYPE_INT64, self->lateness,
+      "avg-latency", G_TYPE_UINT64, self->latency_count ?
+      self->latency_sum / self->latency_count : 0,
+      "max-latency", G_TYPE_UINT64, self->latency_max,
+      "fb-cache-hits", G_TYPE_UINT64, self->fb_cache_hits,
+      "fb-cache-misses", G_TYPE_UINT64, self->fb_cache_misses,
+      "fb-cache-size", G_TYPE_UINT, self->fb_cache ?
+      gst_kms_fb_cache_get_size (self->fb_cache) : 0,
+      "copied", G_TYPE_UINT64, self->copied,
+      "avg-copy-time", G_TYPE_UINT64, self->copied ?
+      self->copy_time_sum / self->copied : 0,
+      "max-copy-time", G_TYPE_UINT64, self->copy_time_max,
+      "scale-path", G_TYPE_STRING, scale_path_names[self->scale_path],
+      "scaled", G_TYPE_UINT64, self->scaled, NULL);
+  if (self->allocator)
+    gst_kms_allocator_add_stats (self->allocator, s);
+  g_mutex_unlock (&self->present_lock);
+
+  return s;
+}
+
+/* holds the frame until just before the vblank closest to the time it is
+ * due at, the render delay lets it come up to a refresh period early */
+static GstClockReturn
+gst_kms_sink_wait_vblank_slot (GstKMSSink * self, GstClockTime target)
+{
+  GstClockTimeDiff offset;
+  GstClockTime period, vblank;
+  gint64 n;
+
+  period = self->refresh_period;
+  if (!GST_CLOCK_TIME_IS_VALID (target) || !period ||
+      !GST_CLOCK_TIME_IS_VALID (self->last_vblank_ts))
+    return GST_CLOCK_OK;
+
+  if (!gst_kms_sink_get_time_offset (self, &offset))
+    return GST_CLOCK_OK;
+
+  /* in running time */
+  vblank = self->last_vblank_ts + offset;
+  if (target <= vblank)
+    return GST_CLOCK_OK;
+
+  n = (target - vblank + period / 2) / period;
+  vblank += n * period;
+
+  GST_LOG_OBJECT (self, "frame due at %" GST_TIME_FORMAT " for the vblank at %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (target), GST_TIME_ARGS (vblank));
+
+  return gst_base_sink_wait_clock (GST_BASE_SINK (self),
+      vblank - period / 4, NULL);
+}
+
+static void
+gst_kms_sink_send_feedback (GstKMSSink * self)
+{
+  GstStructure *stats;
+  GstClockTime now;
+  GstClockTimeDiff diff;
+  GstClockTime timestamp;
+  gboolean qos;
+
+  g_mutex_lock (&self->present_lock);
+  qos = self->qos_pending;
+  diff = self->qos_diff;
+  timestamp = self->qos_timestamp;
+  self->qos_pending = FALSE;
+  g_mutex_unlock (&self->present_lock);
+
+  if (qos && gst_base_sink_is_qos_enabled (GST_BASE_SINK (self))) {
+    GST_CAT_INFO_OBJECT (CAT_PERFORMANCE, self, "frame shown %"
+        GST_STIME_FORMAT " late", GST_STIME_ARGS (diff));
+    gst_pad_push_event (GST_BASE_SINK_PAD (self),
+        gst_event_new_qos (GST_QOS_TYPE_UNDERFLOW, 1.0, diff, timestamp));
+  }
+
+  if (!self->stats_interval)
+    return;
+
+  now = gst_util_get_timestamp ();
+  if (GST_CLOCK_TIME_IS_VALID (self->last_stats_post) &&
+      now - self->last_stats_post < self->stats_interval * GST_MSECOND)
+    return;
+
+  if (GST_CLOCK_TIME_IS_VALID (self->last_stats_post)) {
+    stats = gst_kms_sink_get_stats (self);
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_element (GST_OBJECT (self), stats));
+  }
+  self->last_stats_post = now;
+}
+
+static gint
+atomic_mode_setting (GstKMSSink * self, guint32 fb_id, drmModeModeInfo * mode)
+{
+  GstVideoRectangle rect = { 0, 0, mode->hdisplay, mode->vdisplay };
+  drmModeAtomicReq *req;
+  guint32 blob_id;
+  gint ret;
 
-  /* If no active crtc was found, pick the first possible crtc */
-  if (crtc_id == -1) {
-    for (i = 0; i < conn->count_encoders; i++) {
-      enc = drmModeGetEncoder (fd, conn->encoders[i]);
-      crtcs_for_connector |= enc->possible_crtcs;
-      drmModeFreeEncoder (enc);
-    }
+  ret = drmModeCreatePropertyBlob (self->fd, mode, sizeof (*mode), &blob_id);
+  if (ret)
+    return ret;
 
-    if (crtcs_for_connector != 0)
-      crtc_id = res->crtcs[ffs (crtcs_for_connector) - 1];
+  req = drmModeAtomicAlloc ();
+  if (!req) {
+    drmModeDestroyPropertyBlob (self->fd, blob_id);
+    return -ENOMEM;
   }
 
-  if (crtc_id == -1)
-    return NULL;
+  drmModeAtomicAddProperty (req, self->conn_id, self->conn_crtc_id,
+      self->crtc_id);
+  drmModeAtomicAddProperty (req, self->crtc_id, self->crtc_mode_id, blob_id);
+  drmModeAtomicAddProperty (req, self->crtc_id, self->crtc_active, 1);
+  /* without a framebuffer, the planes stay as they are */
+  if (fb_id)
+    add_plane_props (self, req, fb_id, &rect, &rect);
 
-  for (i = 0; i < res->count_crtcs; i++) {
-    crtc = drmModeGetCrtc (fd, res->crtcs[i]);
-    if (crtc) {
-      if (crtc_id == crtc->crtc_id) {
-        if (pipe)
-          *pipe = i;
-        return crtc;
-      }
-      drmModeFreeCrtc (crtc);
-    }
-  }
+  ret = drmModeAtomicCommit (self->fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET,
+      NULL);
+  drmModeAtomicFree (req);
 
-  return NULL;
+  /* the crtc holds its own reference */
+  drmModeDestroyPropertyBlob (self->fd, blob_id);
+
+  return ret;
 }
 
-static gboolean
-connector_is_used (int fd, drmModeRes * res, drmModeConnector * conn)
+/* in mHz, precise enough for the 1000/1001 rates */
+static guint64
+mode_refresh_rate (const drmModeModeInfo * mode)
 {
-  gboolean result;
-  drmModeCrtc *crtc;
-
-  result = FALSE;
-  crtc = find_crtc_for_connector (fd, res, conn, NULL);
-  if (crtc) {
-    result = crtc->buffer_id != 0;
-    drmModeFreeCrtc (crtc);
-  }
-
-  return result;
+  if (!mode->htotal || !mode->vtotal)
+    return (guint64) mode->vrefresh * 1000;
+  return gst_util_uint64_scale (mode->clock, 1000000,
+      (guint64) mode->htotal * mode->vtotal);
 }
 
-static drmModeConnector *
-find_used_connector_by_type (int fd, drmModeRes * res, int type)
+/* the mode of that size refreshing at the closest integer multiple of the
+ * framerate, within 0.2 %, and the slowest of those equally close */
+static drmModeModeInfo *
+find_refresh_rate_mode (GstKMSSink * self, drmModeConnector * conn,
+    gint width, gint height, GstVideoInfo * vinfo)
 {
-  int i;
-  drmModeConnector *conn;
+  drmModeModeInfo *mode, *best;
+  guint64 fps, rate, mult, diff, err, best_err, best_rate;
+  gint i;
 
-  conn = NULL;
-  for (i = 0; i < res->count_connectors; i++) {
-    conn = drmModeGetConnector (fd, res->connectors[i]);
-    if (conn) {
-      if ((conn->connector_type == type) && connector_is_used (fd, res, conn))
-        return conn;
-      drmModeFreeConnector (conn);
+  if (vinfo->fps_n <= 0 || vinfo->fps_d <= 0)
+    return NULL;
+
+  fps = gst_util_uint64_scale (vinfo->fps_n, 1000, vinfo->fps_d);
+  if (!fps)
+    return NULL;
+
+  best = NULL;
+  best_err = best_rate = G_MAXUINT64;
+  for (i = 0; i < conn->count_modes; i++) {
+    mode = &conn->modes[i];
+
+    if (mode->hdisplay != width || mode->vdisplay != height)
+      continue;
+    if (mode->flags & (DRM_MODE_FLAG_INTERLACE | DRM_MODE_FLAG_DBLSCAN))
+      continue;
+
+    rate = mode_refresh_rate (mode);
+    mult = (rate + fps / 2) / fps;
+    if (!mult)
+      continue;
+
+    /* in steps of 100 ppm, closer than that is rounding of the clock */
+    diff = rate > mult * fps ? rate - mult * fps : mult * fps - rate;
+    err = gst_util_uint64_scale (diff, 10000, rate);
+    if (err > 20)
+      continue;
+
+    if (err < best_err || (err == best_err && rate < best_rate)) {
+      best = mode;
+      best_err = err;
+      best_rate = rate;
     }
   }
 
-  return NULL;
+  if (best)
+    GST_INFO_OBJECT (self, "mode %s at %.3f Hz for %.3f fps", best->name,
+        best_rate / 1000.0, fps / 1000.0);
+
+  return best;
 }
 
-static drmModeConnector *
-find_first_used_connector (int fd, drmModeRes * res)
+/* vblank-sync holds the frames in show_frame, the presentation queue
+ * submits them as they come */
+static gboolean
+gst_kms_sink_holds_frames (GstKMSSink * self)
 {
-  int i;
-  drmModeConnector *conn;
-
-  conn = NULL;
-  for (i = 0; i < res->count_connectors; i++) {
-    conn = drmModeGetConnector (fd, res->connectors[i]);
-    if (conn) {
-      if (connector_is_used (fd, res, conn))
-        return conn;
-      drmModeFreeConnector (conn);
-    }
-  }
+  return self->vblank_sync && self->queue_size == 0;
+}
 
-  return NULL;
+/* the vblank timing follows the new mode */
+static void
+gst_kms_sink_mode_changed (GstKMSSink * self, drmModeModeInfo * mode)
+{
+  self->cur_mode = *mode;
+  if (self->match_refresh_rate)
+    self->mode_switched = TRUE;
+
+  self->last_vblank_ts = GST_CLOCK_TIME_NONE;
+  if (mode->clock)
+    self->refresh_period = gst_util_uint64_scale (mode->htotal *
+        mode->vtotal, GST_MSECOND, mode->clock);
+  if (gst_kms_sink_holds_frames (self) && self->refresh_period)
+    gst_base_sink_set_render_delay (GST_BASE_SINK (self),
+        self->refresh_period);
 }
 
-static drmModeConnector *
-find_main_monitor (int fd, drmModeRes * res)
+/* keeps the size of the crtc and switches to the mode refreshing at a
+ * multiple of the framerate, the planes stay as they are */
+static void
+match_refresh_rate (GstKMSSink * self, GstVideoInfo * vinfo)
 {
-  /* Find the LVDS and eDP connectors: those are the main screens. */
-  static const int priority[] = { DRM_MODE_CONNECTOR_LVDS,
-    DRM_MODE_CONNECTOR_eDP
-  };
-  int i;
   drmModeConnector *conn;
+  drmModeModeInfo *mode;
+  gint err;
 
-  conn = NULL;
-  for (i = 0; !conn && i < G_N_ELEMENTS (priority); i++)
-    conn = find_used_connector_by_type (fd, res, priority[i]);
-
-  /* if we didn't find a connector, grab the first one in use */
+  conn = drmModeGetConnector (self->fd, self->conn_id);
   if (!conn)
-    conn = find_first_used_connector (fd, res);
+    return;
 
-  /* if no connector is used, grab the first one */
-  if (!conn)
-    conn = drmModeGetConnector (fd, res->connectors[0]);
+  mode = find_refresh_rate_mode (self, conn, self->hdisplay, self->vdisplay,
+      vinfo);
+  if (!mode) {
+    GST_INFO_OBJECT (self, "no %dx%d mode refreshing at a multiple of %d/%d "
+        "fps", self->hdisplay, self->vdisplay, vinfo->fps_n, vinfo->fps_d);
+    goto bail;
+  }
 
-  return conn;
-}
+  if (!memcmp (mode, &self->cur_mode, sizeof (*mode)))
+    goto bail;
 
-static void
-log_drm_version (GstKMSSink * self)
-{
-#ifndef GST_DISABLE_GST_DEBUG
-  drmVersion *v;
+  /* the previous frames must be on screen */
+  gst_kms_sink_drain (self);
 
-  v = drmGetVersion (self->fd);
-  if (v) {
-    GST_INFO_OBJECT (self, "DRM v%d.%d.%d [%s — %s — %s]", v->version_major,
-        v->version_minor, v->version_patchlevel, GST_STR_NULL (v->name),
-        GST_STR_NULL (v->desc), GST_STR_NULL (v->date));
-    drmFreeVersion (v);
-  } else {
-    GST_WARNING_OBJECT (self, "could not get driver information: %s",
-        GST_STR_NULL (self->devname));
+  if (self->has_atomic)
+    err = atomic_mode_setting (self, 0, mode);
+  else
+    err = drmModeSetCrtc (self->fd, self->crtc_id, self->buffer_id, 0, 0,
+        (uint32_t *) & self->conn_id, 1, mode);
+  if (err) {
+    GST_WARNING_OBJECT (self, "failed to switch to mode %s: %s", mode->name,
+        strerror (errno));
+    goto bail;
   }
-#endif
-  return;
+
+  gst_kms_sink_mode_changed (self, mode);
+
+bail:
+  drmModeFreeConnector (conn);
 }
 
-static gboolean
-get_drm_caps (GstKMSSink * self)
+static void
+restore_mode (GstKMSSink * self)
 {
-  gint ret;
-  guint64 has_dumb_buffer;
-  guint64 has_prime;
-  guint64 has_async_page_flip;
+  gint err;
 
-  has_dumb_buffer = 0;
-  ret = drmGetCap (self->fd, DRM_CAP_DUMB_BUFFER, &has_dumb_buffer);
-  if (ret)
-    GST_WARNING_OBJECT (self, "could not get dumb buffer capability");
-  if (has_dumb_buffer == 0) {
-    GST_ERROR_OBJECT (self, "driver cannot handle dumb buffers");
-    return FALSE;
-  }
+  if (!self->mode_switched || !self->saved_mode_valid)
+    return;
 
-  has_prime = 0;
-  ret = drmGetCap (self->fd, DRM_CAP_PRIME, &has_prime);
-  if (ret)
-    GST_WARNING_OBJECT (self, "could not get prime capability");
-  else
-    self->has_prime_import = (gboolean) (has_prime & DRM_PRIME_CAP_IMPORT);
+  GST_INFO_OBJECT (self, "restoring mode %s", self->saved_mode.name);
 
-  has_async_page_flip = 0;
-  ret = drmGetCap (self->fd, DRM_CAP_ASYNC_PAGE_FLIP, &has_async_page_flip);
-  if (ret)
-    GST_WARNING_OBJECT (self, "could not get async page flip capability");
+  if (self->has_atomic)
+    err = atomic_mode_setting (self, 0, &self->saved_mode);
   else
-    self->has_async_page_flip = (gboolean) has_async_page_flip;
-
-  GST_INFO_OBJECT (self, "prime import (%s) / async page flip (%s)",
-      self->has_prime_import ? "✓" : "✗",
-      self->has_async_page_flip ? "✓" : "✗");
+    err = drmModeSetCrtc (self->fd, self->crtc_id, self->saved_fb_id, 0, 0,
+        (uint32_t *) & self->conn_id, 1, &self->saved_mode);
+  if (err)
+    GST_WARNING_OBJECT (self, "failed to restore mode %s: %s",
+        self->saved_mode.name, strerror (errno));
 
-  return TRUE;
+  self->mode_switched = FALSE;
 }
 
 static gboolean
@@ -340,6 +1046,9 @@ configure_mode_setting (GstKMSSink * self, GstVideoInfo * vinfo)
 
   GST_INFO_OBJECT (self, "configuring mode setting");
 
+  /* the previous frames must be on screen */
+  gst_kms_sink_drain (self);
+
   kmsmem = (GstKMSMemory *) gst_kms_allocator_bo_alloc (self->allocator, vinfo);
   if (!kmsmem)
     goto bo_failed;
@@ -353,7 +1062,10 @@ configure_mode_setting (GstKMSSink * self, GstVideoInfo * vinfo)
   if (!fb)
     goto framebuffer_failed;
 
-  for (i = 0; i < conn->count_modes; i++) {
+  if (self->match_refresh_rate)
+    mode = find_refresh_rate_mode (self, conn, fb->width, fb->height, vinfo);
+
+  for (i = 0; !mode && i < conn->count_modes; i++) {
     if (conn->modes[i].vdisplay == fb->height &&
         conn->modes[i].hdisplay == fb->width) {
       mode = &conn->modes[i];
@@ -363,11 +1075,15 @@ configure_mode_setting (GstKMSSink * self, GstVideoInfo * vinfo)
   if (!mode)
     goto mode_failed;
 
-  err = drmModeSetCrtc (self->fd, self->crtc_id, fb_id, 0, 0,
-      (uint32_t *) & self->conn_id, 1, mode);
+  if (self->has_atomic)
+    err = atomic_mode_setting (self, fb_id, mode);
+  else
+    err = drmModeSetCrtc (self->fd, self->crtc_id, fb_id, 0, 0,
+        (uint32_t *) & self->conn_id, 1, mode);
   if (err)
     goto modesetting_failed;
 
+  gst_kms_sink_mode_changed (self, mode);
   self->tmp_kmsmem = (GstMemory *) kmsmem;
 
   ret = TRUE;
@@ -491,11 +1207,12 @@ gst_kms_sink_start (GstBaseSink * bsink)
   drmModeCrtc *crtc;
   drmModePlaneRes *pres;
   drmModePlane *plane;
-  gboolean universal_planes;
+  gboolean universal_planes, auto_plane;
   gboolean ret;
 
   self = GST_KMS_SINK (bsink);
   universal_planes = FALSE;
+  auto_plane = self->plane_id == -1;
   ret = FALSE;
   res = NULL;
   conn = NULL;
@@ -503,7 +1220,10 @@ gst_kms_sink_start (GstBaseSink * bsink)
   pres = NULL;
   plane = NULL;
 
-  self->fd = open ("/dev/dri/card0", 0x0002);
+  if (self->devname)
+    self->fd = drmOpen (self->devname, NULL);
+  else
+    self->fd = open ("/dev/dri/card0", 0x0002);
   if (self->fd < 0)
     goto open_failed;
 
@@ -516,13 +1236,14 @@ gst_kms_sink_start (GstBaseSink * bsink)
     goto resources_failed;
 
   if (self->conn_id == -1)
-    conn = find_main_monitor (self->fd, res);
+    conn = gst_kms_find_main_monitor (self->fd, res);
   else
     conn = drmModeGetConnector (self->fd, self->conn_id);
   if (!conn)
     goto connector_failed;
 
-  crtc = find_crtc_for_connector (self->fd, res, conn, &self->pipe);
+  crtc = gst_kms_find_crtc_for_connector (self->fd, res, conn,
+      &self->pipe);
   if (!crtc)
     goto crtc_failed;
 
@@ -542,7 +1263,9 @@ retry_find_plane:
     goto plane_resources_failed;
 
   if (self->plane_id == -1)
-    plane = find_plane_for_crtc (self->fd, res, pres, crtc->crtc_id);
+    plane = find_plane_for_crtc (self->fd, res, pres, crtc->crtc_id,
+        self->modesetting_enabled ? DRM_PLANE_TYPE_PRIMARY :
+        DRM_PLANE_TYPE_OVERLAY);
   else
     plane = drmModeGetPlane (self->fd, self->plane_id);
   if (!plane)
@@ -558,10 +1281,36 @@ retry_find_plane:
   GST_INFO_OBJECT (self, "connector id = %d / crtc id = %d / plane id = %d",
       self->conn_id, self->crtc_id, self->plane_id);
 
+  if (self->has_atomic && !get_atomic_props (self)) {
+    GST_WARNING_OBJECT (self, "missing atomic properties, using legacy API");
+    drmSetClientCap (self->fd, DRM_CLIENT_CAP_ATOMIC, 0);
+    self->has_atomic = FALSE;
+
+    /* the atomic cap turned universal planes on as well, the plane is
+     * picked again among the ones the legacy API was asked for */
+    if (!universal_planes) {
+      drmSetClientCap (self->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 0);
+      if (auto_plane) {
+        self->plane_id = -1;
+        gst_caps_replace (&self->allowed_caps, NULL);
+        drmModeFreePlane (plane);
+        plane = NULL;
+        drmModeFreePlaneResources (pres);
+        pres = NULL;
+        goto retry_find_plane;
+      }
+    }
+  }
+
   self->hdisplay = crtc->mode.hdisplay;
   self->vdisplay = crtc->mode.vdisplay;
   self->buffer_id = crtc->buffer_id;
 
+  self->saved_mode = self->cur_mode = crtc->mode;
+  self->saved_mode_valid = crtc->mode_valid;
+  self->saved_fb_id = crtc->buffer_id;
+  self->mode_switched = FALSE;
+
   self->mm_width = conn->mmWidth;
   self->mm_height = conn->mmHeight;
 
@@ -572,6 +1321,41 @@ retry_find_plane:
   gst_poll_add_fd (self->poll, &self->pollfd);
   gst_poll_fd_ctl_read (self->poll, &self->pollfd, TRUE);
 
+  self->presented = self->missed_vblanks = self->repeated_vblanks = 0;
+  self->last_vblank = 0;
+  self->last_vblank_ts = GST_CLOCK_TIME_NONE;
+  self->pending_submitted = self->pending_target = GST_CLOCK_TIME_NONE;
+  self->presented_at = GST_CLOCK_TIME_NONE;
+  self->lateness = 0;
+  self->present_failed = FALSE;
+  self->latency_sum = self->latency_max = self->latency_count = 0;
+  self->qos_pending = FALSE;
+  self->last_stats_post = GST_CLOCK_TIME_NONE;
+
+  self->fb_cache_hits = self->fb_cache_misses = 0;
+  if (self->fb_cache_size > 0)
+    self->fb_cache = gst_kms_fb_cache_new (self->fb_cache_size);
+
+  self->copied = self->copy_time_sum = self->copy_time_max = 0;
+  self->scale_path = GST_KMS_SCALE_PLANE;
+  self->scaled = 0;
+  self->copier = gst_kms_copier_new (GST_ELEMENT (self), self->copy_threads);
+
+  /* refined by the vblank timestamps */
+  self->refresh_period = 0;
+  if (crtc->mode_valid && crtc->mode.clock)
+    self->refresh_period = gst_util_uint64_scale (crtc->mode.htotal *
+        crtc->mode.vtotal, GST_MSECOND, crtc->mode.clock);
+
+  /* frames come a refresh period early, to be held for their vblank */
+  gst_base_sink_set_render_delay (bsink, 0);
+  if (gst_kms_sink_holds_frames (self) && self->refresh_period)
+    gst_base_sink_set_render_delay (bsink, self->refresh_period);
+
+  if (self->queue_size > 0)
+    self->event_thread = g_thread_new ("kmssink-events",
+        gst_kms_sink_event_thread, self);
+
   ret = TRUE;
 
 bail:
@@ -667,7 +1451,33 @@ gst_kms_sink_stop (GstBaseSink * bsink)
 
   self = GST_KMS_SINK (bsink);
 
+  /* no frame is chained to the last commit from now on */
+  g_mutex_lock (&self->present_lock);
+  gst_kms_sink_flush_queue (self);
+  g_mutex_unlock (&self->present_lock);
+
+  if (self->event_thread) {
+    gst_poll_set_flushing (self->poll, TRUE);
+    g_thread_join (self->event_thread);
+    self->event_thread = NULL;
+    gst_poll_set_flushing (self->poll, FALSE);
+  }
+
+  /* a mode set is refused while a nonblocking commit is still pending */
+  gst_kms_sink_wait_flip (self);
+  restore_mode (self);
+  gst_buffer_replace (&self->pending_buffer, NULL);
+  self->flip_pending = FALSE;
   gst_buffer_replace (&self->last_buffer, NULL);
+  g_clear_pointer (&self->fb_cache, gst_kms_fb_cache_free);
+  g_clear_pointer (&self->copier, gst_kms_copier_free);
+  if (self->scale_pool) {
+    gst_buffer_pool_set_active (self->scale_pool, FALSE);
+    gst_object_replace ((GstObject **) & self->scale_pool, NULL);
+  }
+  GST_OBJECT_LOCK (self);
+  self->scale_width = self->scale_height = 0;
+  GST_OBJECT_UNLOCK (self);
   gst_caps_replace (&self->allowed_caps, NULL);
   gst_object_replace ((GstObject **) & self->pool, NULL);
   gst_object_replace ((GstObject **) & self->allocator, NULL);
@@ -701,6 +1511,18 @@ gst_kms_sink_get_caps (GstBaseSink * bsink, GstCaps * filter)
   self = GST_KMS_SINK (bsink);
 
   caps = gst_kms_sink_get_allowed_caps (self);
+
+  /* frames of the size shown first, for upstream scalers to pick */
+  GST_OBJECT_LOCK (self);
+  if (caps && self->scale_width > 0) {
+    GstCaps *scaled = gst_caps_copy (caps);
+
+    gst_caps_set_simple (scaled, "width", G_TYPE_INT, self->scale_width,
+        "height", G_TYPE_INT, self->scale_height, NULL);
+    caps = gst_caps_merge (scaled, caps);
+  }
+  GST_OBJECT_UNLOCK (self);
+
   if (caps && filter) {
     out_caps = gst_caps_intersect_full (caps, filter, GST_CAPS_INTERSECT_FIRST);
     gst_caps_unref (caps);
@@ -711,17 +1533,49 @@ gst_kms_sink_get_caps (GstBaseSink * bsink, GstCaps * filter)
   return out_caps;
 }
 
+static gboolean
+gst_kms_sink_unlock (GstBaseSink * bsink)
+{
+  GstKMSSink *self;
+
+  self = GST_KMS_SINK (bsink);
+
+  /* frames not on screen yet are dropped */
+  g_mutex_lock (&self->present_lock);
+  self->present_flushing = TRUE;
+  gst_kms_sink_flush_queue (self);
+  g_cond_broadcast (&self->present_cond);
+  g_mutex_unlock (&self->present_lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_kms_sink_unlock_stop (GstBaseSink * bsink)
+{
+  GstKMSSink *self;
+
+  self = GST_KMS_SINK (bsink);
+
+  g_mutex_lock (&self->present_lock);
+  self->present_flushing = FALSE;
+  g_mutex_unlock (&self->present_lock);
+
+  return TRUE;
+}
+
 static void
 ensure_kms_allocator (GstKMSSink * self)
 {
   if (self->allocator)
     return;
   self->allocator = gst_kms_allocator_new (self->fd);
+  g_object_set (self->allocator, "recycle-budget", self->recycle_budget, NULL);
 }
 
 static GstBufferPool *
 gst_kms_sink_create_pool (GstKMSSink * self, GstCaps * caps, gsize size,
-    gint min)
+    gint min, gboolean prime_export)
 {
   GstBufferPool *pool;
   GstStructure *config;
@@ -733,6 +1587,9 @@ gst_kms_sink_create_pool (GstKMSSink * self, GstCaps * caps, gsize size,
   config = gst_buffer_pool_get_config (pool);
   gst_buffer_pool_config_set_params (config, caps, size, min, 0);
   gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  if (prime_export)
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_KMS_PRIME_EXPORT);
 
   ensure_kms_allocator (self);
   gst_buffer_pool_config_set_allocator (config, self->allocator, NULL);
@@ -828,7 +1685,7 @@ gst_kms_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
 
   /* create a new pool for the new configuration */
   newpool = gst_kms_sink_create_pool (self, caps, GST_VIDEO_INFO_SIZE (&vinfo),
-      2);
+      2, FALSE);
   if (!newpool)
     goto no_pool;
 
@@ -843,6 +1700,8 @@ gst_kms_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
 
   if (self->modesetting_enabled && !configure_mode_setting (self, &vinfo))
     goto modesetting_failed;
+  else if (!self->modesetting_enabled && self->match_refresh_rate)
+    match_refresh_rate (self, &vinfo);
 
   self->vinfo = vinfo;
 
@@ -864,260 +1723,105 @@ invalid_size:
     return FALSE;
   }
 
-no_disp_ratio:
-  {
-    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
-        ("Error calculating the output display ratio of the video."));
-    return FALSE;
-  }
-no_pool:
-  {
-    /* Already warned in create_pool */
-    return FALSE;
-  }
-
-modesetting_failed:
-  {
-    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
-        ("failed to configure video mode"));
-    return FALSE;
-  }
-
-}
-
-static gboolean
-gst_kms_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
-{
-  GstKMSSink *self;
-  GstCaps *caps;
-  gboolean need_pool;
-  GstVideoInfo vinfo;
-  GstBufferPool *pool;
-  gsize size;
-
-  self = GST_KMS_SINK (bsink);
-
-  gst_query_parse_allocation (query, &caps, &need_pool);
-  if (!caps)
-    goto no_caps;
-  if (!gst_video_info_from_caps (&vinfo, caps))
-    goto invalid_caps;
-
-  size = GST_VIDEO_INFO_SIZE (&vinfo);
-
-  pool = NULL;
-  if (need_pool) {
-    pool = gst_kms_sink_create_pool (self, caps, size, 0);
-    if (!pool)
-      goto no_pool;
-  }
-
-  if (pool) {
-    /* we need at least 2 buffer because we hold on to the last one */
-    gst_query_add_allocation_pool (query, pool, size, 2, 0);
-    gst_object_unref (pool);
-  }
-
-  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
-  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
-
-  return TRUE;
-
-  /* ERRORS */
-no_caps:
-  {
-    GST_DEBUG_OBJECT (bsink, "no caps specified");
-    return FALSE;
-  }
-invalid_caps:
-  {
-    GST_DEBUG_OBJECT (bsink, "invalid caps specified");
-    return FALSE;
-  }
-no_pool:
-  {
-    /* Already warned in create_pool */
-    return FALSE;
-  }
-}
-
-static void
-sync_handler (gint fd, guint frame, guint sec, guint usec, gpointer data)
-{
-  gboolean *waiting;
-
-  waiting = data;
-  *waiting = FALSE;
-}
-
-static gboolean
-gst_kms_sink_sync (GstKMSSink * self)
-{
-  gint ret;
-  gboolean waiting;
-  drmEventContext evctxt = {
-    .version = DRM_EVENT_CONTEXT_VERSION,
-    .page_flip_handler = sync_handler,
-    .vblank_handler = sync_handler,
-  };
-  drmVBlank vbl = {
-    .request = {
-          .type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT,
-          .sequence = 1,
-          .signal = (gulong) & waiting,
-        },
-  };
-
-  if (self->pipe == 1)
-    vbl.request.type |= DRM_VBLANK_SECONDARY;
-  else if (self->pipe > 1)
-    vbl.request.type |= self->pipe << DRM_VBLANK_HIGH_CRTC_SHIFT;
-
-  waiting = TRUE;
-  if (!self->has_async_page_flip && !self->modesetting_enabled) {
-    ret = drmWaitVBlank (self->fd, &vbl);
-    if (ret)
-      goto vblank_failed;
-  } else {
-    ret = drmModePageFlip (self->fd, self->crtc_id, self->buffer_id,
-        DRM_MODE_PAGE_FLIP_EVENT, &waiting);
-    if (ret)
-      goto pageflip_failed;
-  }
-
-  while (waiting) {
-    do {
-      ret = gst_poll_wait (self->poll, 3 * GST_SECOND);
-    } while (ret == -1 && (errno == EAGAIN || errno == EINTR));
-
-    ret = drmHandleEvent (self->fd, &evctxt);
-    if (ret)
-      goto event_failed;
-  }
-
-  return TRUE;
-
-  /* ERRORS */
-vblank_failed:
+no_disp_ratio:
   {
-    GST_WARNING_OBJECT (self, "drmWaitVBlank failed: %s (%d)", strerror (-ret),
-        ret);
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("Error calculating the output display ratio of the video."));
     return FALSE;
   }
-pageflip_failed:
+no_pool:
   {
-    GST_WARNING_OBJECT (self, "drmModePageFlip failed: %s (%d)",
-        strerror (-ret), ret);
+    /* Already warned in create_pool */
     return FALSE;
   }
-event_failed:
+
+modesetting_failed:
   {
-    GST_ERROR_OBJECT (self, "drmHandleEvent failed: %s (%d)", strerror (-ret),
-        ret);
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("failed to configure video mode"));
     return FALSE;
   }
-}
-
-static GstMemory *
-get_cached_kmsmem (GstMemory * mem)
-{
-  return gst_mini_object_get_qdata (GST_MINI_OBJECT (mem),
-      g_quark_from_static_string ("kmsmem"));
-}
 
-static void
-set_cached_kmsmem (GstMemory * mem, GstMemory * kmsmem)
-{
-  return gst_mini_object_set_qdata (GST_MINI_OBJECT (mem),
-      g_quark_from_static_string ("kmsmem"), kmsmem,
-      (GDestroyNotify) gst_memory_unref);
 }
 
 static gboolean
-gst_kms_sink_import_dmabuf (GstKMSSink * self, GstBuffer * inbuf,
-    GstBuffer ** outbuf)
+gst_kms_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
-  gint prime_fds[GST_VIDEO_MAX_PLANES] = { 0, };
-  GstVideoMeta *meta;
-  guint i, n_mem, n_planes;
-  GstKMSMemory *kmsmem;
-  guint mems_idx[GST_VIDEO_MAX_PLANES];
-  gsize mems_skip[GST_VIDEO_MAX_PLANES];
-  GstMemory *mems[GST_VIDEO_MAX_PLANES];
-
-  if (!self->has_prime_import)
-    return FALSE;
-
-  /* This will eliminate most non-dmabuf out there */
-  if (!gst_is_dmabuf_memory (gst_buffer_peek_memory (inbuf, 0)))
-    return FALSE;
+  GstKMSSink *self;
+  GstCaps *caps;
+  gboolean need_pool;
+  GstVideoInfo vinfo;
+  GstBufferPool *pool;
+  gsize size;
 
-  n_planes = GST_VIDEO_INFO_N_PLANES (&self->vinfo);
-  n_mem = gst_buffer_n_memory (inbuf);
-  meta = gst_buffer_get_video_meta (inbuf);
+  self = GST_KMS_SINK (bsink);
 
-  GST_TRACE_OBJECT (self, "Found a dmabuf with %u planes and %u memories",
-      n_planes, n_mem);
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (!caps)
+    goto no_caps;
+  if (!gst_video_info_from_caps (&vinfo, caps))
+    goto invalid_caps;
 
-  /* We cannot have multiple dmabuf per plane */
-  if (n_mem > n_planes)
-    return FALSE;
+  size = GST_VIDEO_INFO_SIZE (&vinfo);
 
-  /* Update video info based on video meta */
-  if (meta) {
-    GST_VIDEO_INFO_WIDTH (&self->vinfo) = meta->width;
-    GST_VIDEO_INFO_HEIGHT (&self->vinfo) = meta->height;
+  pool = NULL;
+  if (need_pool) {
+    /* upstream elements importing dmabufs, like the v4l2 ones, then render
+     * straight into our framebuffers */
+    pool = gst_kms_sink_create_pool (self, caps, size, 0,
+        self->has_prime_export);
+    if (!pool)
+      goto no_pool;
+  }
 
-    for (i = 0; i < meta->n_planes; i++) {
-      GST_VIDEO_INFO_PLANE_OFFSET (&self->vinfo, i) = meta->offset[i];
-      GST_VIDEO_INFO_PLANE_STRIDE (&self->vinfo, i) = meta->stride[i];
-    }
+  if (pool) {
+    /* we need at least 2 buffer because we hold on to the last one */
+    gst_query_add_allocation_pool (query, pool, size, 2, 0);
+    gst_object_unref (pool);
   }
-  bzero (mems, sizeof (mems));
-  /* Find and validate all memories */
-  for (i = 0; i < n_planes; i++) {
-    guint length;
 
-    if (!gst_buffer_find_memory (inbuf,
-            GST_VIDEO_INFO_PLANE_OFFSET (&self->vinfo, i), 1,
-            &mems_idx[i], &length, &mems_skip[i]))
-      return FALSE;
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+  gst_query_add_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE, NULL);
 
-    mems[i] = gst_buffer_peek_memory (inbuf, mems_idx[i]);
+  return TRUE;
 
-    /* And all memory found must be dmabuf */
-    if (!gst_is_dmabuf_memory (mems[i]))
-      return FALSE;
+  /* ERRORS */
+no_caps:
+  {
+    GST_DEBUG_OBJECT (bsink, "no caps specified");
+    return FALSE;
   }
-
-  kmsmem = (GstKMSMemory *) get_cached_kmsmem (mems[0]);
-  if (kmsmem) {
-    GST_LOG_OBJECT (self, "found KMS mem %p in DMABuf mem %p with fb id = %d",
-        kmsmem, mems[0], kmsmem->fb_id);
-    goto wrap_mem;
+invalid_caps:
+  {
+    GST_DEBUG_OBJECT (bsink, "invalid caps specified");
+    return FALSE;
   }
-
-  for (i = 0; i < n_planes; i++)
-    prime_fds[i] = gst_dmabuf_memory_get_fd (mems[i]);
-
-  GST_LOG_OBJECT (self, "found these prime ids: %d, %d, %d, %d", prime_fds[0],
-      prime_fds[1], prime_fds[2], prime_fds[3]);
-
-  kmsmem = gst_kms_allocator_dmabuf_import (self->allocator, prime_fds,
-      n_planes, mems_skip, &self->vinfo);
-  if (!kmsmem)
+no_pool:
+  {
+    /* Already warned in create_pool */
     return FALSE;
+  }
+}
 
-  GST_LOG_OBJECT (self, "setting KMS mem %p to DMABuf mem %p with fb id = %d",
-      kmsmem, mems[0], kmsmem->fb_id);
-  set_cached_kmsmem (mems[0], GST_MEMORY_CAST (kmsmem));
-
-wrap_mem:
-  *outbuf = gst_buffer_new ();
-  if (!*outbuf)
+static gboolean
+gst_kms_sink_import_dmabuf (GstKMSSink * self, GstBuffer * inbuf,
+    GstBuffer ** outbuf)
+{
+  gboolean cached;
+
+  *outbuf = gst_kms_allocator_import_buffer (self->allocator, self->fb_cache,
+      inbuf, &self->vinfo, self->has_prime_import, &cached);
+  if (!*outbuf) {
+    if (self->has_prime_import &&
+        gst_is_dmabuf_memory (gst_buffer_peek_memory (inbuf, 0)))
+      self->fb_cache_misses++;
     return FALSE;
-  gst_buffer_append_memory (*outbuf, gst_memory_ref (GST_MEMORY_CAST (kmsmem)));
-  gst_buffer_add_parent_buffer_meta (*outbuf, inbuf);
+  }
+
+  if (cached)
+    self->fb_cache_hits++;
+  else
+    self->fb_cache_misses++;
 
   return TRUE;
 }
@@ -1129,6 +1833,7 @@ gst_kms_sink_get_input_buffer (GstKMSSink * self, GstBuffer * inbuf)
   GstBuffer *buf;
   GstFlowReturn ret;
   GstVideoFrame inframe, outframe;
+  GstClockTime start, elapsed;
   gboolean success;
 
   mem = gst_buffer_peek_memory (inbuf, 0);
@@ -1157,12 +1862,23 @@ gst_kms_sink_get_input_buffer (GstKMSSink * self, GstBuffer * inbuf)
   if (!gst_video_frame_map (&outframe, &self->vinfo, buf, GST_MAP_WRITE))
     goto error_map_dst_buffer;
 
-  success = gst_video_frame_copy (&outframe, &inframe);
+  start = gst_util_get_timestamp ();
+  success = gst_kms_copier_copy (self->copier, &outframe, &inframe);
+  elapsed = gst_util_get_timestamp () - start;
   gst_video_frame_unmap (&outframe);
   gst_video_frame_unmap (&inframe);
   if (!success)
     goto error_copy_buffer;
 
+  GST_CAT_LOG_OBJECT (CAT_PERFORMANCE, self, "copied %s %dx%d in %"
+      GST_TIME_FORMAT, GST_VIDEO_INFO_NAME (&self->vinfo),
+      GST_VIDEO_INFO_WIDTH (&self->vinfo), GST_VIDEO_INFO_HEIGHT (&self->vinfo),
+      GST_TIME_ARGS (elapsed));
+
+  self->copied++;
+  self->copy_time_sum += elapsed;
+  self->copy_time_max = MAX (self->copy_time_max, elapsed);
+
   return buf;
 
 bail:
@@ -1247,10 +1963,158 @@ gst_kms_sink_navigation_init (GstNavigationInterface * iface)
   iface->send_event = gst_kms_sink_navigation_send_event;
 }
 
+/* what shows @src at @result: the plane, fetching every other line of the
+ * widest frames, or a frame scaled beforehand when the ratio is beyond
+ * what the plane scales */
+static GstKMSScalePath
+gst_kms_sink_choose_scale_path (GstKMSSink * self, GstVideoRectangle * src,
+    GstVideoRectangle * result)
+{
+  /* the framebuffer is as wide as the frame, whatever the crop */
+  gboolean line_skip =
+      GST_VIDEO_INFO_WIDTH (&self->vinfo) >= GST_KMS_MAX_FETCH_WIDTH;
+  gint h = line_skip ? src->h / 2 : src->h;
+
+  if (src->w > result->w * GST_KMS_MAX_SCALE ||
+      result->w > src->w * GST_KMS_MAX_SCALE ||
+      h > result->h * GST_KMS_MAX_SCALE || result->h > h * GST_KMS_MAX_SCALE)
+    return GST_KMS_SCALE_CONVERTER;
+
+  if (line_skip)
+    return GST_KMS_SCALE_LINE_SKIP;
+
+  if (src->w == self->scale_width && src->h == self->scale_height)
+    return GST_KMS_SCALE_UPSTREAM;
+
+  return GST_KMS_SCALE_PLANE;
+}
+
+/* the size frames are scaled to, shown by the plane as they are */
+static void
+gst_kms_sink_scale_target (GstVideoRectangle * result, gint * width,
+    gint * height)
+{
+  *width = MIN (GST_ROUND_UP_2 (result->w), GST_KMS_MAX_FETCH_WIDTH - 2);
+  *height = GST_ROUND_UP_2 (result->h);
+}
+
+/* asks upstream for frames of that size, a scaler there renegotiates */
+static void
+gst_kms_sink_request_scale (GstKMSSink * self, gint width, gint height)
+{
+  GST_OBJECT_LOCK (self);
+  if (self->scale_width == width && self->scale_height == height) {
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+  self->scale_width = width;
+  self->scale_height = height;
+  GST_OBJECT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "asking upstream for %dx%d frames", width, height);
+  gst_pad_push_event (GST_BASE_SINK_PAD (self), gst_event_new_reconfigure ());
+}
+
+static void
+gst_kms_sink_set_scale_path (GstKMSSink * self, GstKMSScalePath path,
+    GstVideoRectangle * src, GstVideoRectangle * result)
+{
+  if (self->scale_path == path)
+    return;
+  self->scale_path = path;
+
+  GST_INFO_OBJECT (self, "showing %dx%d at %dx%d through the %s",
+      src->w, src->h, result->w, result->h, scale_path_names[path]);
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self),
+          gst_structure_new ("GstKMSSinkScale",
+              "path", G_TYPE_STRING, scale_path_names[path],
+              "src-width", G_TYPE_INT, src->w,
+              "src-height", G_TYPE_INT, src->h,
+              "dest-width", G_TYPE_INT, result->w,
+              "dest-height", G_TYPE_INT, result->h, NULL)));
+}
+
+/* scales @src of @inbuf to a frame of @width x @height in a framebuffer,
+ * while upstream doesn't send frames of that size */
+static GstBuffer *
+gst_kms_sink_scale_buffer (GstKMSSink * self, GstBuffer * inbuf,
+    GstVideoRectangle * src, gint width, gint height)
+{
+  GstVideoInfo out;
+  GstVideoFrame inframe, outframe;
+  GstBufferPool *pool;
+  GstBuffer *buf;
+  GstCaps *caps;
+  GstFlowReturn ret;
+
+  gst_video_info_set_format (&out, GST_VIDEO_INFO_FORMAT (&self->vinfo),
+      width, height);
+  out.colorimetry = self->vinfo.colorimetry;
+  out.chroma_site = self->vinfo.chroma_site;
+
+  if (!self->scale_pool || !gst_video_info_is_equal (&out, &self->scale_info)) {
+    caps = gst_video_info_to_caps (&out);
+    pool = gst_kms_sink_create_pool (self, caps, GST_VIDEO_INFO_SIZE (&out),
+        2, FALSE);
+    gst_caps_unref (caps);
+    if (!pool)
+      return NULL;
+
+    if (self->scale_pool) {
+      gst_buffer_pool_set_active (self->scale_pool, FALSE);
+      gst_object_unref (self->scale_pool);
+    }
+    self->scale_pool = pool;
+    self->scale_info = out;
+  }
+
+  if (!gst_kms_copier_set_scale (self->copier, &self->vinfo, &out, src))
+    return NULL;
+
+  if (!gst_buffer_pool_set_active (self->scale_pool, TRUE))
+    goto activate_pool_failed;
+
+  buf = NULL;
+  ret = gst_buffer_pool_acquire_buffer (self->scale_pool, &buf, NULL);
+  if (ret != GST_FLOW_OK)
+    goto activate_pool_failed;
+
+  if (!gst_video_frame_map (&inframe, &self->vinfo, inbuf, GST_MAP_READ))
+    goto map_failed;
+
+  if (!gst_video_frame_map (&outframe, &out, buf, GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&inframe);
+    goto map_failed;
+  }
+
+  gst_kms_copier_scale (self->copier, &outframe, &inframe);
+  gst_video_frame_unmap (&outframe);
+  gst_video_frame_unmap (&inframe);
+
+  self->scaled++;
+
+  return buf;
+
+  /* ERRORS */
+activate_pool_failed:
+  {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("allocation failed"),
+        ("failed to get a buffer for the scaled frame"));
+    return NULL;
+  }
+map_failed:
+  {
+    GST_WARNING_OBJECT (self, "failed to map buffer");
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+}
+
 static GstFlowReturn
 gst_kms_sink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
 {
-  gint ret;
   gdouble average_fps;
   gdouble time_elapsed;
   GstBuffer *buffer;
@@ -1260,32 +2124,35 @@ gst_kms_sink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
   GstVideoRectangle src = { 0, };
   GstVideoRectangle dst = { 0, };
   GstVideoRectangle result;
+  GstKMSScalePath path;
+  gint width, height;
+  GstKMSFrame frame;
   GstFlowReturn res;
 
   self = GST_KMS_SINK (vsink);
 
   res = GST_FLOW_ERROR;
+  buffer = NULL;
+  path = GST_KMS_SCALE_PLANE;
+  width = height = 0;
 
 #ifdef DEBUG_FPS
   if (g_frame_showed == 0)
     g_start_time = gst_util_get_timestamp ();
 #endif
 
-  buffer = gst_kms_sink_get_input_buffer (self, buf);
-  if (!buffer)
-    return GST_FLOW_ERROR;
-  fb_id = gst_kms_memory_get_fb_id (gst_buffer_peek_memory (buffer, 0));
-  if (fb_id == 0)
-    goto buffer_invalid;
-
-  GST_TRACE_OBJECT (self, "displaying fb %d", fb_id);
-
   if (self->modesetting_enabled) {
-    self->buffer_id = fb_id;
-    goto sync_frame;
+    /* the plane covers the mode set for the frame size */
+    result.x = result.y = 0;
+    src.w = result.w = GST_VIDEO_INFO_WIDTH (&self->vinfo);
+    src.h = result.h = GST_VIDEO_INFO_HEIGHT (&self->vinfo);
+    /* the allocator doubled the pitches of such framebuffers */
+    if (src.w >= GST_KMS_MAX_FETCH_WIDTH)
+      src.h /= 2;
+    goto get_buffer;
   }
 
-  if ((crop = gst_buffer_get_video_crop_meta (buffer))) {
+  if ((crop = gst_buffer_get_video_crop_meta (buf))) {
     GstVideoInfo vinfo = self->vinfo;
     vinfo.width = crop->width;
     vinfo.height = crop->height;
@@ -1322,29 +2189,90 @@ gst_kms_sink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
   }
 
   /* handle hardware limition */
-  if (src.w >= 3840)
-    src.h /= 2;
+  path = gst_kms_sink_choose_scale_path (self, &src, &result);
+  gst_kms_sink_scale_target (&result, &width, &height);
+  switch (path) {
+    case GST_KMS_SCALE_UPSTREAM:
+    case GST_KMS_SCALE_CONVERTER:
+      /* follows the area shown */
+      gst_kms_sink_request_scale (self, width, height);
+      break;
+    case GST_KMS_SCALE_LINE_SKIP:
+      /* the allocator doubles the pitches of such framebuffers. Shown
+       * narrower, full frames of that size are better, until then the
+       * plane keeps skipping lines */
+      src.y /= 2;
+      src.h /= 2;
+      if (result.w < GST_KMS_MAX_FETCH_WIDTH)
+        gst_kms_sink_request_scale (self, width, height);
+      break;
+    default:
+      break;
+  }
+  gst_kms_sink_set_scale_path (self, path, &src, &result);
+
+get_buffer:
+  if (path == GST_KMS_SCALE_CONVERTER) {
+    buffer = gst_kms_sink_scale_buffer (self, buf, &src, width, height);
+    src.x = src.y = 0;
+    src.w = width;
+    src.h = height;
+  } else {
+    buffer = gst_kms_sink_get_input_buffer (self, buf);
+  }
+  if (!buffer)
+    return GST_FLOW_ERROR;
+  fb_id = gst_kms_memory_get_fb_id (gst_buffer_peek_memory (buffer, 0));
+  if (fb_id == 0)
+    goto buffer_invalid;
+
+  GST_TRACE_OBJECT (self, "displaying fb %d", fb_id);
 
   GST_TRACE_OBJECT (self,
-      "drmModeSetPlane at (%i,%i) %ix%i sourcing at (%i,%i) %ix%i",
+      "plane update at (%i,%i) %ix%i sourcing at (%i,%i) %ix%i",
       result.x, result.y, result.w, result.h, src.x, src.y, src.w, src.h);
 
-  ret = drmModeSetPlane (self->fd, self->plane_id, self->crtc_id, fb_id, 0,
-      result.x, result.y, result.w, result.h,
-      /* source/cropping coordinates are given in Q16 */
-      src.x << 16, src.y << 16, src.w << 16, src.h << 16);
-  if (ret)
-    goto set_plane_failed;
+  frame.buffer = buffer;
+  frame.fb_id = fb_id;
+  frame.src = src;
+  frame.dst = result;
+  frame.target = gst_segment_to_running_time (&GST_BASE_SINK (self)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  if (GST_CLOCK_TIME_IS_VALID (frame.target))
+    frame.target += gst_base_sink_get_latency (GST_BASE_SINK (self));
+
+  if (self->event_thread) {
+    res = gst_kms_sink_queue_frame (self, &frame);
+    if (res != GST_FLOW_OK)
+      goto bail;
+  } else {
+    /* only waits when the previous frame is not on screen yet */
+    if (!gst_kms_sink_wait_flip (self))
+      goto bail;
 
-sync_frame:
-  /* Wait for the previous frame to complete redraw */
-  if (!gst_kms_sink_sync (self))
-    goto bail;
+    if (self->vblank_sync &&
+        gst_kms_sink_wait_vblank_slot (self, frame.target) ==
+        GST_CLOCK_UNSCHEDULED) {
+      res = GST_FLOW_FLUSHING;
+      goto bail;
+    }
 
-  gst_buffer_replace (&self->last_buffer, buffer);
-  g_clear_pointer (&self->tmp_kmsmem, gst_memory_unref);
+    g_mutex_lock (&self->present_lock);
+    self->present_chained = FALSE;
+    if (!gst_kms_sink_present (self, &frame)) {
+      g_mutex_unlock (&self->present_lock);
+      goto bail;
+    }
+    g_mutex_unlock (&self->present_lock);
+
+    /* Wait for the frame to complete redraw, atomic commits return at once */
+    if (!self->has_atomic && !gst_kms_sink_wait_flip (self))
+      goto bail;
+
+    res = GST_FLOW_OK;
+  }
 
-  res = GST_FLOW_OK;
+  gst_kms_sink_send_feedback (self);
 
 #ifdef DEBUG_FPS
   if (++g_frame_showed == 60) {
@@ -1358,7 +2286,8 @@ sync_frame:
 #endif
 
 bail:
-  gst_buffer_unref (buffer);
+  if (buffer)
+    gst_buffer_unref (buffer);
   return res;
 
   /* ERRORS */
@@ -1367,16 +2296,6 @@ buffer_invalid:
     GST_ERROR_OBJECT (self, "invalid buffer: it doesn't have a fb id");
     goto bail;
   }
-set_plane_failed:
-  {
-    GST_DEBUG_OBJECT (self, "result = { %d, %d, %d, %d} / "
-        "src = { %d, %d, %d %d } / dst = { %d, %d, %d %d }", result.x, result.y,
-        result.w, result.h, src.x, src.y, src.w, src.h, dst.x, dst.y, dst.w,
-        dst.h);
-    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
-        (NULL), ("drmModeSetPlane failed: %s (%d)", strerror (-ret), ret));
-    goto bail;
-  }
 no_disp_ratio:
   {
     GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
@@ -1406,6 +2325,30 @@ gst_kms_sink_set_property (GObject * object, guint prop_id,
     case PROP_FORCE_MODESETTING:
       sink->modesetting_enabled = g_value_get_boolean (value);
       break;
+    case PROP_QUEUE_SIZE:
+      sink->queue_size = g_value_get_uint (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      sink->stats_interval = g_value_get_uint (value);
+      break;
+    case PROP_VBLANK_SYNC:
+      sink->vblank_sync = g_value_get_boolean (value);
+      break;
+    case PROP_FB_CACHE_SIZE:
+      sink->fb_cache_size = g_value_get_uint (value);
+      break;
+    case PROP_COPY_THREADS:
+      sink->copy_threads = g_value_get_uint (value);
+      break;
+    case PROP_MATCH_REFRESH_RATE:
+      sink->match_refresh_rate = g_value_get_boolean (value);
+      break;
+    case PROP_RECYCLE_BUDGET:
+      sink->recycle_budget = g_value_get_uint64 (value);
+      if (sink->allocator)
+        g_object_set (sink->allocator, "recycle-budget", sink->recycle_budget,
+            NULL);
+      break;
     case PROP_DISPLAY_RATIO:
       sink->display_ratio_enabled = g_value_get_boolean (value);
       break;
@@ -1436,6 +2379,30 @@ gst_kms_sink_get_property (GObject * object, guint prop_id,
     case PROP_FORCE_MODESETTING:
       g_value_set_boolean (value, sink->modesetting_enabled);
       break;
+    case PROP_QUEUE_SIZE:
+      g_value_set_uint (value, sink->queue_size);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_kms_sink_get_stats (sink));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, sink->stats_interval);
+      break;
+    case PROP_VBLANK_SYNC:
+      g_value_set_boolean (value, sink->vblank_sync);
+      break;
+    case PROP_FB_CACHE_SIZE:
+      g_value_set_uint (value, sink->fb_cache_size);
+      break;
+    case PROP_COPY_THREADS:
+      g_value_set_uint (value, sink->copy_threads);
+      break;
+    case PROP_RECYCLE_BUDGET:
+      g_value_set_uint64 (value, sink->recycle_budget);
+      break;
+    case PROP_MATCH_REFRESH_RATE:
+      g_value_set_boolean (value, sink->match_refresh_rate);
+      break;
     case PROP_DISPLAY_RATIO:
       g_value_set_boolean (value, sink->display_ratio_enabled);
       break;
@@ -1453,6 +2420,8 @@ gst_kms_sink_finalize (GObject * object)
   sink = GST_KMS_SINK (object);
   g_clear_pointer (&sink->devname, g_free);
   gst_poll_free (sink->poll);
+  g_mutex_clear (&sink->present_lock);
+  g_cond_clear (&sink->present_cond);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -1464,10 +2433,18 @@ gst_kms_sink_init (GstKMSSink * sink)
   sink->conn_id = -1;
   sink->plane_id = -1;
   sink->display_ratio_enabled = TRUE;
+  sink->fb_cache_size = DEFAULT_FB_CACHE_SIZE;
+  sink->copy_threads = DEFAULT_COPY_THREADS;
+  sink->recycle_budget = DEFAULT_RECYCLE_BUDGET;
+  sink->match_refresh_rate = FALSE;
   gst_poll_fd_init (&sink->pollfd);
   sink->poll = gst_poll_new (TRUE);
   gst_video_info_init (&sink->vinfo);
 
+  g_mutex_init (&sink->present_lock);
+  g_cond_init (&sink->present_cond);
+  g_queue_init (&sink->present_queue);
+
   sink->save_rect.x = 0;
   sink->save_rect.y = 0;
   sink->save_rect.w = 0;
@@ -1500,6 +2477,8 @@ gst_kms_sink_class_init (GstKMSSinkClass * klass)
   basesink_class->stop = GST_DEBUG_FUNCPTR (gst_kms_sink_stop);
   basesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_kms_sink_set_caps);
   basesink_class->get_caps = GST_DEBUG_FUNCPTR (gst_kms_sink_get_caps);
+  basesink_class->unlock = GST_DEBUG_FUNCPTR (gst_kms_sink_unlock);
+  basesink_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_kms_sink_unlock_stop);
   basesink_class->propose_allocation = gst_kms_sink_propose_allocation;
 
   videosink_class->show_frame = gst_kms_sink_show_frame;
@@ -1553,6 +2532,97 @@ gst_kms_sink_class_init (GstKMSSinkClass * klass)
       "When enabled, the sink try to configure the display mode", FALSE,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT);
 
+  /**
+   * kmssink:queue-size:
+   *
+   * Frames waiting for the display. They are presented from a thread
+   * handling the DRM events, so the streaming thread only waits when the
+   * queue is full. With 0, frames are presented from the streaming thread.
+   */
+  g_properties[PROP_QUEUE_SIZE] = g_param_spec_uint ("queue-size",
+      "Queue size", "Frames queued for presentation (0 = no queue)", 0, 16, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:stats:
+   *
+   * Presentation counters: frames presented, vblanks missed while a frame
+   * was ready and vblanks the same frame was shown again for. The timing
+   * comes from the vblank timestamps: refresh period, running time of the
+   * last presentation and its lateness, latency from commit to display.
+   */
+  g_properties[PROP_STATS] = g_param_spec_boxed ("stats", "Statistics",
+      "Presentation statistics", GST_TYPE_STRUCTURE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:stats-interval:
+   *
+   * Milliseconds between element messages carrying the stats.
+   */
+  g_properties[PROP_STATS_INTERVAL] = g_param_spec_uint ("stats-interval",
+      "Stats interval", "Interval between stats messages in ms (0 = none)",
+      0, G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:vblank-sync:
+   *
+   * Take frames a refresh period early and submit each one just before
+   * the vblank closest to its presentation time, rather than on the first
+   * vblank after it. Only without a presentation queue.
+   */
+  g_properties[PROP_VBLANK_SYNC] = g_param_spec_boolean ("vblank-sync",
+      "Vblank sync", "Submit frames just before the vblank they are due at",
+      FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:fb-cache-size:
+   *
+   * Framebuffers of imported dmabufs kept by the sink, looked up by the
+   * inode of the dmabufs with the layout of the frame, so memories wrapping
+   * the same dmabufs again don't import them again. The least recently
+   * used ones are removed first.
+   */
+  g_properties[PROP_FB_CACHE_SIZE] = g_param_spec_uint ("fb-cache-size",
+      "Framebuffer cache size", "Imported framebuffers kept (0 = none)",
+      0, 1024, DEFAULT_FB_CACHE_SIZE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:copy-threads:
+   *
+   * Threads copying the frames that are neither KMS memory nor importable
+   * dmabufs into the framebuffers, each one takes a band of rows. Taken
+   * at start.
+   */
+  g_properties[PROP_COPY_THREADS] = g_param_spec_uint ("copy-threads",
+      "Copy threads", "Threads copying frames (0 = one per core)",
+      0, 64, DEFAULT_COPY_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:recycle-budget:
+   *
+   * Bytes of dumb buffers kept by the allocator once their pool is gone,
+   * with their framebuffers, so a caps change reuses them rather than
+   * going back to the kernel. The oldest ones are destroyed first.
+   */
+  g_properties[PROP_RECYCLE_BUDGET] = g_param_spec_uint64 ("recycle-budget",
+      "Recycle budget", "Bytes of freed dumb buffers kept for reuse "
+      "(0 = none)", 0, G_MAXUINT64, DEFAULT_RECYCLE_BUDGET,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * kmssink:match-refresh-rate:
+   *
+   * Switch the crtc to the mode of its size, or of the frame size with
+   * force-modesetting, refreshing at an integer multiple of the framerate,
+   * the slowest one. The mode it had is restored on stop.
+   */
+  g_properties[PROP_MATCH_REFRESH_RATE] =
+      g_param_spec_boolean ("match-refresh-rate", "Match refresh rate",
+      "Switch to a mode refreshing at a multiple of the framerate", FALSE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class, PROP_N, g_properties);
 
    /**
@@ -1572,6 +2642,10 @@ plugin_init (GstPlugin * plugin)
           GST_TYPE_KMS_SINK))
     return FALSE;
 
+  if (!gst_element_register (plugin, "kmscompositorsink", GST_RANK_NONE,
+          GST_TYPE_KMS_COMPOSITOR))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -27,6 +27,9 @@
 #define __GST_KMS_SINK_H__
 
 #include <gst/video/gstvideosink.h>
+#include <xf86drmMode.h>
+
+#include "gstkmsplanes.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_KMS_SINK \
@@ -42,6 +45,15 @@ G_BEGIN_DECLS
 typedef struct _GstKMSSink GstKMSSink;
 typedef struct _GstKMSSinkClass GstKMSSinkClass;
 
+/* how frames reach the size they are shown at */
+typedef enum
+{
+  GST_KMS_SCALE_PLANE,          /* scaled by the plane */
+  GST_KMS_SCALE_UPSTREAM,       /* sent at that size by upstream */
+  GST_KMS_SCALE_CONVERTER,      /* scaled in the sink, the plane can't */
+  GST_KMS_SCALE_LINE_SKIP,      /* fetched every other line, for 4K */
+} GstKMSScalePath;
+
 struct _GstKMSSink
 {
   GstVideoSink videosink;
@@ -59,16 +71,88 @@ struct _GstKMSSink
 
   /* capabilities */
   gboolean has_prime_import;
+  gboolean has_prime_export;
   gboolean has_async_page_flip;
+  gboolean has_atomic;
+
+  /* property ids of the atomic API, cached at start */
+  GstKMSPlaneProps plane_props;
+  guint32 crtc_mode_id, crtc_active;
+  guint32 conn_crtc_id;
 
   gboolean modesetting_enabled;
   gboolean display_ratio_enabled;
 
+  /* crtc mode at start, put back on stop if the framerate changed it */
+  gboolean match_refresh_rate;
+  drmModeModeInfo saved_mode;
+  gboolean saved_mode_valid;
+  guint32 saved_fb_id;
+  drmModeModeInfo cur_mode;
+  gboolean mode_switched;
+
   GstVideoInfo vinfo;
   GstCaps *allowed_caps;
   GstBufferPool *pool;
   GstAllocator *allocator;
   GstBuffer *last_buffer;
+  GstBuffer *pending_buffer;    /* committed, not scanned out yet */
+  gboolean flip_pending;
+
+  /* presentation queue, serviced by a DRM event thread */
+  guint queue_size;
+  GThread *event_thread;
+  GMutex present_lock;
+  GCond present_cond;
+  GQueue present_queue;
+  gboolean present_flushing;
+  gboolean present_chained;     /* pending frame committed at the last flip */
+  gboolean present_failed;      /* a queued frame failed, the queue dropped */
+
+  guint last_vblank;
+  guint64 presented;
+  guint64 missed_vblanks;
+  guint64 repeated_vblanks;
+
+  /* presentation timing, from the vblank timestamps */
+  gboolean vblank_sync;
+  gboolean has_monotonic_timestamp;
+  GstClockTime refresh_period;
+  GstClockTime last_vblank_ts;
+  GstClockTime pending_submitted;
+  GstClockTime pending_target;  /* running time the pending frame is due at */
+  GstClockTime presented_at;    /* running time of the last flip */
+  GstClockTimeDiff lateness;
+  GstClockTime latency_sum, latency_max;
+  guint64 latency_count;
+
+  gboolean qos_pending;
+  GstClockTimeDiff qos_diff;
+  GstClockTime qos_timestamp;
+
+  guint stats_interval;         /* ms between stats messages, 0 for none */
+  GstClockTime last_stats_post;
+
+  /* framebuffers of imported dmabufs */
+  guint fb_cache_size;
+  struct _GstKMSFBCache *fb_cache;
+  guint64 fb_cache_hits;
+  guint64 fb_cache_misses;
+
+  /* frames neither KMS memory nor importable, copied in bands of rows */
+  guint copy_threads;
+  struct _GstKMSCopier *copier;
+  guint64 copied;
+  GstClockTime copy_time_sum, copy_time_max;
+
+  guint64 recycle_budget;       /* bytes of freed dumb buffers kept */
+
+  /* frames the planes can't scale, size asked from upstream meanwhile */
+  GstKMSScalePath scale_path;
+  gint scale_width, scale_height;
+  GstBufferPool *scale_pool;
+  GstVideoInfo scale_info;
+  guint64 scaled;
   GstMemory *tmp_kmsmem;
 
   gchar *devname;
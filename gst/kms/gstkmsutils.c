@@ -27,7 +27,11 @@
 #include "config.h"
 #endif
 
+#include <xf86drm.h>
+#include <xf86drmMode.h>
 #include <drm_fourcc.h>
+#include <string.h>
+#include <strings.h>
 
 #include "gstkmsutils.h"
 
@@ -227,3 +231,169 @@ gst_video_calculate_device_ratio (guint dev_width, guint dev_height,
   if (dpy_par_d)
     *dpy_par_d = device_par_map[index][windex ^ 1];
 }
+
+gboolean
+gst_kms_get_property (gint fd, guint32 obj_id, guint32 obj_type,
+    const gchar * name, guint32 * prop_id, guint64 * value)
+{
+  drmModeObjectProperties *props;
+  drmModePropertyRes *prop;
+  gboolean found;
+  guint32 i;
+
+  found = FALSE;
+  props = drmModeObjectGetProperties (fd, obj_id, obj_type);
+  if (!props)
+    return FALSE;
+
+  for (i = 0; !found && i < props->count_props; i++) {
+    prop = drmModeGetProperty (fd, props->props[i]);
+    if (!prop)
+      continue;
+
+    if (!strcmp (prop->name, name)) {
+      if (prop_id)
+        *prop_id = prop->prop_id;
+      if (value)
+        *value = props->prop_values[i];
+      found = TRUE;
+    }
+    drmModeFreeProperty (prop);
+  }
+
+  drmModeFreeObjectProperties (props);
+
+  return found;
+}
+
+drmModeCrtc *
+gst_kms_find_crtc_for_connector (gint fd, drmModeRes * res,
+    drmModeConnector * conn, guint * pipe)
+{
+  int i;
+  int crtc_id;
+  drmModeEncoder *enc;
+  drmModeCrtc *crtc;
+  guint32 crtcs_for_connector = 0;
+
+  crtc_id = -1;
+  for (i = 0; i < res->count_encoders; i++) {
+    enc = drmModeGetEncoder (fd, res->encoders[i]);
+    if (enc) {
+      if (enc->encoder_id == conn->encoder_id) {
+        crtc_id = enc->crtc_id;
+        drmModeFreeEncoder (enc);
+        break;
+      }
+      drmModeFreeEncoder (enc);
+    }
+  }
+
+  /* If no active crtc was found, pick the first possible crtc */
+  if (crtc_id == -1) {
+    for (i = 0; i < conn->count_encoders; i++) {
+      enc = drmModeGetEncoder (fd, conn->encoders[i]);
+      crtcs_for_connector |= enc->possible_crtcs;
+      drmModeFreeEncoder (enc);
+    }
+
+    if (crtcs_for_connector != 0)
+      crtc_id = res->crtcs[ffs (crtcs_for_connector) - 1];
+  }
+
+  if (crtc_id == -1)
+    return NULL;
+
+  for (i = 0; i < res->count_crtcs; i++) {
+    crtc = drmModeGetCrtc (fd, res->crtcs[i]);
+    if (crtc) {
+      if (crtc_id == crtc->crtc_id) {
+        if (pipe)
+          *pipe = i;
+        return crtc;
+      }
+      drmModeFreeCrtc (crtc);
+    }
+  }
+
+  return NULL;
+}
+
+static gboolean
+connector_is_used (int fd, drmModeRes * res, drmModeConnector * conn)
+{
+  gboolean result;
+  drmModeCrtc *crtc;
+
+  result = FALSE;
+  crtc = gst_kms_find_crtc_for_connector (fd, res, conn, NULL);
+  if (crtc) {
+    result = crtc->buffer_id != 0;
+    drmModeFreeCrtc (crtc);
+  }
+
+  return result;
+}
+
+static drmModeConnector *
+find_used_connector_by_type (int fd, drmModeRes * res, int type)
+{
+  int i;
+  drmModeConnector *conn;
+
+  conn = NULL;
+  for (i = 0; i < res->count_connectors; i++) {
+    conn = drmModeGetConnector (fd, res->connectors[i]);
+    if (conn) {
+      if ((conn->connector_type == type) && connector_is_used (fd, res, conn))
+        return conn;
+      drmModeFreeConnector (conn);
+    }
+  }
+
+  return NULL;
+}
+
+static drmModeConnector *
+find_first_used_connector (int fd, drmModeRes * res)
+{
+  int i;
+  drmModeConnector *conn;
+
+  conn = NULL;
+  for (i = 0; i < res->count_connectors; i++) {
+    conn = drmModeGetConnector (fd, res->connectors[i]);
+    if (conn) {
+      if (connector_is_used (fd, res, conn))
+        return conn;
+      drmModeFreeConnector (conn);
+    }
+  }
+
+  return NULL;
+}
+
+drmModeConnector *
+gst_kms_find_main_monitor (gint fd, drmModeRes * res)
+{
+  /* Find the LVDS and eDP connectors: those are the main screens. */
+  static const int priority[] = { DRM_MODE_CONNECTOR_LVDS,
+    DRM_MODE_CONNECTOR_eDP
+  };
+  int i;
+  drmModeConnector *conn;
+
+  conn = NULL;
+  for (i = 0; !conn && i < G_N_ELEMENTS (priority); i++)
+    conn = find_used_connector_by_type (fd, res, priority[i]);
+
+  /* if we didn't find a connector, grab the first one in use */
+  if (!conn)
+    conn = find_first_used_connector (fd, res);
+
+  /* if no connector is used, grab the first one */
+  if (!conn)
+    conn = drmModeGetConnector (fd, res->connectors[0]);
+
+  return conn;
+}
@@ -27,6 +27,7 @@
 #define __GST_KMS_UTILS_H__
 
 #include <gst/video/video.h>
+#include <xf86drmMode.h>
 
 G_BEGIN_DECLS GstVideoFormat gst_video_format_from_drm (guint32 drmfmt);
 guint32 gst_drm_format_from_video (GstVideoFormat fmt);
@@ -37,6 +38,11 @@ void gst_video_calculate_device_ratio (guint dev_width,
     guint dev_height,
     guint dev_width_mm,
     guint dev_height_mm, guint * dpy_par_n, guint * dpy_par_d);
+gboolean gst_kms_get_property (gint fd, guint32 obj_id, guint32 obj_type,
+    const gchar * name, guint32 * prop_id, guint64 * value);
+drmModeConnector *gst_kms_find_main_monitor (gint fd, drmModeRes * res);
+drmModeCrtc *gst_kms_find_crtc_for_connector (gint fd, drmModeRes * res,
+    drmModeConnector * conn, guint * pipe);
 
 G_END_DECLS
 #endif
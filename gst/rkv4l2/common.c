@@ -27,6 +27,10 @@
 
 #include <gst/gst-i18n-plugin.h>
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
 #define SYS_PATH		"/sys/class/video4linux/"
 #define DEV_PATH		"/dev/"
 
@@ -55,8 +59,34 @@ __input_string_to_rect (char *input, GstVideoRectangle * rect)
   rect->h = atoi (result);
 }
 
+/*
+ * Device nodes are created and removed in /dev, so its mtime tells us
+ * whenever a cached view of the devices may be stale.
+ */
 gboolean
-rk_common_v4l2device_find_by_name (const char *name, char *ret_name)
+rk_common_dev_tree_changed (gint64 * stamp)
+{
+  struct stat st;
+  gint64 now;
+
+  if (stat (DEV_PATH, &st) < 0)
+    return TRUE;
+
+  now = (gint64) st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) +
+      st.st_mtim.tv_nsec;
+  if (now == *stamp)
+    return FALSE;
+
+  *stamp = now;
+  return TRUE;
+}
+
+static GMutex find_by_name_lock;
+static GHashTable *find_by_name_cache = NULL;
+static gint64 find_by_name_stamp = 0;
+
+static gboolean
+__v4l2device_scan_by_name (const char *name, char *ret_name)
 {
   DIR *dir;
   struct dirent *ent;
@@ -91,6 +121,246 @@ rk_common_v4l2device_find_by_name (const char *name, char *ret_name)
   return ret;
 }
 
+gboolean
+rk_common_v4l2device_find_by_name (const char *name, char *ret_name)
+{
+  char found[512];
+  const gchar *cached;
+  gboolean ret;
+
+  g_mutex_lock (&find_by_name_lock);
+
+  if (rk_common_dev_tree_changed (&find_by_name_stamp) && find_by_name_cache)
+    g_hash_table_remove_all (find_by_name_cache);
+
+  if (!find_by_name_cache)
+    find_by_name_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, g_free);
+
+  cached = g_hash_table_lookup (find_by_name_cache, name);
+  if (cached) {
+    if (ret_name)
+      snprintf (ret_name, 512, "%s", cached);
+    g_mutex_unlock (&find_by_name_lock);
+    return TRUE;
+  }
+
+  ret = __v4l2device_scan_by_name (name, found);
+  if (ret) {
+    g_hash_table_insert (find_by_name_cache, g_strdup (name),
+        g_strdup (found));
+    if (ret_name)
+      snprintf (ret_name, 512, "%s", found);
+  }
+
+  g_mutex_unlock (&find_by_name_lock);
+
+  return ret;
+}
+
+/*
+ * Probed caps of memory to memory devices only depend on the driver, so they
+ * are kept per device for the process and in a file of the user cache dir,
+ * sparing later elements and later processes the ioctls of the probing.
+ * Caps of capture nodes follow the sensor behind them, they are only cached
+ * once the element tagged the object with its media config and sensor format.
+ */
+#define CAPS_CACHE_DIR		"gstreamer-1.0"
+#define CAPS_CACHE_FILE		"rkv4l2-caps.cache"
+#define CAPS_CACHE_HEADER	"cache"
+
+static GMutex caps_cache_lock;
+static GHashTable *caps_cache = NULL;
+
+static gchar *
+__caps_cache_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), CAPS_CACHE_DIR,
+      CAPS_CACHE_FILE, NULL);
+}
+
+static gchar *
+__caps_cache_key (GstRKV4l2Object * v4l2object)
+{
+  struct v4l2_capability *vcap = &v4l2object->vcap;
+  gchar *key;
+
+  if (!(v4l2object->device_caps & (V4L2_CAP_VIDEO_M2M |
+              V4L2_CAP_VIDEO_M2M_MPLANE)) && !v4l2object->caps_cache_tag)
+    return NULL;
+
+  key = g_strdup_printf ("%s/%s/%s/%u.%u.%u/%d%s%s", (gchar *) vcap->driver,
+      (gchar *) vcap->card, (gchar *) vcap->bus_info,
+      (vcap->version >> 16) & 0xff, (vcap->version >> 8) & 0xff,
+      vcap->version & 0xff, v4l2object->type,
+      v4l2object->caps_cache_tag ? "/" : "",
+      v4l2object->caps_cache_tag ? v4l2object->caps_cache_tag : "");
+
+  /* used as a key file group */
+  return g_strdelimit (key, "[]\n", '_');
+}
+
+/* the file of an other version of the plugin may not be trusted */
+static GKeyFile *
+__caps_cache_load_file (const gchar * path)
+{
+  GKeyFile *file = g_key_file_new ();
+  gchar *version;
+
+  if (!g_key_file_load_from_file (file, path, G_KEY_FILE_NONE, NULL))
+    return file;
+
+  version = g_key_file_get_string (file, CAPS_CACHE_HEADER, "version", NULL);
+  if (g_strcmp0 (version, PACKAGE_VERSION)) {
+    g_key_file_free (file);
+    file = g_key_file_new ();
+  }
+  g_free (version);
+
+  return file;
+}
+
+static void
+__caps_cache_load (void)
+{
+  GKeyFile *file;
+  gchar *path, **groups;
+  guint i;
+
+  caps_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) gst_caps_unref);
+
+  path = __caps_cache_path ();
+  file = __caps_cache_load_file (path);
+  groups = g_key_file_get_groups (file, NULL);
+
+  for (i = 0; groups[i]; i++) {
+    gchar *str;
+    GstCaps *caps;
+
+    if (!strcmp (groups[i], CAPS_CACHE_HEADER))
+      continue;
+
+    str = g_key_file_get_string (file, groups[i], "caps", NULL);
+    caps = str ? gst_caps_from_string (str) : NULL;
+    g_free (str);
+
+    if (!caps)
+      continue;
+
+    if (gst_caps_is_empty (caps)) {
+      gst_caps_unref (caps);
+      continue;
+    }
+
+    g_hash_table_insert (caps_cache, g_strdup (groups[i]), caps);
+  }
+
+  GST_DEBUG ("loaded %u cached caps from %s", g_hash_table_size (caps_cache),
+      path);
+
+  g_strfreev (groups);
+  g_key_file_free (file);
+  g_free (path);
+}
+
+GstCaps *
+rk_common_caps_cache_lookup (GstRKV4l2Object * v4l2object)
+{
+  GstCaps *caps;
+  gchar *key;
+
+  key = __caps_cache_key (v4l2object);
+  if (!key)
+    return NULL;
+
+  g_mutex_lock (&caps_cache_lock);
+
+  if (!caps_cache)
+    __caps_cache_load ();
+
+  caps = g_hash_table_lookup (caps_cache, key);
+  if (caps)
+    gst_caps_ref (caps);
+
+  g_mutex_unlock (&caps_cache_lock);
+
+  GST_DEBUG_OBJECT (v4l2object->element, "cached caps for %s: %"
+      GST_PTR_FORMAT, key, caps);
+
+  g_free (key);
+
+  return caps;
+}
+
+void
+rk_common_caps_cache_store (GstRKV4l2Object * v4l2object, GstCaps * caps)
+{
+  GKeyFile *file;
+  GError *error = NULL;
+  gchar *key, *path, *lock_path, *dir, *str, *data;
+  gsize size;
+  gint lock_fd;
+
+  /* a failed probe is retried next time */
+  if (gst_caps_is_empty (caps))
+    return;
+
+  key = __caps_cache_key (v4l2object);
+  if (!key)
+    return;
+
+  str = gst_caps_to_string (caps);
+  path = __caps_cache_path ();
+  lock_path = g_strconcat (path, ".lock", NULL);
+  dir = g_path_get_dirname (path);
+
+  g_mutex_lock (&caps_cache_lock);
+
+  if (!caps_cache)
+    __caps_cache_load ();
+
+  g_hash_table_insert (caps_cache, g_strdup (key), gst_caps_ref (caps));
+
+  /* other processes may be updating the file too, serialize the whole read,
+   * modify and write so that none of their devices get lost */
+  g_mkdir_with_parents (dir, 0755);
+  lock_fd = open (lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock_fd < 0 || flock (lock_fd, LOCK_EX) < 0) {
+    GST_WARNING_OBJECT (v4l2object->element, "failed to lock %s: %s",
+        lock_path, g_strerror (errno));
+    goto done;
+  }
+
+  /* reread the file, other processes may have added their devices */
+  file = __caps_cache_load_file (path);
+  g_key_file_set_string (file, CAPS_CACHE_HEADER, "version", PACKAGE_VERSION);
+  g_key_file_set_string (file, key, "caps", str);
+  data = g_key_file_to_data (file, &size, NULL);
+
+  /* the file is replaced atomically, a reader never sees it half written */
+  if (!g_file_set_contents (path, data, size, &error)) {
+    GST_WARNING_OBJECT (v4l2object->element, "failed to write %s: %s", path,
+        error->message);
+    g_clear_error (&error);
+  }
+
+  g_free (data);
+  g_key_file_free (file);
+
+done:
+  if (lock_fd >= 0)
+    close (lock_fd);
+
+  g_mutex_unlock (&caps_cache_lock);
+
+  g_free (dir);
+  g_free (lock_path);
+  g_free (path);
+  g_free (str);
+  g_free (key);
+}
+
 /*
  * v4l2 calls
  */
@@ -205,6 +475,9 @@ rk_common_set_property_helper (GstRKV4l2Object * v4l2object,
 {
   char *string_val = NULL;
 
+  if (prop_id < PROP_VPU_STRIDE || prop_id >= PROP_RK_LAST)
+    return FALSE;
+
   /* common */
   switch (prop_id) {
     case PROP_INPUT_CROP:
@@ -263,6 +536,9 @@ rk_common_get_property_helper (GstRKV4l2Object * v4l2object,
 {
   char out[32];
 
+  if (prop_id < PROP_VPU_STRIDE || prop_id >= PROP_RK_LAST)
+    return FALSE;
+
   /* rga */
   switch (prop_id) {
     case PROP_OUTPUT_ROTATION:
@@ -324,4 +600,5 @@ rk_common_new (GstRKV4l2Object * v4l2object)
   /* isp */
   v4l2object->disable_autoconf = FALSE;
   v4l2object->xml_path = "/etc/cam_iq.xml";
+  v4l2object->media_config = NULL;
 }
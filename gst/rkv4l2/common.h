@@ -65,7 +65,8 @@ G_END_DECLS
     PROP_INPUT_CROP, \
     PROP_DISABLE_AUTOCONF, \
     PROP_3A_MODE, \
-    PROP_XML_FILE
+    PROP_XML_FILE, \
+    PROP_RK_LAST
 
 #define RK_V4L2_OBJECT \
   /* Rockchip Common */ \
@@ -79,12 +80,19 @@ G_END_DECLS
   /* Rockchip ISP */ \
   gboolean disable_autoconf; \
   GstRk3AMode isp_mode;  \
-  const gchar *xml_path;
+  const gchar *xml_path; \
+  gchar *media_config; \
+  /* set by capture elements whose caps follow the sensor setup */ \
+  gchar *caps_cache_tag;
 
 struct _GstV4l2Object;
 
 // utils
 gboolean rk_common_v4l2device_find_by_name (const char *name, char *ret_name);
+gboolean rk_common_dev_tree_changed (gint64 * stamp);
+GstCaps *rk_common_caps_cache_lookup (struct _GstV4l2Object *v4l2object);
+void rk_common_caps_cache_store (struct _GstV4l2Object *v4l2object,
+    GstCaps * caps);
 
 #define gst_rect_to_v4l2_rect(gst_rect, rect) \
 { \
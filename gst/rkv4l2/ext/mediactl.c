@@ -939,6 +939,55 @@ void media_print_streampos(struct media_device *media, const char *p,
 	media_dbg(media, " %*s\n", pos, "^");
 }
 
+static int media_parse_check_link(struct media_device *media,
+				  const char *p, char **endp)
+{
+	struct media_link *link;
+	char *end;
+
+	link = media_parse_link(media, p, &end);
+	if (link == NULL) {
+		*endp = end;
+		return -EINVAL;
+	}
+
+	p = end;
+	if (*p++ != '[') {
+		*endp = (char *)p - 1;
+		return -EINVAL;
+	}
+
+	strtoul(p, &end, 10);
+	for (p = end; isspace(*p); p++);
+	if (*p++ != ']') {
+		*endp = (char *)p - 1;
+		return -EINVAL;
+	}
+
+	for (; isspace(*p); p++);
+	*endp = (char *)p;
+
+	return 0;
+}
+
+int media_parse_check_links(struct media_device *media, const char *p)
+{
+	char *end;
+	int ret;
+
+	do {
+		ret = media_parse_check_link(media, p, &end);
+		if (ret < 0) {
+			media_print_streampos(media, p, end);
+			return ret;
+		}
+
+		p = end + 1;
+	} while (*end == ',');
+
+	return *end ? -EINVAL : 0;
+}
+
 int media_parse_setup_links(struct media_device *media, const char *p)
 {
 	char *end;
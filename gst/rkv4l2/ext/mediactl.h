@@ -420,4 +420,17 @@ int media_parse_setup_link(struct media_device *media,
  */
 int media_parse_setup_links(struct media_device *media, const char *p);
 
+/**
+ * @brief Parse string to link(s) on the media device without applying them.
+ * @param media - media device.
+ * @param p - input string
+ *
+ * Parse NULL terminated string p describing link(s) separated by
+ * commas (,) and check that every link exists, but leave the hardware
+ * untouched.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int media_parse_check_links(struct media_device *media, const char *p);
+
 #endif
@@ -623,6 +623,33 @@ int v4l2_subdev_parse_setup_formats(struct media_device *media, const char *p)
 	return *end ? -EINVAL : 0;
 }
 
+int v4l2_subdev_parse_check_formats(struct media_device *media, const char *p)
+{
+	struct v4l2_mbus_framefmt format;
+	struct v4l2_rect crop;
+	struct v4l2_rect compose;
+	struct v4l2_fract interval;
+	struct media_pad *pad;
+	char *end = 0;
+
+	do {
+		memset(&format, 0, sizeof(format));
+		pad = v4l2_subdev_parse_pad_format(media, &format, &crop,
+						   &compose, &interval, p, &end);
+		if (pad == NULL) {
+			media_print_streampos(media, p, end);
+			media_dbg(media, "Unable to parse format\n");
+			return -EINVAL;
+		}
+
+		for (p = end; isspace(*p); p++);
+		end = (char *)p;
+		p = end + 1;
+	} while (*end == ',');
+
+	return *end ? -EINVAL : 0;
+}
+
 static struct {
 	const char *name;
 	enum v4l2_mbus_pixelcode code;
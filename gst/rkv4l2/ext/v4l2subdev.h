@@ -181,6 +181,18 @@ int v4l2_subdev_set_frame_interval(struct media_entity *entity,
  */
 int v4l2_subdev_parse_setup_formats(struct media_device *media, const char *p);
 
+/**
+ * @brief Parse string to format(s) without applying them.
+ * @param media - media device.
+ * @param p - input string
+ *
+ * Same syntax as v4l2_subdev_parse_setup_formats(), but only checks that
+ * every pad exists and every format description parses.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int v4l2_subdev_parse_check_formats(struct media_device *media, const char *p);
+
 /**
  * @brief Convert media bus pixel code to string.
  * @param code - input string
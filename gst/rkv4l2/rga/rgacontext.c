@@ -0,0 +1,381 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/allocators/gstdmabuf.h>
+#include <gst/video/gstvideometa.h>
+
+#include "common.h"
+#include "v4l2_calls.h"
+#include "rgacontext.h"
+#include "rgadmabuf.h"
+
+/* how long a single blit may take */
+#define GST_RGA_CONTEXT_TIMEOUT_MS 1000
+
+GST_DEBUG_CATEGORY_EXTERN (v4l2_debug);
+#define GST_CAT_DEFAULT v4l2_debug
+
+GstRGAContext *
+gst_rga_context_new (GstElement * element, const gchar * device)
+{
+  GstRGAContext *ctx = g_new0 (GstRGAContext, 1);
+
+  ctx->element = element;
+
+  ctx->v4l2output = gst_v4l2_object_new (element,
+      V4L2_BUF_TYPE_VIDEO_OUTPUT, device,
+      gst_v4l2_get_output, gst_v4l2_set_output, NULL);
+  ctx->v4l2output->no_initial_format = TRUE;
+  ctx->v4l2output->keep_aspect = FALSE;
+  ctx->v4l2output->req_mode = GST_V4L2_IO_DMABUF_IMPORT;
+
+  ctx->v4l2capture = gst_v4l2_object_new (element,
+      V4L2_BUF_TYPE_VIDEO_CAPTURE, device,
+      gst_v4l2_get_input, gst_v4l2_set_input, NULL);
+  ctx->v4l2capture->no_initial_format = TRUE;
+  ctx->v4l2capture->keep_aspect = FALSE;
+  ctx->v4l2capture->req_mode = GST_V4L2_IO_DMABUF_IMPORT;
+
+  /* every open of the device is a context of its own */
+  if (!gst_v4l2_object_open (ctx->v4l2output))
+    goto open_failed;
+
+  if (!gst_v4l2_object_open_shared (ctx->v4l2capture, ctx->v4l2output))
+    goto open_failed;
+
+  return ctx;
+
+open_failed:
+  {
+    gst_rga_context_free (ctx);
+    return NULL;
+  }
+}
+
+void
+gst_rga_context_free (GstRGAContext * ctx)
+{
+  gst_rga_context_stop (ctx);
+
+  if (GST_V4L2_IS_OPEN (ctx->v4l2output))
+    gst_v4l2_object_close (ctx->v4l2output);
+  if (GST_V4L2_IS_OPEN (ctx->v4l2capture))
+    gst_v4l2_object_close (ctx->v4l2capture);
+
+  gst_v4l2_object_destroy (ctx->v4l2output);
+  gst_v4l2_object_destroy (ctx->v4l2capture);
+  gst_buffer_replace (&ctx->staging, NULL);
+
+  g_free (ctx);
+}
+
+static gboolean
+gst_rga_context_reqbufs (GstRKV4l2Object * obj, guint * count)
+{
+  struct v4l2_requestbuffers req = { 0 };
+
+  req.type = obj->type;
+  req.memory = V4L2_MEMORY_DMABUF;
+  req.count = *count;
+
+  if (v4l2_ioctl (obj->video_fd, VIDIOC_REQBUFS, &req) < 0) {
+    GST_WARNING_OBJECT (obj->element, "REQBUFS(%u) failed: %s", *count,
+        g_strerror (errno));
+    return FALSE;
+  }
+
+  if (*count > 0 && req.count == 0)
+    return FALSE;
+
+  *count = req.count;
+  return TRUE;
+}
+
+void
+gst_rga_context_stop (GstRGAContext * ctx)
+{
+  guint count = 0;
+
+  if (!GST_V4L2_IS_OPEN (ctx->v4l2output))
+    return;
+
+  if (ctx->streaming) {
+    v4l2_ioctl (ctx->v4l2output->video_fd, VIDIOC_STREAMOFF,
+        &ctx->v4l2output->type);
+    v4l2_ioctl (ctx->v4l2capture->video_fd, VIDIOC_STREAMOFF,
+        &ctx->v4l2capture->type);
+    ctx->streaming = FALSE;
+  }
+
+  if (ctx->configured) {
+    gst_rga_context_reqbufs (ctx->v4l2output, &count);
+    count = 0;
+    gst_rga_context_reqbufs (ctx->v4l2capture, &count);
+  }
+
+  gst_v4l2_object_stop (ctx->v4l2output);
+  gst_v4l2_object_stop (ctx->v4l2capture);
+
+  /* the staging copy follows the input format */
+  gst_buffer_replace (&ctx->staging, NULL);
+
+  ctx->queued = FALSE;
+  ctx->configured = FALSE;
+}
+
+gboolean
+gst_rga_context_configure (GstRGAContext * ctx, GstCaps * incaps,
+    GstCaps * outcaps, guint capture_count)
+{
+  GstV4l2Error error = GST_V4L2_ERROR_INIT;
+  GstRKV4l2Object *obj = ctx->v4l2output;
+  struct v4l2_rect rect;
+  guint count;
+
+  gst_rga_context_stop (ctx);
+
+  if (!gst_v4l2_object_set_format (ctx->v4l2output, incaps, &error))
+    goto format_failed;
+
+  if (!gst_v4l2_object_set_format (ctx->v4l2capture, outcaps, &error))
+    goto format_failed;
+
+  /* one input at a time */
+  count = 1;
+  if (!gst_rga_context_reqbufs (ctx->v4l2output, &count))
+    goto reqbufs_failed;
+
+  count = capture_count;
+  if (!gst_rga_context_reqbufs (ctx->v4l2capture, &count))
+    goto reqbufs_failed;
+  ctx->capture_count = count;
+  ctx->configured = TRUE;
+
+  /* the rockchip properties live on the output object, like rgaconvert */
+  rk_common_v4l2_set_rotation (obj, obj->rotation);
+  rk_common_v4l2_set_vflip (obj, obj->vflip);
+  rk_common_v4l2_set_hflip (obj, obj->hflip);
+
+  if (obj->input_crop.w != 0) {
+    gst_rect_to_v4l2_rect (&obj->input_crop, &rect);
+    rk_common_v4l2_set_selection (obj, &rect, FALSE);
+  }
+
+  if (obj->output_crop.w != 0) {
+    gst_rect_to_v4l2_rect (&obj->output_crop, &rect);
+    rk_common_v4l2_set_selection (obj, &rect, TRUE);
+  }
+
+  GST_DEBUG_OBJECT (ctx->element, "configured %" GST_PTR_FORMAT " -> %"
+      GST_PTR_FORMAT, incaps, outcaps);
+
+  return TRUE;
+
+format_failed:
+  {
+    GST_ERROR_OBJECT (ctx->element, "failed to set format");
+    gst_v4l2_error (ctx->element, &error);
+    gst_rga_context_stop (ctx);
+    return FALSE;
+  }
+reqbufs_failed:
+  {
+    GST_ELEMENT_ERROR (ctx->element, RESOURCE, SETTINGS,
+        ("failed to allocate RGA buffers"), (NULL));
+    ctx->configured = TRUE;
+    gst_rga_context_stop (ctx);
+    return FALSE;
+  }
+}
+
+/* whether the RGA can read @inbuf as laid out by the output format */
+static gboolean
+gst_rga_context_can_import (GstRGAContext * ctx, GstBuffer * inbuf)
+{
+  GstMemory *mem = gst_buffer_peek_memory (inbuf, 0);
+  GstVideoMeta *vmeta;
+  gsize offset;
+  guint i;
+
+  if (gst_buffer_n_memory (inbuf) != 1 || !gst_is_dmabuf_memory (mem))
+    return FALSE;
+
+  gst_memory_get_sizes (mem, &offset, NULL);
+  if (offset != 0)
+    return FALSE;
+
+  vmeta = gst_buffer_get_video_meta (inbuf);
+  if (vmeta) {
+    GstVideoInfo *info = &ctx->v4l2output->info;
+
+    for (i = 0; i < vmeta->n_planes; i++)
+      if (vmeta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE (info, i)
+          || vmeta->offset[i] != GST_VIDEO_INFO_PLANE_OFFSET (info, i))
+        return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* the RGA can only read dmabuf, copy anything else once */
+GstBuffer *
+gst_rga_context_import (GstRGAContext * ctx, GstBuffer * inbuf,
+    GstVideoInfo * info, gint drm_fd, GstAllocator * allocator)
+{
+  GstVideoFrame src, dest;
+
+  if (gst_rga_context_can_import (ctx, inbuf))
+    return inbuf;
+
+  if (!ctx->staging) {
+    ctx->staging = gst_rga_dmabuf_alloc (drm_fd, allocator,
+        &ctx->v4l2output->info, ctx->v4l2output->format.fmt.pix.sizeimage);
+    if (!ctx->staging)
+      return NULL;
+  }
+
+  GST_LOG_OBJECT (ctx->element, "copying %p into dmabuf", inbuf);
+
+  if (!gst_video_frame_map (&src, info, inbuf, GST_MAP_READ))
+    return NULL;
+
+  if (!gst_video_frame_map (&dest, &ctx->v4l2output->info, ctx->staging,
+          GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&src);
+    return NULL;
+  }
+
+  gst_video_frame_copy (&dest, &src);
+  gst_video_frame_unmap (&dest);
+  gst_video_frame_unmap (&src);
+
+  return ctx->staging;
+}
+
+/* @inbuf must come from gst_rga_context_import(), @outbuf from a dmabuf
+ * pool laid out as the capture format */
+gboolean
+gst_rga_context_queue (GstRGAContext * ctx, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  struct v4l2_buffer src = { 0 }, dest = { 0 };
+  GstMemory *mem;
+  gsize size, maxsize;
+
+  mem = gst_buffer_peek_memory (inbuf, 0);
+  size = gst_memory_get_sizes (mem, NULL, &maxsize);
+  src.type = ctx->v4l2output->type;
+  src.memory = V4L2_MEMORY_DMABUF;
+  src.index = 0;
+  src.m.fd = gst_dmabuf_memory_get_fd (mem);
+  src.bytesused = size;
+  src.length = maxsize;
+
+  mem = gst_buffer_peek_memory (outbuf, 0);
+  size = gst_memory_get_sizes (mem, NULL, &maxsize);
+  dest.type = ctx->v4l2capture->type;
+  dest.memory = V4L2_MEMORY_DMABUF;
+  dest.index = gst_rga_dmabuf_get_index (outbuf) % ctx->capture_count;
+  dest.m.fd = gst_dmabuf_memory_get_fd (mem);
+  dest.length = maxsize;
+
+  if (v4l2_ioctl (ctx->v4l2output->video_fd, VIDIOC_QBUF, &src) < 0)
+    goto qbuf_failed;
+
+  ctx->queued = TRUE;
+
+  if (v4l2_ioctl (ctx->v4l2capture->video_fd, VIDIOC_QBUF, &dest) < 0)
+    goto qbuf_failed;
+
+  if (!ctx->streaming) {
+    ctx->streaming = TRUE;
+    if (v4l2_ioctl (ctx->v4l2output->video_fd, VIDIOC_STREAMON,
+            &ctx->v4l2output->type) < 0
+        || v4l2_ioctl (ctx->v4l2capture->video_fd, VIDIOC_STREAMON,
+            &ctx->v4l2capture->type) < 0)
+      goto streamon_failed;
+  }
+
+  return TRUE;
+
+qbuf_failed:
+  {
+    GST_ERROR_OBJECT (ctx->element, "QBUF failed: %s", g_strerror (errno));
+    gst_rga_context_stop (ctx);
+    return FALSE;
+  }
+streamon_failed:
+  {
+    GST_ERROR_OBJECT (ctx->element, "STREAMON failed: %s", g_strerror (errno));
+    gst_rga_context_stop (ctx);
+    return FALSE;
+  }
+}
+
+gboolean
+gst_rga_context_wait (GstRGAContext * ctx)
+{
+  struct pollfd pfd = { 0 };
+  struct v4l2_buffer buf = { 0 };
+
+  if (!ctx->queued)
+    return TRUE;
+
+  ctx->queued = FALSE;
+
+  pfd.fd = ctx->v4l2capture->video_fd;
+  pfd.events = POLLIN;
+  if (poll (&pfd, 1, GST_RGA_CONTEXT_TIMEOUT_MS) <= 0)
+    goto timeout;
+
+  buf.type = ctx->v4l2capture->type;
+  buf.memory = V4L2_MEMORY_DMABUF;
+  if (v4l2_ioctl (ctx->v4l2capture->video_fd, VIDIOC_DQBUF, &buf) < 0)
+    goto dqbuf_failed;
+
+  if (buf.flags & V4L2_BUF_FLAG_ERROR)
+    GST_WARNING_OBJECT (ctx->element, "RGA reported an error");
+
+  buf.type = ctx->v4l2output->type;
+  if (v4l2_ioctl (ctx->v4l2output->video_fd, VIDIOC_DQBUF, &buf) < 0)
+    goto dqbuf_failed;
+
+  return TRUE;
+
+timeout:
+  {
+    GST_ERROR_OBJECT (ctx->element, "RGA did not complete in %d ms",
+        GST_RGA_CONTEXT_TIMEOUT_MS);
+    goto reset;
+  }
+dqbuf_failed:
+  {
+    GST_ERROR_OBJECT (ctx->element, "DQBUF failed: %s", g_strerror (errno));
+    goto reset;
+  }
+reset:
+  /* start over with fresh queues next time */
+  gst_rga_context_stop (ctx);
+  return FALSE;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_CONTEXT_H__
+#define __GST_RGA_CONTEXT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <gstv4l2object.h>
+
+G_BEGIN_DECLS
+typedef struct _GstRGAContext GstRGAContext;
+
+/**
+ * GstRGAContext:
+ *
+ * One m2m context on the RGA, driven with imported dmabufs only. Used by
+ * the elements that run several blits per input or output frame.
+ */
+struct _GstRGAContext
+{
+  GstElement *element;
+
+  GstRKV4l2Object *v4l2output;
+  GstRKV4l2Object *v4l2capture;
+
+  gboolean configured;          /* formats set and buffers requested */
+  gboolean streaming;
+  gboolean queued;              /* a job is waiting for completion */
+  guint capture_count;          /* buffers allocated on the capture queue */
+
+  GstBuffer *staging;           /* dmabuf copy of non-dmabuf input */
+};
+
+GstRGAContext *gst_rga_context_new (GstElement * element,
+    const gchar * device);
+void gst_rga_context_free (GstRGAContext * ctx);
+
+gboolean gst_rga_context_configure (GstRGAContext * ctx, GstCaps * incaps,
+    GstCaps * outcaps, guint capture_count);
+void gst_rga_context_stop (GstRGAContext * ctx);
+
+GstBuffer *gst_rga_context_import (GstRGAContext * ctx, GstBuffer * inbuf,
+    GstVideoInfo * info, gint drm_fd, GstAllocator * allocator);
+gboolean gst_rga_context_queue (GstRGAContext * ctx, GstBuffer * inbuf,
+    GstBuffer * outbuf);
+gboolean gst_rga_context_wait (GstRGAContext * ctx);
+
+G_END_DECLS
+#endif /* __GST_RGA_CONTEXT_H__ */
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <drm/drm.h>
+#include <drm/drm_mode.h>
+
+#include <gst/allocators/gstdmabuf.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+
+#include "rgadmabuf.h"
+
+#ifndef DRM_RDWR
+#define DRM_RDWR O_RDWR
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_rga_dmabuf_debug);
+#define GST_CAT_DEFAULT gst_rga_dmabuf_debug
+
+static void
+gst_rga_dmabuf_debug_init (void)
+{
+  static gsize done = 0;
+
+  if (g_once_init_enter (&done)) {
+    GST_DEBUG_CATEGORY_INIT (gst_rga_dmabuf_debug, "rgadmabuf", 0,
+        "RGA dmabuf allocation");
+    g_once_init_leave (&done, 1);
+  }
+}
+
+#define GST_RGA_DMABUF_INDEX_QUARK gst_rga_dmabuf_index_quark ()
+
+static GQuark
+gst_rga_dmabuf_index_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (quark == 0)
+    quark = g_quark_from_string ("GstRGADmaBufIndex");
+
+  return quark;
+}
+
+GstBuffer *
+gst_rga_dmabuf_alloc (gint drm_fd, GstAllocator * allocator,
+    GstVideoInfo * info, gsize size)
+{
+  struct drm_mode_create_dumb create = { 0 };
+  struct drm_mode_destroy_dumb destroy = { 0 };
+  struct drm_prime_handle prime = { 0 };
+  GstMemory *mem;
+  GstBuffer *buffer;
+  gint ret;
+
+  gst_rga_dmabuf_debug_init ();
+
+  /* a linear blob, the layout comes from the v4l2 format */
+  create.width = 4096;
+  create.height = (size + 4095) / 4096;
+  create.bpp = 8;
+  if (ioctl (drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
+    GST_ERROR ("failed to create dumb buffer: %s", g_strerror (errno));
+    return NULL;
+  }
+
+  prime.handle = create.handle;
+  prime.flags = DRM_CLOEXEC | DRM_RDWR;
+  ret = ioctl (drm_fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &prime);
+
+  /* the dmabuf keeps the storage alive */
+  destroy.handle = create.handle;
+  ioctl (drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+
+  if (ret < 0) {
+    GST_ERROR ("failed to export dumb buffer: %s", g_strerror (errno));
+    return NULL;
+  }
+
+  mem = gst_dmabuf_allocator_alloc (allocator, prime.fd, create.size);
+  gst_memory_resize (mem, 0, size);
+
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, mem);
+  gst_buffer_add_video_meta_full (buffer, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_INFO_FORMAT (info), GST_VIDEO_INFO_WIDTH (info),
+      GST_VIDEO_INFO_HEIGHT (info), GST_VIDEO_INFO_N_PLANES (info),
+      info->offset, info->stride);
+
+  return buffer;
+}
+
+guint
+gst_rga_dmabuf_get_index (GstBuffer * buffer)
+{
+  return GPOINTER_TO_UINT (gst_mini_object_get_qdata (GST_MINI_OBJECT
+          (buffer), GST_RGA_DMABUF_INDEX_QUARK));
+}
+
+/*
+ * pool
+ */
+
+typedef struct
+{
+  GstBufferPool parent;
+
+  gint drm_fd;
+  GstAllocator *allocator;
+  GstVideoInfo info;
+  gsize size;
+  guint n_buffers;
+} GstRGADmaBufPool;
+
+typedef struct
+{
+  GstBufferPoolClass parent_class;
+} GstRGADmaBufPoolClass;
+
+GType gst_rga_dmabuf_pool_get_type (void);
+G_DEFINE_TYPE (GstRGADmaBufPool, gst_rga_dmabuf_pool, GST_TYPE_BUFFER_POOL);
+
+static const gchar **
+gst_rga_dmabuf_pool_get_options (GstBufferPool * pool)
+{
+  static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
+
+  return options;
+}
+
+static GstFlowReturn
+gst_rga_dmabuf_pool_alloc_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstRGADmaBufPool *pool = (GstRGADmaBufPool *) bpool;
+  GstBuffer *buf;
+
+  buf = gst_rga_dmabuf_alloc (pool->drm_fd, pool->allocator, &pool->info,
+      pool->size);
+  if (!buf)
+    return GST_FLOW_ERROR;
+
+  /* lets users map a buffer to a fixed v4l2 index */
+  gst_mini_object_set_qdata (GST_MINI_OBJECT (buf),
+      GST_RGA_DMABUF_INDEX_QUARK, GUINT_TO_POINTER (pool->n_buffers++), NULL);
+
+  *buffer = buf;
+  return GST_FLOW_OK;
+}
+
+static void
+gst_rga_dmabuf_pool_finalize (GObject * object)
+{
+  GstRGADmaBufPool *pool = (GstRGADmaBufPool *) object;
+
+  if (pool->drm_fd >= 0)
+    close (pool->drm_fd);
+  gst_object_unref (pool->allocator);
+
+  G_OBJECT_CLASS (gst_rga_dmabuf_pool_parent_class)->finalize (object);
+}
+
+static void
+gst_rga_dmabuf_pool_init (GstRGADmaBufPool * pool)
+{
+  pool->drm_fd = -1;
+}
+
+static void
+gst_rga_dmabuf_pool_class_init (GstRGADmaBufPoolClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+  gobject_class->finalize = gst_rga_dmabuf_pool_finalize;
+  pool_class->get_options = gst_rga_dmabuf_pool_get_options;
+  pool_class->alloc_buffer = gst_rga_dmabuf_pool_alloc_buffer;
+}
+
+GstBufferPool *
+gst_rga_dmabuf_pool_new (gint drm_fd, GstAllocator * allocator,
+    GstCaps * caps, GstVideoInfo * info, gsize size, guint max_buffers)
+{
+  GstRGADmaBufPool *pool;
+  GstStructure *config;
+
+  pool = g_object_new (gst_rga_dmabuf_pool_get_type (), NULL);
+  pool->drm_fd = dup (drm_fd);
+  pool->allocator = gst_object_ref (allocator);
+  pool->info = *info;
+  pool->size = size;
+
+  config = gst_buffer_pool_get_config (GST_BUFFER_POOL (pool));
+  gst_buffer_pool_config_set_params (config, caps, size, MIN (2, max_buffers),
+      max_buffers);
+  gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  if (!gst_buffer_pool_set_config (GST_BUFFER_POOL (pool), config)) {
+    gst_object_unref (pool);
+    return NULL;
+  }
+
+  return GST_BUFFER_POOL (pool);
+}
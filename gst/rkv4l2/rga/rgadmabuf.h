@@ -0,0 +1,39 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_DMABUF_H__
+#define __GST_RGA_DMABUF_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* dumb buffers exported as dmabuf, laid out as @info */
+GstBuffer *gst_rga_dmabuf_alloc (gint drm_fd, GstAllocator * allocator,
+    GstVideoInfo * info, gsize size);
+
+/* a pool of the above, every buffer gets its own index */
+GstBufferPool *gst_rga_dmabuf_pool_new (gint drm_fd, GstAllocator * allocator,
+    GstCaps * caps, GstVideoInfo * info, gsize size, guint max_buffers);
+
+guint gst_rga_dmabuf_get_index (GstBuffer * buffer);
+
+G_END_DECLS
+#endif /* __GST_RGA_DMABUF_H__ */
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rgascheduler.h"
+
+GST_DEBUG_CATEGORY_EXTERN (v4l2_debug);
+#define GST_CAT_DEFAULT v4l2_debug
+
+/* The kernel runs the m2m contexts round robin, so with many clients a
+ * preview frame can wait behind every other queued job. Clients take
+ * units here before queueing a job: a full frame takes
+ * GST_RGA_SCHEDULER_JOB_UNITS, a small one a single unit, so small jobs
+ * are let through together. A waiter only runs once no higher priority is
+ * waiting, so the worst a realtime job waits for is what is in flight.
+ *
+ * A client only blocks while it has nothing in flight: the jobs it holds
+ * are released by the same thread, so waiting on them would never end.
+ * Clients keeping several jobs in flight take the next ones with
+ * gst_rga_scheduler_try_acquire () and complete their oldest job when it
+ * fails, which also lets every waiter through once the hardware drains. */
+#define GST_RGA_SCHEDULER_MAX_JOBS 2
+#define GST_RGA_SCHEDULER_JOB_UNITS 4
+#define GST_RGA_SCHEDULER_MAX_UNITS \
+  (GST_RGA_SCHEDULER_MAX_JOBS * GST_RGA_SCHEDULER_JOB_UNITS)
+#define GST_RGA_SCHEDULER_SMALL_JOB (640 * 480)
+
+typedef struct
+{
+  guint units;
+  GstClockTime start;
+} GstRGAJob;
+
+typedef struct
+{
+  guint units;
+  GstRGAPriority priority;
+} GstRGAWaiter;
+
+struct _GstRGASchedulerClient
+{
+  GstObject *owner;
+  GstRGAPriority priority;
+  gboolean flushing;
+  GQueue jobs;                  /* in the hardware, oldest first */
+
+  /* stats */
+  guint num_jobs;
+  guint num_small;
+  GstClockTime wait_time;
+  GstClockTime wait_max;
+  GstClockTime hw_time;
+  GstClockTime hw_max;
+};
+
+/* one per process */
+static struct
+{
+  GMutex lock;
+  GCond cond;
+  guint units;
+  GQueue waiting[GST_RGA_PRIORITY_LAST];
+} scheduler;
+
+GType
+gst_rga_priority_get_type (void)
+{
+  static GType rga_priority = 0;
+
+  if (!rga_priority) {
+    static const GEnumValue priorities[] = {
+      {GST_RGA_PRIORITY_BACKGROUND, "GST_RGA_PRIORITY_BACKGROUND",
+          "background"},
+      {GST_RGA_PRIORITY_NORMAL, "GST_RGA_PRIORITY_NORMAL", "normal"},
+      {GST_RGA_PRIORITY_REALTIME, "GST_RGA_PRIORITY_REALTIME", "realtime"},
+      {0, NULL, NULL}
+    };
+    rga_priority = g_enum_register_static ("GstRGAPriority", priorities);
+  }
+
+  return rga_priority;
+}
+
+GstRGASchedulerClient *
+gst_rga_scheduler_client_new (GstObject * owner, GstRGAPriority priority)
+{
+  GstRGASchedulerClient *client = g_new0 (GstRGASchedulerClient, 1);
+
+  client->owner = owner;
+  client->priority = priority;
+  g_queue_init (&client->jobs);
+
+  return client;
+}
+
+/* give back the units of every job still accounted to @client */
+static void
+gst_rga_scheduler_client_drop_jobs (GstRGASchedulerClient * client)
+{
+  GstRGAJob *job;
+
+  while ((job = g_queue_pop_head (&client->jobs))) {
+    scheduler.units -= job->units;
+    g_slice_free (GstRGAJob, job);
+  }
+
+  g_cond_broadcast (&scheduler.cond);
+}
+
+void
+gst_rga_scheduler_client_free (GstRGASchedulerClient * client)
+{
+  g_mutex_lock (&scheduler.lock);
+  gst_rga_scheduler_client_drop_jobs (client);
+  g_mutex_unlock (&scheduler.lock);
+
+  g_free (client);
+}
+
+void
+gst_rga_scheduler_client_set_priority (GstRGASchedulerClient * client,
+    GstRGAPriority priority)
+{
+  /* a pending acquire keeps the priority it started with */
+  g_mutex_lock (&scheduler.lock);
+  client->priority = priority;
+  g_mutex_unlock (&scheduler.lock);
+}
+
+void
+gst_rga_scheduler_client_set_flushing (GstRGASchedulerClient * client,
+    gboolean flushing)
+{
+  g_mutex_lock (&scheduler.lock);
+  client->flushing = flushing;
+  /* the queues are about to be stopped, nothing will be released */
+  if (flushing)
+    gst_rga_scheduler_client_drop_jobs (client);
+  g_mutex_unlock (&scheduler.lock);
+}
+
+static gboolean
+gst_rga_scheduler_can_run (GstRGAWaiter * waiter)
+{
+  gint p;
+
+  for (p = waiter->priority + 1; p < GST_RGA_PRIORITY_LAST; p++)
+    if (!g_queue_is_empty (&scheduler.waiting[p]))
+      return FALSE;
+
+  if (g_queue_peek_head (&scheduler.waiting[waiter->priority]) != waiter)
+    return FALSE;
+
+  return scheduler.units + waiter->units <= GST_RGA_SCHEDULER_MAX_UNITS;
+}
+
+static guint
+gst_rga_scheduler_job_units (guint64 pixels)
+{
+  return pixels <= GST_RGA_SCHEDULER_SMALL_JOB ? 1 :
+      GST_RGA_SCHEDULER_JOB_UNITS;
+}
+
+/* called with the lock */
+static void
+gst_rga_scheduler_add_job (GstRGASchedulerClient * client, guint units,
+    GstClockTime start)
+{
+  GstRGAJob *job;
+  GstClockTime waited;
+
+  job = g_slice_new (GstRGAJob);
+  job->units = units;
+  job->start = gst_util_get_timestamp ();
+  g_queue_push_tail (&client->jobs, job);
+  scheduler.units += job->units;
+
+  waited = job->start - start;
+  client->num_jobs++;
+  if (job->units == 1)
+    client->num_small++;
+  client->wait_time += waited;
+  client->wait_max = MAX (client->wait_max, waited);
+
+  GST_LOG_OBJECT (client->owner, "job of %u units after %" GST_TIME_FORMAT,
+      job->units, GST_TIME_ARGS (waited));
+}
+
+gboolean
+gst_rga_scheduler_acquire (GstRGASchedulerClient * client, guint64 pixels)
+{
+  GstRGAWaiter waiter;
+  GstClockTime start;
+  gboolean ret;
+
+  start = gst_util_get_timestamp ();
+
+  g_mutex_lock (&scheduler.lock);
+
+  /* the jobs this client holds would never be released */
+  if (!g_queue_is_empty (&client->jobs)) {
+    g_mutex_unlock (&scheduler.lock);
+    g_critical ("RGA client %s waits with %u job(s) in flight",
+        client->owner ? GST_OBJECT_NAME (client->owner) : "(none)",
+        g_queue_get_length (&client->jobs));
+    return FALSE;
+  }
+
+  waiter.units = gst_rga_scheduler_job_units (pixels);
+  waiter.priority = client->priority;
+
+  g_queue_push_tail (&scheduler.waiting[waiter.priority], &waiter);
+  while (!client->flushing && !gst_rga_scheduler_can_run (&waiter))
+    g_cond_wait (&scheduler.cond, &scheduler.lock);
+  g_queue_remove (&scheduler.waiting[waiter.priority], &waiter);
+
+  ret = !client->flushing;
+  if (ret)
+    gst_rga_scheduler_add_job (client, waiter.units, start);
+
+  /* the next waiter of this priority may be the head now */
+  g_cond_broadcast (&scheduler.cond);
+  g_mutex_unlock (&scheduler.lock);
+
+  return ret;
+}
+
+gboolean
+gst_rga_scheduler_try_acquire (GstRGASchedulerClient * client, guint64 pixels)
+{
+  guint units = gst_rga_scheduler_job_units (pixels);
+  gboolean ret = FALSE;
+  gint p;
+
+  g_mutex_lock (&scheduler.lock);
+
+  if (client->flushing)
+    goto done;
+
+  /* keeping a window is not worth starving anybody, a waiter of any
+   * priority goes first */
+  for (p = 0; p < GST_RGA_PRIORITY_LAST; p++)
+    if (!g_queue_is_empty (&scheduler.waiting[p]))
+      goto done;
+
+  if (scheduler.units + units > GST_RGA_SCHEDULER_MAX_UNITS)
+    goto done;
+
+  gst_rga_scheduler_add_job (client, units, gst_util_get_timestamp ());
+  ret = TRUE;
+
+done:
+  g_mutex_unlock (&scheduler.lock);
+
+  return ret;
+}
+
+void
+gst_rga_scheduler_release (GstRGASchedulerClient * client)
+{
+  GstClockTime hw;
+  GstRGAJob *job;
+
+  g_mutex_lock (&scheduler.lock);
+  job = g_queue_pop_head (&client->jobs);
+  if (job) {
+    hw = gst_util_get_timestamp () - job->start;
+    client->hw_time += hw;
+    client->hw_max = MAX (client->hw_max, hw);
+
+    scheduler.units -= job->units;
+    g_slice_free (GstRGAJob, job);
+    g_cond_broadcast (&scheduler.cond);
+  }
+  g_mutex_unlock (&scheduler.lock);
+}
+
+GstStructure *
+gst_rga_scheduler_client_get_stats (GstRGASchedulerClient * client)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&scheduler.lock);
+  s = gst_structure_new ("GstRGASchedulerStats",
+      "priority", GST_TYPE_RGA_PRIORITY, client->priority,
+      "jobs", G_TYPE_UINT, client->num_jobs,
+      "small-jobs", G_TYPE_UINT, client->num_small,
+      "in-flight", G_TYPE_UINT, g_queue_get_length (&client->jobs),
+      "queue-time", G_TYPE_UINT64, client->wait_time,
+      "max-queue-time", G_TYPE_UINT64, client->wait_max,
+      "hardware-time", G_TYPE_UINT64, client->hw_time,
+      "max-hardware-time", G_TYPE_UINT64, client->hw_max, NULL);
+  g_mutex_unlock (&scheduler.lock);
+
+  return s;
+}
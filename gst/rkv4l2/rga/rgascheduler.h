@@ -0,0 +1,64 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_SCHEDULER_H__
+#define __GST_RGA_SCHEDULER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RGA_PRIORITY (gst_rga_priority_get_type())
+GType gst_rga_priority_get_type (void);
+
+typedef enum
+{
+  GST_RGA_PRIORITY_BACKGROUND,
+  GST_RGA_PRIORITY_NORMAL,
+  GST_RGA_PRIORITY_REALTIME,
+  GST_RGA_PRIORITY_LAST
+} GstRGAPriority;
+
+typedef struct _GstRGASchedulerClient GstRGASchedulerClient;
+
+/* every client shares the one scheduler of the process, which limits the
+ * jobs in the hardware so higher priorities only wait for those */
+GstRGASchedulerClient *gst_rga_scheduler_client_new (GstObject * owner,
+    GstRGAPriority priority);
+void gst_rga_scheduler_client_free (GstRGASchedulerClient * client);
+
+void gst_rga_scheduler_client_set_priority (GstRGASchedulerClient * client,
+    GstRGAPriority priority);
+void gst_rga_scheduler_client_set_flushing (GstRGASchedulerClient * client,
+    gboolean flushing);
+GstStructure *gst_rga_scheduler_client_get_stats (GstRGASchedulerClient *
+    client);
+
+/* around each job: acquire before it is queued, release once it is done.
+ * acquire blocks and is only allowed with no job of the client in flight,
+ * further jobs are taken with try_acquire, which never waits and fails
+ * when the client should complete one of its jobs first */
+gboolean gst_rga_scheduler_acquire (GstRGASchedulerClient * client,
+    guint64 pixels);
+gboolean gst_rga_scheduler_try_acquire (GstRGASchedulerClient * client,
+    guint64 pixels);
+void gst_rga_scheduler_release (GstRGASchedulerClient * client);
+
+G_END_DECLS
+#endif /* __GST_RGA_SCHEDULER_H__ */
@@ -0,0 +1,416 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "rgasoftconvert.h"
+
+GST_DEBUG_CATEGORY_EXTERN (v4l2_debug);
+#define GST_CAT_DEFAULT v4l2_debug
+
+/* the rotation bands are cut at aligned rows so the chroma of 4:2:0 stays
+ * whole */
+#define GST_RGA_SOFT_BAND_ALIGN 16
+#define GST_RGA_SOFT_MIN_BAND_ROWS 64
+
+#define GST_RGA_SOFT_FORMATS "{ NV12, NV21, NV16, I420, YV12, Y42B, Y444, " \
+  "YUY2, UYVY, YVYU, P010_10LE, GRAY8, RGB, BGR, RGBx, BGRx, xRGB, xBGR, " \
+  "RGBA, BGRA, ARGB, ABGR, RGB16, BGR16 }"
+
+static GstStaticCaps soft_caps =
+GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_RGA_SOFT_FORMATS));
+
+typedef struct
+{
+  gint y0, y1;                  /* rows of the intermediate frame */
+} GstRGASoftBand;
+
+struct _GstRGASoftConverter
+{
+  GstElement *element;
+
+  GstVideoInfo in;
+  GstVideoInfo out;
+  GstVideoRectangle dest;
+
+  /* a single converter, so the filter taps cross the whole frame */
+  GstVideoConverter *convert;
+
+  /* rotation and flips run as a second pass on a scaled copy */
+  gboolean transform;
+  GstVideoInfo mid;
+  GstBuffer *mid_buf;
+  guint rotation;
+  gboolean hflip;
+  gboolean vflip;
+
+  /* the second pass is cut in bands, all but the first run in the pool */
+  GstRGASoftBand *bands;
+  guint n_bands;
+  GThreadPool *pool;
+  GMutex lock;
+  GCond cond;
+  guint pending;
+
+  GstVideoFrame src_frame;
+  GstVideoFrame mid_frame;
+  GstVideoFrame dest_frame;
+};
+
+GstCaps *
+gst_rga_soft_converter_get_caps (void)
+{
+  return gst_static_caps_get (&soft_caps);
+}
+
+/* every component of a plane must be sampled alike to move whole pixels,
+ * and a quarter turn needs the same subsampling in both directions */
+static gboolean
+gst_rga_soft_converter_can_transform (const GstVideoFormatInfo * finfo,
+    gboolean swap)
+{
+  guint c, first;
+
+  if (GST_VIDEO_FORMAT_INFO_IS_COMPLEX (finfo)
+      || GST_VIDEO_FORMAT_INFO_IS_TILED (finfo))
+    return FALSE;
+
+  for (c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); c++) {
+    for (first = 0; first < c; first++)
+      if (GST_VIDEO_FORMAT_INFO_PLANE (finfo, first) ==
+          GST_VIDEO_FORMAT_INFO_PLANE (finfo, c))
+        break;
+
+    if (GST_VIDEO_FORMAT_INFO_W_SUB (finfo, c) !=
+        GST_VIDEO_FORMAT_INFO_W_SUB (finfo, first)
+        || GST_VIDEO_FORMAT_INFO_H_SUB (finfo, c) !=
+        GST_VIDEO_FORMAT_INFO_H_SUB (finfo, first))
+      return FALSE;
+
+    if (swap && GST_VIDEO_FORMAT_INFO_W_SUB (finfo, c) !=
+        GST_VIDEO_FORMAT_INFO_H_SUB (finfo, c))
+      return FALSE;
+
+    if (GST_VIDEO_FORMAT_INFO_PSTRIDE (finfo, c) == 0)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_rga_soft_converter_copy_row (const guint8 * s, guint8 * d, gint width,
+    gint bpp, gssize step)
+{
+  gint x;
+
+  switch (bpp) {
+    case 1:
+      for (x = 0; x < width; x++, d += step)
+        *d = s[x];
+      break;
+    case 2:
+      for (x = 0; x < width; x++, d += step)
+        memcpy (d, s + 2 * x, 2);
+      break;
+    case 4:
+      for (x = 0; x < width; x++, d += step)
+        memcpy (d, s + 4 * x, 4);
+      break;
+    default:
+      for (x = 0; x < width; x++, d += step)
+        memcpy (d, s + bpp * x, bpp);
+      break;
+  }
+}
+
+/* move rows [@y0, @y1) of the intermediate frame to where they land in the
+ * output, as ox = cx + ax * x + bx * y and oy = cy + ay * x + by * y */
+static void
+gst_rga_soft_converter_transform_band (GstRGASoftConverter * conv, gint y0,
+    gint y1)
+{
+  const GstVideoFormatInfo *finfo = conv->mid.finfo;
+  gboolean swap = conv->rotation == 90 || conv->rotation == 270;
+  guint p, c;
+
+  for (p = 0; p < GST_VIDEO_FORMAT_INFO_N_PLANES (finfo); p++) {
+    gint w, h, ow, oh, py0, py1, bpp, y;
+    gint ax, bx, cx, ay, by, cy;
+    gint sstride, dstride;
+    guint8 *sdata, *ddata;
+
+    for (c = 0; GST_VIDEO_FORMAT_INFO_PLANE (finfo, c) != p; c++);
+
+    w = GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, c,
+        GST_VIDEO_INFO_WIDTH (&conv->mid));
+    h = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c,
+        GST_VIDEO_INFO_HEIGHT (&conv->mid));
+    ow = swap ? h : w;
+    oh = swap ? w : h;
+    py0 = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c, y0);
+    py1 = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c, y1);
+    bpp = GST_VIDEO_FORMAT_INFO_PSTRIDE (finfo, c);
+
+    switch (conv->rotation) {
+      case 90:
+        ax = 0, bx = -1, cx = h - 1, ay = 1, by = 0, cy = 0;
+        break;
+      case 180:
+        ax = -1, bx = 0, cx = w - 1, ay = 0, by = -1, cy = h - 1;
+        break;
+      case 270:
+        ax = 0, bx = 1, cx = 0, ay = -1, by = 0, cy = w - 1;
+        break;
+      default:
+        ax = 1, bx = 0, cx = 0, ay = 0, by = 1, cy = 0;
+        break;
+    }
+
+    if (conv->hflip)
+      ax = -ax, bx = -bx, cx = ow - 1 - cx;
+    if (conv->vflip)
+      ay = -ay, by = -by, cy = oh - 1 - cy;
+
+    sstride = GST_VIDEO_FRAME_PLANE_STRIDE (&conv->mid_frame, p);
+    sdata = GST_VIDEO_FRAME_PLANE_DATA (&conv->mid_frame, p);
+    dstride = GST_VIDEO_FRAME_PLANE_STRIDE (&conv->dest_frame, p);
+    ddata = GST_VIDEO_FRAME_PLANE_DATA (&conv->dest_frame, p);
+    ddata += GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, c, conv->dest.y) *
+        dstride;
+    ddata += GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, c, conv->dest.x) * bpp;
+
+    for (y = py0; y < py1; y++)
+      gst_rga_soft_converter_copy_row (sdata + y * sstride,
+          ddata + (cy + by * y) * dstride + (cx + bx * y) * bpp, w, bpp,
+          ay * dstride + ax * bpp);
+  }
+}
+
+static void
+gst_rga_soft_converter_run_band (GstRGASoftBand * band,
+    GstRGASoftConverter * conv)
+{
+  gst_rga_soft_converter_transform_band (conv, band->y0, band->y1);
+
+  g_mutex_lock (&conv->lock);
+  if (--conv->pending == 0)
+    g_cond_signal (&conv->cond);
+  g_mutex_unlock (&conv->lock);
+}
+
+/* edge @i of @n bands of @len rows */
+static gint
+gst_rga_soft_converter_band_edge (gint len, guint n, guint i)
+{
+  if (i == n)
+    return len;
+
+  return GST_ROUND_DOWN_N (len * i / n, GST_RGA_SOFT_BAND_ALIGN);
+}
+
+GstRGASoftConverter *
+gst_rga_soft_converter_new (GstElement * element, GstVideoInfo * in,
+    GstVideoInfo * out, GstVideoRectangle * src, GstVideoRectangle * dest,
+    guint rotation, gboolean hflip, gboolean vflip, guint n_threads)
+{
+  GstRGASoftConverter *conv;
+  GstVideoRectangle rect;
+  GstVideoInfo *target;
+  gboolean swap = rotation == 90 || rotation == 270;
+  GstStructure *config;
+  guint i, n;
+
+  if ((rotation != 0 || hflip || vflip)
+      && !gst_rga_soft_converter_can_transform (out->finfo, swap)) {
+    GST_WARNING_OBJECT (element, "can't rotate or flip %s in software",
+        GST_VIDEO_INFO_NAME (out));
+    return NULL;
+  }
+
+  conv = g_new0 (GstRGASoftConverter, 1);
+  conv->element = element;
+  conv->in = *in;
+  conv->out = *out;
+  conv->dest = *dest;
+  conv->rotation = rotation;
+  conv->hflip = hflip;
+  conv->vflip = vflip;
+  conv->transform = rotation != 0 || hflip || vflip;
+  g_mutex_init (&conv->lock);
+  g_cond_init (&conv->cond);
+
+  if (conv->transform) {
+    /* whole pixels of the subsampled planes */
+    conv->dest.x = GST_ROUND_DOWN_2 (dest->x);
+    conv->dest.y = GST_ROUND_DOWN_2 (dest->y);
+
+    gst_video_info_set_format (&conv->mid, GST_VIDEO_INFO_FORMAT (out),
+        swap ? dest->h : dest->w, swap ? dest->w : dest->h);
+    conv->mid.colorimetry = out->colorimetry;
+    conv->mid.chroma_site = out->chroma_site;
+    conv->mid_buf = gst_buffer_new_allocate (NULL,
+        GST_VIDEO_INFO_SIZE (&conv->mid), NULL);
+
+    target = &conv->mid;
+    rect.x = rect.y = 0;
+    rect.w = GST_VIDEO_INFO_WIDTH (&conv->mid);
+    rect.h = GST_VIDEO_INFO_HEIGHT (&conv->mid);
+  } else {
+    target = &conv->out;
+    rect = conv->dest;
+  }
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  config = gst_structure_new ("GstRGASoftConverter",
+      GST_VIDEO_CONVERTER_OPT_SRC_X, G_TYPE_INT, src->x,
+      GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, src->y,
+      GST_VIDEO_CONVERTER_OPT_SRC_WIDTH, G_TYPE_INT, src->w,
+      GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, src->h,
+      GST_VIDEO_CONVERTER_OPT_DEST_X, G_TYPE_INT, rect.x,
+      GST_VIDEO_CONVERTER_OPT_DEST_Y, G_TYPE_INT, rect.y,
+      GST_VIDEO_CONVERTER_OPT_DEST_WIDTH, G_TYPE_INT, rect.w,
+      GST_VIDEO_CONVERTER_OPT_DEST_HEIGHT, G_TYPE_INT, rect.h,
+      GST_VIDEO_CONVERTER_OPT_RESAMPLER_METHOD,
+      GST_TYPE_VIDEO_RESAMPLER_METHOD, GST_VIDEO_RESAMPLER_METHOD_LINEAR,
+      GST_VIDEO_CONVERTER_OPT_CHROMA_RESAMPLER_METHOD,
+      GST_TYPE_VIDEO_RESAMPLER_METHOD, GST_VIDEO_RESAMPLER_METHOD_LINEAR,
+      GST_VIDEO_CONVERTER_OPT_DITHER_METHOD,
+      GST_TYPE_VIDEO_DITHER_METHOD, GST_VIDEO_DITHER_NONE,
+      /* like the RGA, leave the output outside the rectangle alone */
+      GST_VIDEO_CONVERTER_OPT_FILL_BORDER, G_TYPE_BOOLEAN, FALSE, NULL);
+  /* older converters scale on the calling thread only */
+#if GST_CHECK_VERSION (1, 14, 0)
+  gst_structure_set (config, GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT,
+      n_threads, NULL);
+#endif
+
+  conv->convert = gst_video_converter_new (in, target, config);
+  if (!conv->convert)
+    goto no_converter;
+
+  n = 1;
+  if (conv->transform) {
+    n = MIN (n_threads, rect.h / GST_RGA_SOFT_MIN_BAND_ROWS);
+    n = MAX (n, 1);
+  }
+
+  conv->bands = g_new0 (GstRGASoftBand, n);
+  conv->n_bands = n;
+
+  for (i = 0; i < n; i++) {
+    conv->bands[i].y0 = gst_rga_soft_converter_band_edge (rect.h, n, i);
+    conv->bands[i].y1 = gst_rga_soft_converter_band_edge (rect.h, n, i + 1);
+  }
+
+  if (n > 1) {
+    conv->pool = g_thread_pool_new ((GFunc) gst_rga_soft_converter_run_band,
+        conv, n - 1, FALSE, NULL);
+    if (!conv->pool)
+      goto no_converter;
+  }
+
+  GST_INFO_OBJECT (element, "software conversion %s %dx%d -> %s %dx%d "
+      "rotation %u on %u threads", GST_VIDEO_INFO_NAME (in), src->w, src->h,
+      GST_VIDEO_INFO_NAME (out), dest->w, dest->h, rotation, n_threads);
+
+  return conv;
+
+no_converter:
+  {
+    GST_WARNING_OBJECT (element, "no software conversion from %s to %s",
+        GST_VIDEO_INFO_NAME (in), GST_VIDEO_INFO_NAME (out));
+    gst_rga_soft_converter_free (conv);
+    return NULL;
+  }
+}
+
+void
+gst_rga_soft_converter_free (GstRGASoftConverter * conv)
+{
+  if (conv->pool)
+    g_thread_pool_free (conv->pool, FALSE, TRUE);
+
+  if (conv->convert)
+    gst_video_converter_free (conv->convert);
+  g_free (conv->bands);
+
+  gst_buffer_replace (&conv->mid_buf, NULL);
+  g_mutex_clear (&conv->lock);
+  g_cond_clear (&conv->cond);
+
+  g_free (conv);
+}
+
+gboolean
+gst_rga_soft_converter_process (GstRGASoftConverter * conv,
+    GstBuffer * inbuf, GstBuffer * outbuf)
+{
+  guint i;
+
+  if (!gst_video_frame_map (&conv->src_frame, &conv->in, inbuf, GST_MAP_READ))
+    goto map_failed;
+
+  if (!gst_video_frame_map (&conv->dest_frame, &conv->out, outbuf,
+          GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&conv->src_frame);
+    goto map_failed;
+  }
+
+  if (conv->transform && !gst_video_frame_map (&conv->mid_frame, &conv->mid,
+          conv->mid_buf, GST_MAP_READWRITE)) {
+    gst_video_frame_unmap (&conv->dest_frame);
+    gst_video_frame_unmap (&conv->src_frame);
+    goto map_failed;
+  }
+
+  gst_video_converter_frame (conv->convert, &conv->src_frame,
+      conv->transform ? &conv->mid_frame : &conv->dest_frame);
+
+  if (conv->transform) {
+    conv->pending = conv->n_bands;
+    for (i = 1; i < conv->n_bands; i++)
+      g_thread_pool_push (conv->pool, &conv->bands[i], NULL);
+    gst_rga_soft_converter_run_band (&conv->bands[0], conv);
+
+    g_mutex_lock (&conv->lock);
+    while (conv->pending > 0)
+      g_cond_wait (&conv->cond, &conv->lock);
+    g_mutex_unlock (&conv->lock);
+
+    gst_video_frame_unmap (&conv->mid_frame);
+  }
+  gst_video_frame_unmap (&conv->dest_frame);
+  gst_video_frame_unmap (&conv->src_frame);
+
+  return TRUE;
+
+map_failed:
+  {
+    GST_ERROR_OBJECT (conv->element, "failed to map frames");
+    return FALSE;
+  }
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_SOFT_CONVERT_H__
+#define __GST_RGA_SOFT_CONVERT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstRGASoftConverter GstRGASoftConverter;
+
+/* formats the software path converts between */
+GstCaps *gst_rga_soft_converter_get_caps (void);
+
+/* does what the RGA would: scale @src of the input into @dest of the
+ * output, then rotate by @rotation degrees and flip. NULL if the formats
+ * can't be converted or rotated in software */
+GstRGASoftConverter *gst_rga_soft_converter_new (GstElement * element,
+    GstVideoInfo * in, GstVideoInfo * out, GstVideoRectangle * src,
+    GstVideoRectangle * dest, guint rotation, gboolean hflip, gboolean vflip,
+    guint n_threads);
+void gst_rga_soft_converter_free (GstRGASoftConverter * conv);
+
+gboolean gst_rga_soft_converter_process (GstRGASoftConverter * conv,
+    GstBuffer * inbuf, GstBuffer * outbuf);
+
+G_END_DECLS
+#endif /* __GST_RGA_SOFT_CONVERT_H__ */
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rgastats.h"
+
+/* frames the latencies and the frame rate are computed over */
+#define GST_RGA_STATS_WINDOW 256
+
+struct _GstRGAStats
+{
+  GMutex lock;
+
+  guint64 frames;
+  guint64 corrupted;
+  guint64 dropped;
+  guint64 bytes_in;
+  guint64 bytes_out;
+
+  /* ring of the last frames */
+  GstClockTime latency[GST_RGA_STATS_WINDOW];
+  GstClockTime wait[GST_RGA_STATS_WINDOW];
+  GstClockTime done[GST_RGA_STATS_WINDOW];
+  guint n;
+  guint pos;
+
+  GstClockTime last_post;
+};
+
+GstRGAStats *
+gst_rga_stats_new (void)
+{
+  GstRGAStats *stats = g_new0 (GstRGAStats, 1);
+
+  g_mutex_init (&stats->lock);
+  stats->last_post = GST_CLOCK_TIME_NONE;
+
+  return stats;
+}
+
+void
+gst_rga_stats_free (GstRGAStats * stats)
+{
+  g_mutex_clear (&stats->lock);
+  g_free (stats);
+}
+
+void
+gst_rga_stats_reset (GstRGAStats * stats)
+{
+  g_mutex_lock (&stats->lock);
+  stats->frames = stats->corrupted = stats->dropped = 0;
+  stats->bytes_in = stats->bytes_out = 0;
+  stats->n = stats->pos = 0;
+  stats->last_post = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&stats->lock);
+}
+
+void
+gst_rga_stats_add_frame (GstRGAStats * stats, GstClockTime wait,
+    GstClockTime latency, gsize bytes_in, gsize bytes_out)
+{
+  g_mutex_lock (&stats->lock);
+  stats->frames++;
+  stats->bytes_in += bytes_in;
+  stats->bytes_out += bytes_out;
+
+  stats->latency[stats->pos] = latency;
+  stats->wait[stats->pos] = wait;
+  stats->done[stats->pos] = gst_util_get_timestamp ();
+  stats->pos = (stats->pos + 1) % GST_RGA_STATS_WINDOW;
+  stats->n = MIN (stats->n + 1, GST_RGA_STATS_WINDOW);
+  g_mutex_unlock (&stats->lock);
+}
+
+void
+gst_rga_stats_add_corrupted (GstRGAStats * stats, gboolean dropped)
+{
+  g_mutex_lock (&stats->lock);
+  stats->corrupted++;
+  if (dropped)
+    stats->dropped++;
+  g_mutex_unlock (&stats->lock);
+}
+
+static gint
+gst_rga_stats_compare (gconstpointer a, gconstpointer b)
+{
+  GstClockTime ta = *(const GstClockTime *) a;
+  GstClockTime tb = *(const GstClockTime *) b;
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+GstStructure *
+gst_rga_stats_get (GstRGAStats * stats)
+{
+  GstClockTime sorted[GST_RGA_STATS_WINDOW];
+  GstClockTime latency_sum = 0, wait_sum = 0, wait_max = 0, span;
+  GstClockTime min = 0, avg = 0, p99 = 0, max = 0, wait_avg = 0;
+  gdouble fps = 0;
+  GstStructure *s;
+  guint i, first, last;
+
+  g_mutex_lock (&stats->lock);
+
+  if (stats->n > 0) {
+    for (i = 0; i < stats->n; i++) {
+      latency_sum += stats->latency[i];
+      wait_sum += stats->wait[i];
+      wait_max = MAX (wait_max, stats->wait[i]);
+    }
+
+    memcpy (sorted, stats->latency, stats->n * sizeof (GstClockTime));
+    qsort (sorted, stats->n, sizeof (GstClockTime), gst_rga_stats_compare);
+
+    min = sorted[0];
+    max = sorted[stats->n - 1];
+    p99 = sorted[(stats->n - 1) * 99 / 100];
+    avg = latency_sum / stats->n;
+    wait_avg = wait_sum / stats->n;
+
+    /* frames completed over the window */
+    last = (stats->pos + GST_RGA_STATS_WINDOW - 1) % GST_RGA_STATS_WINDOW;
+    first = stats->n < GST_RGA_STATS_WINDOW ? 0 : stats->pos;
+    span = stats->done[last] - stats->done[first];
+    if (stats->n > 1 && span > 0)
+      fps = (gdouble) (stats->n - 1) * GST_SECOND / span;
+  }
+
+  s = gst_structure_new ("GstRGAStats",
+      "frames", G_TYPE_UINT64, stats->frames,
+      "corrupted", G_TYPE_UINT64, stats->corrupted,
+      "dropped", G_TYPE_UINT64, stats->dropped,
+      "bytes-in", G_TYPE_UINT64, stats->bytes_in,
+      "bytes-out", G_TYPE_UINT64, stats->bytes_out,
+      "fps", G_TYPE_DOUBLE, fps,
+      "min-latency", G_TYPE_UINT64, min,
+      "avg-latency", G_TYPE_UINT64, avg,
+      "p99-latency", G_TYPE_UINT64, p99,
+      "max-latency", G_TYPE_UINT64, max,
+      "avg-queue-time", G_TYPE_UINT64, wait_avg,
+      "max-queue-time", G_TYPE_UINT64, wait_max, NULL);
+
+  g_mutex_unlock (&stats->lock);
+
+  return s;
+}
+
+gboolean
+gst_rga_stats_due (GstRGAStats * stats, GstClockTime interval)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+  gboolean due = FALSE;
+
+  g_mutex_lock (&stats->lock);
+  if (!GST_CLOCK_TIME_IS_VALID (stats->last_post))
+    stats->last_post = now;
+  else if (now - stats->last_post >= interval) {
+    stats->last_post = now;
+    due = TRUE;
+  }
+  g_mutex_unlock (&stats->lock);
+
+  return due;
+}
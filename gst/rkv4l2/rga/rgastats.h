@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_STATS_H__
+#define __GST_RGA_STATS_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstRGAStats GstRGAStats;
+
+/* counters since the last reset, latencies over the last frames only */
+GstRGAStats *gst_rga_stats_new (void);
+void gst_rga_stats_free (GstRGAStats * stats);
+void gst_rga_stats_reset (GstRGAStats * stats);
+
+/* @wait is the time spent waiting for the RGA, @latency from queueing the
+ * job to getting the output back */
+void gst_rga_stats_add_frame (GstRGAStats * stats, GstClockTime wait,
+    GstClockTime latency, gsize bytes_in, gsize bytes_out);
+void gst_rga_stats_add_corrupted (GstRGAStats * stats, gboolean dropped);
+
+GstStructure *gst_rga_stats_get (GstRGAStats * stats);
+
+/* TRUE at most once per @interval, to post the stats periodically */
+gboolean gst_rga_stats_due (GstRGAStats * stats, GstClockTime interval);
+
+G_END_DECLS
+#endif /* __GST_RGA_STATS_H__ */
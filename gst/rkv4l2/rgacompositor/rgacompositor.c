@@ -0,0 +1,1218 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/**
+ * SECTION:element-rgacompositor
+ *
+ * Composes several video streams into one with the RGA. Every sink pad
+ * gets its own m2m context on the RGA device and blits its frames into the
+ * compose rectangle (xpos, ypos, width, height) of a shared output buffer.
+ * Pads are blitted in increasing zorder. Output buffers are dmabuf backed
+ * DRM dumb buffers, so they can be imported by kmssink without a copy.
+ *
+ * The output runs at the highest framerate of the pads. The last frame of
+ * a slower pad is blitted again until its next one is due. Areas not
+ * covered by any pad are black.
+ *
+ * <refsect2>
+ * |[
+ * gst-launch-1.0 rgacompositor name=c sink_1::xpos=640 ! kmssink \
+ *     v4l2src device=/dev/video0 ! c. \
+ *     v4l2src device=/dev/video1 ! c.
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gst/allocators/gstdmabuf.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+
+#include "common.h"
+#include "rga/rgadmabuf.h"
+#include "rgacompositor.h"
+
+#include <gst/gst-i18n-plugin.h>
+
+#define DEFAULT_PROP_DRM_DEVICE "/dev/dri/card0"
+
+#define DEFAULT_PAD_XPOS 0
+#define DEFAULT_PAD_YPOS 0
+#define DEFAULT_PAD_WIDTH 0
+#define DEFAULT_PAD_HEIGHT 0
+
+/* output buffers, also the number of capture buffers of every context */
+#define GST_RGA_COMPOSITOR_MAX_BUFFERS 4
+
+GST_DEBUG_CATEGORY_STATIC (gst_rga_compositor_debug);
+#define GST_CAT_DEFAULT gst_rga_compositor_debug
+
+static GstStaticPadTemplate gst_rga_compositor_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("video/x-raw, "
+        "framerate = (fraction) [ 0, MAX ], "
+        "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]")
+    );
+
+static GstStaticPadTemplate gst_rga_compositor_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw, "
+        "framerate = (fraction) [ 0, MAX ], "
+        "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]")
+    );
+
+/*
+ * GstRGACompositorPad
+ */
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ZORDER,
+};
+
+G_DEFINE_TYPE (GstRGACompositorPad, gst_rga_compositor_pad, GST_TYPE_PAD);
+
+static gint
+gst_rga_compositor_pad_compare (gconstpointer a, gconstpointer b)
+{
+  const GstRGACompositorPad *pad1 = a;
+  const GstRGACompositorPad *pad2 = b;
+
+  return (gint) pad1->zorder - (gint) pad2->zorder;
+}
+
+static void
+gst_rga_compositor_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (object);
+  GstRGACompositor *self =
+      GST_RGA_COMPOSITOR (gst_pad_get_parent (GST_PAD (pad)));
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      pad->xpos = g_value_get_int (value);
+      break;
+    case PROP_PAD_YPOS:
+      pad->ypos = g_value_get_int (value);
+      break;
+    case PROP_PAD_WIDTH:
+      pad->width = g_value_get_int (value);
+      break;
+    case PROP_PAD_HEIGHT:
+      pad->height = g_value_get_int (value);
+      break;
+    case PROP_PAD_ZORDER:
+      pad->zorder = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  pad->compose_changed = TRUE;
+  GST_OBJECT_UNLOCK (pad);
+
+  /* the output size follows the pad rectangles */
+  if (self) {
+    GST_OBJECT_LOCK (self);
+    self->sinkpads = g_list_sort (self->sinkpads,
+        gst_rga_compositor_pad_compare);
+    self->need_reconfigure = TRUE;
+    GST_OBJECT_UNLOCK (self);
+    gst_object_unref (self);
+  }
+}
+
+static void
+gst_rga_compositor_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      g_value_set_int (value, pad->xpos);
+      break;
+    case PROP_PAD_YPOS:
+      g_value_set_int (value, pad->ypos);
+      break;
+    case PROP_PAD_WIDTH:
+      g_value_set_int (value, pad->width);
+      break;
+    case PROP_PAD_HEIGHT:
+      g_value_set_int (value, pad->height);
+      break;
+    case PROP_PAD_ZORDER:
+      g_value_set_uint (value, pad->zorder);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+gst_rga_compositor_pad_finalize (GObject * object)
+{
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (object);
+
+  if (pad->ctx)
+    gst_rga_context_free (pad->ctx);
+  gst_caps_replace (&pad->caps, NULL);
+  gst_buffer_replace (&pad->buffer, NULL);
+
+  G_OBJECT_CLASS (gst_rga_compositor_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_rga_compositor_pad_init (GstRGACompositorPad * pad)
+{
+  pad->xpos = DEFAULT_PAD_XPOS;
+  pad->ypos = DEFAULT_PAD_YPOS;
+  pad->width = DEFAULT_PAD_WIDTH;
+  pad->height = DEFAULT_PAD_HEIGHT;
+}
+
+static void
+gst_rga_compositor_pad_class_init (GstRGACompositorPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_rga_compositor_pad_set_property;
+  gobject_class->get_property = gst_rga_compositor_pad_get_property;
+  gobject_class->finalize = gst_rga_compositor_pad_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+      g_param_spec_int ("xpos", "X Position", "X position of the picture",
+          0, G_MAXINT, DEFAULT_PAD_XPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+      g_param_spec_int ("ypos", "Y Position", "Y position of the picture",
+          0, G_MAXINT, DEFAULT_PAD_YPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Width of the picture, 0 to use the input width",
+          0, G_MAXINT, DEFAULT_PAD_WIDTH,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Height of the picture, 0 to use the input height",
+          0, G_MAXINT, DEFAULT_PAD_HEIGHT,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
+      g_param_spec_uint ("zorder", "Z-Order", "Z order of the picture",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+}
+
+/*
+ * per pad m2m context
+ */
+
+/* the area of the output @pad is blitted into, call with the pad lock */
+static void
+gst_rga_compositor_pad_get_rect (GstRGACompositor * self,
+    GstRGACompositorPad * pad, struct v4l2_rect *rect)
+{
+  rect->left = pad->xpos;
+  rect->top = pad->ypos;
+  rect->width = pad->width > 0 ? pad->width : GST_VIDEO_INFO_WIDTH (&pad->info);
+  rect->height =
+      pad->height > 0 ? pad->height : GST_VIDEO_INFO_HEIGHT (&pad->info);
+
+  /* the output is sized to fit every pad, but it may not be updated yet */
+  rect->width = MIN (rect->width,
+      MAX (GST_VIDEO_INFO_WIDTH (&self->info) - (gint) rect->left, 0));
+  rect->height = MIN (rect->height,
+      MAX (GST_VIDEO_INFO_HEIGHT (&self->info) - (gint) rect->top, 0));
+}
+
+static void
+gst_rga_compositor_pad_set_compose (GstRGACompositor * self,
+    GstRGACompositorPad * pad)
+{
+  struct v4l2_rect rect;
+
+  GST_OBJECT_LOCK (pad);
+  gst_rga_compositor_pad_get_rect (self, pad, &rect);
+  pad->compose_changed = FALSE;
+  GST_OBJECT_UNLOCK (pad);
+
+  /* the rockchip RGA driver takes the compose rectangle on the output
+   * queue, like rgaconvert and its stripes */
+  if (!rk_common_v4l2_set_selection (pad->ctx->v4l2output, &rect, TRUE))
+    GST_WARNING_OBJECT (pad, "failed to set compose rectangle");
+}
+
+static gboolean
+gst_rga_compositor_pad_configure (GstRGACompositor * self,
+    GstRGACompositorPad * pad)
+{
+  /* one capture buffer per output buffer */
+  if (!gst_rga_context_configure (pad->ctx, pad->caps, self->srccaps,
+          GST_RGA_COMPOSITOR_MAX_BUFFERS))
+    return FALSE;
+
+  gst_rga_compositor_pad_set_compose (self, pad);
+
+  return TRUE;
+}
+
+/*
+ * GstRGACompositor
+ */
+
+enum
+{
+  PROP_0,
+  PROP_DEVICE,
+  PROP_DRM_DEVICE,
+};
+
+#define gst_rga_compositor_parent_class parent_class
+G_DEFINE_TYPE (GstRGACompositor, gst_rga_compositor, GST_TYPE_ELEMENT);
+
+static void
+gst_rga_compositor_clear_pools (GstRGACompositor * self)
+{
+  if (self->pool) {
+    gst_buffer_pool_set_active (self->pool, FALSE);
+    gst_object_unref (self->pool);
+    self->pool = NULL;
+  }
+
+  if (self->out_pool) {
+    gst_buffer_pool_set_active (self->out_pool, FALSE);
+    gst_object_unref (self->out_pool);
+    self->out_pool = NULL;
+  }
+  self->copy_out = FALSE;
+
+  gst_buffer_replace (&self->bg_buffer, NULL);
+}
+
+/* size the output to fit every pad and pick a format downstream likes */
+static gboolean
+gst_rga_compositor_negotiate (GstRGACompositor * self)
+{
+  GstRGACompositorPad *first = NULL;
+  GstCaps *caps, *peercaps, *filter;
+  GstStructure *s;
+  GList *l;
+  gint width = 0, height = 0, fps_n = 0, fps_d = 1;
+
+  GST_OBJECT_LOCK (self);
+  self->need_reconfigure = FALSE;
+  for (l = self->sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+    gint w, h;
+
+    if (!pad->caps)
+      continue;
+
+    if (!first)
+      first = pad;
+
+    GST_OBJECT_LOCK (pad);
+    w = pad->width > 0 ? pad->width : GST_VIDEO_INFO_WIDTH (&pad->info);
+    h = pad->height > 0 ? pad->height : GST_VIDEO_INFO_HEIGHT (&pad->info);
+    width = MAX (width, pad->xpos + w);
+    height = MAX (height, pad->ypos + h);
+    GST_OBJECT_UNLOCK (pad);
+
+    if (gst_util_fraction_compare (GST_VIDEO_INFO_FPS_N (&pad->info),
+            GST_VIDEO_INFO_FPS_D (&pad->info), fps_n, fps_d) > 0) {
+      fps_n = GST_VIDEO_INFO_FPS_N (&pad->info);
+      fps_d = GST_VIDEO_INFO_FPS_D (&pad->info);
+    }
+  }
+  if (first)
+    gst_object_ref (first);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!first)
+    goto no_input;
+
+  /* formats the RGA can write */
+  filter = gst_v4l2_object_get_caps (first->ctx->v4l2capture,
+      gst_v4l2_object_get_raw_caps ());
+  gst_object_unref (first);
+
+  peercaps = gst_pad_peer_query_caps (self->srcpad, filter);
+  gst_caps_unref (filter);
+  if (gst_caps_is_empty (peercaps)) {
+    gst_caps_unref (peercaps);
+    goto no_format;
+  }
+
+  caps = gst_caps_make_writable (gst_caps_truncate (peercaps));
+  s = gst_caps_get_structure (caps, 0);
+  gst_structure_set (s, "width", G_TYPE_INT, width, "height", G_TYPE_INT,
+      height, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+  if (gst_structure_has_field (s, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio", 1, 1);
+  caps = gst_caps_fixate (caps);
+
+  if (self->srccaps && gst_caps_is_equal (caps, self->srccaps)) {
+    gst_caps_unref (caps);
+    return TRUE;
+  }
+
+  GST_DEBUG_OBJECT (self, "output caps %" GST_PTR_FORMAT, caps);
+
+  if (self->send_stream_start) {
+    gchar *stream_id = gst_pad_create_stream_id (self->srcpad,
+        GST_ELEMENT_CAST (self), NULL);
+
+    gst_pad_push_event (self->srcpad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    self->send_stream_start = FALSE;
+  }
+
+  if (!gst_pad_set_caps (self->srcpad, caps)) {
+    gst_caps_unref (caps);
+    goto no_format;
+  }
+
+  if (self->send_segment) {
+    GstSegment segment;
+
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (self->srcpad, gst_event_new_segment (&segment));
+    self->send_segment = FALSE;
+  }
+
+  gst_video_info_from_caps (&self->info, caps);
+  gst_caps_replace (&self->srccaps, caps);
+  gst_caps_unref (caps);
+
+  /* every context writes the new format, and the output pool goes too */
+  GST_OBJECT_LOCK (self);
+  for (l = self->sinkpads; l; l = l->next)
+    GST_RGA_COMPOSITOR_PAD (l->data)->reconfigure = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_rga_compositor_clear_pools (self);
+
+  return TRUE;
+
+no_input:
+  {
+    GST_DEBUG_OBJECT (self, "no input configured yet");
+    return FALSE;
+  }
+no_format:
+  {
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("no output format downstream accepts"));
+    return FALSE;
+  }
+}
+
+/* whether downstream reads the output buffers as they are, or needs them
+ * copied into its own */
+static gboolean
+gst_rga_compositor_decide_allocation (GstRGACompositor * self,
+    GstVideoInfo * layout)
+{
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstQuery *query;
+  gboolean video_meta;
+  guint i, size, min = 0, max = 0;
+
+  query = gst_query_new_allocation (self->srccaps, TRUE);
+  if (!gst_pad_peer_query (self->srcpad, query))
+    GST_DEBUG_OBJECT (self, "downstream didn't answer the allocation query");
+
+  video_meta = gst_query_find_allocation_meta (query,
+      GST_VIDEO_META_API_TYPE, NULL);
+
+  self->copy_out = FALSE;
+  if (!video_meta) {
+    for (i = 0; i < GST_VIDEO_INFO_N_PLANES (&self->info); i++)
+      if (GST_VIDEO_INFO_PLANE_STRIDE (layout, i) !=
+          GST_VIDEO_INFO_PLANE_STRIDE (&self->info, i) ||
+          GST_VIDEO_INFO_PLANE_OFFSET (layout, i) !=
+          GST_VIDEO_INFO_PLANE_OFFSET (&self->info, i))
+        self->copy_out = TRUE;
+  }
+
+  if (!self->copy_out) {
+    gst_query_unref (query);
+    return TRUE;
+  }
+
+  GST_INFO_OBJECT (self, "downstream has no video meta, copying the output");
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  if (!pool)
+    pool = gst_video_buffer_pool_new ();
+  gst_query_unref (query);
+
+  size = GST_VIDEO_INFO_SIZE (&self->info);
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, self->srccaps, size, min, max);
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    gst_object_unref (pool);
+    return FALSE;
+  }
+  self->out_pool = pool;
+
+  return TRUE;
+}
+
+/* a black frame the background context scales over the whole output */
+static gboolean
+gst_rga_compositor_configure_background (GstRGACompositor * self)
+{
+  GstRKV4l2Object *obj;
+  GstVideoInfo info;
+  GstCaps *caps;
+  gboolean ret;
+
+  if (!self->bg) {
+    self->bg = gst_rga_context_new (GST_ELEMENT (self), self->videodev);
+    if (!self->bg)
+      return FALSE;
+  }
+
+  /* black scaled up stays black, only a quarter of it is read */
+  gst_video_info_set_format (&info, GST_VIDEO_FORMAT_BGRx,
+      GST_ROUND_UP_2 (MAX (GST_VIDEO_INFO_WIDTH (&self->info) / 4, 2)),
+      GST_ROUND_UP_2 (MAX (GST_VIDEO_INFO_HEIGHT (&self->info) / 4, 2)));
+  caps = gst_video_info_to_caps (&info);
+  ret = gst_rga_context_configure (self->bg, caps, self->srccaps,
+      GST_RGA_COMPOSITOR_MAX_BUFFERS);
+  gst_caps_unref (caps);
+  if (!ret)
+    return FALSE;
+
+  obj = self->bg->v4l2output;
+  self->bg_buffer = gst_rga_dmabuf_alloc (self->drm_fd, self->allocator,
+      &obj->info, MAX (GST_VIDEO_INFO_SIZE (&obj->info),
+          obj->format.fmt.pix.sizeimage));
+  if (!self->bg_buffer)
+    return FALSE;
+
+  gst_buffer_memset (self->bg_buffer, 0, 0,
+      gst_buffer_get_size (self->bg_buffer));
+
+  return TRUE;
+}
+
+static gint
+gst_rga_compositor_compare_int (gconstpointer a, gconstpointer b)
+{
+  return *(const gint *) a - *(const gint *) b;
+}
+
+/* whether the pads with a frame cover the whole output, checked on the
+ * grid of their edges */
+static gboolean
+gst_rga_compositor_covered (GstRGACompositor * self, GList * sinkpads)
+{
+  struct v4l2_rect *rects;
+  gint *xs, *ys;
+  guint i, j, k, n, n_rects = 0;
+  gboolean covered = TRUE;
+  GList *l;
+
+  n = g_list_length (sinkpads);
+  rects = g_new (struct v4l2_rect, n);
+  xs = g_new (gint, 2 * n + 2);
+  ys = g_new (gint, 2 * n + 2);
+
+  xs[0] = ys[0] = 0;
+  xs[1] = GST_VIDEO_INFO_WIDTH (&self->info);
+  ys[1] = GST_VIDEO_INFO_HEIGHT (&self->info);
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+    struct v4l2_rect *r = &rects[n_rects];
+
+    if (!pad->buffer || !pad->ctx->configured)
+      continue;
+
+    GST_OBJECT_LOCK (pad);
+    gst_rga_compositor_pad_get_rect (self, pad, r);
+    GST_OBJECT_UNLOCK (pad);
+
+    xs[2 + 2 * n_rects] = r->left;
+    xs[3 + 2 * n_rects] = r->left + r->width;
+    ys[2 + 2 * n_rects] = r->top;
+    ys[3 + 2 * n_rects] = r->top + r->height;
+    n_rects++;
+  }
+
+  qsort (xs, 2 + 2 * n_rects, sizeof (gint), gst_rga_compositor_compare_int);
+  qsort (ys, 2 + 2 * n_rects, sizeof (gint), gst_rga_compositor_compare_int);
+
+  /* every cell of the grid inside the output is in some rectangle */
+  for (i = 0; covered && i + 1 < 2 + 2 * n_rects; i++) {
+    if (xs[i] == xs[i + 1] || xs[i] >= GST_VIDEO_INFO_WIDTH (&self->info))
+      continue;
+    for (j = 0; covered && j + 1 < 2 + 2 * n_rects; j++) {
+      if (ys[j] == ys[j + 1] || ys[j] >= GST_VIDEO_INFO_HEIGHT (&self->info))
+        continue;
+
+      for (k = 0; k < n_rects; k++)
+        if (rects[k].left <= xs[i] &&
+            xs[i + 1] <= (gint) (rects[k].left + rects[k].width) &&
+            rects[k].top <= ys[j] &&
+            ys[j + 1] <= (gint) (rects[k].top + rects[k].height))
+          break;
+      if (k == n_rects)
+        covered = FALSE;
+    }
+  }
+
+  g_free (rects);
+  g_free (xs);
+  g_free (ys);
+
+  return covered;
+}
+
+static gboolean
+gst_rga_compositor_configure (GstRGACompositor * self, GList * sinkpads)
+{
+  GstRGACompositorPad *first = NULL;
+  GList *l;
+
+  if (self->need_reconfigure && !gst_rga_compositor_negotiate (self))
+    return FALSE;
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+
+    if (!pad->caps)
+      continue;
+
+    if (pad->reconfigure || !pad->ctx->configured) {
+      pad->reconfigure = FALSE;
+      if (!gst_rga_compositor_pad_configure (self, pad))
+        return FALSE;
+    } else if (pad->compose_changed) {
+      gst_rga_compositor_pad_set_compose (self, pad);
+    }
+
+    if (!first)
+      first = pad;
+  }
+
+  if (!first)
+    return FALSE;
+
+  if (!self->pool) {
+    GstRKV4l2Object *obj = first->ctx->v4l2capture;
+    gsize size = MAX (GST_VIDEO_INFO_SIZE (&obj->info),
+        obj->format.fmt.pix.sizeimage);
+
+    /* laid out as the driver expects the capture buffers */
+    self->pool = gst_rga_dmabuf_pool_new (self->drm_fd, self->allocator,
+        self->srccaps, &obj->info, size, GST_RGA_COMPOSITOR_MAX_BUFFERS);
+    if (!self->pool || !gst_buffer_pool_set_active (self->pool, TRUE))
+      goto pool_failed;
+
+    if (!gst_rga_compositor_decide_allocation (self, &obj->info))
+      goto pool_failed;
+  }
+
+  if (!self->bg_buffer && !gst_rga_compositor_configure_background (self))
+    return FALSE;
+
+  return TRUE;
+
+pool_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("failed to activate bufferpool"), ("failed to activate bufferpool"));
+    if (self->pool)
+      gst_object_unref (self->pool);
+    self->pool = NULL;
+    return FALSE;
+  }
+}
+
+/* copied into a buffer of the downstream pool, in the default layout */
+static GstBuffer *
+gst_rga_compositor_copy_out (GstRGACompositor * self, GstBuffer * outbuf)
+{
+  GstVideoFrame src, dest;
+  GstBuffer *buf = NULL;
+
+  if (gst_buffer_pool_acquire_buffer (self->out_pool, &buf, NULL) !=
+      GST_FLOW_OK)
+    goto failed;
+
+  if (!gst_video_frame_map (&src, &self->info, outbuf, GST_MAP_READ))
+    goto failed;
+  if (!gst_video_frame_map (&dest, &self->info, buf, GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&src);
+    goto failed;
+  }
+
+  gst_video_frame_copy (&dest, &src);
+  gst_video_frame_unmap (&dest);
+  gst_video_frame_unmap (&src);
+
+  gst_buffer_unref (outbuf);
+  return buf;
+
+failed:
+  {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, (NULL),
+        ("failed to copy the output for downstream"));
+    if (buf)
+      gst_buffer_unref (buf);
+    gst_buffer_unref (outbuf);
+    return NULL;
+  }
+}
+
+/* takes the frames due by the output time, the others wait for a later
+ * output frame. Returns FALSE when every pad is EOS */
+static gboolean
+gst_rga_compositor_fill_queues (GstRGACompositor * self,
+    GstCollectPads * collect, GList * sinkpads)
+{
+  GstClockTime running_time, earliest = GST_CLOCK_TIME_NONE;
+  gboolean eos = TRUE;
+  GstBuffer *buf;
+  GList *l;
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+
+    buf = gst_collect_pads_peek (collect, pad->cdata);
+    if (!buf) {
+      if (GST_COLLECT_PADS_STATE_IS_SET (pad->cdata,
+              GST_COLLECT_PADS_STATE_EOS))
+        gst_buffer_replace (&pad->buffer, NULL);
+      continue;
+    }
+
+    eos = FALSE;
+    running_time = gst_segment_to_running_time (&pad->cdata->segment,
+        GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+    if (GST_CLOCK_TIME_IS_VALID (running_time)
+        && (!GST_CLOCK_TIME_IS_VALID (earliest) || running_time < earliest))
+      earliest = running_time;
+    gst_buffer_unref (buf);
+  }
+
+  if (eos)
+    return FALSE;
+
+  /* starts with the earliest frame, and follows the frames without a
+   * framerate */
+  if (GST_CLOCK_TIME_IS_VALID (earliest) &&
+      (!GST_CLOCK_TIME_IS_VALID (self->out_time) ||
+          GST_VIDEO_INFO_FPS_N (&self->info) == 0))
+    self->out_time = earliest;
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+
+    buf = gst_collect_pads_peek (collect, pad->cdata);
+    if (!buf)
+      continue;
+
+    running_time = gst_segment_to_running_time (&pad->cdata->segment,
+        GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+    gst_buffer_unref (buf);
+
+    if (GST_CLOCK_TIME_IS_VALID (running_time) &&
+        GST_CLOCK_TIME_IS_VALID (self->out_time) &&
+        running_time > self->out_time)
+      continue;
+
+    buf = gst_collect_pads_pop (collect, pad->cdata);
+    gst_buffer_replace (&pad->buffer, buf);
+    gst_buffer_unref (buf);
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_rga_compositor_collected (GstCollectPads * collect, GstRGACompositor * self)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *outbuf = NULL;
+  GstClockTime duration = GST_CLOCK_TIME_NONE;
+  GList *sinkpads, *l;
+
+  GST_OBJECT_LOCK (self);
+  sinkpads = g_list_copy_deep (self->sinkpads, (GCopyFunc) gst_object_ref,
+      NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!gst_rga_compositor_fill_queues (self, collect, sinkpads)) {
+    GST_DEBUG_OBJECT (self, "all pads are EOS");
+    gst_pad_push_event (self->srcpad, gst_event_new_eos ());
+    ret = GST_FLOW_EOS;
+    goto done;
+  }
+
+  if (!gst_rga_compositor_configure (self, sinkpads)) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+    goto done;
+  }
+
+  ret = gst_buffer_pool_acquire_buffer (self->pool, &outbuf, NULL);
+  if (ret != GST_FLOW_OK)
+    goto done;
+
+  /* queue every blit back to back, the RGA runs them in that order. The
+   * buffers come back from the pool with an earlier frame in them */
+  if (!gst_rga_compositor_covered (self, sinkpads) &&
+      !gst_rga_context_queue (self->bg, self->bg_buffer, outbuf))
+    ret = GST_FLOW_ERROR;
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+    GstBuffer *inbuf;
+
+    if (!pad->buffer || !pad->ctx->configured)
+      continue;
+
+    inbuf = gst_rga_context_import (pad->ctx, pad->buffer, &pad->info,
+        self->drm_fd, self->allocator);
+    if (!inbuf || !gst_rga_context_queue (pad->ctx, inbuf, outbuf))
+      ret = GST_FLOW_ERROR;
+  }
+
+  if (!gst_rga_context_wait (self->bg))
+    ret = GST_FLOW_ERROR;
+
+  for (l = sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+
+    if (!gst_rga_context_wait (pad->ctx))
+      ret = GST_FLOW_ERROR;
+  }
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (outbuf);
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("RGA composition failed"),
+        (NULL));
+    goto done;
+  }
+
+  if (self->copy_out) {
+    outbuf = gst_rga_compositor_copy_out (self, outbuf);
+    if (!outbuf) {
+      ret = GST_FLOW_ERROR;
+      goto done;
+    }
+  }
+
+  if (GST_VIDEO_INFO_FPS_N (&self->info) > 0)
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&self->info), GST_VIDEO_INFO_FPS_N (&self->info));
+
+  GST_BUFFER_PTS (outbuf) = self->out_time;
+  GST_BUFFER_DURATION (outbuf) = duration;
+
+  if (GST_CLOCK_TIME_IS_VALID (self->out_time) &&
+      GST_CLOCK_TIME_IS_VALID (duration))
+    self->out_time += duration;
+
+  ret = gst_pad_push (self->srcpad, outbuf);
+
+done:
+  g_list_free_full (sinkpads, gst_object_unref);
+
+  return ret;
+}
+
+static gboolean
+gst_rga_compositor_sink_event (GstCollectPads * collect, GstCollectData * cdata,
+    GstEvent * event, GstRGACompositor * self)
+{
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (cdata->pad);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      GstVideoInfo info;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&info, caps)) {
+        GST_ERROR_OBJECT (pad, "invalid caps %" GST_PTR_FORMAT, caps);
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      GST_OBJECT_LOCK (self);
+      gst_caps_replace (&pad->caps, caps);
+      pad->info = info;
+      pad->reconfigure = TRUE;
+      self->need_reconfigure = TRUE;
+      GST_OBJECT_UNLOCK (self);
+
+      gst_event_unref (event);
+      return TRUE;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      /* the output restarts from the next frames */
+      gst_buffer_replace (&pad->buffer, NULL);
+      self->out_time = GST_CLOCK_TIME_NONE;
+      break;
+    default:
+      break;
+  }
+
+  return gst_collect_pads_event_default (collect, cdata, event, FALSE);
+}
+
+static gboolean
+gst_rga_compositor_sink_query (GstCollectPads * collect, GstCollectData * cdata,
+    GstQuery * query, GstRGACompositor * self)
+{
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (cdata->pad);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    {
+      GstCaps *filter, *caps;
+
+      gst_query_parse_caps (query, &filter);
+
+      caps = gst_v4l2_object_get_caps (pad->ctx->v4l2output,
+          gst_v4l2_object_get_raw_caps ());
+      if (filter) {
+        GstCaps *tmp = caps;
+        caps = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (tmp);
+      }
+
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    default:
+      break;
+  }
+
+  return gst_collect_pads_query_default (collect, cdata, query, FALSE);
+}
+
+static GstPad *
+gst_rga_compositor_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * req_name, const GstCaps * caps)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (element);
+  GstRGACompositorPad *pad;
+  gchar *name;
+  guint serial;
+
+  GST_OBJECT_LOCK (self);
+  if (req_name && sscanf (req_name, "sink_%u", &serial) == 1) {
+    if (serial >= self->next_pad_id)
+      self->next_pad_id = serial + 1;
+  } else {
+    serial = self->next_pad_id++;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  name = g_strdup_printf ("sink_%u", serial);
+  pad = g_object_new (GST_TYPE_RGA_COMPOSITOR_PAD, "name", name,
+      "direction", templ->direction, "template", templ, NULL);
+  g_free (name);
+
+  pad->zorder = serial;
+
+  /* every pad opens its own m2m context */
+  pad->ctx = gst_rga_context_new (element, self->videodev);
+  if (!pad->ctx)
+    goto open_failed;
+
+  pad->cdata = gst_collect_pads_add_pad (self->collect, GST_PAD (pad),
+      sizeof (GstCollectData), NULL, TRUE);
+
+  GST_OBJECT_LOCK (self);
+  self->sinkpads = g_list_insert_sorted (self->sinkpads, pad,
+      gst_rga_compositor_pad_compare);
+  self->need_reconfigure = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_element_add_pad (element, GST_PAD (pad));
+
+  GST_DEBUG_OBJECT (self, "created pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  return GST_PAD (pad);
+
+open_failed:
+  {
+    gst_object_unref (pad);
+    return NULL;
+  }
+}
+
+static void
+gst_rga_compositor_release_pad (GstElement * element, GstPad * gpad)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (element);
+  GstRGACompositorPad *pad = GST_RGA_COMPOSITOR_PAD (gpad);
+
+  GST_DEBUG_OBJECT (self, "release pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  GST_OBJECT_LOCK (self);
+  self->sinkpads = g_list_remove (self->sinkpads, pad);
+  self->need_reconfigure = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_collect_pads_remove_pad (self->collect, gpad);
+
+  /* don't pull the context from under a running composition */
+  GST_COLLECT_PADS_STREAM_LOCK (self->collect);
+  gst_rga_context_free (pad->ctx);
+  pad->ctx = NULL;
+  gst_buffer_replace (&pad->buffer, NULL);
+  GST_COLLECT_PADS_STREAM_UNLOCK (self->collect);
+
+  gst_element_remove_pad (element, gpad);
+}
+
+static void
+gst_rga_compositor_reset (GstRGACompositor * self)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  for (l = self->sinkpads; l; l = l->next) {
+    GstRGACompositorPad *pad = l->data;
+
+    gst_rga_context_stop (pad->ctx);
+    gst_buffer_replace (&pad->buffer, NULL);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (self->bg)
+    gst_rga_context_stop (self->bg);
+  gst_rga_compositor_clear_pools (self);
+
+  gst_caps_replace (&self->srccaps, NULL);
+  self->out_time = GST_CLOCK_TIME_NONE;
+  self->need_reconfigure = TRUE;
+  self->send_stream_start = TRUE;
+  self->send_segment = TRUE;
+}
+
+static GstStateChangeReturn
+gst_rga_compositor_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      self->drm_fd = open (self->drm_device, O_RDWR | O_CLOEXEC);
+      if (self->drm_fd < 0) {
+        GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+            (_("Could not open device '%s' for reading and writing."),
+                self->drm_device), GST_ERROR_SYSTEM);
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      self->allocator = gst_dmabuf_allocator_new ();
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rga_compositor_reset (self);
+      gst_collect_pads_start (self->collect);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_collect_pads_stop (self->collect);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rga_compositor_reset (self);
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      if (self->allocator)
+        gst_object_unref (self->allocator);
+      self->allocator = NULL;
+      if (self->drm_fd >= 0)
+        close (self->drm_fd);
+      self->drm_fd = -1;
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_rga_compositor_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      g_free (self->videodev);
+      self->videodev = g_value_dup_string (value);
+      break;
+    case PROP_DRM_DEVICE:
+      g_free (self->drm_device);
+      self->drm_device = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rga_compositor_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (object);
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      g_value_set_string (value, self->videodev);
+      break;
+    case PROP_DRM_DEVICE:
+      g_value_set_string (value, self->drm_device);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rga_compositor_finalize (GObject * object)
+{
+  GstRGACompositor *self = GST_RGA_COMPOSITOR (object);
+
+  gst_object_unref (self->collect);
+  if (self->bg)
+    gst_rga_context_free (self->bg);
+  g_free (self->videodev);
+  g_free (self->drm_device);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rga_compositor_init (GstRGACompositor * self)
+{
+  rk_common_v4l2device_find_by_name ("rockchip-rga", self->default_device);
+  self->videodev = g_strdup (self->default_device);
+  self->drm_device = g_strdup (DEFAULT_PROP_DRM_DEVICE);
+  self->drm_fd = -1;
+
+  self->srcpad =
+      gst_pad_new_from_static_template (&gst_rga_compositor_src_template,
+      "src");
+  gst_pad_use_fixed_caps (self->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->srcpad);
+
+  self->collect = gst_collect_pads_new ();
+  gst_collect_pads_set_function (self->collect,
+      (GstCollectPadsFunction) gst_rga_compositor_collected, self);
+  gst_collect_pads_set_event_function (self->collect,
+      (GstCollectPadsEventFunction) gst_rga_compositor_sink_event, self);
+  gst_collect_pads_set_query_function (self->collect,
+      (GstCollectPadsQueryFunction) gst_rga_compositor_sink_query, self);
+
+  gst_rga_compositor_reset (self);
+}
+
+static void
+gst_rga_compositor_class_init (GstRGACompositorClass * klass)
+{
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_rga_compositor_src_template));
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_rga_compositor_sink_template));
+
+  GST_DEBUG_CATEGORY_INIT (gst_rga_compositor_debug, "rgacompositor", 0,
+      "RGA Compositor(Rockchip)");
+
+  gst_element_class_set_static_metadata (element_class,
+      "RGA Video Compositor",
+      "Filter/Editor/Video/Compositor",
+      "Composite multiple video streams via V4L2 API", " ");
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_rga_compositor_finalize);
+  gobject_class->set_property =
+      GST_DEBUG_FUNCPTR (gst_rga_compositor_set_property);
+  gobject_class->get_property =
+      GST_DEBUG_FUNCPTR (gst_rga_compositor_get_property);
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_rga_compositor_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_rga_compositor_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_rga_compositor_change_state);
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      g_param_spec_string ("device", "Device",
+          "RGA device used by pads requested from now on", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DRM_DEVICE,
+      g_param_spec_string ("drm-device", "DRM device",
+          "DRM device the output dmabufs are allocated from",
+          DEFAULT_PROP_DRM_DEVICE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_ref (GST_TYPE_RGA_COMPOSITOR_PAD);
+}
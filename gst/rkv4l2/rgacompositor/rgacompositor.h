@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_COMPOSITOR_H__
+#define __GST_RGA_COMPOSITOR_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstcollectpads.h>
+
+#include "rga/rgacontext.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_RGA_COMPOSITOR_PAD \
+  (gst_rga_compositor_pad_get_type())
+#define GST_RGA_COMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RGA_COMPOSITOR_PAD,GstRGACompositorPad))
+#define GST_IS_RGA_COMPOSITOR_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RGA_COMPOSITOR_PAD))
+#define GST_TYPE_RGA_COMPOSITOR \
+  (gst_rga_compositor_get_type())
+#define GST_RGA_COMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RGA_COMPOSITOR,GstRGACompositor))
+#define GST_IS_RGA_COMPOSITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RGA_COMPOSITOR))
+typedef struct _GstRGACompositorPad GstRGACompositorPad;
+typedef struct _GstRGACompositorPadClass GstRGACompositorPadClass;
+typedef struct _GstRGACompositor GstRGACompositor;
+typedef struct _GstRGACompositorClass GstRGACompositorClass;
+
+/**
+ * GstRGACompositorPad:
+ *
+ * Each sink pad owns a RGA m2m context, its input is blitted into the
+ * compose rectangle of the shared output buffer.
+ */
+struct _GstRGACompositorPad
+{
+  GstPad parent;
+
+  GstCollectData *cdata;
+
+  /* one m2m context per pad */
+  GstRGAContext *ctx;
+
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  /* last frame popped, blitted again until a frame comes for the output
+   * time */
+  GstBuffer *buffer;
+
+  /* properties */
+  gint xpos;
+  gint ypos;
+  gint width;
+  gint height;
+  guint zorder;
+
+  gboolean reconfigure;         /* caps changed on either side */
+  gboolean compose_changed;     /* compose rectangle needs updating */
+};
+
+struct _GstRGACompositorPadClass
+{
+  GstPadClass parent_class;
+};
+
+struct _GstRGACompositor
+{
+  GstElement parent;
+
+  /* < private > */
+  GstPad *srcpad;
+  GstCollectPads *collect;
+
+  GList *sinkpads;              /* sorted by zorder */
+  guint next_pad_id;
+
+  gchar default_device[32];
+  gchar *videodev;
+  gchar *drm_device;
+  gint drm_fd;
+  GstAllocator *allocator;
+
+  /* output */
+  GstCaps *srccaps;
+  GstVideoInfo info;
+  GstBufferPool *pool;
+  GstClockTime out_time;        /* running time of the next output frame */
+
+  /* black, blitted over the whole output when the pads don't cover it */
+  GstRGAContext *bg;
+  GstBuffer *bg_buffer;
+
+  /* downstream can't read the driver layout without a video meta, the
+   * frames are copied into buffers of its pool */
+  GstBufferPool *out_pool;
+  gboolean copy_out;
+
+  gboolean need_reconfigure;
+  gboolean send_stream_start;
+  gboolean send_segment;
+};
+
+struct _GstRGACompositorClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_rga_compositor_pad_get_type (void);
+GType gst_rga_compositor_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_RGA_COMPOSITOR_H__ */
@@ -39,12 +39,26 @@
 
 #include "common.h"
 #include "v4l2_calls.h"
+#include "rga/rgadmabuf.h"
 #include "rgaconvert.h"
 
 #include <string.h>
+#include <gst/allocators/gstdmabuf.h>
 #include <gst/gst-i18n-plugin.h>
 
 #define DEFAULT_PROP_DEVICE "/dev/video10"
+#define DEFAULT_PROP_FRAMES_IN_FLIGHT 1
+#define DEFAULT_PROP_PRIORITY GST_RGA_PRIORITY_NORMAL
+#define DEFAULT_PROP_DRM_DEVICE "/dev/dri/card0"
+#define DEFAULT_PROP_SOFTWARE_FALLBACK TRUE
+#define DEFAULT_PROP_SOFTWARE_THREADS 0
+#define DEFAULT_PROP_STATS_INTERVAL 0
+
+/* largest rectangle the RGA processes in one job */
+#define GST_RGA_CONVERT_MAX_JOB_SIZE 4096
+/* stripe edges, aligned for the subsampled formats */
+#define GST_RGA_CONVERT_STRIPE_ALIGN 16
+#define GST_RGA_CONVERT_STRIPE_BUFFERS 4
 
 static GstStaticPadTemplate gst_rga_convert_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
@@ -70,9 +84,33 @@ GST_DEBUG_CATEGORY_STATIC (gst_rga_convert_debug);
 enum
 {
   PROP_0,
-  V4L2_STD_OBJECT_PROPS
+  V4L2_STD_OBJECT_PROPS,
+  PROP_FRAMES_IN_FLIGHT,
+  PROP_PRIORITY,
+  PROP_SCHEDULER_STATS,
+  PROP_DRM_DEVICE,
+  PROP_SOFTWARE_FALLBACK,
+  PROP_SOFTWARE_THREADS,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
 };
 
+typedef struct
+{
+  struct v4l2_rect src;
+  struct v4l2_rect dest;
+} GstRGAStripe;
+
+/* timing of a frame in flight, kept on its metadata buffer */
+typedef struct
+{
+  GstClockTime wait;
+  GstClockTime queued;
+  gsize size;
+} GstRGAConvertJob;
+
+static GQuark gst_rga_convert_job_quark;
+
 #define gst_rga_convert_parent_class parent_class
 G_DEFINE_TYPE (GstRGAConvert, gst_rga_convert, GST_TYPE_BASE_TRANSFORM);
 
@@ -91,6 +129,27 @@ gst_rga_convert_set_property (GObject * object,
       gst_v4l2_object_set_property_helper (self->v4l2capture, prop_id, value,
           pspec);
       break;
+    case PROP_FRAMES_IN_FLIGHT:
+      self->frames_in_flight = g_value_get_uint (value);
+      break;
+    case PROP_PRIORITY:
+      self->priority = g_value_get_enum (value);
+      if (self->sched)
+        gst_rga_scheduler_client_set_priority (self->sched, self->priority);
+      break;
+    case PROP_DRM_DEVICE:
+      g_free (self->drm_device);
+      self->drm_device = g_value_dup_string (value);
+      break;
+    case PROP_SOFTWARE_FALLBACK:
+      self->software_fallback = g_value_get_boolean (value);
+      break;
+    case PROP_SOFTWARE_THREADS:
+      self->software_threads = g_value_get_uint (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      self->stats_interval = g_value_get_uint (value);
+      break;
       /* By default, only set on output */
     default:
       if (!gst_v4l2_object_set_property_helper (self->v4l2output,
@@ -120,6 +179,32 @@ gst_rga_convert_get_property (GObject * object,
       gst_v4l2_object_get_property_helper (self->v4l2capture, prop_id, value,
           pspec);
       break;
+    case PROP_FRAMES_IN_FLIGHT:
+      g_value_set_uint (value, self->frames_in_flight);
+      break;
+    case PROP_PRIORITY:
+      g_value_set_enum (value, self->priority);
+      break;
+    case PROP_SCHEDULER_STATS:
+      if (self->sched)
+        g_value_take_boxed (value,
+            gst_rga_scheduler_client_get_stats (self->sched));
+      break;
+    case PROP_DRM_DEVICE:
+      g_value_set_string (value, self->drm_device);
+      break;
+    case PROP_SOFTWARE_FALLBACK:
+      g_value_set_boolean (value, self->software_fallback);
+      break;
+    case PROP_SOFTWARE_THREADS:
+      g_value_set_uint (value, self->software_threads);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_rga_stats_get (self->stats));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, self->stats_interval);
+      break;
       /* By default read from output */
     default:
       if (!gst_v4l2_object_get_property_helper (self->v4l2output,
@@ -134,11 +219,33 @@ gst_rga_convert_get_property (GObject * object,
   }
 }
 
+/* the RGA may be held by an other process */
+static gboolean
+gst_rga_convert_device_busy (GstRGAConvert * self)
+{
+  gint fd;
+
+  fd = open (self->v4l2output->videodev, O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return errno == EBUSY;
+
+  close (fd);
+  return FALSE;
+}
+
 static gboolean
 gst_rga_convert_open (GstRGAConvert * self)
 {
   GST_DEBUG_OBJECT (self, "Opening");
 
+  /* opening a missing or busy device would post an error */
+  if (self->software_fallback && (!self->v4l2output->videodev
+          || !g_file_test (self->v4l2output->videodev, G_FILE_TEST_EXISTS)))
+    goto no_device;
+
+  if (self->software_fallback && gst_rga_convert_device_busy (self))
+    goto device_busy;
+
   if (!gst_v4l2_object_open (self->v4l2output))
     goto failure;
 
@@ -157,13 +264,38 @@ gst_rga_convert_open (GstRGAConvert * self)
   if (gst_caps_is_empty (self->probed_srccaps))
     goto no_output_format;
 
+  /* after the RGA formats, so those are preferred */
+  if (self->software_fallback) {
+    self->probed_sinkcaps = gst_caps_merge (self->probed_sinkcaps,
+        gst_rga_soft_converter_get_caps ());
+    self->probed_srccaps = gst_caps_merge (self->probed_srccaps,
+        gst_rga_soft_converter_get_caps ());
+  }
+
   rk_common_v4l2_set_rotation (self->v4l2output, self->v4l2output->rotation);
   rk_common_v4l2_set_vflip (self->v4l2output, self->v4l2output->vflip);
   rk_common_v4l2_set_hflip (self->v4l2output, self->v4l2output->hflip);
 
+  self->sched = gst_rga_scheduler_client_new (GST_OBJECT (self),
+      self->priority);
+
   return TRUE;
 
+no_device:
+  GST_ELEMENT_WARNING (self, RESOURCE, NOT_FOUND,
+      ("No converter on device %s, converting in software",
+          GST_STR_NULL (self->v4l2output->videodev)), (NULL));
+  goto software_only;
+
+device_busy:
+  GST_ELEMENT_WARNING (self, RESOURCE, BUSY,
+      ("Converter on device %s is busy, converting in software",
+          self->v4l2output->videodev), (NULL));
+  goto software_only;
+
 no_input_format:
+  if (self->software_fallback)
+    goto no_device_format;
   GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
       (_("Converter on device %s has no supported input format"),
           self->v4l2output->videodev), (NULL));
@@ -171,11 +303,29 @@ no_input_format:
 
 
 no_output_format:
+  if (self->software_fallback)
+    goto no_device_format;
   GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
       (_("Converter on device %s has no supported output format"),
           self->v4l2output->videodev), (NULL));
   goto failure;
 
+no_device_format:
+  GST_ELEMENT_WARNING (self, RESOURCE, SETTINGS,
+      ("Converter on device %s has no supported format, converting in "
+          "software", self->v4l2output->videodev), (NULL));
+  gst_v4l2_object_close (self->v4l2output);
+  gst_v4l2_object_close (self->v4l2capture);
+  gst_caps_replace (&self->probed_srccaps, NULL);
+  gst_caps_replace (&self->probed_sinkcaps, NULL);
+  goto software_only;
+
+software_only:
+  self->software_only = TRUE;
+  self->probed_sinkcaps = gst_rga_soft_converter_get_caps ();
+  self->probed_srccaps = gst_rga_soft_converter_get_caps ();
+  return TRUE;
+
 failure:
   if (GST_V4L2_IS_OPEN (self->v4l2output))
     gst_v4l2_object_close (self->v4l2output);
@@ -194,11 +344,378 @@ gst_rga_convert_close (GstRGAConvert * self)
 {
   GST_DEBUG_OBJECT (self, "Closing");
 
-  gst_v4l2_object_close (self->v4l2output);
-  gst_v4l2_object_close (self->v4l2capture);
+  if (GST_V4L2_IS_OPEN (self->v4l2output))
+    gst_v4l2_object_close (self->v4l2output);
+  if (GST_V4L2_IS_OPEN (self->v4l2capture))
+    gst_v4l2_object_close (self->v4l2capture);
+  self->software_only = FALSE;
 
   gst_caps_replace (&self->probed_srccaps, NULL);
   gst_caps_replace (&self->probed_sinkcaps, NULL);
+
+  if (self->sched)
+    gst_rga_scheduler_client_free (self->sched);
+  self->sched = NULL;
+
+  if (self->striper)
+    gst_rga_context_free (self->striper);
+  self->striper = NULL;
+
+  if (self->allocator)
+    gst_object_unref (self->allocator);
+  self->allocator = NULL;
+
+  if (self->drm_fd >= 0)
+    close (self->drm_fd);
+  self->drm_fd = -1;
+}
+
+/* forget the frames still in the RGA, the queues are being stopped */
+static void
+gst_rga_convert_clear_pending (GstRGAConvert * self)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (&self->ready)))
+    gst_buffer_unref (buf);
+  while ((buf = g_queue_pop_head (&self->pending)))
+    gst_buffer_unref (buf);
+}
+
+static gboolean
+gst_rga_convert_is_pipelined (GstRGAConvert * self)
+{
+  return self->frames_in_flight > 1 && !self->stripes && !self->soft
+      && !gst_base_transform_is_passthrough (GST_BASE_TRANSFORM (self));
+}
+
+static GstFlowReturn gst_rga_convert_dequeue (GstRGAConvert * self,
+    GstBuffer ** outbuf);
+
+/* push every frame still in the RGA */
+static void
+gst_rga_convert_drain (GstRGAConvert * self)
+{
+  GstBuffer *outbuf;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while ((outbuf = g_queue_pop_head (&self->ready))) {
+    ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (self), outbuf);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  while (ret == GST_FLOW_OK && !g_queue_is_empty (&self->pending)) {
+    outbuf = NULL;
+    ret = gst_rga_convert_dequeue (self, &outbuf);
+    if (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER)
+      continue;
+    if (ret != GST_FLOW_OK)
+      break;
+
+    ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (self), outbuf);
+    if (ret != GST_FLOW_OK)
+      break;
+  }
+
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "drain stopped: %s", gst_flow_get_name (ret));
+    gst_rga_convert_clear_pending (self);
+  }
+}
+
+/* position of the edge @i of @n stripes, the larger side is cut at aligned
+ * positions and the other one follows in proportion */
+static void
+gst_rga_convert_stripe_edge (gint src_len, gint dest_len, guint n, guint i,
+    gint * src_edge, gint * dest_edge)
+{
+  if (i == n) {
+    *src_edge = src_len;
+    *dest_edge = dest_len;
+  } else if (src_len >= dest_len) {
+    *src_edge = GST_ROUND_DOWN_N (src_len * i / n,
+        GST_RGA_CONVERT_STRIPE_ALIGN);
+    *dest_edge = GST_ROUND_DOWN_2 ((gint64) * src_edge * dest_len / src_len);
+  } else {
+    *dest_edge = GST_ROUND_DOWN_N (dest_len * i / n,
+        GST_RGA_CONVERT_STRIPE_ALIGN);
+    *src_edge = GST_ROUND_DOWN_2 ((gint64) * dest_edge * src_len / dest_len);
+  }
+}
+
+static guint
+gst_rga_convert_stripe_count (gint src_len, gint dest_len)
+{
+  /* leave room for the alignment of the edges */
+  gint max = GST_RGA_CONVERT_MAX_JOB_SIZE - GST_RGA_CONVERT_STRIPE_ALIGN;
+
+  if (MAX (src_len, dest_len) <= GST_RGA_CONVERT_MAX_JOB_SIZE)
+    return 1;
+
+  return (MAX (src_len, dest_len) + max - 1) / max;
+}
+
+/* the part of the input read and of the output written */
+static void
+gst_rga_convert_get_rects (GstRGAConvert * self, GstVideoInfo * in,
+    GstVideoInfo * out, GstVideoRectangle * src, GstVideoRectangle * dest)
+{
+  GstRKV4l2Object *obj = self->v4l2output;
+
+  src->x = src->y = dest->x = dest->y = 0;
+  src->w = GST_VIDEO_INFO_WIDTH (in);
+  src->h = GST_VIDEO_INFO_HEIGHT (in);
+  dest->w = GST_VIDEO_INFO_WIDTH (out);
+  dest->h = GST_VIDEO_INFO_HEIGHT (out);
+
+  if (obj->input_crop.w != 0)
+    *src = obj->input_crop;
+  if (obj->output_crop.w != 0)
+    *dest = obj->output_crop;
+}
+
+/* split the conversion in jobs the RGA can do, NULL if one is enough */
+static GArray *
+gst_rga_convert_compute_stripes (GstRGAConvert * self, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstVideoInfo in, out;
+  GstVideoRectangle src, dest;
+  GstRGAStripe stripe;
+  GArray *stripes;
+  guint nx, ny, i, j;
+  gint x0, x1, y0, y1, dx0, dx1, dy0, dy1;
+
+  if (!gst_video_info_from_caps (&in, incaps)
+      || !gst_video_info_from_caps (&out, outcaps))
+    return NULL;
+
+  gst_rga_convert_get_rects (self, &in, &out, &src, &dest);
+
+  nx = gst_rga_convert_stripe_count (src.w, dest.w);
+  ny = gst_rga_convert_stripe_count (src.h, dest.h);
+  if (nx == 1 && ny == 1)
+    return NULL;
+
+  stripes = g_array_sized_new (FALSE, FALSE, sizeof (GstRGAStripe), nx * ny);
+
+  for (j = 0; j < ny; j++) {
+    gst_rga_convert_stripe_edge (src.h, dest.h, ny, j, &y0, &dy0);
+    gst_rga_convert_stripe_edge (src.h, dest.h, ny, j + 1, &y1, &dy1);
+
+    for (i = 0; i < nx; i++) {
+      gst_rga_convert_stripe_edge (src.w, dest.w, nx, i, &x0, &dx0);
+      gst_rga_convert_stripe_edge (src.w, dest.w, nx, i + 1, &x1, &dx1);
+
+      stripe.src.left = src.x + x0;
+      stripe.src.top = src.y + y0;
+      stripe.src.width = x1 - x0;
+      stripe.src.height = y1 - y0;
+      stripe.dest.left = dest.x + dx0;
+      stripe.dest.top = dest.y + dy0;
+      stripe.dest.width = dx1 - dx0;
+      stripe.dest.height = dy1 - dy0;
+      g_array_append_val (stripes, stripe);
+    }
+  }
+
+  GST_INFO_OBJECT (self, "%dx%d -> %dx%d in %ux%u stripes", src.w, src.h,
+      dest.w, dest.h, nx, ny);
+
+  return stripes;
+}
+
+static void
+gst_rga_convert_stop_stripes (GstRGAConvert * self)
+{
+  if (self->stripes)
+    g_array_unref (self->stripes);
+  self->stripes = NULL;
+
+  if (self->striper)
+    gst_rga_context_stop (self->striper);
+}
+
+/* the v4l2 buffer pools can't queue one output buffer once per stripe, so
+ * stripes run on a context importing dmabufs on both sides */
+static gboolean
+gst_rga_convert_setup_stripes (GstRGAConvert * self, GArray * stripes)
+{
+  GstRKV4l2Object *obj = self->v4l2output;
+
+  if (obj->rotation != 0 || obj->hflip || obj->vflip)
+    goto not_supported;
+
+  gst_v4l2_object_stop (self->v4l2output);
+  gst_v4l2_object_stop (self->v4l2capture);
+
+  if (self->drm_fd < 0) {
+    self->drm_fd = open (self->drm_device, O_RDWR | O_CLOEXEC);
+    if (self->drm_fd < 0)
+      goto drm_open_failed;
+  }
+
+  if (!self->allocator)
+    self->allocator = gst_dmabuf_allocator_new ();
+
+  if (!self->striper)
+    self->striper = gst_rga_context_new (GST_ELEMENT (self), obj->videodev);
+  if (!self->striper)
+    goto failed;
+
+  if (!gst_rga_context_configure (self->striper, self->incaps, self->outcaps,
+          GST_RGA_CONVERT_STRIPE_BUFFERS))
+    goto failed;
+
+  self->stripes = stripes;
+
+  return TRUE;
+
+not_supported:
+  {
+    GST_ELEMENT_ERROR (self, STREAM, FORMAT,
+        ("Frames beyond %d pixels can't be rotated or flipped",
+            GST_RGA_CONVERT_MAX_JOB_SIZE), (NULL));
+    goto failed;
+  }
+drm_open_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+        (_("Could not open device '%s' for reading and writing."),
+            self->drm_device), GST_ERROR_SYSTEM);
+    goto failed;
+  }
+failed:
+  g_array_unref (stripes);
+  return FALSE;
+}
+
+/* what the RGA can't do, or all of it without a RGA, runs on the CPU */
+static gboolean
+gst_rga_convert_setup_software (GstRGAConvert * self)
+{
+  GstRKV4l2Object *obj = self->v4l2output;
+  GstVideoInfo in, out;
+  GstVideoRectangle src, dest;
+
+  if (!gst_video_info_from_caps (&in, self->incaps)
+      || !gst_video_info_from_caps (&out, self->outcaps))
+    return FALSE;
+
+  gst_v4l2_object_stop (self->v4l2output);
+  gst_v4l2_object_stop (self->v4l2capture);
+
+  gst_rga_convert_get_rects (self, &in, &out, &src, &dest);
+  self->soft = gst_rga_soft_converter_new (GST_ELEMENT (self), &in, &out,
+      &src, &dest, obj->rotation, obj->hflip, obj->vflip,
+      self->software_threads);
+  if (!self->soft)
+    goto not_supported;
+
+  return TRUE;
+
+not_supported:
+  {
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION,
+        ("No conversion from %s to %s", GST_VIDEO_INFO_NAME (&in),
+            GST_VIDEO_INFO_NAME (&out)), (NULL));
+    return FALSE;
+  }
+}
+
+static gboolean
+gst_rga_convert_pool_busy (GstBufferPool * pool)
+{
+  return pool && GST_V4L2_BUFFER_POOL (pool)->busy;
+}
+
+/* a queue refused to stream because the RGA is held by an other process,
+ * the buffers already negotiated are replaced on the next reconfigure */
+static gboolean
+gst_rga_convert_busy_fallback (GstRGAConvert * self)
+{
+  GST_ELEMENT_WARNING (self, RESOURCE, BUSY,
+      ("Converter on device %s is busy, converting in software",
+          self->v4l2output->videodev), (NULL));
+
+  /* nothing was queued to the RGA */
+  gst_rga_convert_clear_pending (self);
+
+  if (!gst_rga_convert_setup_software (self))
+    return FALSE;
+
+  gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (self));
+  return TRUE;
+}
+
+static void
+gst_rga_convert_stop_software (GstRGAConvert * self)
+{
+  if (self->soft)
+    gst_rga_soft_converter_free (self->soft);
+  self->soft = NULL;
+}
+
+static GstFlowReturn
+gst_rga_convert_process_stripes (GstRGAConvert * self, GstBuffer * inbuf,
+    GstBuffer * outbuf, GstClockTime * wait)
+{
+  GstClockTime start;
+  GstRGAContext *ctx = self->striper;
+  GstRGAStripe *stripe;
+  GstVideoInfo info;
+  GstBuffer *imported;
+  guint i;
+
+  /* a failed job resets the context */
+  if (!ctx->configured && !gst_rga_context_configure (ctx, self->incaps,
+          self->outcaps, GST_RGA_CONVERT_STRIPE_BUFFERS))
+    return GST_FLOW_ERROR;
+
+  gst_video_info_from_caps (&info, self->incaps);
+  imported = gst_rga_context_import (ctx, inbuf, &info, self->drm_fd,
+      self->allocator);
+  if (!imported)
+    goto import_failed;
+
+  for (i = 0; i < self->stripes->len; i++) {
+    stripe = &g_array_index (self->stripes, GstRGAStripe, i);
+
+    rk_common_v4l2_set_selection (ctx->v4l2output, &stripe->src, FALSE);
+    rk_common_v4l2_set_selection (ctx->v4l2output, &stripe->dest, TRUE);
+
+    start = gst_util_get_timestamp ();
+    if (!gst_rga_scheduler_acquire (self->sched,
+            (guint64) MAX (stripe->src.width, stripe->dest.width) *
+            MAX (stripe->src.height, stripe->dest.height)))
+      return GST_FLOW_FLUSHING;
+    *wait += gst_util_get_timestamp () - start;
+
+    if (!gst_rga_context_queue (ctx, imported, outbuf)
+        || !gst_rga_context_wait (ctx)) {
+      gst_rga_scheduler_release (self->sched);
+      goto stripe_failed;
+    }
+
+    gst_rga_scheduler_release (self->sched);
+  }
+
+  return GST_FLOW_OK;
+
+import_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ,
+        ("could not import input buffer"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+stripe_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        ("failed to convert stripe %u of %u", i + 1, self->stripes->len),
+        (NULL));
+    return GST_FLOW_ERROR;
+  }
 }
 
 static gboolean
@@ -208,6 +725,11 @@ gst_rga_convert_stop (GstBaseTransform * trans)
 
   GST_DEBUG_OBJECT (self, "Stop");
 
+  gst_rga_convert_clear_pending (self);
+  gst_rga_convert_stop_stripes (self);
+  gst_rga_convert_stop_software (self);
+  gst_rga_stats_reset (self->stats);
+
   gst_v4l2_object_stop (self->v4l2output);
   gst_v4l2_object_stop (self->v4l2capture);
   gst_caps_replace (&self->incaps, NULL);
@@ -216,6 +738,162 @@ gst_rga_convert_stop (GstBaseTransform * trans)
   return TRUE;
 }
 
+/* whether going from @old to @new caps needs a new v4l2 format, fields
+ * like framerate or colorimetry don't */
+static gboolean
+gst_rga_convert_caps_need_restart (GstCaps * old, GstCaps * new)
+{
+  GstVideoInfo old_info, new_info;
+
+  if (!old)
+    return TRUE;
+
+  if (gst_caps_is_equal (old, new))
+    return FALSE;
+
+  if (!gst_video_info_from_caps (&old_info, old)
+      || !gst_video_info_from_caps (&new_info, new))
+    return TRUE;
+
+  return GST_VIDEO_INFO_FORMAT (&old_info) != GST_VIDEO_INFO_FORMAT (&new_info)
+      || GST_VIDEO_INFO_WIDTH (&old_info) != GST_VIDEO_INFO_WIDTH (&new_info)
+      || GST_VIDEO_INFO_HEIGHT (&old_info) != GST_VIDEO_INFO_HEIGHT (&new_info)
+      || GST_VIDEO_INFO_INTERLACE_MODE (&old_info) !=
+      GST_VIDEO_INFO_INTERLACE_MODE (&new_info);
+}
+
+static gboolean
+gst_rga_convert_downstream_has_meta (GstRGAConvert * self, GstCaps * caps,
+    GType api)
+{
+  GstQuery *query;
+  gboolean ret = FALSE;
+
+  query = gst_query_new_allocation (caps, FALSE);
+  if (gst_pad_peer_query (GST_BASE_TRANSFORM_SRC_PAD (self), query))
+    ret = gst_query_find_allocation_meta (query, api, NULL);
+  gst_query_unref (query);
+
+  return ret;
+}
+
+/* whether downstream crops by itself, like kmssink does */
+static gboolean
+gst_rga_convert_downstream_crops (GstRGAConvert * self, GstCaps * caps)
+{
+  return gst_rga_convert_downstream_has_meta (self, caps,
+      GST_VIDEO_CROP_META_API_TYPE);
+}
+
+/* a smaller output of the same format fits in the buffers of the capture
+ * queue: the RGA composes it in their top left corner and downstream
+ * reads it through the video meta, with the strides it already had */
+static gboolean
+gst_rga_convert_keep_capture (GstRGAConvert * self, GstCaps * outcaps)
+{
+  GstRKV4l2Object *obj = self->v4l2capture;
+  struct v4l2_rect rect = { 0 };
+  GstVideoInfo info;
+  guint width, height;
+
+  if (!obj->pool || obj->align.padding_left || obj->align.padding_top)
+    return FALSE;
+
+  if (!gst_video_info_from_caps (&info, outcaps))
+    return FALSE;
+
+  if (V4L2_TYPE_IS_MULTIPLANAR (obj->type)) {
+    width = obj->format.fmt.pix_mp.width;
+    height = obj->format.fmt.pix_mp.height;
+  } else {
+    width = obj->format.fmt.pix.width;
+    height = obj->format.fmt.pix.height;
+  }
+
+  if (GST_VIDEO_INFO_FORMAT (&info) != GST_VIDEO_INFO_FORMAT (&obj->info)
+      || GST_VIDEO_INFO_INTERLACE_MODE (&info) !=
+      GST_VIDEO_INFO_INTERLACE_MODE (&obj->info)
+      || GST_VIDEO_INFO_WIDTH (&info) > width
+      || GST_VIDEO_INFO_HEIGHT (&info) > height)
+    return FALSE;
+
+  if (!gst_rga_convert_downstream_has_meta (self, outcaps,
+          GST_VIDEO_META_API_TYPE))
+    return FALSE;
+
+  rect.width = GST_VIDEO_INFO_WIDTH (&info);
+  rect.height = GST_VIDEO_INFO_HEIGHT (&info);
+  if (!rk_common_v4l2_set_selection (obj, &rect, TRUE)
+      || rect.width != GST_VIDEO_INFO_WIDTH (&info)
+      || rect.height != GST_VIDEO_INFO_HEIGHT (&info))
+    return FALSE;
+
+  /* the video meta of the buffers follows */
+  GST_VIDEO_INFO_WIDTH (&obj->info) = rect.width;
+  GST_VIDEO_INFO_HEIGHT (&obj->info) = rect.height;
+  self->capture_composed = TRUE;
+
+  return TRUE;
+}
+
+/* with the same caps on both sides there is only work to do if the
+ * properties ask for some, and a crop alone can be left to downstream */
+static void
+gst_rga_convert_update_passthrough (GstRGAConvert * self, GstCaps * outcaps)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstRKV4l2Object *obj = self->v4l2output;
+
+  self->crop_meta = FALSE;
+
+  if (!gst_base_transform_is_passthrough (trans))
+    return;
+
+  if (obj->rotation == 0 && !obj->hflip && !obj->vflip
+      && obj->output_crop.w == 0) {
+    if (obj->input_crop.w == 0)
+      return;
+
+    if (gst_rga_convert_downstream_crops (self, outcaps)) {
+      GST_INFO_OBJECT (self, "Leaving the crop to downstream");
+      self->crop_meta = TRUE;
+      return;
+    }
+  }
+
+  gst_base_transform_set_passthrough (trans, FALSE);
+}
+
+/* the crop is left to downstream, no RGA job at all */
+static GstBuffer *
+gst_rga_convert_add_crop_meta (GstRGAConvert * self, GstBuffer * inbuf)
+{
+  GstVideoRectangle *crop = &self->v4l2output->input_crop;
+  GstVideoCropMeta *meta;
+  GstBuffer *buf = inbuf;
+  guint x = 0, y = 0;
+
+  /* the base class drops its reference to @inbuf if we return another */
+  if (!gst_buffer_is_writable (buf))
+    buf = gst_buffer_copy (inbuf);
+
+  /* within what upstream already cropped */
+  meta = gst_buffer_get_video_crop_meta (buf);
+  if (meta) {
+    x = meta->x;
+    y = meta->y;
+  } else {
+    meta = gst_buffer_add_video_crop_meta (buf);
+  }
+
+  meta->x = x + crop->x;
+  meta->y = y + crop->y;
+  meta->width = crop->w;
+  meta->height = crop->h;
+
+  return buf;
+}
+
 static gboolean
 gst_rga_convert_set_caps (GstBaseTransform * trans, GstCaps * incaps,
     GstCaps * outcaps)
@@ -223,6 +901,12 @@ gst_rga_convert_set_caps (GstBaseTransform * trans, GstCaps * incaps,
   GstV4l2Error error = GST_V4L2_ERROR_INIT;
   GstRGAConvert *self = GST_RGA_CONVERT (trans);
   struct v4l2_rect rect;
+  gboolean restart_output, restart_capture;
+  GstClockTime start;
+  GArray *stripes;
+
+  /* the base class just enabled passthrough if the caps are the same */
+  gst_rga_convert_update_passthrough (self, outcaps);
 
   if (self->incaps && self->outcaps) {
     if (gst_caps_is_equal (incaps, self->incaps) &&
@@ -232,18 +916,69 @@ gst_rga_convert_set_caps (GstBaseTransform * trans, GstCaps * incaps,
     }
   }
 
-  /* TODO Add renegotiation support */
-  g_return_val_if_fail (!GST_V4L2_IS_ACTIVE (self->v4l2output), FALSE);
-  g_return_val_if_fail (!GST_V4L2_IS_ACTIVE (self->v4l2capture), FALSE);
+  start = gst_util_get_timestamp ();
+
+  /* the queues were left stopped while converting in stripes or software */
+  restart_output = self->stripes != NULL || self->soft != NULL ||
+      gst_rga_convert_caps_need_restart (self->incaps, incaps);
+  restart_capture = self->stripes != NULL || self->soft != NULL ||
+      gst_rga_convert_caps_need_restart (self->outcaps, outcaps);
 
   gst_caps_replace (&self->incaps, incaps);
   gst_caps_replace (&self->outcaps, outcaps);
 
-  if (!gst_v4l2_object_set_format (self->v4l2output, incaps, &error))
-    goto incaps_failed;
+  if (!restart_output && !restart_capture) {
+    GST_DEBUG_OBJECT (self, "Same formats, keep both queues streaming");
+    return TRUE;
+  }
+
+  /* frames still in the RGA were queued with the old formats */
+  gst_rga_convert_drain (self);
+  gst_rga_convert_stop_stripes (self);
+  gst_rga_convert_stop_software (self);
+
+  if (self->software_only)
+    goto software;
+
+  stripes = gst_rga_convert_compute_stripes (self, incaps, outcaps);
+  if (stripes) {
+    if (!gst_rga_convert_setup_stripes (self, stripes))
+      goto failed;
+
+    GST_INFO_OBJECT (self, "Configured %u stripes in %" GST_TIME_FORMAT,
+        stripes->len, GST_TIME_ARGS (gst_util_get_timestamp () - start));
+    return TRUE;
+  }
+
+  if (restart_capture && gst_rga_convert_keep_capture (self, outcaps)) {
+    GST_DEBUG_OBJECT (self, "Output fits, keep the capture queue");
+    restart_capture = FALSE;
+  }
+
+  /* only the queue whose format changed is stopped, the other one keeps its
+   * buffers */
+  if (restart_output) {
+    gst_v4l2_object_stop (self->v4l2output);
+
+    if (!gst_v4l2_object_set_format (self->v4l2output, incaps, &error))
+      goto incaps_failed;
+  }
+
+  if (restart_capture) {
+    gst_v4l2_object_stop (self->v4l2capture);
 
-  if (!gst_v4l2_object_set_format (self->v4l2capture, outcaps, &error))
-    goto outcaps_failed;
+    if (!gst_v4l2_object_set_format (self->v4l2capture, outcaps, &error))
+      goto outcaps_failed;
+
+    /* back to the whole buffer */
+    if (self->capture_composed) {
+      rect.left = rect.top = 0;
+      rect.width = GST_VIDEO_INFO_WIDTH (&self->v4l2capture->info);
+      rect.height = GST_VIDEO_INFO_HEIGHT (&self->v4l2capture->info);
+      rk_common_v4l2_set_selection (self->v4l2capture, &rect, TRUE);
+      self->capture_composed = FALSE;
+    }
+  }
 
   if (self->v4l2output->input_crop.w != 0) {
     gst_rect_to_v4l2_rect (&self->v4l2output->input_crop, &rect);
@@ -262,10 +997,28 @@ gst_rga_convert_set_caps (GstBaseTransform * trans, GstCaps * incaps,
   if (!gst_v4l2_object_set_crop (self->v4l2capture))
     goto failed;
 
+  GST_INFO_OBJECT (self, "Configured %s%s in %" GST_TIME_FORMAT,
+      restart_output ? "input " : "", restart_capture ? "output" : "",
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
   return TRUE;
 
+software:
+  {
+    if (!gst_rga_convert_setup_software (self))
+      goto failed;
+
+    GST_INFO_OBJECT (self, "Configured software conversion in %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (gst_util_get_timestamp () - start));
+    return TRUE;
+  }
 incaps_failed:
   {
+    if (self->software_fallback) {
+      GST_INFO_OBJECT (self, "RGA can't take %" GST_PTR_FORMAT, incaps);
+      gst_v4l2_clear_error (&error);
+      goto software;
+    }
     GST_ERROR_OBJECT (self, "failed to set input caps: %" GST_PTR_FORMAT,
         incaps);
     gst_v4l2_error (self, &error);
@@ -274,12 +1027,20 @@ incaps_failed:
 outcaps_failed:
   {
     gst_v4l2_object_stop (self->v4l2output);
+    if (self->software_fallback) {
+      GST_INFO_OBJECT (self, "RGA can't produce %" GST_PTR_FORMAT, outcaps);
+      gst_v4l2_clear_error (&error);
+      goto software;
+    }
     GST_ERROR_OBJECT (self, "failed to set output caps: %" GST_PTR_FORMAT,
         outcaps);
     gst_v4l2_error (self, &error);
     goto failed;
   }
 failed:
+  /* make the next attempt configure both queues again */
+  gst_caps_replace (&self->incaps, NULL);
+  gst_caps_replace (&self->outcaps, NULL);
   return FALSE;
 }
 
@@ -339,6 +1100,34 @@ gst_rga_convert_query (GstBaseTransform * trans, GstPadDirection direction,
   return ret;
 }
 
+/* every stripe is written into the same buffer, which must be a dmabuf
+ * the RGA can import */
+static gboolean
+gst_rga_convert_decide_stripes_allocation (GstRGAConvert * self,
+    GstQuery * query)
+{
+  GstRKV4l2Object *obj = self->striper->v4l2capture;
+  GstBufferPool *pool;
+  gsize size;
+
+  size = MAX (GST_VIDEO_INFO_SIZE (&obj->info), obj->format.fmt.pix.sizeimage);
+  pool = gst_rga_dmabuf_pool_new (self->drm_fd, self->allocator,
+      self->outcaps, &obj->info, size, GST_RGA_CONVERT_STRIPE_BUFFERS);
+  if (!pool)
+    return FALSE;
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size,
+        GST_RGA_CONVERT_STRIPE_BUFFERS, GST_RGA_CONVERT_STRIPE_BUFFERS);
+  else
+    gst_query_add_allocation_pool (query, pool, size,
+        GST_RGA_CONVERT_STRIPE_BUFFERS, GST_RGA_CONVERT_STRIPE_BUFFERS);
+  gst_object_unref (pool);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation
+      (GST_BASE_TRANSFORM (self), query);
+}
+
 static gboolean
 gst_rga_convert_decide_allocation (GstBaseTransform * trans, GstQuery * query)
 {
@@ -347,6 +1136,13 @@ gst_rga_convert_decide_allocation (GstBaseTransform * trans, GstQuery * query)
 
   GST_DEBUG_OBJECT (self, "called");
 
+  if (self->stripes)
+    return gst_rga_convert_decide_stripes_allocation (self, query);
+
+  if (self->soft)
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+        query);
+
   if (gst_v4l2_object_decide_allocation (self->v4l2capture, query)) {
     GstBufferPool *pool = GST_BUFFER_POOL (self->v4l2capture->pool);
 
@@ -355,16 +1151,60 @@ gst_rga_convert_decide_allocation (GstBaseTransform * trans, GstQuery * query)
 
     if (!gst_buffer_pool_set_active (pool, TRUE))
       goto activate_failed;
+
+    /* the capture queue starts streaming on activation */
+    if (self->software_fallback && gst_rga_convert_pool_busy (pool))
+      goto busy;
   }
 
   return ret;
 
+busy:
+  if (!gst_rga_convert_busy_fallback (self))
+    return FALSE;
+
+  while (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_remove_nth_allocation_pool (query, 0);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+      query);
+
 activate_failed:
   GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
       ("failed to activate bufferpool"), ("failed to activate bufferpool"));
   return TRUE;
 }
 
+/* let upstream write straight into dmabufs the RGA can read */
+static gboolean
+gst_rga_convert_propose_stripes_allocation (GstRGAConvert * self,
+    GstQuery * query)
+{
+  GstRKV4l2Object *obj = self->striper->v4l2output;
+  GstBufferPool *pool;
+  GstCaps *caps;
+  gboolean need_pool;
+  gsize size;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  if (need_pool && caps) {
+    size = MAX (GST_VIDEO_INFO_SIZE (&obj->info),
+        obj->format.fmt.pix.sizeimage);
+    pool = gst_rga_dmabuf_pool_new (self->drm_fd, self->allocator, caps,
+        &obj->info, size, GST_RGA_CONVERT_STRIPE_BUFFERS);
+    if (pool) {
+      gst_query_add_allocation_pool (query, pool, size, 2,
+          GST_RGA_CONVERT_STRIPE_BUFFERS);
+      gst_object_unref (pool);
+    }
+  }
+
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+  return TRUE;
+}
+
 static gboolean
 gst_rga_convert_propose_allocation (GstBaseTransform * trans,
     GstQuery * decide_query, GstQuery * query)
@@ -376,6 +1216,10 @@ gst_rga_convert_propose_allocation (GstBaseTransform * trans,
 
   if (decide_query == NULL)
     ret = TRUE;
+  else if (self->stripes)
+    ret = gst_rga_convert_propose_stripes_allocation (self, query);
+  else if (self->soft)
+    ret = TRUE;
   else
     ret = gst_v4l2_object_propose_allocation (self->v4l2output, query);
 
@@ -908,6 +1752,255 @@ done:
   return othercaps;
 }
 
+/* the RGA cost of a job is driven by the larger side of the conversion */
+static guint64
+gst_rga_convert_job_pixels (GstRGAConvert * self)
+{
+  GstVideoInfo *in = &self->v4l2output->info;
+  GstVideoInfo *out = &self->v4l2capture->info;
+
+  return MAX ((guint64) GST_VIDEO_INFO_WIDTH (in) * GST_VIDEO_INFO_HEIGHT (in),
+      (guint64) GST_VIDEO_INFO_WIDTH (out) * GST_VIDEO_INFO_HEIGHT (out));
+}
+
+static void
+gst_rga_convert_update_stats (GstRGAConvert * self, GstClockTime wait,
+    GstClockTime latency, gsize bytes_in, gsize bytes_out)
+{
+  GstStructure *s;
+
+  gst_rga_stats_add_frame (self->stats, wait, latency, bytes_in, bytes_out);
+
+  if (self->stats_interval == 0 || !gst_rga_stats_due (self->stats,
+          self->stats_interval * GST_MSECOND))
+    return;
+
+  s = gst_rga_stats_get (self->stats);
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), s));
+}
+
+/* take the oldest frame out of the RGA, the jobs complete in order */
+static GstFlowReturn
+gst_rga_convert_dequeue (GstRGAConvert * self, GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBaseTransformClass *bclass = GST_BASE_TRANSFORM_CLASS (parent_class);
+  GstBufferPool *pool;
+  GstBuffer *meta;
+  GstRGAConvertJob *job;
+  GstFlowReturn ret;
+
+  pool = gst_base_transform_get_buffer_pool (trans);
+  if (!pool || !gst_buffer_pool_set_active (pool, TRUE)) {
+    if (pool)
+      gst_object_unref (pool);
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("failed to activate bufferpool"), ("failed to activate bufferpool"));
+    return GST_FLOW_ERROR;
+  }
+
+  GST_DEBUG_OBJECT (self, "Dequeue output buffer");
+  ret = gst_buffer_pool_acquire_buffer (pool, outbuf, NULL);
+  gst_object_unref (pool);
+
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  ret = gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL
+      (self->v4l2capture->pool), outbuf);
+  gst_rga_scheduler_release (self->sched);
+
+  meta = g_queue_pop_head (&self->pending);
+
+  if (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER) {
+    GST_WARNING_OBJECT (self, "dropping corrupted frame");
+    gst_rga_stats_add_corrupted (self->stats, TRUE);
+    gst_buffer_replace (&meta, NULL);
+    gst_buffer_replace (outbuf, NULL);
+    return ret;
+  }
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_replace (outbuf, NULL);
+    gst_buffer_replace (&meta, NULL);
+    return ret;
+  }
+
+  if (meta) {
+    job = gst_mini_object_get_qdata (GST_MINI_OBJECT (meta),
+        gst_rga_convert_job_quark);
+    if (job)
+      gst_rga_convert_update_stats (self, job->wait,
+          gst_util_get_timestamp () - job->queued, job->size,
+          gst_buffer_get_size (*outbuf));
+
+    if (bclass->copy_metadata && !bclass->copy_metadata (trans, meta, *outbuf))
+      GST_ELEMENT_WARNING (self, STREAM, NOT_IMPLEMENTED,
+          ("could not copy metadata"), (NULL));
+    gst_buffer_unref (meta);
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* queue the input in the RGA, generate_output () takes it out later */
+static GstFlowReturn
+gst_rga_convert_queue_input (GstRGAConvert * self, GstBuffer * inbuf)
+{
+  GstBufferPool *pool = GST_BUFFER_POOL (self->v4l2output->pool);
+  guint64 pixels = gst_rga_convert_job_pixels (self);
+  GstRGAConvertJob *job;
+  GstClockTime start;
+  GstBuffer *meta, *outbuf;
+  GstFlowReturn ret;
+
+  start = gst_util_get_timestamp ();
+
+  /* only wait for the scheduler with nothing of ours in the RGA, else
+   * make room by taking our oldest frame out, it is pushed next */
+  while (!gst_rga_scheduler_try_acquire (self->sched, pixels)) {
+    if (g_queue_is_empty (&self->pending)) {
+      if (!gst_rga_scheduler_acquire (self->sched, pixels))
+        return GST_FLOW_FLUSHING;
+      break;
+    }
+
+    outbuf = NULL;
+    ret = gst_rga_convert_dequeue (self, &outbuf);
+    if (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER)
+      continue;
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    g_queue_push_tail (&self->ready, outbuf);
+  }
+
+  /* the input is gone once queued, its metadata is applied on dequeue */
+  meta = gst_buffer_new ();
+  gst_buffer_copy_into (meta, inbuf, GST_BUFFER_COPY_METADATA, 0, -1);
+
+  job = g_new (GstRGAConvertJob, 1);
+  job->queued = gst_util_get_timestamp ();
+  job->wait = job->queued - start;
+  job->size = gst_buffer_get_size (inbuf);
+  gst_mini_object_set_qdata (GST_MINI_OBJECT (meta),
+      gst_rga_convert_job_quark, job, g_free);
+
+  GST_DEBUG_OBJECT (self, "Queue input buffer");
+  ret = gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (pool), &inbuf);
+  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+    gst_rga_scheduler_release (self->sched);
+    gst_buffer_unref (meta);
+    return ret;
+  }
+
+  g_queue_push_tail (&self->pending, meta);
+
+  return GST_FLOW_OK;
+}
+
+/* the input queue is set up on the first frame, once the caps are known */
+static gboolean
+gst_rga_convert_activate_input (GstRGAConvert * self)
+{
+  GstBufferPool *pool = GST_BUFFER_POOL (self->v4l2output->pool);
+  GstStructure *config;
+  gint min;
+
+  if (gst_buffer_pool_is_active (pool))
+    return TRUE;
+
+  config = gst_buffer_pool_get_config (pool);
+  min = self->v4l2output->min_buffers == 0 ? GST_V4L2_MIN_BUFFERS :
+      self->v4l2output->min_buffers;
+
+  /* one more than in flight so the next input can be prepared */
+  min = MAX (min, self->frames_in_flight + 1);
+  gst_buffer_pool_config_set_params (config, self->incaps,
+      self->v4l2output->info.size, min, min);
+
+  /* There is no reason to refuse this config */
+  if (!gst_buffer_pool_set_config (pool, config))
+    return FALSE;
+
+  return gst_buffer_pool_set_active (pool, TRUE);
+}
+
+/* converted in transform (), the RGA pool negotiated before falling back is
+ * only replaced on the next reconfigure */
+static GstFlowReturn
+gst_rga_convert_prepare_software (GstRGAConvert * self, GstBuffer * inbuf,
+    GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBaseTransformClass *bclass = GST_BASE_TRANSFORM_CLASS (parent_class);
+  GstBufferPool *pool;
+  GstVideoInfo info;
+  gboolean stale;
+
+  pool = gst_base_transform_get_buffer_pool (trans);
+  stale = pool && GST_IS_V4L2_BUFFER_POOL (pool);
+  if (pool)
+    gst_object_unref (pool);
+
+  if (!stale)
+    return bclass->prepare_output_buffer (trans, inbuf, outbuf);
+
+  if (!gst_video_info_from_caps (&info, self->outcaps))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  *outbuf = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&info), NULL);
+  if (bclass->copy_metadata && !bclass->copy_metadata (trans, inbuf, *outbuf))
+    GST_ELEMENT_WARNING (self, STREAM, NOT_IMPLEMENTED,
+        ("could not copy metadata"), (NULL));
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_rga_convert_prepare_stripes (GstRGAConvert * self, GstBuffer * inbuf,
+    GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBaseTransformClass *bclass = GST_BASE_TRANSFORM_CLASS (parent_class);
+  GstBufferPool *pool;
+  GstClockTime start, wait = 0;
+  GstFlowReturn ret;
+
+  pool = gst_base_transform_get_buffer_pool (trans);
+  if (!pool || !gst_buffer_pool_set_active (pool, TRUE)) {
+    if (pool)
+      gst_object_unref (pool);
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("failed to activate bufferpool"), ("failed to activate bufferpool"));
+    return GST_FLOW_ERROR;
+  }
+
+  ret = gst_buffer_pool_acquire_buffer (pool, outbuf, NULL);
+  gst_object_unref (pool);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  start = gst_util_get_timestamp ();
+  ret = gst_rga_convert_process_stripes (self, inbuf, *outbuf, &wait);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (*outbuf);
+    *outbuf = NULL;
+    return ret;
+  }
+
+  gst_rga_convert_update_stats (self, wait,
+      gst_util_get_timestamp () - start - wait, gst_buffer_get_size (inbuf),
+      gst_buffer_get_size (*outbuf));
+
+  if (bclass->copy_metadata && !bclass->copy_metadata (trans, inbuf, *outbuf))
+    GST_ELEMENT_WARNING (self, STREAM, NOT_IMPLEMENTED,
+        ("could not copy metadata"), (NULL));
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_rga_convert_prepare_output_buffer (GstBaseTransform * trans,
     GstBuffer * inbuf, GstBuffer ** outbuf)
@@ -916,43 +2009,55 @@ gst_rga_convert_prepare_output_buffer (GstBaseTransform * trans,
   GstBufferPool *pool = GST_BUFFER_POOL (self->v4l2output->pool);
   GstFlowReturn ret = GST_FLOW_OK;
   GstBaseTransformClass *bclass = GST_BASE_TRANSFORM_CLASS (parent_class);
-  struct timespec start, end;
-  unsigned long long time_consumed;
+  GstClockTime start, queued, done;
 
   if (gst_base_transform_is_passthrough (trans)) {
     GST_DEBUG_OBJECT (self, "Passthrough, no need to do anything");
     *outbuf = inbuf;
+    if (self->crop_meta)
+      *outbuf = gst_rga_convert_add_crop_meta (self, inbuf);
     goto beach;
   }
 
-  /* Ensure input internal pool is active */
-  if (!gst_buffer_pool_is_active (pool)) {
-    GstStructure *config = gst_buffer_pool_get_config (pool);
-    gint min = self->v4l2output->min_buffers == 0 ? GST_V4L2_MIN_BUFFERS :
-        self->v4l2output->min_buffers;
-    gst_buffer_pool_config_set_params (config, self->incaps,
-        self->v4l2output->info.size, min, min);
+  if (self->stripes) {
+    ret = gst_rga_convert_prepare_stripes (self, inbuf, outbuf);
+    goto beach;
+  }
 
-    /* There is no reason to refuse this config */
-    if (!gst_buffer_pool_set_config (pool, config))
-      goto activate_failed;
+  if (self->soft)
+    goto software;
 
-    if (!gst_buffer_pool_set_active (pool, TRUE))
-      goto activate_failed;
+  if (!gst_rga_convert_activate_input (self))
+    goto activate_failed;
+
+  /* wait for our turn on the RGA, the job is done once the output is back */
+  start = gst_util_get_timestamp ();
+  if (!gst_rga_scheduler_acquire (self->sched,
+          gst_rga_convert_job_pixels (self))) {
+    ret = GST_FLOW_FLUSHING;
+    goto beach;
   }
 
   GST_DEBUG_OBJECT (self, "Queue input buffer");
   ret = gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (pool), &inbuf);
-  if (G_UNLIKELY (ret != GST_FLOW_OK))
+  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+    gst_rga_scheduler_release (self->sched);
+    /* the output queue starts streaming on the first frame */
+    if (self->software_fallback && gst_rga_convert_pool_busy (pool))
+      goto busy;
     goto beach;
+  }
 
-  clock_gettime (CLOCK_MONOTONIC, &start);
+  queued = gst_util_get_timestamp ();
 
   do {
     pool = gst_base_transform_get_buffer_pool (trans);
 
-    if (!gst_buffer_pool_set_active (pool, TRUE))
+    if (!gst_buffer_pool_set_active (pool, TRUE)) {
+      gst_object_unref (pool);
+      gst_rga_scheduler_release (self->sched);
       goto activate_failed;
+    }
 
     GST_DEBUG_OBJECT (self, "Dequeue output buffer");
     ret = gst_buffer_pool_acquire_buffer (pool, outbuf, NULL);
@@ -964,21 +2069,25 @@ gst_rga_convert_prepare_output_buffer (GstBaseTransform * trans,
     pool = self->v4l2capture->pool;
     ret = gst_v4l2_buffer_pool_process (GST_V4L2_BUFFER_POOL (pool), outbuf);
 
+    if (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER)
+      gst_rga_stats_add_corrupted (self->stats, FALSE);
   } while (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER);
 
-  clock_gettime (CLOCK_MONOTONIC, &end);
+  gst_rga_scheduler_release (self->sched);
 
-  time_consumed = (end.tv_sec - start.tv_sec) * 1000000000ULL;
-  time_consumed += (end.tv_nsec - start.tv_nsec);
-  time_consumed /= 1000;
-
-  GST_INFO_OBJECT (self, "Time cost: %f msecs\n", time_consumed * 1.0 / 1000);
+  done = gst_util_get_timestamp ();
+  GST_INFO_OBJECT (self, "Time cost: %f msecs",
+      (gdouble) (done - queued) / GST_MSECOND);
 
   if (ret != GST_FLOW_OK) {
     gst_buffer_unref (*outbuf);
     *outbuf = NULL;
+    goto beach;
   }
 
+  gst_rga_convert_update_stats (self, queued - start, done - queued,
+      gst_buffer_get_size (inbuf), gst_buffer_get_size (*outbuf));
+
   if (bclass->copy_metadata)
     if (!bclass->copy_metadata (trans, inbuf, *outbuf)) {
       /* something failed, post a warning */
@@ -989,14 +2098,97 @@ gst_rga_convert_prepare_output_buffer (GstBaseTransform * trans,
 beach:
   return ret;
 
+busy:
+  if (!gst_rga_convert_busy_fallback (self))
+    return GST_FLOW_ERROR;
+
+software:
+  return gst_rga_convert_prepare_software (self, inbuf, outbuf);
+
 activate_failed:
   GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
       ("failed to activate bufferpool"), ("failed to activate bufferpool"));
-  g_object_unref (pool);
   return GST_FLOW_ERROR;
 
 alloc_failed:
   GST_DEBUG_OBJECT (self, "could not allocate buffer from pool");
+  gst_rga_scheduler_release (self->sched);
+  return ret;
+}
+
+/* with frames in flight, the input is queued in the RGA here and the
+ * converted frames are taken out by generate_output () */
+static GstFlowReturn
+gst_rga_convert_submit_input_buffer (GstBaseTransform * trans,
+    gboolean is_discont, GstBuffer * input)
+{
+  GstRGAConvert *self = GST_RGA_CONVERT (trans);
+  GstBufferPool *pool;
+  GstBuffer *inbuf;
+  GstFlowReturn ret;
+
+  /* QoS first, a late frame is not worth converting */
+  ret = GST_BASE_TRANSFORM_CLASS (parent_class)->submit_input_buffer (trans,
+      is_discont, input);
+  if (ret != GST_FLOW_OK || !gst_rga_convert_is_pipelined (self))
+    return ret;
+
+  inbuf = trans->queued_buf;
+  trans->queued_buf = NULL;
+  if (!inbuf)
+    return GST_FLOW_OK;
+
+  if (!gst_rga_convert_activate_input (self)) {
+    gst_buffer_unref (inbuf);
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("failed to activate bufferpool"), ("failed to activate bufferpool"));
+    return GST_FLOW_ERROR;
+  }
+
+  pool = self->v4l2output->pool;
+  ret = gst_rga_convert_queue_input (self, inbuf);
+
+  /* the output queue starts streaming on the first frame */
+  if (ret == GST_FLOW_ERROR && self->software_fallback
+      && gst_rga_convert_pool_busy (pool)) {
+    if (!gst_rga_convert_busy_fallback (self)) {
+      gst_buffer_unref (inbuf);
+      return GST_FLOW_ERROR;
+    }
+
+    /* converted by the default generate_output () */
+    trans->queued_buf = inbuf;
+    return GST_FLOW_OK;
+  }
+
+  gst_buffer_unref (inbuf);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_rga_convert_generate_output (GstBaseTransform * trans, GstBuffer ** outbuf)
+{
+  GstRGAConvert *self = GST_RGA_CONVERT (trans);
+  GstFlowReturn ret;
+
+  if (!gst_rga_convert_is_pipelined (self))
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->generate_output (trans,
+        outbuf);
+
+  /* frames taken out early to make room go first */
+  *outbuf = g_queue_pop_head (&self->ready);
+  if (*outbuf)
+    return GST_FLOW_OK;
+
+  /* keep the RGA busy until it holds frames-in-flight frames */
+  if (g_queue_get_length (&self->pending) < self->frames_in_flight)
+    return GST_FLOW_OK;
+
+  ret = gst_rga_convert_dequeue (self, outbuf);
+  if (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER)
+    ret = GST_FLOW_OK;
+
   return ret;
 }
 
@@ -1004,7 +2196,23 @@ static GstFlowReturn
 gst_rga_convert_transform (GstBaseTransform * trans, GstBuffer * inbuf,
     GstBuffer * outbuf)
 {
-  /* Nothing to do */
+  GstRGAConvert *self = GST_RGA_CONVERT (trans);
+  GstClockTime start;
+
+  /* Nothing to do, the RGA already wrote the output */
+  if (!self->soft)
+    return GST_FLOW_OK;
+
+  start = gst_util_get_timestamp ();
+  if (!gst_rga_soft_converter_process (self->soft, inbuf, outbuf)) {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED,
+        ("software conversion failed"), (NULL));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_rga_convert_update_stats (self, 0, gst_util_get_timestamp () - start,
+      gst_buffer_get_size (inbuf), gst_buffer_get_size (outbuf));
+
   return GST_FLOW_OK;
 }
 
@@ -1021,10 +2229,16 @@ gst_rga_convert_sink_event (GstBaseTransform * trans, GstEvent * event)
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_FLUSH_START:
       GST_DEBUG_OBJECT (self, "flush start");
+      gst_rga_scheduler_client_set_flushing (self->sched, TRUE);
       gst_v4l2_object_unlock (self->v4l2output);
       gst_v4l2_object_unlock (self->v4l2capture);
       break;
+    case GST_EVENT_FLUSH_STOP:
+      break;
     default:
+      /* keep serialized events behind the frames still in flight */
+      if (GST_EVENT_IS_SERIALIZED (event))
+        gst_rga_convert_drain (self);
       break;
   }
 
@@ -1034,8 +2248,10 @@ gst_rga_convert_sink_event (GstBaseTransform * trans, GstEvent * event)
     case GST_EVENT_FLUSH_STOP:
       /* Buffer should be back now */
       GST_DEBUG_OBJECT (self, "flush stop");
+      gst_rga_convert_clear_pending (self);
       gst_v4l2_object_unlock_stop (self->v4l2capture);
       gst_v4l2_object_unlock_stop (self->v4l2output);
+      gst_rga_scheduler_client_set_flushing (self->sched, FALSE);
       break;
     default:
       break;
@@ -1055,7 +2271,11 @@ gst_rga_convert_change_state (GstElement * element, GstStateChange transition)
       if (!gst_rga_convert_open (self))
         return GST_STATE_CHANGE_FAILURE;
       break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rga_scheduler_client_set_flushing (self->sched, FALSE);
+      break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rga_scheduler_client_set_flushing (self->sched, TRUE);
       gst_v4l2_object_unlock (self->v4l2output);
       gst_v4l2_object_unlock (self->v4l2capture);
       break;
@@ -1094,6 +2314,8 @@ gst_rga_convert_finalize (GObject * object)
 
   gst_v4l2_object_destroy (self->v4l2capture);
   gst_v4l2_object_destroy (self->v4l2output);
+  g_free (self->drm_device);
+  gst_rga_stats_free (self->stats);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -1115,6 +2337,17 @@ gst_rga_convert_init (GstRGAConvert * self)
   self->v4l2capture->no_initial_format = TRUE;
   self->v4l2output->keep_aspect = FALSE;
 
+  self->frames_in_flight = DEFAULT_PROP_FRAMES_IN_FLIGHT;
+  self->priority = DEFAULT_PROP_PRIORITY;
+  self->drm_device = g_strdup (DEFAULT_PROP_DRM_DEVICE);
+  self->drm_fd = -1;
+  self->software_fallback = DEFAULT_PROP_SOFTWARE_FALLBACK;
+  self->software_threads = DEFAULT_PROP_SOFTWARE_THREADS;
+  self->stats = gst_rga_stats_new ();
+  self->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  g_queue_init (&self->pending);
+  g_queue_init (&self->ready);
+
   /* V4L2 object are created in subinstance_init */
   /* enable QoS */
   gst_base_transform_set_qos_enabled (GST_BASE_TRANSFORM (self), TRUE);
@@ -1140,6 +2373,8 @@ gst_rga_convert_class_init (GstRGAConvertClass * klass)
   GST_DEBUG_CATEGORY_INIT (gst_rga_convert_debug, "rgaconvert", 0,
       "V4L2 Converter(Rockchip)");
 
+  gst_rga_convert_job_quark = g_quark_from_static_string ("GstRGAConvertJob");
+
   gst_element_class_set_static_metadata (element_class,
       "RGA Video Converter",
       "Filter/Converter/Video/Scaler", "Transform streams via V4L2 API", " ");
@@ -1166,6 +2401,10 @@ gst_rga_convert_class_init (GstRGAConvertClass * klass)
       GST_DEBUG_FUNCPTR (gst_rga_convert_fixate_caps);
   base_transform_class->prepare_output_buffer =
       GST_DEBUG_FUNCPTR (gst_rga_convert_prepare_output_buffer);
+  base_transform_class->submit_input_buffer =
+      GST_DEBUG_FUNCPTR (gst_rga_convert_submit_input_buffer);
+  base_transform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_rga_convert_generate_output);
   base_transform_class->transform =
       GST_DEBUG_FUNCPTR (gst_rga_convert_transform);
 
@@ -1176,4 +2415,54 @@ gst_rga_convert_class_init (GstRGAConvertClass * klass)
 
   gst_v4l2_object_install_m2m_properties_helper (gobject_class);
   rk_common_install_rockchip_properties_helper (gobject_class);
+
+  g_object_class_install_property (gobject_class, PROP_FRAMES_IN_FLIGHT,
+      g_param_spec_uint ("frames-in-flight", "Frames in flight",
+          "Number of frames queued in the RGA before waiting for one to "
+          "complete, above 1 the output lags the input by as many frames", 1,
+          16, DEFAULT_PROP_FRAMES_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PRIORITY,
+      g_param_spec_enum ("priority", "Priority",
+          "Priority of the conversions among all RGA converters of the "
+          "process", GST_TYPE_RGA_PRIORITY, DEFAULT_PROP_PRIORITY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCHEDULER_STATS,
+      g_param_spec_boxed ("scheduler-stats", "Scheduler stats",
+          "Jobs, time waited for the RGA and time spent in it",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DRM_DEVICE,
+      g_param_spec_string ("drm-device", "DRM device",
+          "DRM device the output dmabufs are allocated from when frames are "
+          "converted in stripes", DEFAULT_PROP_DRM_DEVICE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SOFTWARE_FALLBACK,
+      g_param_spec_boolean ("software-fallback", "Software fallback",
+          "Convert on the CPU when there is no RGA, it is busy or it refuses "
+          "the caps",
+          DEFAULT_PROP_SOFTWARE_FALLBACK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SOFTWARE_THREADS,
+      g_param_spec_uint ("software-threads", "Software threads",
+          "Threads converting the frame in software (0 = one per CPU)", 0, 64,
+          DEFAULT_PROP_SOFTWARE_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Conversion counters: frames, corrupted, dropped, bytes-in, "
+          "bytes-out and fps, and over the last frames min/avg/p99/max "
+          "latency and avg/max queue time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Stats interval",
+          "Post the stats as an element message every this many ms "
+          "(0 = never)", 0, G_MAXUINT, DEFAULT_PROP_STATS_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
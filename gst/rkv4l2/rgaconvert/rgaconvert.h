@@ -27,6 +27,11 @@
 #include <gstv4l2object.h>
 #include <gstv4l2bufferpool.h>
 
+#include "rga/rgacontext.h"
+#include "rga/rgascheduler.h"
+#include "rga/rgasoftconvert.h"
+#include "rga/rgastats.h"
+
 GST_DEBUG_CATEGORY_EXTERN (v4l2transform_debug);
 
 G_BEGIN_DECLS
@@ -62,6 +67,35 @@ struct _GstRGAConvert
   GstCaps *outcaps;
 
   gchar default_device[32];
+
+  /* pipelined mode, the output lags the input by frames_in_flight frames */
+  guint frames_in_flight;
+  GQueue pending;               /* metadata of the frames queued in the RGA */
+  GQueue ready;                 /* taken out to make room, not pushed yet */
+
+  /* share of the RGA among all converters of the process */
+  GstRGASchedulerClient *sched;
+  GstRGAPriority priority;
+
+  /* frames beyond the size of a RGA job, converted stripe by stripe on a
+   * context of their own into dumb buffers of the DRM device */
+  GArray *stripes;
+  GstRGAContext *striper;
+  gchar *drm_device;
+  gint drm_fd;
+  GstAllocator *allocator;
+
+  /* caps the RGA refuses, or any caps without a RGA, converted on the CPU */
+  gboolean software_fallback;
+  guint software_threads;
+  gboolean software_only;
+  GstRGASoftConverter *soft;
+
+  gboolean crop_meta;           /* passthrough, downstream crops */
+  gboolean capture_composed;    /* output smaller than the capture format */
+
+  GstRGAStats *stats;
+  guint stats_interval;         /* ms between stats messages, 0 for none */
 };
 
 struct _GstRGAConvertClass
@@ -0,0 +1,871 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/**
+ * SECTION:element-rgamulticonvert
+ *
+ * Converts one input into several renditions with the RGA. Every src pad
+ * gets its own m2m context with its own caps, crop, rotation and flip. The
+ * input is imported once, every conversion is queued back to back and the
+ * results are pushed from the streaming thread, so it replaces a tee in
+ * front of several rgaconvert.
+ *
+ * <refsect2>
+ * |[
+ * gst-launch-1.0 v4l2src ! rgamulticonvert name=m \
+ *     m. ! video/x-raw,width=1920,height=1080 ! queue ! mpph264enc ! fakesink \
+ *     m. ! video/x-raw,width=640,height=360 ! queue ! kmssink \
+ *     m. ! video/x-raw,format=BGR,width=300,height=300 ! queue ! appsink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include <gst/allocators/gstdmabuf.h>
+#include <gst/video/video.h>
+
+#include "common.h"
+#include "rga/rgadmabuf.h"
+#include "rgamulticonvert.h"
+
+#include <gst/gst-i18n-plugin.h>
+
+#define DEFAULT_PROP_DRM_DEVICE "/dev/dri/card0"
+
+/* output buffers of every pad, also its number of capture buffers */
+#define GST_RGA_MULTI_CONVERT_MAX_BUFFERS 4
+
+GST_DEBUG_CATEGORY_STATIC (gst_rga_multi_convert_debug);
+#define GST_CAT_DEFAULT gst_rga_multi_convert_debug
+
+static GstStaticPadTemplate gst_rga_multi_convert_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw, "
+        "framerate = (fraction) [ 0, MAX ], "
+        "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]")
+    );
+
+static GstStaticPadTemplate gst_rga_multi_convert_src_template =
+GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("video/x-raw, "
+        "framerate = (fraction) [ 0, MAX ], "
+        "width = (int) [ 1, MAX ], " "height = (int) [ 1, MAX ]")
+    );
+
+/*
+ * GstRGAMultiConvertPad
+ */
+
+/* same ids as rgaconvert, so the rockchip helpers can be reused */
+enum
+{
+  PROP_PAD_0,
+  V4L2_STD_OBJECT_PROPS,
+};
+
+G_DEFINE_TYPE (GstRGAMultiConvertPad, gst_rga_multi_convert_pad,
+    GST_TYPE_PAD);
+
+static void
+gst_rga_multi_convert_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRGAMultiConvertPad *pad = GST_RGA_MULTI_CONVERT_PAD (object);
+
+  if (!pad->ctx || !rk_common_set_property_helper (pad->ctx->v4l2output,
+          prop_id, value, pspec)) {
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    return;
+  }
+
+  /* applied with the next frame */
+  pad->reconfigure = TRUE;
+}
+
+static void
+gst_rga_multi_convert_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRGAMultiConvertPad *pad = GST_RGA_MULTI_CONVERT_PAD (object);
+
+  if (!pad->ctx || !rk_common_get_property_helper (pad->ctx->v4l2output,
+          prop_id, value, pspec))
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+}
+
+static void
+gst_rga_multi_convert_pad_finalize (GObject * object)
+{
+  GstRGAMultiConvertPad *pad = GST_RGA_MULTI_CONVERT_PAD (object);
+
+  if (pad->pool) {
+    gst_buffer_pool_set_active (pad->pool, FALSE);
+    gst_object_unref (pad->pool);
+  }
+  if (pad->ctx)
+    gst_rga_context_free (pad->ctx);
+  gst_caps_replace (&pad->caps, NULL);
+
+  G_OBJECT_CLASS (gst_rga_multi_convert_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_rga_multi_convert_pad_init (GstRGAMultiConvertPad * pad)
+{
+  pad->reconfigure = TRUE;
+}
+
+static void
+gst_rga_multi_convert_pad_class_init (GstRGAMultiConvertPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_rga_multi_convert_pad_set_property;
+  gobject_class->get_property = gst_rga_multi_convert_pad_get_property;
+  gobject_class->finalize = gst_rga_multi_convert_pad_finalize;
+
+  /* the rga subset of rk_common_install_rockchip_properties_helper() */
+  g_object_class_install_property (gobject_class, PROP_INPUT_CROP,
+      g_param_spec_string ("input-crop", "input-crop",
+          " ", " ", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_CROP,
+      g_param_spec_string ("output-crop", "output-crop",
+          " ", " ", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_ROTATION,
+      g_param_spec_uint ("rotation", "rotation",
+          "Output rotation in 90-degree steps", 0, 360, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HFLIP,
+      g_param_spec_boolean ("hflip", "hflip",
+          "horizontal flip", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_VFLIP,
+      g_param_spec_boolean ("vflip", "vflip",
+          "vertical flip", FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+/*
+ * negotiation
+ */
+
+typedef struct
+{
+  GstPad *pad;
+  gboolean after_caps;
+} GstRGAMultiConvertStickyData;
+
+/* pads requested late miss the events already sent, caps are our own */
+static gboolean
+gst_rga_multi_convert_copy_sticky (GstPad * sinkpad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstRGAMultiConvertStickyData *data = user_data;
+  GstEventType type = GST_EVENT_TYPE (*event);
+
+  if (type == GST_EVENT_CAPS || type == GST_EVENT_EOS)
+    return TRUE;
+
+  if ((type > GST_EVENT_CAPS) == data->after_caps)
+    gst_pad_store_sticky_event (data->pad, *event);
+
+  return TRUE;
+}
+
+/* keep the input format and size unless downstream asks otherwise */
+static GstCaps *
+gst_rga_multi_convert_fixate (GstRGAMultiConvert * self,
+    GstRGAMultiConvertPad * pad, GstCaps * caps)
+{
+  GstRKV4l2Object *obj = pad->ctx->v4l2output;
+  GstStructure *s;
+  gint width = GST_VIDEO_INFO_WIDTH (&self->info);
+  gint height = GST_VIDEO_INFO_HEIGHT (&self->info);
+  gint fps_n = GST_VIDEO_INFO_FPS_N (&self->info);
+  gint fps_d = GST_VIDEO_INFO_FPS_D (&self->info);
+
+  if (obj->input_crop.w != 0) {
+    width = obj->input_crop.w;
+    height = obj->input_crop.h;
+  }
+
+  if (obj->rotation == 90 || obj->rotation == 270) {
+    gint tmp = width;
+    width = height;
+    height = tmp;
+  }
+
+  caps = gst_caps_make_writable (gst_caps_truncate (caps));
+  s = gst_caps_get_structure (caps, 0);
+
+  gst_structure_fixate_field_string (s, "format",
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&self->info)));
+  gst_structure_fixate_field_nearest_int (s, "width", width);
+  gst_structure_fixate_field_nearest_int (s, "height", height);
+  if (gst_structure_has_field (s, "framerate"))
+    gst_structure_fixate_field_nearest_fraction (s, "framerate", fps_n, fps_d);
+  else
+    gst_structure_set (s, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+  if (gst_structure_has_field (s, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio", 1, 1);
+
+  return gst_caps_fixate (caps);
+}
+
+static gboolean
+gst_rga_multi_convert_pad_negotiate (GstRGAMultiConvert * self,
+    GstRGAMultiConvertPad * pad)
+{
+  GstRGAMultiConvertStickyData sticky = { GST_PAD (pad), FALSE };
+  GstRKV4l2Object *obj;
+  GstCaps *filter, *peercaps, *caps;
+  gsize size;
+
+  if (!self->sinkcaps)
+    return FALSE;
+
+  pad->reconfigure = FALSE;
+
+  /* formats the RGA can write */
+  filter = gst_v4l2_object_get_caps (pad->ctx->v4l2capture,
+      gst_v4l2_object_get_raw_caps ());
+  peercaps = gst_pad_peer_query_caps (GST_PAD (pad), filter);
+  gst_caps_unref (filter);
+
+  if (gst_caps_is_empty (peercaps)) {
+    gst_caps_unref (peercaps);
+    goto no_format;
+  }
+
+  caps = gst_rga_multi_convert_fixate (self, pad, peercaps);
+
+  GST_DEBUG_OBJECT (pad, "output caps %" GST_PTR_FORMAT, caps);
+
+  gst_pad_sticky_events_foreach (self->sinkpad,
+      gst_rga_multi_convert_copy_sticky, &sticky);
+
+  if (!pad->caps || !gst_caps_is_equal (caps, pad->caps)) {
+    if (!gst_pad_set_caps (GST_PAD (pad), caps)) {
+      gst_caps_unref (caps);
+      goto no_format;
+    }
+    gst_caps_replace (&pad->caps, caps);
+  }
+  gst_caps_unref (caps);
+
+  sticky.after_caps = TRUE;
+  gst_pad_sticky_events_foreach (self->sinkpad,
+      gst_rga_multi_convert_copy_sticky, &sticky);
+
+  if (pad->pool) {
+    gst_buffer_pool_set_active (pad->pool, FALSE);
+    gst_object_unref (pad->pool);
+    pad->pool = NULL;
+  }
+
+  if (!gst_rga_context_configure (pad->ctx, self->sinkcaps, pad->caps,
+          GST_RGA_MULTI_CONVERT_MAX_BUFFERS))
+    goto failed;
+
+  /* laid out as the driver expects the capture buffers */
+  obj = pad->ctx->v4l2capture;
+  size = MAX (GST_VIDEO_INFO_SIZE (&obj->info), obj->format.fmt.pix.sizeimage);
+  pad->pool = gst_rga_dmabuf_pool_new (self->drm_fd, self->allocator,
+      pad->caps, &obj->info, size, GST_RGA_MULTI_CONVERT_MAX_BUFFERS);
+  if (!pad->pool || !gst_buffer_pool_set_active (pad->pool, TRUE))
+    goto pool_failed;
+
+  return TRUE;
+
+no_format:
+  {
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("no output format %s:%s accepts", GST_DEBUG_PAD_NAME (pad)));
+    goto failed;
+  }
+pool_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("failed to activate bufferpool"), ("failed to activate bufferpool"));
+    if (pad->pool)
+      gst_object_unref (pad->pool);
+    pad->pool = NULL;
+    goto failed;
+  }
+failed:
+  pad->reconfigure = TRUE;
+  return FALSE;
+}
+
+/* make sure @pad can take a conversion of the current input */
+static GstFlowReturn
+gst_rga_multi_convert_pad_prepare (GstRGAMultiConvert * self,
+    GstRGAMultiConvertPad * pad)
+{
+  if (!gst_pad_is_linked (GST_PAD (pad)))
+    return GST_FLOW_NOT_LINKED;
+
+  if (gst_pad_check_reconfigure (GST_PAD (pad)))
+    pad->reconfigure = TRUE;
+
+  if (!pad->reconfigure && pad->ctx->configured && pad->pool)
+    return GST_FLOW_OK;
+
+  if (!gst_rga_multi_convert_pad_negotiate (self, pad))
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  return GST_FLOW_OK;
+}
+
+/*
+ * GstRGAMultiConvert
+ */
+
+enum
+{
+  PROP_0,
+  PROP_DEVICE,
+  PROP_DRM_DEVICE,
+};
+
+#define gst_rga_multi_convert_parent_class parent_class
+G_DEFINE_TYPE (GstRGAMultiConvert, gst_rga_multi_convert, GST_TYPE_ELEMENT);
+
+static GstFlowReturn
+gst_rga_multi_convert_chain (GstPad * sinkpad, GstObject * parent,
+    GstBuffer * inbuf)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (parent);
+  GstFlowReturn ret = GST_FLOW_OK, pad_ret;
+  GstBuffer *imported = NULL;
+  GstBuffer **outbufs;
+  GList *srcpads, *l;
+  gboolean failed = FALSE;
+  guint i, n;
+
+  GST_OBJECT_LOCK (self);
+  srcpads = g_list_copy_deep (self->srcpads, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  n = g_list_length (srcpads);
+  outbufs = g_new0 (GstBuffer *, n);
+
+  /* import the input once and queue every conversion back to back */
+  for (l = srcpads, i = 0; l; l = l->next, i++) {
+    GstRGAMultiConvertPad *pad = l->data;
+
+    pad_ret = gst_rga_multi_convert_pad_prepare (self, pad);
+    if (pad_ret == GST_FLOW_OK)
+      pad_ret = gst_buffer_pool_acquire_buffer (pad->pool, &outbufs[i], NULL);
+
+    if (pad_ret != GST_FLOW_OK) {
+      ret = gst_flow_combiner_update_pad_flow (self->combiner, GST_PAD (pad),
+          pad_ret);
+      continue;
+    }
+
+    if (!imported) {
+      imported = gst_rga_context_import (pad->ctx, inbuf, &self->info,
+          self->drm_fd, self->allocator);
+      if (!imported)
+        goto import_failed;
+    }
+
+    if (!gst_rga_context_queue (pad->ctx, imported, outbufs[i])) {
+      gst_buffer_replace (&outbufs[i], NULL);
+      failed = TRUE;
+    }
+  }
+
+  for (l = srcpads, i = 0; l; l = l->next, i++) {
+    GstRGAMultiConvertPad *pad = l->data;
+
+    if (!outbufs[i])
+      continue;
+
+    if (!gst_rga_context_wait (pad->ctx)) {
+      gst_buffer_replace (&outbufs[i], NULL);
+      failed = TRUE;
+      continue;
+    }
+
+    gst_buffer_copy_into (outbufs[i], inbuf,
+        GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+    pad_ret = gst_pad_push (GST_PAD (pad), outbufs[i]);
+    outbufs[i] = NULL;
+    ret = gst_flow_combiner_update_pad_flow (self->combiner, GST_PAD (pad),
+        pad_ret);
+  }
+
+  if (failed) {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("RGA conversion failed"),
+        (NULL));
+    ret = GST_FLOW_ERROR;
+  }
+
+done:
+  for (i = 0; i < n; i++)
+    if (outbufs[i])
+      gst_buffer_unref (outbufs[i]);
+  g_free (outbufs);
+  g_list_free_full (srcpads, gst_object_unref);
+  gst_buffer_unref (inbuf);
+
+  return ret;
+
+import_failed:
+  {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("failed to import input"),
+        (NULL));
+    ret = GST_FLOW_ERROR;
+
+    /* wait for what was already queued before the buffers go */
+    for (l = srcpads; l; l = l->next)
+      gst_rga_context_wait (GST_RGA_MULTI_CONVERT_PAD (l->data)->ctx);
+    goto done;
+  }
+}
+
+static gboolean
+gst_rga_multi_convert_sink_event (GstPad * sinkpad, GstObject * parent,
+    GstEvent * event)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (parent);
+  GList *srcpads, *l;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      GstVideoInfo info;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&info, caps)) {
+        GST_ERROR_OBJECT (self, "invalid caps %" GST_PTR_FORMAT, caps);
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      GST_DEBUG_OBJECT (self, "input caps %" GST_PTR_FORMAT, caps);
+
+      gst_caps_replace (&self->sinkcaps, caps);
+      self->info = info;
+
+      /* every pad negotiates its own caps, now if it's linked so the
+       * allocation query can be answered, or with its first buffer */
+      GST_OBJECT_LOCK (self);
+      srcpads = g_list_copy_deep (self->srcpads, (GCopyFunc) gst_object_ref,
+          NULL);
+      GST_OBJECT_UNLOCK (self);
+
+      for (l = srcpads; l; l = l->next) {
+        GstRGAMultiConvertPad *pad = l->data;
+
+        pad->reconfigure = TRUE;
+        gst_rga_multi_convert_pad_prepare (self, pad);
+      }
+      g_list_free_full (srcpads, gst_object_unref);
+
+      gst_event_unref (event);
+      return TRUE;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      gst_flow_combiner_reset (self->combiner);
+      break;
+    default:
+      break;
+  }
+
+  /* a segment can't go out before the caps, the pads that aren't
+   * negotiated yet copy it when they are */
+  if (GST_EVENT_IS_STICKY (event) && GST_EVENT_TYPE (event) > GST_EVENT_CAPS
+      && GST_EVENT_TYPE (event) != GST_EVENT_EOS) {
+    GST_OBJECT_LOCK (self);
+    srcpads = g_list_copy_deep (self->srcpads, (GCopyFunc) gst_object_ref,
+        NULL);
+    GST_OBJECT_UNLOCK (self);
+
+    for (l = srcpads; l; l = l->next) {
+      GstRGAMultiConvertPad *pad = l->data;
+
+      if (pad->caps)
+        gst_pad_push_event (GST_PAD (pad), gst_event_ref (event));
+    }
+
+    g_list_free_full (srcpads, gst_object_unref);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_event_default (sinkpad, parent, event);
+}
+
+static gboolean
+gst_rga_multi_convert_sink_query (GstPad * sinkpad, GstObject * parent,
+    GstQuery * query)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (parent);
+  GstRGAMultiConvertPad *first = NULL;
+  gboolean ret = FALSE;
+
+  GST_OBJECT_LOCK (self);
+  if (self->srcpads)
+    first = gst_object_ref (self->srcpads->data);
+  GST_OBJECT_UNLOCK (self);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    {
+      GstCaps *filter, *caps;
+
+      gst_query_parse_caps (query, &filter);
+
+      if (first)
+        caps = gst_v4l2_object_get_caps (first->ctx->v4l2output,
+            gst_v4l2_object_get_raw_caps ());
+      else
+        caps = gst_pad_get_pad_template_caps (sinkpad);
+
+      if (filter) {
+        GstCaps *tmp = caps;
+        caps = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (tmp);
+      }
+
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_ALLOCATION:
+    {
+      GstRKV4l2Object *obj;
+      GstBufferPool *pool;
+      GstCaps *caps;
+      gboolean need_pool;
+      gsize size;
+
+      gst_query_parse_allocation (query, &caps, &need_pool);
+
+      /* let upstream write straight into dmabufs the RGA can read */
+      if (!first || !caps || self->drm_fd < 0
+          || !first->ctx->configured || !gst_caps_is_equal (caps,
+              self->sinkcaps))
+        break;
+
+      obj = first->ctx->v4l2output;
+      size = MAX (GST_VIDEO_INFO_SIZE (&obj->info),
+          obj->format.fmt.pix.sizeimage);
+
+      if (need_pool) {
+        pool = gst_rga_dmabuf_pool_new (self->drm_fd, self->allocator, caps,
+            &obj->info, size, GST_RGA_MULTI_CONVERT_MAX_BUFFERS);
+        if (pool) {
+          gst_query_add_allocation_pool (query, pool, size, 2,
+              GST_RGA_MULTI_CONVERT_MAX_BUFFERS);
+          gst_object_unref (pool);
+        }
+      }
+
+      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+      ret = TRUE;
+      break;
+    }
+    default:
+      ret = gst_pad_query_default (sinkpad, parent, query);
+      break;
+  }
+
+  if (first)
+    gst_object_unref (first);
+
+  return ret;
+}
+
+static GstPad *
+gst_rga_multi_convert_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * req_name, const GstCaps * caps)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (element);
+  GstRGAMultiConvertPad *pad;
+  gchar *name;
+  guint serial;
+
+  GST_OBJECT_LOCK (self);
+  if (req_name && sscanf (req_name, "src_%u", &serial) == 1) {
+    if (serial >= self->next_pad_id)
+      self->next_pad_id = serial + 1;
+  } else {
+    serial = self->next_pad_id++;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  name = g_strdup_printf ("src_%u", serial);
+  pad = g_object_new (GST_TYPE_RGA_MULTI_CONVERT_PAD, "name", name,
+      "direction", templ->direction, "template", templ, NULL);
+  g_free (name);
+
+  /* every pad opens its own m2m context */
+  pad->ctx = gst_rga_context_new (element, self->videodev);
+  if (!pad->ctx)
+    goto open_failed;
+
+  GST_OBJECT_LOCK (self);
+  self->srcpads = g_list_append (self->srcpads, pad);
+  GST_OBJECT_UNLOCK (self);
+
+  gst_flow_combiner_add_pad (self->combiner, GST_PAD (pad));
+  gst_pad_set_active (GST_PAD (pad), TRUE);
+  gst_element_add_pad (element, GST_PAD (pad));
+
+  GST_DEBUG_OBJECT (self, "created pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  return GST_PAD (pad);
+
+open_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+        (_("Could not open device '%s' for reading and writing."),
+            self->videodev), (NULL));
+    gst_object_unref (pad);
+    return NULL;
+  }
+}
+
+static void
+gst_rga_multi_convert_release_pad (GstElement * element, GstPad * gpad)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (element);
+  GstRGAMultiConvertPad *pad = GST_RGA_MULTI_CONVERT_PAD (gpad);
+
+  GST_DEBUG_OBJECT (self, "release pad %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  GST_OBJECT_LOCK (self);
+  self->srcpads = g_list_remove (self->srcpads, pad);
+  GST_OBJECT_UNLOCK (self);
+
+  /* don't pull the context from under a running conversion */
+  GST_PAD_STREAM_LOCK (self->sinkpad);
+  gst_flow_combiner_remove_pad (self->combiner, gpad);
+  gst_rga_context_free (pad->ctx);
+  pad->ctx = NULL;
+  GST_PAD_STREAM_UNLOCK (self->sinkpad);
+
+  gst_pad_set_active (gpad, FALSE);
+  gst_element_remove_pad (element, gpad);
+}
+
+static void
+gst_rga_multi_convert_reset (GstRGAMultiConvert * self)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  for (l = self->srcpads; l; l = l->next) {
+    GstRGAMultiConvertPad *pad = l->data;
+
+    gst_rga_context_stop (pad->ctx);
+    if (pad->pool) {
+      gst_buffer_pool_set_active (pad->pool, FALSE);
+      gst_object_unref (pad->pool);
+      pad->pool = NULL;
+    }
+    gst_caps_replace (&pad->caps, NULL);
+    pad->reconfigure = TRUE;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  gst_caps_replace (&self->sinkcaps, NULL);
+  gst_flow_combiner_reset (self->combiner);
+}
+
+static GstStateChangeReturn
+gst_rga_multi_convert_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      self->drm_fd = open (self->drm_device, O_RDWR | O_CLOEXEC);
+      if (self->drm_fd < 0) {
+        GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ_WRITE,
+            (_("Could not open device '%s' for reading and writing."),
+                self->drm_device), GST_ERROR_SYSTEM);
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      self->allocator = gst_dmabuf_allocator_new ();
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rga_multi_convert_reset (self);
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      if (self->allocator)
+        gst_object_unref (self->allocator);
+      self->allocator = NULL;
+      if (self->drm_fd >= 0)
+        close (self->drm_fd);
+      self->drm_fd = -1;
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static void
+gst_rga_multi_convert_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (object);
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      g_free (self->videodev);
+      self->videodev = g_value_dup_string (value);
+      break;
+    case PROP_DRM_DEVICE:
+      g_free (self->drm_device);
+      self->drm_device = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rga_multi_convert_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (object);
+
+  switch (prop_id) {
+    case PROP_DEVICE:
+      g_value_set_string (value, self->videodev);
+      break;
+    case PROP_DRM_DEVICE:
+      g_value_set_string (value, self->drm_device);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rga_multi_convert_finalize (GObject * object)
+{
+  GstRGAMultiConvert *self = GST_RGA_MULTI_CONVERT (object);
+
+  gst_flow_combiner_free (self->combiner);
+  gst_caps_replace (&self->sinkcaps, NULL);
+  g_free (self->videodev);
+  g_free (self->drm_device);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rga_multi_convert_init (GstRGAMultiConvert * self)
+{
+  rk_common_v4l2device_find_by_name ("rockchip-rga", self->default_device);
+  self->videodev = g_strdup (self->default_device);
+  self->drm_device = g_strdup (DEFAULT_PROP_DRM_DEVICE);
+  self->drm_fd = -1;
+
+  self->sinkpad =
+      gst_pad_new_from_static_template (&gst_rga_multi_convert_sink_template,
+      "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_sink_event));
+  gst_pad_set_query_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_sink_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+
+  self->combiner = gst_flow_combiner_new ();
+}
+
+static void
+gst_rga_multi_convert_class_init (GstRGAMultiConvertClass * klass)
+{
+  GstElementClass *element_class = (GstElementClass *) klass;
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_rga_multi_convert_src_template));
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_rga_multi_convert_sink_template));
+
+  GST_DEBUG_CATEGORY_INIT (gst_rga_multi_convert_debug, "rgamulticonvert", 0,
+      "RGA Multi Converter(Rockchip)");
+
+  gst_element_class_set_static_metadata (element_class,
+      "RGA Video Multi Converter",
+      "Filter/Converter/Video/Scaler",
+      "Transform one stream into several via V4L2 API", " ");
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_rga_multi_convert_finalize);
+  gobject_class->set_property =
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_set_property);
+  gobject_class->get_property =
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_get_property);
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_rga_multi_convert_change_state);
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      g_param_spec_string ("device", "Device",
+          "RGA device used by pads requested from now on", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DRM_DEVICE,
+      g_param_spec_string ("drm-device", "DRM device",
+          "DRM device the output dmabufs are allocated from",
+          DEFAULT_PROP_DRM_DEVICE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_type_class_ref (GST_TYPE_RGA_MULTI_CONVERT_PAD);
+}
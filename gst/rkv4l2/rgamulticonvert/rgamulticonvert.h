@@ -0,0 +1,98 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+#ifndef __GST_RGA_MULTI_CONVERT_H__
+#define __GST_RGA_MULTI_CONVERT_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
+
+#include "rga/rgacontext.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_RGA_MULTI_CONVERT_PAD \
+  (gst_rga_multi_convert_pad_get_type())
+#define GST_RGA_MULTI_CONVERT_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RGA_MULTI_CONVERT_PAD,GstRGAMultiConvertPad))
+#define GST_IS_RGA_MULTI_CONVERT_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RGA_MULTI_CONVERT_PAD))
+#define GST_TYPE_RGA_MULTI_CONVERT \
+  (gst_rga_multi_convert_get_type())
+#define GST_RGA_MULTI_CONVERT(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RGA_MULTI_CONVERT,GstRGAMultiConvert))
+#define GST_IS_RGA_MULTI_CONVERT(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RGA_MULTI_CONVERT))
+typedef struct _GstRGAMultiConvertPad GstRGAMultiConvertPad;
+typedef struct _GstRGAMultiConvertPadClass GstRGAMultiConvertPadClass;
+typedef struct _GstRGAMultiConvert GstRGAMultiConvert;
+typedef struct _GstRGAMultiConvertClass GstRGAMultiConvertClass;
+
+/**
+ * GstRGAMultiConvertPad:
+ *
+ * Each src pad owns a RGA m2m context converting the shared input into
+ * its own caps, with its own crop, rotation and flip.
+ */
+struct _GstRGAMultiConvertPad
+{
+  GstPad parent;
+
+  GstRGAContext *ctx;
+
+  GstCaps *caps;
+  GstBufferPool *pool;
+  gboolean reconfigure;         /* input caps or properties changed */
+};
+
+struct _GstRGAMultiConvertPadClass
+{
+  GstPadClass parent_class;
+};
+
+struct _GstRGAMultiConvert
+{
+  GstElement parent;
+
+  /* < private > */
+  GstPad *sinkpad;
+  GList *srcpads;
+  guint next_pad_id;
+  GstFlowCombiner *combiner;
+
+  gchar default_device[32];
+  gchar *videodev;
+  gchar *drm_device;
+  gint drm_fd;
+  GstAllocator *allocator;
+
+  /* input */
+  GstCaps *sinkcaps;
+  GstVideoInfo info;
+};
+
+struct _GstRGAMultiConvertClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_rga_multi_convert_pad_get_type (void);
+GType gst_rga_multi_convert_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_RGA_MULTI_CONVERT_H__ */
@@ -20,20 +20,56 @@
  */
 #include "media-controller.h"
 
+#include <string.h>
+#include <glib/gstdio.h>
+
 #include "common.h"
 
 #define MAX_MEDIA_INDEX 16
 
-GstMediaController *
-gst_media_controller_new_by_vnode (const gchar * vnode)
+/*
+ * Process-wide topology cache.
+ *
+ * Every media device is opened and enumerated once, and each video node
+ * found in its graph is mapped to it.  The cache holds one reference on
+ * every media device, each GstMediaController holds another one, so a
+ * flush never pulls a device from under a running element.  The whole
+ * cache is dropped when a device node shows up or goes away in /dev, and
+ * after a media config changed the links, so later elements enumerate the
+ * graph as the kernel has it.
+ */
+static GMutex topology_lock;
+static GHashTable *topology_by_vnode = NULL;
+static gint64 topology_stamp = 0;
+
+static void
+gst_media_topology_unref_device (gpointer data)
+{
+  media_device_unref ((struct media_device *) data);
+}
+
+static void
+gst_media_topology_flush_unlocked (void)
+{
+  if (topology_by_vnode) {
+    g_hash_table_unref (topology_by_vnode);
+    topology_by_vnode = NULL;
+  }
+}
+
+static void
+gst_media_topology_build_unlocked (void)
 {
-  GstMediaController *it;
   gchar sys_path[64];
-  struct media_device *device = NULL;
   guint nents, j, i = 0;
   FILE *fp;
 
+  topology_by_vnode = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, gst_media_topology_unref_device);
+
   while (i < MAX_MEDIA_INDEX) {
+    struct media_device *device;
+
     snprintf (sys_path, 64, "/dev/media%d", i++);
     fp = fopen (sys_path, "r");
     if (!fp)
@@ -41,23 +77,62 @@ gst_media_controller_new_by_vnode (const gchar * vnode)
     fclose (fp);
 
     device = media_device_new (sys_path);
+    if (!device)
+      continue;
 
     /* Enumerate entities, pads and links. */
-    media_device_enumerate (device);
+    if (media_device_enumerate (device) < 0) {
+      media_device_unref (device);
+      continue;
+    }
 
     nents = media_get_entities_count (device);
     for (j = 0; j < nents; ++j) {
       struct media_entity *entity = media_get_entity (device, j);
       const char *devname = media_entity_get_devname (entity);
-      if (!strcmp (devname, vnode)) {
-        goto out;
-      }
+
+      if (!devname || !devname[0])
+        continue;
+
+      g_hash_table_replace (topology_by_vnode, g_strdup (devname),
+          media_device_ref (device));
     }
 
     media_device_unref (device);
   }
 
-out:
+  GST_DEBUG ("media topology cache built, %u nodes",
+      g_hash_table_size (topology_by_vnode));
+}
+
+void
+gst_media_topology_invalidate (void)
+{
+  g_mutex_lock (&topology_lock);
+  gst_media_topology_flush_unlocked ();
+  g_mutex_unlock (&topology_lock);
+}
+
+GstMediaController *
+gst_media_controller_new_by_vnode (const gchar * vnode)
+{
+  GstMediaController *it;
+  struct media_device *device;
+
+  g_mutex_lock (&topology_lock);
+
+  if (rk_common_dev_tree_changed (&topology_stamp))
+    gst_media_topology_flush_unlocked ();
+
+  if (!topology_by_vnode)
+    gst_media_topology_build_unlocked ();
+
+  device = g_hash_table_lookup (topology_by_vnode, vnode);
+  if (device)
+    media_device_ref (device);
+
+  g_mutex_unlock (&topology_lock);
+
   if (!device)
     return NULL;
 
@@ -70,7 +145,12 @@ out:
 void
 gst_media_controller_delete (GstMediaController * controller)
 {
+  if (!controller)
+    return;
+
+  g_mutex_lock (&topology_lock);
   media_device_unref (controller->device);
+  g_mutex_unlock (&topology_lock);
 
   g_slice_free (GstMediaController, controller);
 }
@@ -94,3 +174,298 @@ gst_media_get_last_entity (GstMediaController * controller)
 
   return entity;
 }
+
+GstMediaEntity *
+gst_media_find_sensor_entity (GstMediaController * controller)
+{
+  guint nents, i, j;
+
+  /* prefer the sensor actually linked into the pipeline */
+  nents = media_get_entities_count (controller->device);
+  for (i = 0; i < nents; i++) {
+    GstMediaEntity *entity = media_get_entity (controller->device, i);
+
+    if (media_entity_type (entity) != MEDIA_ENT_T_V4L2_SUBDEV
+        || media_entity_get_info (entity)->type !=
+        MEDIA_ENT_T_V4L2_SUBDEV_SENSOR)
+      continue;
+
+    for (j = 0; j < media_entity_get_links_count (entity); j++) {
+      const struct media_link *link = media_entity_get_link (entity, j);
+
+      if (link->source->entity == entity
+          && (link->flags & MEDIA_LNK_FL_ENABLED))
+        return entity;
+    }
+  }
+
+  /* assume the last enity is sensor_subdev */
+  return gst_media_get_last_entity (controller);
+}
+
+/*
+ * Declarative media pipeline setup.
+ *
+ * The config is either a path to a file or the description itself. Each
+ * line (or ';' separated item) is either a link, in media-ctl -l syntax,
+ * or a pad format, in media-ctl -V syntax. Lines starting with '#' are
+ * ignored. Parsed and validated configs are cached per board, a config
+ * file is parsed again once it is modified.
+ */
+typedef struct
+{
+  gchar *links;
+  gchar *formats;
+  gint64 mtime;                 /* of the config file, 0 for a description */
+} GstMediaConfig;
+
+typedef struct
+{
+  struct media_link *link;
+  __u32 flags;
+} GstMediaLinkState;
+
+typedef struct
+{
+  struct media_entity *entity;
+  guint pad;
+  struct v4l2_mbus_framefmt format;
+} GstMediaPadState;
+
+static GMutex config_lock;
+static GHashTable *config_by_board = NULL;
+
+static void
+gst_media_config_free (gpointer data)
+{
+  GstMediaConfig *config = data;
+
+  g_free (config->links);
+  g_free (config->formats);
+  g_slice_free (GstMediaConfig, config);
+}
+
+static gint64
+gst_media_config_mtime (const gchar * desc)
+{
+  GStatBuf st;
+
+  if (!g_file_test (desc, G_FILE_TEST_IS_REGULAR) || g_stat (desc, &st) < 0)
+    return 0;
+
+  return st.st_mtime;
+}
+
+static GstMediaConfig *
+gst_media_config_parse (GstMediaController * controller, const gchar * desc)
+{
+  GstMediaConfig *config;
+  GString *links, *formats;
+  gchar *contents = NULL;
+  gchar **items, **item;
+  gint64 mtime = gst_media_config_mtime (desc);
+
+  if (g_file_test (desc, G_FILE_TEST_IS_REGULAR)) {
+    GError *err = NULL;
+
+    if (!g_file_get_contents (desc, &contents, NULL, &err)) {
+      GST_WARNING ("Can't read media config %s: %s", desc, err->message);
+      g_error_free (err);
+      return NULL;
+    }
+    desc = contents;
+  }
+
+  links = g_string_new (NULL);
+  formats = g_string_new (NULL);
+
+  items = g_strsplit_set (desc, "\n;", -1);
+  for (item = items; *item; item++) {
+    GString *target;
+    gchar *line = g_strstrip (*item);
+
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+
+    target = strstr (line, "->") ? links : formats;
+    if (target->len)
+      g_string_append_c (target, ',');
+    g_string_append (target, line);
+  }
+  g_strfreev (items);
+  g_free (contents);
+
+  config = g_slice_new0 (GstMediaConfig);
+  config->links = g_string_free (links, FALSE);
+  config->formats = g_string_free (formats, FALSE);
+  config->mtime = mtime;
+
+  /* validate everything before touching the hardware */
+  if ((config->links[0]
+          && media_parse_check_links (controller->device, config->links) < 0)
+      || (config->formats[0]
+          && v4l2_subdev_parse_check_formats (controller->device,
+              config->formats) < 0)) {
+    GST_WARNING ("Invalid media config, links: \"%s\" formats: \"%s\"",
+        config->links, config->formats);
+    gst_media_config_free (config);
+    return NULL;
+  }
+
+  return config;
+}
+
+static GArray *
+gst_media_save_links (GstMediaController * controller)
+{
+  GArray *state = g_array_new (FALSE, FALSE, sizeof (GstMediaLinkState));
+  struct media_device *device = controller->device;
+  guint i, j;
+
+  for (i = 0; i < device->entities_count; i++) {
+    struct media_entity *entity = &device->entities[i];
+
+    for (j = 0; j < entity->num_links; j++) {
+      GstMediaLinkState s;
+
+      if (entity->links[j].source->entity != entity)
+        continue;
+
+      s.link = &entity->links[j];
+      s.flags = entity->links[j].flags;
+      g_array_append_val (state, s);
+    }
+  }
+
+  return state;
+}
+
+static void
+gst_media_restore_links (GstMediaController * controller, GArray * state)
+{
+  guint i;
+
+  for (i = 0; i < state->len; i++) {
+    GstMediaLinkState *s = &g_array_index (state, GstMediaLinkState, i);
+
+    if (s->link->flags == s->flags
+        || (s->flags & MEDIA_LNK_FL_IMMUTABLE))
+      continue;
+
+    media_setup_link (controller->device, s->link->source, s->link->sink,
+        s->flags);
+  }
+}
+
+static GArray *
+gst_media_save_formats (GstMediaController * controller)
+{
+  GArray *state = g_array_new (FALSE, FALSE, sizeof (GstMediaPadState));
+  struct media_device *device = controller->device;
+  guint i, j;
+
+  for (i = 0; i < device->entities_count; i++) {
+    struct media_entity *entity = &device->entities[i];
+
+    if (media_entity_type (entity) != MEDIA_ENT_T_V4L2_SUBDEV)
+      continue;
+
+    for (j = 0; j < entity->info.pads; j++) {
+      GstMediaPadState s;
+
+      s.entity = entity;
+      s.pad = j;
+      if (v4l2_subdev_get_format (entity, &s.format, j,
+              V4L2_SUBDEV_FORMAT_ACTIVE) == 0)
+        g_array_append_val (state, s);
+    }
+  }
+
+  return state;
+}
+
+static void
+gst_media_restore_formats (GstMediaController * controller, GArray * state)
+{
+  struct v4l2_mbus_framefmt format;
+  guint i;
+
+  for (i = 0; i < state->len; i++) {
+    GstMediaPadState *s = &g_array_index (state, GstMediaPadState, i);
+
+    if (v4l2_subdev_get_format (s->entity, &format, s->pad,
+            V4L2_SUBDEV_FORMAT_ACTIVE) == 0
+        && !memcmp (&format, &s->format, sizeof (format)))
+      continue;
+
+    format = s->format;
+    v4l2_subdev_set_format (s->entity, &format, s->pad,
+        V4L2_SUBDEV_FORMAT_ACTIVE);
+  }
+}
+
+gboolean
+gst_media_controller_setup (GstMediaController * controller,
+    const gchar * desc)
+{
+  const struct media_device_info *info;
+  GstMediaConfig *config;
+  GArray *state, *formats = NULL;
+  gchar *key;
+  gboolean ret = FALSE;
+
+  info = media_get_info (controller->device);
+  key = g_strdup_printf ("%s|%s|%s", info->model, info->bus_info, desc);
+
+  g_mutex_lock (&config_lock);
+
+  if (!config_by_board)
+    config_by_board = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, gst_media_config_free);
+
+  config = g_hash_table_lookup (config_by_board, key);
+  if (config && config->mtime != gst_media_config_mtime (desc)) {
+    g_hash_table_remove (config_by_board, key);
+    config = NULL;
+  }
+
+  if (!config) {
+    config = gst_media_config_parse (controller, desc);
+    if (!config)
+      goto done;
+    g_hash_table_insert (config_by_board, key, config);
+    key = NULL;
+  }
+
+  /* apply links then formats, undo both if anything fails */
+  state = gst_media_save_links (controller);
+  if (config->formats[0])
+    formats = gst_media_save_formats (controller);
+
+  if (config->links[0]
+      && media_parse_setup_links (controller->device, config->links) < 0) {
+    GST_WARNING ("Failed to setup media links \"%s\"", config->links);
+    gst_media_restore_links (controller, state);
+  } else if (config->formats[0]
+      && v4l2_subdev_parse_setup_formats (controller->device,
+          config->formats) < 0) {
+    GST_WARNING ("Failed to setup pad formats \"%s\"", config->formats);
+    gst_media_restore_formats (controller, formats);
+    gst_media_restore_links (controller, state);
+  } else {
+    ret = TRUE;
+  }
+
+  g_array_free (state, TRUE);
+  if (formats)
+    g_array_free (formats, TRUE);
+
+  if (config->links[0])
+    gst_media_topology_invalidate ();
+
+done:
+  g_mutex_unlock (&config_lock);
+  g_free (key);
+
+  return ret;
+}
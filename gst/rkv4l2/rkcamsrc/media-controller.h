@@ -45,9 +45,14 @@ struct _GstMediaController
 
 GstMediaController *gst_media_controller_new_by_vnode (const gchar * vnode);
 void gst_media_controller_delete (GstMediaController * controller);
+void gst_media_topology_invalidate (void);
 
 GstMediaEntity *gst_media_find_entity_by_name (GstMediaController * controller,
     const gchar * dev_name);
 GstMediaEntity *gst_media_get_last_entity (GstMediaController * controller);
+GstMediaEntity *gst_media_find_sensor_entity (GstMediaController * controller);
+
+gboolean gst_media_controller_setup (GstMediaController * controller,
+    const gchar * desc);
 G_END_DECLS
 #endif
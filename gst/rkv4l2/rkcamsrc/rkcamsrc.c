@@ -42,11 +42,25 @@ GST_DEBUG_CATEGORY (rkcamsrc_debug);
 #define GST_CAT_DEFAULT rkcamsrc_debug
 
 #define DEFAULT_PROP_DEVICE "/dev/video0"
+#define DEFAULT_PROP_ADAPTIVE_POOL FALSE
+#define DEFAULT_PROP_POOL_MIN_BUFFERS 4
+#define DEFAULT_PROP_POOL_MAX_BUFFERS 16
+#define DEFAULT_PROP_LOW_BUFFER_POLICY GST_V4L2_LOW_BUFFER_COPY
+#define DEFAULT_PROP_SPARE_BUFFERS 2
+#define DEFAULT_PROP_DEQUEUE_THREAD FALSE
 
 enum
 {
   PROP_0,
   V4L2_STD_OBJECT_PROPS,
+  PROP_ADAPTIVE_POOL,
+  PROP_POOL_MIN_BUFFERS,
+  PROP_POOL_MAX_BUFFERS,
+  PROP_POOL_STATS,
+  PROP_LOW_BUFFER_POLICY,
+  PROP_SPARE_BUFFERS,
+  PROP_DEQUEUE_THREAD,
+  PROP_MEDIA_CONFIG,
   PROP_LAST
 };
 
@@ -109,6 +123,49 @@ gst_rkcamsrc_class_init (GstRKCamSrcClass * klass)
       DEFAULT_PROP_DEVICE);
   rk_common_install_rockchip_properties_helper (gobject_class);
 
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_POOL,
+      g_param_spec_boolean ("adaptive-pool", "Adaptive pool",
+          "Start with min-pool-buffers, grow the capture pool when it starves "
+          "and park buffers out of the queue when idle, to be freed on the "
+          "next restart", DEFAULT_PROP_ADAPTIVE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POOL_MIN_BUFFERS,
+      g_param_spec_uint ("min-pool-buffers", "Minimum pool buffers",
+          "Lower bound of the adaptive capture pool", 2, VIDEO_MAX_FRAME,
+          DEFAULT_PROP_POOL_MIN_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POOL_MAX_BUFFERS,
+      g_param_spec_uint ("max-pool-buffers", "Maximum pool buffers",
+          "Upper bound of the adaptive capture pool", 2, VIDEO_MAX_FRAME,
+          DEFAULT_PROP_POOL_MAX_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POOL_STATS,
+      g_param_spec_boxed ("pool-stats", "Pool statistics",
+          "Capture pool counters: buffers, queued, parked, grown, shrunk, "
+          "unparked, starved-count, starved-time, hold-time, copies, swapped, "
+          "dropped, overruns and handoff-latency",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_LOW_BUFFER_POLICY,
+      g_param_spec_enum ("low-buffer-policy", "Low buffer policy",
+          "What to do when the capture queue runs low: copy the frame, "
+          "swap in a spare buffer or drop the frame",
+          GST_TYPE_V4L2_LOW_BUFFER_POLICY, DEFAULT_PROP_LOW_BUFFER_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SPARE_BUFFERS,
+      g_param_spec_uint ("spare-buffers", "Spare buffers",
+          "Buffers kept out of the driver queue for low-buffer-policy=spare",
+          0, 8, DEFAULT_PROP_SPARE_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DEQUEUE_THREAD,
+      g_param_spec_boolean ("dequeue-thread", "Dequeue thread",
+          "Dequeue frames from a dedicated thread as soon as they are ready",
+          DEFAULT_PROP_DEQUEUE_THREAD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MEDIA_CONFIG,
+      g_param_spec_string ("media-config", "media pipeline config",
+          "Links and pad formats in media-ctl syntax, or a file holding them",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
     /**
    * GstRKCamSrc::prepare-format:
    * @rkcamsrc: the rkcamsrc instance
@@ -161,6 +218,13 @@ gst_rkcamsrc_init (GstRKCamSrc * rkcamsrc)
       V4L2_BUF_TYPE_VIDEO_CAPTURE, DEFAULT_PROP_DEVICE,
       gst_v4l2_get_input, gst_v4l2_set_input, NULL);
 
+  rkcamsrc->adaptive_pool = DEFAULT_PROP_ADAPTIVE_POOL;
+  rkcamsrc->pool_min_buffers = DEFAULT_PROP_POOL_MIN_BUFFERS;
+  rkcamsrc->pool_max_buffers = DEFAULT_PROP_POOL_MAX_BUFFERS;
+  rkcamsrc->low_buffer_policy = DEFAULT_PROP_LOW_BUFFER_POLICY;
+  rkcamsrc->spare_buffers = DEFAULT_PROP_SPARE_BUFFERS;
+  rkcamsrc->dequeue_thread = DEFAULT_PROP_DEQUEUE_THREAD;
+
   gst_base_src_set_format (GST_BASE_SRC (rkcamsrc), GST_FORMAT_TIME);
   gst_base_src_set_live (GST_BASE_SRC (rkcamsrc), TRUE);
 }
@@ -184,6 +248,28 @@ gst_rkcamsrc_set_property (GObject * object,
     if (!rk_common_set_property_helper (rkcamsrc->capture_object,
             prop_id, value, pspec)) {
       switch (prop_id) {
+        case PROP_ADAPTIVE_POOL:
+          rkcamsrc->adaptive_pool = g_value_get_boolean (value);
+          break;
+        case PROP_POOL_MIN_BUFFERS:
+          rkcamsrc->pool_min_buffers = g_value_get_uint (value);
+          break;
+        case PROP_POOL_MAX_BUFFERS:
+          rkcamsrc->pool_max_buffers = g_value_get_uint (value);
+          break;
+        case PROP_LOW_BUFFER_POLICY:
+          rkcamsrc->low_buffer_policy = g_value_get_enum (value);
+          break;
+        case PROP_SPARE_BUFFERS:
+          rkcamsrc->spare_buffers = g_value_get_uint (value);
+          break;
+        case PROP_DEQUEUE_THREAD:
+          rkcamsrc->dequeue_thread = g_value_get_boolean (value);
+          break;
+        case PROP_MEDIA_CONFIG:
+          g_free (rkcamsrc->capture_object->media_config);
+          rkcamsrc->capture_object->media_config = g_value_dup_string (value);
+          break;
         default:
           G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
           break;
@@ -203,6 +289,35 @@ gst_rkcamsrc_get_property (GObject * object,
     if (!rk_common_get_property_helper (rkcamsrc->capture_object,
             prop_id, value, pspec)) {
       switch (prop_id) {
+        case PROP_ADAPTIVE_POOL:
+          g_value_set_boolean (value, rkcamsrc->adaptive_pool);
+          break;
+        case PROP_POOL_MIN_BUFFERS:
+          g_value_set_uint (value, rkcamsrc->pool_min_buffers);
+          break;
+        case PROP_POOL_MAX_BUFFERS:
+          g_value_set_uint (value, rkcamsrc->pool_max_buffers);
+          break;
+        case PROP_LOW_BUFFER_POLICY:
+          g_value_set_enum (value, rkcamsrc->low_buffer_policy);
+          break;
+        case PROP_SPARE_BUFFERS:
+          g_value_set_uint (value, rkcamsrc->spare_buffers);
+          break;
+        case PROP_DEQUEUE_THREAD:
+          g_value_set_boolean (value, rkcamsrc->dequeue_thread);
+          break;
+        case PROP_MEDIA_CONFIG:
+          g_value_set_string (value, rkcamsrc->capture_object->media_config);
+          break;
+        case PROP_POOL_STATS:
+          if (rkcamsrc->capture_object->pool)
+            g_value_take_boxed (value,
+                gst_v4l2_buffer_pool_get_stats (GST_V4L2_BUFFER_POOL
+                    (rkcamsrc->capture_object->pool)));
+          else
+            g_value_set_boxed (value, NULL);
+          break;
         default:
           G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
           break;
@@ -442,8 +557,9 @@ gst_rkcamsrc_set_format (GstRKCamSrc * rkcamsrc, GstCaps * caps)
     return FALSE;
   }
 
-  /* do auto-conf */
-  if (!rkcamsrc->capture_object->disable_autoconf)
+  /* do auto-conf, unless the media config already set the pads up */
+  if (!rkcamsrc->capture_object->disable_autoconf
+      && !rkcamsrc->capture_object->media_config)
     gst_rkcamsrc_init_pad_format_and_selection (rkcamsrc);
   gst_rkcamsrc_set_capture_selection (rkcamsrc);
 
@@ -496,6 +612,17 @@ gst_rkcamsrc_decide_allocation (GstBaseSrc * bsrc, GstQuery * query)
       ret = GST_BASE_SRC_CLASS (parent_class)->decide_allocation (bsrc, query);
   }
 
+  if (ret) {
+    GstRKV4l2BufferPool *pool =
+        GST_V4L2_BUFFER_POOL (src->capture_object->pool);
+
+    gst_v4l2_buffer_pool_set_adaptive (pool, src->adaptive_pool,
+        src->pool_min_buffers, src->pool_max_buffers);
+    gst_v4l2_buffer_pool_set_low_buffer_policy (pool, src->low_buffer_policy,
+        src->spare_buffers);
+    gst_v4l2_buffer_pool_set_dequeue_thread (pool, src->dequeue_thread);
+  }
+
   if (ret) {
     if (!gst_buffer_pool_set_active (src->capture_object->pool, TRUE))
       goto activate_failed;
@@ -511,6 +638,40 @@ activate_failed:{
   }
 }
 
+/* the probed caps depend on the sensor setup, tag the cached ones with the
+ * media config (its contents when it is a file) and the sensor format */
+static void
+gst_rkcamsrc_update_caps_cache_tag (GstRKCamSrc * rkcamsrc)
+{
+  GstRKV4l2Object *obj = rkcamsrc->capture_object;
+  struct v4l2_mbus_framefmt format;
+  gchar *contents = NULL;
+  guint config_hash = 0;
+  gchar *tag = NULL;
+
+  if (obj->media_config) {
+    if (!g_file_test (obj->media_config, G_FILE_TEST_IS_REGULAR)
+        || !g_file_get_contents (obj->media_config, &contents, NULL, NULL))
+      contents = g_strdup (obj->media_config);
+    config_hash = g_str_hash (contents);
+    g_free (contents);
+  }
+
+  if (rkcamsrc->sensor_subdev
+      && !v4l2_subdev_get_format (rkcamsrc->sensor_subdev, &format, 0,
+          V4L2_SUBDEV_FORMAT_ACTIVE))
+    tag = g_strdup_printf ("%s/%08x/%04x:%ux%u",
+        media_entity_get_info (rkcamsrc->sensor_subdev)->name, config_hash,
+        format.code, format.width, format.height);
+
+  /* caps probed before the setup may not match it */
+  if (g_strcmp0 (tag, obj->caps_cache_tag))
+    gst_caps_replace (&obj->probed_caps, NULL);
+
+  g_free (obj->caps_cache_tag);
+  obj->caps_cache_tag = tag;
+}
+
 /* start and stop are not symmetric -- start will open the device, but not start
  * capture. it's setcaps that will start capture, which is called via basesrc's
  * negotiate method. stop will both stop capture and close the device.
@@ -532,9 +693,22 @@ gst_rkcamsrc_start (GstBaseSrc * src)
 
   rkcamsrc->controller =
       gst_media_controller_new_by_vnode (rkcamsrc->capture_object->videodev);
-  if (!rkcamsrc->controller)
+  if (!rkcamsrc->controller) {
     GST_ERROR_OBJECT (rkcamsrc,
         "Can't find controller, maybe use a wrong video-node or wrong permission to media node");
+    return FALSE;
+  }
+
+  if (rkcamsrc->capture_object->media_config &&
+      !gst_media_controller_setup (rkcamsrc->controller,
+          rkcamsrc->capture_object->media_config)) {
+    GST_ELEMENT_ERROR (rkcamsrc, RESOURCE, SETTINGS,
+        ("Failed to apply media config"),
+        ("media-config: %s", rkcamsrc->capture_object->media_config));
+    gst_media_controller_delete (rkcamsrc->controller);
+    rkcamsrc->controller = NULL;
+    return FALSE;
+  }
 
   rkcamsrc->main_path =
       gst_media_find_entity_by_name (rkcamsrc->controller, "rkisp1_mainpath");
@@ -550,9 +724,10 @@ gst_rkcamsrc_start (GstBaseSrc * src)
   rkcamsrc->phy_subdev =
       gst_media_find_entity_by_name (rkcamsrc->controller,
       "rockchip-sy-mipi-dphy");
+  rkcamsrc->sensor_subdev =
+      gst_media_find_sensor_entity (rkcamsrc->controller);
 
-  /* assume the last enity is sensor_subdev */
-  rkcamsrc->sensor_subdev = gst_media_get_last_entity (rkcamsrc->controller);
+  gst_rkcamsrc_update_caps_cache_tag (rkcamsrc);
 
   if (strcmp (rkcamsrc->capture_object->videodev,
           media_entity_get_devname (rkcamsrc->main_path)))
@@ -610,6 +785,7 @@ gst_rkcamsrc_stop (GstBaseSrc * src)
   RKISP1_3A_THREAD_EXIT (rkcamsrc->thread_3a);
 
   gst_media_controller_delete (rkcamsrc->controller);
+  rkcamsrc->controller = NULL;
 
   return TRUE;
 }
@@ -675,7 +851,10 @@ gst_rkcamsrc_create (GstPushSrc * src, GstBuffer ** buf)
 
     ret = gst_v4l2_buffer_pool_process (pool, buf);
 
-  } while (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER);
+    /* dropped frames show up as a sequence gap below and are reported
+     * through QoS there */
+  } while (ret == GST_V4L2_FLOW_CORRUPTED_BUFFER
+      || ret == GST_V4L2_FLOW_DROPPED_BUFFER);
 
   if (G_UNLIKELY (ret != GST_FLOW_OK))
     goto error;
@@ -87,6 +87,14 @@ struct _GstRKCamSrc
   /* v4l2 stream */
   GstRKV4l2Object *capture_object;
 
+  /* capture pool sizing */
+  gboolean adaptive_pool;
+  guint pool_min_buffers;
+  guint pool_max_buffers;
+  GstV4l2LowBufferPolicy low_buffer_policy;
+  guint spare_buffers;
+  gboolean dequeue_thread;
+
   /* v4l2src part */
   guint64 offset;
   /* offset adjust after renegotiation */
@@ -45,6 +45,8 @@
 #include "v4l2/gstv4l2object.h"
 #include "rkcamsrc/rkcamsrc.h"
 #include "rgaconvert/rgaconvert.h"
+#include "rgacompositor/rgacompositor.h"
+#include "rgamulticonvert/rgamulticonvert.h"
 
 /* used in v4l2_calls.c and v4l2src_calls.c */
 GST_DEBUG_CATEGORY (v4l2_debug);
@@ -67,7 +69,11 @@ plugin_init (GstPlugin * plugin)
   if (!gst_element_register (plugin, "rkcamsrc", GST_RANK_PRIMARY,
           GST_TYPE_RKCAMSRC) ||
       !gst_element_register (plugin, "rgaconvert", GST_RANK_NONE,
-          GST_TYPE_RGACONVERT)
+          GST_TYPE_RGACONVERT) ||
+      !gst_element_register (plugin, "rgacompositor", GST_RANK_NONE,
+          GST_TYPE_RGA_COMPOSITOR) ||
+      !gst_element_register (plugin, "rgamulticonvert", GST_RANK_NONE,
+          GST_TYPE_RGA_MULTI_CONVERT)
       )
     return FALSE;
 
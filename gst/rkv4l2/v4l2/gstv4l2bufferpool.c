@@ -52,6 +52,13 @@ GST_DEBUG_CATEGORY_STATIC (CAT_PERFORMANCE);
 
 #define GST_V4L2_IMPORT_QUARK gst_v4l2_buffer_pool_import_quark ()
 
+/* how long the capture queue must stay fed before an adaptive pool parks
+ * one more buffer */
+#define GST_V4L2_ADAPTIVE_IDLE_TIME (2 * GST_SECOND)
+
+/* ring indexes run over twice the ring size to tell full from empty */
+#define GST_V4L2_RING_WRAP (2 * VIDEO_MAX_FRAME)
+
 
 /*
  * GstRKV4l2BufferPool:
@@ -68,6 +75,25 @@ enum _GstV4l2BufferPoolAcquireFlags
 
 static void gst_v4l2_buffer_pool_release_buffer (GstBufferPool * bpool,
     GstBuffer * buffer);
+static GstFlowReturn gst_v4l2_buffer_pool_dqbuf (GstRKV4l2BufferPool * pool,
+    GstBuffer ** buffer);
+
+GType
+gst_v4l2_low_buffer_policy_get_type (void)
+{
+  static GType policy_type = 0;
+
+  if (!policy_type) {
+    static const GEnumValue policies[] = {
+      {GST_V4L2_LOW_BUFFER_COPY, "GST_V4L2_LOW_BUFFER_COPY", "copy"},
+      {GST_V4L2_LOW_BUFFER_SPARE, "GST_V4L2_LOW_BUFFER_SPARE", "spare"},
+      {GST_V4L2_LOW_BUFFER_DROP, "GST_V4L2_LOW_BUFFER_DROP", "drop"},
+      {0, NULL, NULL}
+    };
+    policy_type = g_enum_register_static ("GstV4l2LowBufferPolicy", policies);
+  }
+  return policy_type;
+}
 
 static gboolean
 gst_v4l2_is_buffer_valid (GstBuffer * buffer, GstRKV4l2MemoryGroup ** out_group)
@@ -625,6 +651,7 @@ gst_v4l2_buffer_pool_streamon (GstRKV4l2BufferPool * pool)
           goto streamon_failed;
 
         pool->streaming = TRUE;
+        pool->busy = FALSE;
 
         GST_DEBUG_OBJECT (pool, "Started streaming");
       }
@@ -637,6 +664,7 @@ gst_v4l2_buffer_pool_streamon (GstRKV4l2BufferPool * pool)
 
 streamon_failed:
   {
+    pool->busy = errno == EBUSY;
     GST_ERROR_OBJECT (pool, "error with STREAMON %d (%s)", errno,
         g_strerror (errno));
     return FALSE;
@@ -703,6 +731,7 @@ gst_v4l2_buffer_pool_start (GstBufferPool * bpool)
   guint size, min_buffers, max_buffers;
   guint max_latency, min_latency, copy_threshold = 0;
   gboolean can_allocate = FALSE;
+  gint i;
 
   GST_DEBUG_OBJECT (pool, "activating pool");
 
@@ -733,6 +762,26 @@ gst_v4l2_buffer_pool_start (GstBufferPool * bpool)
 
       can_allocate = GST_V4L2_ALLOCATOR_CAN_ALLOCATE (pool->vallocator, MMAP);
 
+      /* start small and let starvation grow the pool within the bounds */
+      if (pool->adaptive && can_allocate && !V4L2_TYPE_IS_OUTPUT (obj->type)) {
+        min_buffers = MAX (pool->adaptive_min, min_latency);
+        /* back to what was in use, the parked buffers were freed */
+        if (pool->adaptive_restart)
+          min_buffers = MAX (min_buffers,
+              MIN (pool->adaptive_restart, pool->adaptive_max));
+        max_buffers = MAX (pool->adaptive_max, min_buffers);
+        GST_DEBUG_OBJECT (pool, "adaptive pool, %u to %u buffers",
+            min_buffers, max_buffers);
+      }
+
+      /* the spare ring is allocated with the rest and parked on release */
+      pool->spares_pending = 0;
+      if (pool->low_policy == GST_V4L2_LOW_BUFFER_SPARE
+          && !V4L2_TYPE_IS_OUTPUT (obj->type)) {
+        min_buffers = MIN (min_buffers + pool->num_spares, VIDEO_MAX_FRAME);
+        pool->spares_pending = pool->num_spares;
+      }
+
       count = gst_v4l2_allocator_start (pool->vallocator, min_buffers,
           V4L2_MEMORY_MMAP);
 
@@ -817,6 +866,26 @@ gst_v4l2_buffer_pool_start (GstBufferPool * bpool)
   pool->min_latency = min_latency;
   pool->num_queued = 0;
 
+  pool->starved_since = GST_CLOCK_TIME_NONE;
+  pool->last_starved = pool->last_parked = gst_util_get_timestamp ();
+  for (i = 0; i < VIDEO_MAX_FRAME; i++)
+    pool->dequeue_time[i] = GST_CLOCK_TIME_NONE;
+  pool->num_grown = pool->num_parked = pool->num_copies = 0;
+  pool->num_unparked = pool->num_idle = 0;
+  pool->num_swapped = pool->num_dropped = 0;
+  pool->num_overruns = 0;
+  pool->handoff_time = 0;
+  pool->ring_head = pool->ring_tail = 0;
+
+  if (pool->dq_threaded && (V4L2_TYPE_IS_OUTPUT (obj->type)
+          || (obj->mode != GST_V4L2_IO_MMAP
+              && obj->mode != GST_V4L2_IO_DMABUF))) {
+    GST_DEBUG_OBJECT (pool, "dequeue thread only used for MMAP/DMABUF capture");
+    pool->dq_threaded = FALSE;
+  }
+  pool->starved_count = 0;
+  pool->starved_time = pool->hold_time = 0;
+
   if (max_buffers != 0 && max_buffers < min_buffers)
     max_buffers = min_buffers;
 
@@ -873,6 +942,7 @@ gst_v4l2_buffer_pool_stop (GstBufferPool * bpool)
 {
   GstRKV4l2BufferPool *pool = GST_V4L2_BUFFER_POOL (bpool);
   GstBufferPoolClass *pclass = GST_BUFFER_POOL_CLASS (parent_class);
+  GstBuffer *parked;
   gboolean ret;
   gint i;
 
@@ -892,6 +962,15 @@ gst_v4l2_buffer_pool_stop (GstBufferPool * bpool)
 
   gst_v4l2_buffer_pool_streamoff (pool);
 
+  /* REQBUFS (0) frees the parked buffers with the others, the next start
+   * only requests those that were in use */
+  if (pool->adaptive && pool->vallocator)
+    pool->adaptive_restart = pool->vallocator->count -
+        g_queue_get_length (&pool->parked);
+
+  while ((parked = g_queue_pop_head (&pool->parked)))
+    pclass->release_buffer (bpool, parked);
+
   for (i = 0; i < VIDEO_MAX_FRAME; i++) {
     if (pool->buffers[i]) {
       GstBuffer *buffer = pool->buffers[i];
@@ -923,6 +1002,185 @@ gst_v4l2_buffer_pool_stop (GstBufferPool * bpool)
   return ret;
 }
 
+static guint
+gst_v4l2_buffer_pool_ring_count (GstRKV4l2BufferPool * pool)
+{
+  gint head = g_atomic_int_get (&pool->ring_head);
+  gint tail = g_atomic_int_get (&pool->ring_tail);
+
+  return (head - tail + GST_V4L2_RING_WRAP) % GST_V4L2_RING_WRAP;
+}
+
+/* dequeue thread side */
+static gboolean
+gst_v4l2_buffer_pool_ring_push (GstRKV4l2BufferPool * pool, GstBuffer * buf)
+{
+  gint head = g_atomic_int_get (&pool->ring_head);
+
+  if (gst_v4l2_buffer_pool_ring_count (pool) >= VIDEO_MAX_FRAME)
+    return FALSE;
+
+  pool->ring[head % VIDEO_MAX_FRAME] = buf;
+  pool->ring_time[head % VIDEO_MAX_FRAME] = gst_util_get_timestamp ();
+  g_atomic_int_set (&pool->ring_head, (head + 1) % GST_V4L2_RING_WRAP);
+
+  /* only bother with the lock when the streaming thread went to sleep */
+  if (g_atomic_int_get (&pool->ring_waiting)) {
+    g_mutex_lock (&pool->ring_lock);
+    g_cond_signal (&pool->ring_cond);
+    g_mutex_unlock (&pool->ring_lock);
+  }
+
+  return TRUE;
+}
+
+/* streaming thread side */
+static GstBuffer *
+gst_v4l2_buffer_pool_ring_pop (GstRKV4l2BufferPool * pool)
+{
+  gint tail = g_atomic_int_get (&pool->ring_tail);
+  GstClockTime latency;
+  GstBuffer *buf;
+
+  if (gst_v4l2_buffer_pool_ring_count (pool) == 0)
+    return NULL;
+
+  buf = pool->ring[tail % VIDEO_MAX_FRAME];
+  latency = gst_util_get_timestamp () - pool->ring_time[tail % VIDEO_MAX_FRAME];
+  pool->ring[tail % VIDEO_MAX_FRAME] = NULL;
+  g_atomic_int_set (&pool->ring_tail, (tail + 1) % GST_V4L2_RING_WRAP);
+
+  pool->handoff_time = pool->handoff_time ?
+      (7 * pool->handoff_time + latency) / 8 : latency;
+
+  return buf;
+}
+
+static GstFlowReturn
+gst_v4l2_buffer_pool_ring_wait (GstRKV4l2BufferPool * pool,
+    GstBuffer ** buffer)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if ((*buffer = gst_v4l2_buffer_pool_ring_pop (pool)))
+    return GST_FLOW_OK;
+
+  g_mutex_lock (&pool->ring_lock);
+  g_atomic_int_set (&pool->ring_waiting, 1);
+  while (!(*buffer = gst_v4l2_buffer_pool_ring_pop (pool))) {
+    if (pool->ring_flushing) {
+      ret = GST_FLOW_FLUSHING;
+      break;
+    }
+    if (pool->dq_ret != GST_FLOW_OK) {
+      ret = pool->dq_ret;
+      break;
+    }
+    g_cond_wait (&pool->ring_cond, &pool->ring_lock);
+  }
+  g_atomic_int_set (&pool->ring_waiting, 0);
+  g_mutex_unlock (&pool->ring_lock);
+
+  return ret;
+}
+
+static gpointer
+gst_v4l2_buffer_pool_dequeue_thread (GstRKV4l2BufferPool * pool)
+{
+  GstFlowReturn ret;
+  GstBuffer *buffer;
+
+  GST_DEBUG_OBJECT (pool, "dequeue thread started");
+
+  while (TRUE) {
+    ret = gst_v4l2_buffer_pool_dqbuf (pool, &buffer);
+    if (ret != GST_FLOW_OK)
+      break;
+
+    /* the driver is about to run dry while older frames are still waiting
+     * for the streaming thread, give this one straight back */
+    if ((g_atomic_int_get (&pool->num_queued) == 0
+            && gst_v4l2_buffer_pool_ring_count (pool) > 0)
+        || !gst_v4l2_buffer_pool_ring_push (pool, buffer)) {
+      GST_DEBUG_OBJECT (pool, "overrun, requeuing buffer %p", buffer);
+      g_atomic_int_inc ((gint *) & pool->num_overruns);
+      gst_v4l2_buffer_pool_release_buffer (GST_BUFFER_POOL (pool), buffer);
+    }
+  }
+
+  GST_DEBUG_OBJECT (pool, "dequeue thread stopped: %s",
+      gst_flow_get_name (ret));
+
+  g_mutex_lock (&pool->ring_lock);
+  pool->dq_ret = ret;
+  g_cond_signal (&pool->ring_cond);
+  g_mutex_unlock (&pool->ring_lock);
+
+  return NULL;
+}
+
+static void
+gst_v4l2_buffer_pool_start_dequeue_thread (GstRKV4l2BufferPool * pool)
+{
+  GError *error = NULL;
+
+  if (pool->dq_thread)
+    return;
+
+  if (!pool->can_poll_device) {
+    GST_WARNING_OBJECT (pool, "device can't be polled, not using a dequeue "
+        "thread");
+    pool->dq_threaded = FALSE;
+    return;
+  }
+
+  g_mutex_lock (&pool->ring_lock);
+  pool->dq_ret = GST_FLOW_OK;
+  pool->ring_flushing = FALSE;
+  g_mutex_unlock (&pool->ring_lock);
+
+  pool->dq_thread = g_thread_try_new ("v4l2-dequeue",
+      (GThreadFunc) gst_v4l2_buffer_pool_dequeue_thread, pool, &error);
+  if (!pool->dq_thread) {
+    GST_WARNING_OBJECT (pool, "failed to start dequeue thread: %s",
+        error->message);
+    g_error_free (error);
+    pool->dq_threaded = FALSE;
+  }
+}
+
+/* must be called once the poll is flushing so the thread can get out */
+static void
+gst_v4l2_buffer_pool_stop_dequeue_thread (GstRKV4l2BufferPool * pool)
+{
+  GstRKV4l2MemoryGroup *group;
+  GstBuffer *buffer;
+
+  g_mutex_lock (&pool->ring_lock);
+  pool->ring_flushing = TRUE;
+  g_cond_broadcast (&pool->ring_cond);
+  g_mutex_unlock (&pool->ring_lock);
+
+  if (!pool->dq_thread)
+    return;
+
+  g_thread_join (pool->dq_thread);
+  pool->dq_thread = NULL;
+
+  /* frames nobody picked up are handed back as if they were still queued,
+   * flush_stop() or stop() will then deal with them */
+  while ((buffer = gst_v4l2_buffer_pool_ring_pop (pool))) {
+    if (!gst_v4l2_is_buffer_valid (buffer, &group)) {
+      gst_buffer_unref (buffer);
+      continue;
+    }
+    GST_OBJECT_LOCK (pool);
+    pool->buffers[group->buffer.index] = buffer;
+    g_atomic_int_inc (&pool->num_queued);
+    GST_OBJECT_UNLOCK (pool);
+  }
+}
+
 static void
 gst_v4l2_buffer_pool_flush_start (GstBufferPool * bpool)
 {
@@ -937,6 +1195,8 @@ gst_v4l2_buffer_pool_flush_start (GstBufferPool * bpool)
   g_cond_broadcast (&pool->empty_cond);
   GST_OBJECT_UNLOCK (pool);
 
+  gst_v4l2_buffer_pool_stop_dequeue_thread (pool);
+
   if (pool->other_pool)
     gst_buffer_pool_set_flushing (pool->other_pool, TRUE);
 }
@@ -1005,6 +1265,9 @@ streamon:
     gst_v4l2_buffer_pool_streamon (pool);
 
   gst_poll_set_flushing (pool->poll, FALSE);
+
+  if (pool->dq_threaded && pool->streaming)
+    gst_v4l2_buffer_pool_start_dequeue_thread (pool);
 }
 
 static GstFlowReturn
@@ -1066,6 +1329,27 @@ select_error:
   }
 }
 
+/* called with the pool lock, when a capture buffer goes back to the driver */
+static void
+gst_v4l2_buffer_pool_account_qbuf (GstRKV4l2BufferPool * pool, gint index)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  if (GST_CLOCK_TIME_IS_VALID (pool->dequeue_time[index])) {
+    GstClockTime hold = now - pool->dequeue_time[index];
+
+    pool->hold_time = pool->hold_time ? (7 * pool->hold_time + hold) / 8 : hold;
+    pool->dequeue_time[index] = GST_CLOCK_TIME_NONE;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (pool->starved_since)) {
+    pool->starved_time += now - pool->starved_since;
+    pool->starved_count++;
+    pool->starved_since = GST_CLOCK_TIME_NONE;
+    pool->last_starved = now;
+  }
+}
+
 static GstFlowReturn
 gst_v4l2_buffer_pool_qbuf (GstRKV4l2BufferPool * pool, GstBuffer * buf)
 {
@@ -1115,6 +1399,9 @@ gst_v4l2_buffer_pool_qbuf (GstRKV4l2BufferPool * pool, GstBuffer * buf)
   }
 
   GST_OBJECT_LOCK (pool);
+  if (!V4L2_TYPE_IS_OUTPUT (obj->type))
+    gst_v4l2_buffer_pool_account_qbuf (pool, index);
+
   g_atomic_int_inc (&pool->num_queued);
   pool->buffers[index] = buf;
 
@@ -1177,9 +1464,14 @@ gst_v4l2_buffer_pool_dqbuf (GstRKV4l2BufferPool * pool, GstBuffer ** buffer)
   if (g_atomic_int_dec_and_test (&pool->num_queued)) {
     GST_OBJECT_LOCK (pool);
     pool->empty = TRUE;
+    if (!V4L2_TYPE_IS_OUTPUT (obj->type))
+      pool->starved_since = gst_util_get_timestamp ();
     GST_OBJECT_UNLOCK (pool);
   }
 
+  if (!V4L2_TYPE_IS_OUTPUT (obj->type))
+    pool->dequeue_time[group->buffer.index] = gst_util_get_timestamp ();
+
   timestamp = GST_TIMEVAL_TO_TIME (group->buffer.timestamp);
 
 #ifndef GST_DISABLE_GST_DEBUG
@@ -1293,6 +1585,117 @@ no_buffer:
   }
 }
 
+static gboolean
+gst_v4l2_buffer_pool_grow (GstRKV4l2BufferPool * pool)
+{
+  GstBuffer *buffer;
+  guint count;
+
+  gboolean idle = FALSE;
+
+  /* parked buffers come back first, they cost nothing */
+  GST_OBJECT_LOCK (pool);
+  buffer = g_queue_pop_head (&pool->parked);
+  if (buffer && pool->num_idle > 0) {
+    pool->num_idle--;
+    idle = TRUE;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  if (buffer) {
+    GST_DEBUG_OBJECT (pool, "unparking %s buffer %p", idle ? "idle" : "spare",
+        buffer);
+    if (gst_v4l2_buffer_pool_qbuf (pool, buffer) == GST_FLOW_OK) {
+      if (idle)
+        pool->num_unparked++;
+      else
+        pool->num_swapped++;
+      return TRUE;
+    }
+    GST_BUFFER_POOL_CLASS (parent_class)->release_buffer (GST_BUFFER_POOL
+        (pool), buffer);
+  }
+
+  if (!GST_V4L2_ALLOCATOR_CAN_ALLOCATE (pool->vallocator, MMAP))
+    return FALSE;
+
+  count = pool->vallocator->count;
+  if (pool->adaptive && count >= pool->adaptive_max)
+    return FALSE;
+
+  if (gst_v4l2_buffer_pool_resurect_buffer (pool) != GST_FLOW_OK)
+    return FALSE;
+
+  if (pool->vallocator->count > count) {
+    pool->num_grown++;
+    GST_INFO_OBJECT (pool, "capture queue starved, grown to %u buffers",
+        pool->vallocator->count);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_v4l2_buffer_pool_park (GstRKV4l2BufferPool * pool, GstBuffer * buffer)
+{
+  GstClockTime now;
+  gboolean parked = FALSE;
+  guint active;
+
+  if (pool->other_pool)
+    return FALSE;
+
+  GST_OBJECT_LOCK (pool);
+  if (pool->spares_pending > 0) {
+    pool->spares_pending--;
+    g_queue_push_tail (&pool->parked, buffer);
+    GST_OBJECT_UNLOCK (pool);
+    GST_DEBUG_OBJECT (pool, "keeping %p as spare buffer", buffer);
+    return TRUE;
+  }
+
+  /* refill the spare ring once the queue has recovered from a starvation */
+  if (pool->low_policy == GST_V4L2_LOW_BUFFER_SPARE
+      && g_queue_get_length (&pool->parked) < pool->num_spares
+      && !GST_CLOCK_TIME_IS_VALID (pool->starved_since)
+      && g_atomic_int_get (&pool->num_queued) > pool->min_latency) {
+    g_queue_push_tail (&pool->parked, buffer);
+    GST_OBJECT_UNLOCK (pool);
+    GST_DEBUG_OBJECT (pool, "re-parking %p as spare buffer", buffer);
+    return TRUE;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  if (!pool->adaptive)
+    return FALSE;
+
+  now = gst_util_get_timestamp ();
+
+  GST_OBJECT_LOCK (pool);
+  active = pool->vallocator->count - g_queue_get_length (&pool->parked);
+
+  /* shrink one buffer at a time, only once the queue has been fed for a
+   * while and still has headroom */
+  if (!GST_CLOCK_TIME_IS_VALID (pool->starved_since)
+      && g_atomic_int_get (&pool->num_queued) > pool->min_latency
+      && active > pool->adaptive_min
+      && now - pool->last_starved > GST_V4L2_ADAPTIVE_IDLE_TIME
+      && now - pool->last_parked > GST_V4L2_ADAPTIVE_IDLE_TIME) {
+    g_queue_push_tail (&pool->parked, buffer);
+    pool->last_parked = now;
+    pool->num_parked++;
+    pool->num_idle++;
+    parked = TRUE;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  if (parked)
+    GST_INFO_OBJECT (pool, "capture queue idle, parked buffer %p, %u active",
+        buffer, active - 1);
+
+  return parked;
+}
+
 static GstFlowReturn
 gst_v4l2_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
     GstBufferPoolAcquireParams * params)
@@ -1329,7 +1732,10 @@ gst_v4l2_buffer_pool_acquire_buffer (GstBufferPool * bpool, GstBuffer ** buffer,
           /* just dequeue a buffer, we basically use the queue of v4l2 as the
            * storage for our buffers. This function does poll first so we can
            * interrupt it fine. */
-          ret = gst_v4l2_buffer_pool_dqbuf (pool, buffer);
+          if (pool->dq_threaded)
+            ret = gst_v4l2_buffer_pool_ring_wait (pool, buffer);
+          else
+            ret = gst_v4l2_buffer_pool_dqbuf (pool, buffer);
           break;
         }
         default:
@@ -1401,6 +1807,9 @@ gst_v4l2_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
           GstRKV4l2MemoryGroup *group;
           if (gst_v4l2_is_buffer_valid (buffer, &group)) {
             gst_v4l2_allocator_reset_group (pool->vallocator, group);
+            /* keep it out of the device while the pool is oversized */
+            if (gst_v4l2_buffer_pool_park (pool, buffer))
+              break;
             /* queue back in the device */
             if (pool->other_pool)
               gst_v4l2_buffer_pool_prepare_buffer (pool, buffer, NULL);
@@ -1517,6 +1926,8 @@ gst_v4l2_buffer_pool_finalize (GObject * object)
   gst_object_unref (pool->obj->element);
 
   g_cond_clear (&pool->empty_cond);
+  g_mutex_clear (&pool->ring_lock);
+  g_cond_clear (&pool->ring_cond);
 
   /* FIXME have we done enough here ? */
 
@@ -1530,6 +1941,13 @@ gst_v4l2_buffer_pool_init (GstRKV4l2BufferPool * pool)
   pool->can_poll_device = TRUE;
   g_cond_init (&pool->empty_cond);
   pool->empty = TRUE;
+  g_queue_init (&pool->parked);
+  pool->adaptive_min = GST_V4L2_MIN_BUFFERS;
+  pool->adaptive_max = VIDEO_MAX_FRAME;
+  pool->starved_since = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&pool->ring_lock);
+  g_cond_init (&pool->ring_cond);
+  pool->ring_flushing = TRUE;
 }
 
 static void
@@ -1751,28 +2169,30 @@ gst_v4l2_buffer_pool_process (GstRKV4l2BufferPool * pool, GstBuffer ** buf)
                 num_queued);
 
             /* If we have no more buffer, and can allocate it time to do so */
-            if (num_queued == 0) {
-              if (GST_V4L2_ALLOCATOR_CAN_ALLOCATE (pool->vallocator, MMAP)) {
-                ret = gst_v4l2_buffer_pool_resurect_buffer (pool);
-                if (ret == GST_FLOW_OK)
-                  goto done;
-              }
+            if (num_queued == 0 && gst_v4l2_buffer_pool_grow (pool)) {
+              ret = GST_FLOW_OK;
+              goto done;
             }
 
             /* start copying buffers when we are running low on buffers */
             if (num_queued < pool->copy_threshold) {
               GstBuffer *copy;
 
-              if (GST_V4L2_ALLOCATOR_CAN_ALLOCATE (pool->vallocator, MMAP)) {
-                ret = gst_v4l2_buffer_pool_resurect_buffer (pool);
-                if (ret == GST_FLOW_OK)
-                  goto done;
+              if (gst_v4l2_buffer_pool_grow (pool)) {
+                ret = GST_FLOW_OK;
+                goto done;
               }
 
+              /* don't stall the streaming thread on a full frame copy,
+               * give the frame back to the driver instead */
+              if (pool->low_policy != GST_V4L2_LOW_BUFFER_COPY)
+                goto dropped;
+
               /* copy the buffer */
               copy = gst_buffer_copy_region (*buf,
                   GST_BUFFER_COPY_ALL | GST_BUFFER_COPY_DEEP, 0, -1);
               GST_LOG_OBJECT (pool, "copy buffer %p->%p", *buf, copy);
+              pool->num_copies++;
 
               /* and requeue so that we can continue capturing */
               gst_buffer_unref (*buf);
@@ -1785,7 +2205,11 @@ gst_v4l2_buffer_pool_process (GstRKV4l2BufferPool * pool, GstBuffer ** buf)
           }
 
           /* buffer not from our pool, grab a frame and copy it into the target */
-          if ((ret = gst_v4l2_buffer_pool_dqbuf (pool, &tmp)) != GST_FLOW_OK)
+          if (pool->dq_threaded)
+            ret = gst_v4l2_buffer_pool_ring_wait (pool, &tmp);
+          else
+            ret = gst_v4l2_buffer_pool_dqbuf (pool, &tmp);
+          if (ret != GST_FLOW_OK)
             goto done;
 
           /* An empty buffer on capture indicates the end of stream */
@@ -1802,6 +2226,7 @@ gst_v4l2_buffer_pool_process (GstRKV4l2BufferPool * pool, GstBuffer ** buf)
           }
 
           ret = gst_v4l2_buffer_pool_copy_buffer (pool, *buf, tmp);
+          pool->num_copies++;
 
           /* an queue the buffer again after the copy */
           gst_v4l2_buffer_pool_release_buffer (bpool, tmp);
@@ -1956,6 +2381,14 @@ copy_failed:
     GST_ERROR_OBJECT (pool, "failed to copy buffer");
     return ret;
   }
+dropped:
+  {
+    GST_DEBUG_OBJECT (pool, "capture queue low, dropping buffer %p", *buf);
+    pool->num_dropped++;
+    gst_buffer_unref (*buf);
+    *buf = NULL;
+    return GST_V4L2_FLOW_DROPPED_BUFFER;
+  }
 buffer_corrupted:
   {
     GST_WARNING_OBJECT (pool, "Dropping corrupted buffer without payload");
@@ -2015,3 +2448,113 @@ gst_v4l2_buffer_pool_copy_at_threshold (GstRKV4l2BufferPool * pool,
   pool->enable_copy_threshold = copy;
   GST_OBJECT_UNLOCK (pool);
 }
+
+/**
+ * gst_v4l2_buffer_pool_set_adaptive:
+ * @pool: a capture #GstRKV4l2BufferPool
+ * @adaptive: enable adaptive sizing
+ * @min_buffers: number of buffers to start with
+ * @max_buffers: upper bound when growing with CREATE_BUFS
+ *
+ * An adaptive pool starts with @min_buffers, grows whenever the capture
+ * queue runs empty and parks buffers again once it has been idle for a
+ * while. Parked buffers stay allocated out of the queue until the pool is
+ * stopped, the next start only requests the buffers that were in use.
+ * Must be called before the pool is activated.
+ */
+void
+gst_v4l2_buffer_pool_set_adaptive (GstRKV4l2BufferPool * pool,
+    gboolean adaptive, guint min_buffers, guint max_buffers)
+{
+  g_return_if_fail (!gst_buffer_pool_is_active (GST_BUFFER_POOL (pool)));
+
+  GST_OBJECT_LOCK (pool);
+  pool->adaptive = adaptive;
+  pool->adaptive_restart = 0;
+  pool->adaptive_min = CLAMP (min_buffers, GST_V4L2_MIN_BUFFERS,
+      VIDEO_MAX_FRAME);
+  pool->adaptive_max = CLAMP (max_buffers, pool->adaptive_min,
+      VIDEO_MAX_FRAME);
+  GST_OBJECT_UNLOCK (pool);
+}
+
+/**
+ * gst_v4l2_buffer_pool_get_stats:
+ * @pool: a #GstRKV4l2BufferPool
+ *
+ * Returns: (transfer full): a snapshot of the pool counters.
+ */
+GstStructure *
+gst_v4l2_buffer_pool_get_stats (GstRKV4l2BufferPool * pool)
+{
+  GstStructure *s;
+  GstClockTime starved_time;
+
+  GST_OBJECT_LOCK (pool);
+  starved_time = pool->starved_time;
+  if (GST_CLOCK_TIME_IS_VALID (pool->starved_since))
+    starved_time += gst_util_get_timestamp () - pool->starved_since;
+
+  s = gst_structure_new ("GstV4l2BufferPoolStats",
+      "adaptive", G_TYPE_BOOLEAN, pool->adaptive,
+      "buffers", G_TYPE_UINT, pool->vallocator ? pool->vallocator->count : 0,
+      "queued", G_TYPE_UINT, g_atomic_int_get (&pool->num_queued),
+      "parked", G_TYPE_UINT, g_queue_get_length (&pool->parked),
+      "grown", G_TYPE_UINT, pool->num_grown,
+      "shrunk", G_TYPE_UINT, pool->num_parked,
+      "unparked", G_TYPE_UINT, pool->num_unparked,
+      "starved-count", G_TYPE_UINT, pool->starved_count,
+      "starved-time", G_TYPE_UINT64, starved_time,
+      "hold-time", G_TYPE_UINT64, pool->hold_time,
+      "copies", G_TYPE_UINT, pool->num_copies,
+      "swapped", G_TYPE_UINT, pool->num_swapped,
+      "dropped", G_TYPE_UINT, pool->num_dropped,
+      "overruns", G_TYPE_UINT, g_atomic_int_get (&pool->num_overruns),
+      "handoff-latency", G_TYPE_UINT64, pool->handoff_time, NULL);
+  GST_OBJECT_UNLOCK (pool);
+
+  return s;
+}
+
+/**
+ * gst_v4l2_buffer_pool_set_low_buffer_policy:
+ * @pool: a capture #GstRKV4l2BufferPool
+ * @policy: what to do when the capture queue runs low
+ * @num_spares: spare buffers to allocate for %GST_V4L2_LOW_BUFFER_SPARE
+ *
+ * Must be called before the pool is activated.
+ */
+void
+gst_v4l2_buffer_pool_set_low_buffer_policy (GstRKV4l2BufferPool * pool,
+    GstV4l2LowBufferPolicy policy, guint num_spares)
+{
+  g_return_if_fail (!gst_buffer_pool_is_active (GST_BUFFER_POOL (pool)));
+
+  GST_OBJECT_LOCK (pool);
+  pool->low_policy = policy;
+  pool->num_spares = num_spares;
+  GST_OBJECT_UNLOCK (pool);
+}
+
+/**
+ * gst_v4l2_buffer_pool_set_dequeue_thread:
+ * @pool: a capture #GstRKV4l2BufferPool
+ * @threaded: dequeue from a dedicated thread
+ *
+ * A threaded pool polls and dequeues frames as soon as the driver has them
+ * and hands them to acquire through a lock-free ring, so short downstream
+ * stalls don't delay the dequeue. When the driver is about to run out of
+ * buffers the newest frame is requeued and counted as an overrun. Only
+ * MMAP and DMABUF capture are supported. Must be called before the pool is
+ * activated.
+ */
+void
+gst_v4l2_buffer_pool_set_dequeue_thread (GstRKV4l2BufferPool * pool,
+    gboolean threaded)
+{
+  g_return_if_fail (!gst_buffer_pool_is_active (GST_BUFFER_POOL (pool)));
+
+  GST_OBJECT_LOCK (pool);
+  pool->dq_threaded = threaded;
+  GST_OBJECT_UNLOCK (pool);
+}
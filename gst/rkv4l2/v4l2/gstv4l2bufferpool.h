@@ -49,6 +49,21 @@ G_BEGIN_DECLS
  * with the error flag and had no payload. This error should be recovered by
  * simply waiting for next buffer. */
 #define GST_V4L2_FLOW_CORRUPTED_BUFFER GST_FLOW_CUSTOM_SUCCESS_1
+/* This flow return is used to indicated that the captured frame was dropped
+ * to keep the capture queue fed. The caller should report it through QoS and
+ * wait for next buffer. */
+#define GST_V4L2_FLOW_DROPPED_BUFFER GST_FLOW_CUSTOM_SUCCESS_2
+
+#define GST_TYPE_V4L2_LOW_BUFFER_POLICY (gst_v4l2_low_buffer_policy_get_type ())
+GType gst_v4l2_low_buffer_policy_get_type (void);
+
+/* What a capture pool does when the driver queue runs low */
+typedef enum
+{
+  GST_V4L2_LOW_BUFFER_COPY,     /* hand out a deep copy of the frame */
+  GST_V4L2_LOW_BUFFER_SPARE,    /* queue a spare buffer, drop when none left */
+  GST_V4L2_LOW_BUFFER_DROP,     /* requeue the frame and drop it */
+} GstV4l2LowBufferPolicy;
     struct _GstV4l2BufferPool
 {
   GstBufferPool parent;
@@ -79,6 +94,7 @@ G_BEGIN_DECLS
 
   gboolean streaming;
   gboolean flushing;
+  gboolean busy;                /* STREAMON failed with EBUSY */
 
   GstBuffer *buffers[VIDEO_MAX_FRAME];
 
@@ -87,6 +103,51 @@ G_BEGIN_DECLS
 
   /* Control to warn only once on buggy feild driver bug */
   gboolean has_warned_on_buggy_field;
+
+  /* adaptive sizing, grow on starvation and park buffers when idle */
+  gboolean adaptive;
+  guint adaptive_min;           /* buffers to start with */
+  guint adaptive_max;           /* never grow past this */
+  guint adaptive_restart;       /* buffers in use when last stopped */
+  GQueue parked;                /* capture buffers kept out of the driver */
+  GstClockTime starved_since;   /* when the capture queue ran empty */
+  GstClockTime last_starved;    /* when it was last refilled */
+  GstClockTime last_parked;
+  GstClockTime dequeue_time[VIDEO_MAX_FRAME];
+
+  /* counters, see gst_v4l2_buffer_pool_get_stats() */
+  guint num_grown;
+  guint num_parked;             /* shrunk by parking an idle buffer */
+  guint num_idle;               /* idle buffers among the parked ones */
+  guint num_unparked;           /* idle buffers queued again */
+  guint starved_count;
+  GstClockTime starved_time;
+  GstClockTime hold_time;       /* running average of downstream hold time */
+  guint num_copies;
+  guint num_swapped;            /* spare buffers swapped in */
+  guint num_dropped;
+
+  /* starvation policy */
+  GstV4l2LowBufferPolicy low_policy;
+  guint num_spares;             /* spare buffers allocated at start */
+  guint spares_pending;         /* spares to park before streaming */
+
+  /* dequeue thread, frames are handed to acquire through a single producer,
+   * single consumer ring. ring_head is only written by the dequeue thread
+   * and ring_tail by the streaming thread. */
+  gboolean dq_threaded;
+  GThread *dq_thread;
+  GstFlowReturn dq_ret;         /* why the dequeue thread stopped */
+  GstBuffer *ring[VIDEO_MAX_FRAME];
+  GstClockTime ring_time[VIDEO_MAX_FRAME];
+  gint ring_head;
+  gint ring_tail;
+  gint ring_waiting;
+  gboolean ring_flushing;
+  GMutex ring_lock;             /* only taken to sleep and to wake up */
+  GCond ring_cond;
+  guint num_overruns;
+  GstClockTime handoff_time;    /* running average of dequeue to acquire */
 };
 
 struct _GstV4l2BufferPoolClass
@@ -105,6 +166,13 @@ void gst_v4l2_buffer_pool_set_other_pool (GstRKV4l2BufferPool * pool,
     GstBufferPool * other_pool);
 void gst_v4l2_buffer_pool_copy_at_threshold (GstRKV4l2BufferPool * pool,
     gboolean copy);
+void gst_v4l2_buffer_pool_set_adaptive (GstRKV4l2BufferPool * pool,
+    gboolean adaptive, guint min_buffers, guint max_buffers);
+GstStructure *gst_v4l2_buffer_pool_get_stats (GstRKV4l2BufferPool * pool);
+void gst_v4l2_buffer_pool_set_low_buffer_policy (GstRKV4l2BufferPool * pool,
+    GstV4l2LowBufferPolicy policy, guint num_spares);
+void gst_v4l2_buffer_pool_set_dequeue_thread (GstRKV4l2BufferPool * pool,
+    gboolean threaded);
 
 G_END_DECLS
 #endif /*__GST_V4L2_BUFFER_POOL_H__ */
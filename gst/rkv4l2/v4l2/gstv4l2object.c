@@ -447,6 +447,8 @@ gst_v4l2_object_destroy (GstRKV4l2Object * v4l2object)
   g_return_if_fail (v4l2object != NULL);
 
   g_free (v4l2object->videodev);
+  g_free (v4l2object->media_config);
+  g_free (v4l2object->caps_cache_tag);
 
   if (v4l2object->formats) {
     gst_v4l2_object_clear_format_list (v4l2object);
@@ -3782,7 +3784,12 @@ gst_v4l2_object_get_caps (GstRKV4l2Object * v4l2object, GstCaps * filter)
   GstCaps *ret;
 
   if (v4l2object->probed_caps == NULL)
+    v4l2object->probed_caps = rk_common_caps_cache_lookup (v4l2object);
+
+  if (v4l2object->probed_caps == NULL) {
     v4l2object->probed_caps = gst_v4l2_object_probe_caps (v4l2object, NULL);
+    rk_common_caps_cache_store (v4l2object, v4l2object->probed_caps);
+  }
 
   if (filter) {
     ret = gst_caps_intersect_full (filter, v4l2object->probed_caps,
@@ -43,6 +43,9 @@ MotifWmHints, MwmHints;
 
 #define MWM_HINTS_DECORATIONS   (1L << 1)
 
+/* the VOP scales by up to 8 either way */
+#define RKX_MAX_SCALE 8
+
 static void gst_x_image_sink_reset (GstRkXImageSink * ximagesink);
 static void gst_x_image_sink_xwindow_update_geometry (GstRkXImageSink *
     ximagesink);
@@ -474,6 +477,40 @@ gst_x_image_sink_xwindow_draw_borders (GstRkXImageSink * ximagesink,
   }
 }
 
+/* brings @len within the scaling range of the plane for @src_len,
+ * keeping its center */
+static void
+gst_x_image_sink_clamp_scale (gint src_len, gint * pos, gint * len)
+{
+  gint clamped;
+
+  clamped = CLAMP (*len, (src_len + RKX_MAX_SCALE - 1) / RKX_MAX_SCALE,
+      src_len * RKX_MAX_SCALE);
+  *pos = MAX (*pos + (*len - clamped) / 2, 0);
+  *len = clamped;
+}
+
+/* TRUE when upstream has to be asked for frames of the new size */
+static gboolean
+gst_x_image_sink_set_scale_target (GstRkXImageSink * ximagesink, gint width,
+    gint height)
+{
+  gboolean changed;
+
+  GST_OBJECT_LOCK (ximagesink);
+  changed = ximagesink->scale_width != width ||
+      ximagesink->scale_height != height;
+  ximagesink->scale_width = width;
+  ximagesink->scale_height = height;
+  GST_OBJECT_UNLOCK (ximagesink);
+
+  if (changed)
+    GST_DEBUG_OBJECT (ximagesink, "asking upstream for %dx%d frames", width,
+        height);
+
+  return changed;
+}
+
 /* This function puts a GstXImageBuffer on a GstRkXImageSink's window */
 static gboolean
 gst_x_image_sink_ximage_put (GstRkXImageSink * ximagesink, GstBuffer * ximage)
@@ -489,7 +526,11 @@ gst_x_image_sink_ximage_put (GstRkXImageSink * ximagesink, GstBuffer * ximage)
   guint32 offsets[4] = { 0, };
   guint32 pitches[4] = { 0, };
   gint ret;
-  float scl_w, scl_h;
+  gboolean too_tall, skip_line;
+  GstMessage *report = NULL;
+  const gchar *path;
+  gint target_w, target_h;
+  gboolean reconfigure = FALSE;
 
   /* We take the flow_lock. If expose is in there we don't want to run
      concurrently from the data flow thread */
@@ -608,21 +649,53 @@ gst_x_image_sink_ximage_put (GstRkXImageSink * ximagesink, GstBuffer * ximage)
   bo_handles[0] = gem_handle;
   bo_handles[1] = gem_handle;
 
-  /* handle hardware limition */
-  scl_w = src.w / result.w;
-  scl_h = src.h / result.h;
-  if (scl_w > 8 || scl_w < 1 / 8 || scl_h > 8 || scl_w < 1 / 8) {
-    /* VOP can't scale up/down more than 8 */
-    goto out;
-  }
+  /* handle hardware limition, frames of the size shown are asked from
+   * upstream while the plane gets as close as it can */
+  target_w = GST_ROUND_UP_2 (result.w);
+  target_h = GST_ROUND_UP_2 (result.h);
 
-   /* Skip Line to avoid blink */
-  if (scl_w >= 2 && scl_h >= 4) {
+  /* fetch every other line while too tall, and once to avoid blink when
+   * shrinking at least twice across and four times down */
+  too_tall = src.h > result.h * RKX_MAX_SCALE;
+  skip_line = src.w >= result.w * 2 && src.h >= result.h * 4;
+  while (skip_line || src.h > result.h * RKX_MAX_SCALE) {
     src.h /= 2;
     pitches[0] *= 2;
     pitches[1] *= 2;
+    skip_line = FALSE;
   }
-  
+
+  if (too_tall || src.w > result.w * RKX_MAX_SCALE ||
+      result.w > src.w * RKX_MAX_SCALE || result.h > src.h * RKX_MAX_SCALE) {
+    path = too_tall ? "line-skip" : "clamped";
+
+    gst_x_image_sink_clamp_scale (src.w, &result.x, &result.w);
+    gst_x_image_sink_clamp_scale (src.h, &result.y, &result.h);
+  } else if (src.w == ximagesink->scale_width &&
+      src.h == ximagesink->scale_height) {
+    path = "upstream";
+  } else {
+    path = "plane";
+  }
+
+  /* follows the area shown once asked */
+  if (strcmp (path, "plane"))
+    reconfigure = gst_x_image_sink_set_scale_target (ximagesink, target_w,
+        target_h);
+
+  if (strcmp (path, ximagesink->scale_path)) {
+    GST_INFO_OBJECT (ximagesink, "showing %dx%d at %dx%d through the %s",
+        src.w, src.h, result.w, result.h, path);
+    ximagesink->scale_path = path;
+    report = gst_message_new_element (GST_OBJECT (ximagesink),
+        gst_structure_new ("GstRkXImageSinkScale",
+            "path", G_TYPE_STRING, path,
+            "src-width", G_TYPE_INT, src.w,
+            "src-height", G_TYPE_INT, src.h,
+            "dest-width", G_TYPE_INT, result.w,
+            "dest-height", G_TYPE_INT, result.h, NULL));
+  }
+
    /* drop pixel */
   if (src.w >= 4090) {
     src.w = 3840;
@@ -666,12 +739,20 @@ out:
   gst_buffer_unref (ximage);
   g_mutex_unlock (&ximagesink->x_lock);
 
+  if (report)
+    gst_element_post_message (GST_ELEMENT (ximagesink), report);
+  if (reconfigure)
+    gst_pad_push_event (GST_BASE_SINK_PAD (ximagesink),
+        gst_event_new_reconfigure ());
+
   return TRUE;
 
 error:
   gst_buffer_unref (ximage);
   g_mutex_unlock (&ximagesink->x_lock);
   g_mutex_unlock (&ximagesink->flow_lock);
+  if (report)
+    gst_message_unref (report);
   return GST_FLOW_ERROR;
 }
 
@@ -1290,6 +1371,18 @@ gst_x_image_sink_getcaps (GstBaseSink * bsink, GstCaps * filter)
   ximagesink = GST_X_IMAGE_SINK (bsink);
 
   caps = gst_x_image_sink_get_allowed_caps (ximagesink);
+
+  /* frames of the size shown first, for upstream scalers to pick */
+  GST_OBJECT_LOCK (ximagesink);
+  if (caps && ximagesink->scale_width > 0) {
+    GstCaps *scaled = gst_caps_copy (caps);
+
+    gst_caps_set_simple (scaled, "width", G_TYPE_INT, ximagesink->scale_width,
+        "height", G_TYPE_INT, ximagesink->scale_height, NULL);
+    caps = gst_caps_merge (scaled, caps);
+  }
+  GST_OBJECT_UNLOCK (ximagesink);
+
   if (caps && filter) {
     out_caps = gst_caps_intersect_full (caps, filter, GST_CAPS_INTERSECT_FIRST);
     gst_caps_unref (caps);
@@ -1921,6 +2014,7 @@ gst_x_image_sink_init (GstRkXImageSink * ximagesink)
   ximagesink->handle_events = TRUE;
   ximagesink->handle_expose = TRUE;
   ximagesink->display_ratio_enabled = TRUE;
+  ximagesink->scale_path = "plane";
 
   ximagesink->fd = -1;
   ximagesink->conn_id = -1;
@@ -2106,6 +2200,11 @@ gst_x_image_sink_stop (GstBaseSink * bsink)
   gst_caps_replace (&self->allowed_caps, NULL);
   gst_object_replace ((GstObject **) & self->allocator, NULL);
 
+  GST_OBJECT_LOCK (self);
+  self->scale_width = self->scale_height = 0;
+  GST_OBJECT_UNLOCK (self);
+  self->scale_path = "plane";
+
   gst_poll_remove_fd (self->poll, &self->pollfd);
   gst_poll_restart (self->poll);
   gst_poll_fd_init (&self->pollfd);
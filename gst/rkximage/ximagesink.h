@@ -184,6 +184,10 @@ struct _GstRkXImageSink
   guint32 last_fb_id;
   GstVideoRectangle save_rect;
   gboolean paused;
+
+  /* frames the plane can't scale, size asked from upstream meanwhile */
+  const gchar *scale_path;
+  gint scale_width, scale_height;
 };
 
 struct _GstRkXImageSinkClass
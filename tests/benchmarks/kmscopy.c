@@ -0,0 +1,221 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* Times gst_kms_copier_copy () against gst_video_frame_copy () per format
+ * and resolution, the way kmssink copies the frames it can't import. With
+ * --device the frames go into mapped dumb buffers of that DRM device, else
+ * into system memory with 64 byte aligned strides.
+ *
+ *   kmscopy [--device /dev/dri/card0] [--threads 0] [--frames 100]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "kms/gstkmsallocator.h"
+#include "kms/gstkmscopy.h"
+
+static const GstVideoFormat formats[] = {
+  GST_VIDEO_FORMAT_NV12,
+  GST_VIDEO_FORMAT_I420,
+  GST_VIDEO_FORMAT_YUY2,
+  GST_VIDEO_FORMAT_BGRx,
+};
+
+static const struct
+{
+  gint width, height;
+} sizes[] = {
+  {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160},
+};
+
+static gchar *device = NULL;
+static gint n_threads = 0;
+static gint n_frames = 100;
+
+static GOptionEntry entries[] = {
+  {"device", 'd', 0, G_OPTION_ARG_FILENAME, &device,
+      "DRM device to copy into dumb buffers of", "PATH"},
+  {"threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+      "Copy threads, 0 for one per core", "N"},
+  {"frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+      "Frames copied per measure", "N"},
+  {NULL}
+};
+
+/* @info takes the strides of the buffer */
+static GstBuffer *
+dest_buffer_new (GstAllocator * allocator, GstVideoInfo * info)
+{
+  GstVideoAlignment align;
+  GstBuffer *buf;
+  GstMemory *mem;
+  guint i;
+
+  if (allocator) {
+    mem = gst_kms_allocator_bo_alloc (allocator, info);
+    if (!mem)
+      return NULL;
+
+    buf = gst_buffer_new ();
+    gst_buffer_append_memory (buf, mem);
+    return buf;
+  }
+
+  gst_video_alignment_reset (&align);
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    align.stride_align[i] = 63;
+  gst_video_info_align (info, &align);
+
+  return gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (info), NULL);
+}
+
+typedef gboolean (*CopyFunc) (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src);
+
+static gboolean
+frame_copy (GstKMSCopier * copier, GstVideoFrame * dest,
+    const GstVideoFrame * src)
+{
+  return gst_video_frame_copy (dest, src);
+}
+
+/* ms per frame */
+static gdouble
+measure (CopyFunc copy, GstKMSCopier * copier, GstVideoFrame * dest,
+    GstVideoFrame * src)
+{
+  gint64 start;
+  guint i;
+
+  /* faults the pages in */
+  copy (copier, dest, src);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < n_frames; i++)
+    copy (copier, dest, src);
+
+  return (g_get_monotonic_time () - start) / 1000.0 / n_frames;
+}
+
+static void
+run (GstKMSCopier * copier, GstAllocator * allocator, GstVideoFormat format,
+    gint width, gint height)
+{
+  GstVideoInfo src_info, dest_info;
+  GstVideoFrame src, dest;
+  GstBuffer *src_buf, *dest_buf;
+  gdouble plain, banded, mb;
+
+  gst_video_info_set_format (&src_info, format, width, height);
+  dest_info = src_info;
+
+  src_buf = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&src_info),
+      NULL);
+  gst_buffer_memset (src_buf, 0, 0x80, GST_VIDEO_INFO_SIZE (&src_info));
+
+  dest_buf = dest_buffer_new (allocator, &dest_info);
+  if (!dest_buf) {
+    g_printerr ("can't allocate %s %dx%d\n", gst_video_format_to_string
+        (format), width, height);
+    gst_buffer_unref (src_buf);
+    return;
+  }
+
+  if (!gst_video_frame_map (&src, &src_info, src_buf, GST_MAP_READ))
+    g_error ("can't map the source");
+  if (!gst_video_frame_map (&dest, &dest_info, dest_buf, GST_MAP_WRITE))
+    g_error ("can't map the destination");
+
+  plain = measure (frame_copy, copier, &dest, &src);
+  banded = measure (gst_kms_copier_copy, copier, &dest, &src);
+  mb = GST_VIDEO_INFO_SIZE (&src_info) / 1e6;
+
+  g_print ("%-5s %4dx%-4d  %7.2f ms %8.1f MB/s  %7.2f ms %8.1f MB/s  x%.2f\n",
+      gst_video_format_to_string (format), width, height, plain,
+      mb * 1000 / plain, banded, mb * 1000 / banded, plain / banded);
+
+  gst_video_frame_unmap (&dest);
+  gst_video_frame_unmap (&src);
+  gst_buffer_unref (dest_buf);
+  gst_buffer_unref (src_buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GstAllocator *allocator = NULL;
+  GstKMSCopier *copier;
+  gint fd = -1;
+  guint i, j;
+
+  ctx = g_option_context_new ("- benchmark the kmssink frame copy");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (n_threads < 0 || n_frames <= 0) {
+    g_printerr ("invalid thread or frame count\n");
+    return 1;
+  }
+
+  if (device) {
+    fd = open (device, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      g_printerr ("can't open %s: %s\n", device, g_strerror (errno));
+      return 1;
+    }
+    allocator = gst_kms_allocator_new (fd);
+  }
+
+  copier = gst_kms_copier_new (NULL, n_threads);
+
+  g_print ("%d frames into %s\n", n_frames, device ? device : "system memory");
+  g_print ("%-5s %-9s  %-24s  %-24s\n", "", "", "gst_video_frame_copy",
+      "gst_kms_copier_copy");
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++)
+    for (j = 0; j < G_N_ELEMENTS (sizes); j++)
+      run (copier, allocator, formats[i], sizes[j].width, sizes[j].height);
+
+  gst_kms_copier_free (copier);
+  if (allocator)
+    gst_object_unref (allocator);
+  if (fd >= 0)
+    close (fd);
+
+  return 0;
+}
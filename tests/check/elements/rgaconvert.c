@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+#include <gst/video/video.h>
+
+/* runs against the m2m node in RGACONVERT_DEVICE, the RGA or vim2m,
+ * and passes without one */
+#define CAPS(w, h) \
+  "video/x-raw,format=RGB16,width=" #w ",height=" #h ",framerate=30/1"
+
+static GstHarness *
+harness_new (void)
+{
+  const gchar *device = g_getenv ("RGACONVERT_DEVICE");
+  GstHarness *h;
+
+  if (!device)
+    return NULL;
+
+  h = gst_harness_new ("rgaconvert");
+  g_object_set (h->element, "device", device, NULL);
+  gst_harness_add_propose_allocation_meta (h, GST_VIDEO_META_API_TYPE, NULL);
+
+  return h;
+}
+
+/* pushes @n frames and checks what comes out is @width x @height */
+static void
+convert_frames (GstHarness * h, guint n, gint width, gint height)
+{
+  GstVideoInfo info;
+  GstVideoMeta *meta;
+  GstBuffer *buf;
+  GstCaps *caps;
+  guint i;
+
+  caps = gst_pad_get_current_caps (h->srcpad);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  for (i = 0; i < n; i++) {
+    buf = gst_buffer_new_and_alloc (GST_VIDEO_INFO_SIZE (&info));
+    gst_buffer_memset (buf, 0, i, GST_VIDEO_INFO_SIZE (&info));
+    GST_BUFFER_PTS (buf) = i * GST_SECOND / 30;
+    fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+
+    buf = gst_harness_pull (h);
+    fail_unless (buf != NULL);
+
+    caps = gst_pad_get_current_caps (h->sinkpad);
+    fail_unless (gst_video_info_from_caps (&info, caps));
+    gst_caps_unref (caps);
+    fail_unless_equals_int (GST_VIDEO_INFO_WIDTH (&info), width);
+    fail_unless_equals_int (GST_VIDEO_INFO_HEIGHT (&info), height);
+
+    /* a kept capture queue says so in the meta */
+    meta = gst_buffer_get_video_meta (buf);
+    if (meta) {
+      fail_unless_equals_int (meta->width, width);
+      fail_unless_equals_int (meta->height, height);
+    } else {
+      fail_unless (gst_buffer_get_size (buf) >= GST_VIDEO_INFO_SIZE (&info));
+    }
+    gst_buffer_unref (buf);
+
+    caps = gst_pad_get_current_caps (h->srcpad);
+    fail_unless (gst_video_info_from_caps (&info, caps));
+    gst_caps_unref (caps);
+  }
+}
+
+GST_START_TEST (test_renegotiate_output)
+{
+  GstHarness *h = harness_new ();
+
+  if (!h)
+    return;
+
+  gst_harness_set_caps_str (h, CAPS (640, 480), CAPS (320, 240));
+  convert_frames (h, 5, 320, 240);
+
+  /* smaller, the capture queue keeps its buffers */
+  gst_harness_set_sink_caps_str (h, CAPS (160, 120));
+  gst_harness_push_upstream_event (h, gst_event_new_reconfigure ());
+  convert_frames (h, 5, 160, 120);
+
+  /* larger than the buffers, the capture queue is set up again */
+  gst_harness_set_sink_caps_str (h, CAPS (640, 480));
+  gst_harness_push_upstream_event (h, gst_event_new_reconfigure ());
+  convert_frames (h, 5, 640, 480);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_renegotiate_input)
+{
+  GstHarness *h = harness_new ();
+
+  if (!h)
+    return;
+
+  gst_harness_set_caps_str (h, CAPS (640, 480), CAPS (320, 240));
+  convert_frames (h, 5, 320, 240);
+
+  gst_harness_set_src_caps_str (h, CAPS (320, 240));
+  convert_frames (h, 5, 320, 240);
+
+  gst_harness_set_src_caps_str (h, CAPS (1280, 720));
+  convert_frames (h, 5, 320, 240);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+static Suite *
+rgaconvert_suite (void)
+{
+  Suite *s = suite_create ("rgaconvert");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_renegotiate_output);
+  tcase_add_test (tc_chain, test_renegotiate_input);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rgaconvert);
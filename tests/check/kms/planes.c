@@ -0,0 +1,188 @@
+/* GStreamer
+ *
+ * Copyright (C) 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include "kms/gstkmsplanes.h"
+
+static guint32 xrgb[] = { DRM_FORMAT_XRGB8888 };
+static guint32 nv12[] = { DRM_FORMAT_NV12 };
+static guint32 argb_xrgb[] = { DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888 };
+static guint32 xrgb_nv12[] = { DRM_FORMAT_XRGB8888, DRM_FORMAT_NV12 };
+
+#define PLANE(id, type, zpos, formats) \
+  { id, DRM_PLANE_TYPE_##type, zpos, formats, G_N_ELEMENTS (formats) }
+
+/* @planes come from the bottom up, like gst_kms_planes_probe () sorts them */
+static GPtrArray *
+planes_new (GstKMSPlane * planes, guint n)
+{
+  GPtrArray *array = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < n; i++)
+    g_ptr_array_add (array, &planes[i]);
+
+  return array;
+}
+
+static void
+check_assign (GPtrArray * planes, const guint32 * fourccs, guint n_inputs,
+    guint max_planes, guint expected, const gint * expected_assignment,
+    gint expected_canvas)
+{
+  gint assignment[8];
+  gint canvas;
+  guint i;
+
+  fail_unless_equals_int (gst_kms_planes_assign (planes, fourccs, n_inputs,
+          max_planes, DRM_FORMAT_XRGB8888, assignment, &canvas), expected);
+  fail_unless_equals_int (canvas, expected_canvas);
+  for (i = 0; i < n_inputs; i++)
+    fail_unless_equals_int (assignment[i], expected_assignment[i]);
+}
+
+GST_START_TEST (test_formats)
+{
+  GstKMSPlane p[] = {
+    PLANE (31, PRIMARY, 0, xrgb_nv12),
+    PLANE (37, OVERLAY, 1, nv12),
+    PLANE (43, OVERLAY, 2, argb_xrgb),
+  };
+  GPtrArray *planes = planes_new (p, G_N_ELEMENTS (p));
+  const guint32 in[] = { DRM_FORMAT_NV12, DRM_FORMAT_ARGB8888 };
+  const gint out[] = { 0, 2 };
+
+  fail_unless (gst_kms_plane_has_format (&p[0], DRM_FORMAT_NV12));
+  fail_if (gst_kms_plane_has_format (&p[1], DRM_FORMAT_ARGB8888));
+
+  /* the NV12 stream takes the lowest plane that has it */
+  check_assign (planes, in, 2, 8, 2, out, -1);
+
+  g_ptr_array_unref (planes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_zpos_order)
+{
+  GstKMSPlane p[] = {
+    PLANE (31, PRIMARY, 0, argb_xrgb),
+    PLANE (37, OVERLAY, 1, nv12),
+  };
+  GPtrArray *planes = planes_new (p, G_N_ELEMENTS (p));
+  const guint32 video_on_top[] = { DRM_FORMAT_ARGB8888, DRM_FORMAT_NV12 };
+  const guint32 video_below[] = { DRM_FORMAT_NV12, DRM_FORMAT_ARGB8888 };
+  const gint on_planes[] = { 0, 1 };
+  const gint composed[] = { -1, -1 };
+
+  check_assign (planes, video_on_top, 2, 8, 2, on_planes, -1);
+
+  /* the ARGB stream would have to go below the video, all composed */
+  check_assign (planes, video_below, 2, 8, 0, composed, 0);
+
+  g_ptr_array_unref (planes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_canvas_fallback)
+{
+  GstKMSPlane p[] = {
+    PLANE (31, PRIMARY, 0, xrgb),
+    PLANE (37, OVERLAY, 1, nv12),
+  };
+  GPtrArray *planes = planes_new (p, G_N_ELEMENTS (p));
+  const guint32 in[] = { DRM_FORMAT_NV12, DRM_FORMAT_NV12, DRM_FORMAT_NV12 };
+  const gint out[] = { -1, -1, 1 };
+
+  /* the canvas takes the bottom streams, the top one keeps its plane */
+  check_assign (planes, in, 3, 8, 1, out, 0);
+
+  g_ptr_array_unref (planes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_no_canvas)
+{
+  GstKMSPlane p[] = {
+    PLANE (31, PRIMARY, 0, nv12),
+  };
+  GPtrArray *planes = planes_new (p, G_N_ELEMENTS (p));
+  const guint32 in[] = { DRM_FORMAT_NV12, DRM_FORMAT_NV12 };
+  const gint out[] = { -1, -1 };
+
+  check_assign (planes, in, 2, 8, 0, out, -1);
+
+  g_ptr_array_unref (planes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_max_planes)
+{
+  GstKMSPlane p[] = {
+    PLANE (31, PRIMARY, 0, xrgb_nv12),
+    PLANE (37, OVERLAY, 1, nv12),
+    PLANE (43, OVERLAY, 2, nv12),
+    PLANE (49, OVERLAY, 3, nv12),
+  };
+  GPtrArray *planes = planes_new (p, G_N_ELEMENTS (p));
+  const guint32 in[] = { DRM_FORMAT_NV12, DRM_FORMAT_NV12, DRM_FORMAT_NV12 };
+  const gint three[] = { 0, 1, 2 };
+  const gint two[] = { -1, 1, 2 };
+  const gint one[] = { -1, -1, 1 };
+  const gint none[] = { -1, -1, -1 };
+
+  check_assign (planes, in, 3, 3, 3, three, -1);
+  check_assign (planes, in, 3, 2, 2, two, 0);
+  check_assign (planes, in, 3, 1, 1, one, 0);
+  check_assign (planes, in, 3, 0, 0, none, 0);
+
+  g_ptr_array_unref (planes);
+}
+
+GST_END_TEST;
+
+static Suite *
+kmsplanes_suite (void)
+{
+  Suite *s = suite_create ("kmsplanes");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_formats);
+  tcase_add_test (tc_chain, test_zpos_order);
+  tcase_add_test (tc_chain, test_canvas_fallback);
+  tcase_add_test (tc_chain, test_no_canvas);
+  tcase_add_test (tc_chain, test_max_planes);
+
+  return s;
+}
+
+GST_CHECK_MAIN (kmsplanes);
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2017 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include "rga/rgascheduler.h"
+
+GST_DEBUG_CATEGORY (v4l2_debug);
+
+#define FULL_FRAME (1920 * 1080)
+#define SMALL_FRAME (320 * 240)
+#define HW_TIME 200             /* us */
+#define NUM_FRAMES 200
+
+/* a client the way rgaconvert drives it: up to @window frames in the
+ * hardware, the oldest one completed whenever the next does not fit */
+typedef struct
+{
+  GstRGASchedulerClient *client;
+  GstRGAPriority priority;
+  guint window;
+  guint64 pixels;
+  guint done;
+} TestClient;
+
+static gpointer
+run_client (TestClient * c)
+{
+  guint held = 0;
+  guint i;
+
+  for (i = 0; i < NUM_FRAMES; i++) {
+    while (held > 0 && !gst_rga_scheduler_try_acquire (c->client, c->pixels)) {
+      g_usleep (HW_TIME);
+      gst_rga_scheduler_release (c->client);
+      held--;
+      c->done++;
+    }
+    if (held == 0)
+      fail_unless (gst_rga_scheduler_acquire (c->client, c->pixels));
+    held++;
+
+    if (held >= c->window) {
+      g_usleep (HW_TIME);
+      gst_rga_scheduler_release (c->client);
+      held--;
+      c->done++;
+    }
+  }
+
+  while (held--) {
+    gst_rga_scheduler_release (c->client);
+    c->done++;
+  }
+
+  return NULL;
+}
+
+/* check's timeout catches a deadlock, a starved client never finishes */
+static void
+run_clients (TestClient * clients, guint n)
+{
+  GThread **threads = g_new (GThread *, n);
+  GstStructure *stats;
+  guint in_flight;
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    clients[i].client = gst_rga_scheduler_client_new (NULL,
+        clients[i].priority);
+    clients[i].done = 0;
+  }
+
+  for (i = 0; i < n; i++)
+    threads[i] = g_thread_new ("client", (GThreadFunc) run_client,
+        &clients[i]);
+
+  for (i = 0; i < n; i++) {
+    g_thread_join (threads[i]);
+    fail_unless_equals_int (clients[i].done, NUM_FRAMES);
+
+    stats = gst_rga_scheduler_client_get_stats (clients[i].client);
+    fail_unless (gst_structure_get_uint (stats, "in-flight", &in_flight));
+    fail_unless_equals_int (in_flight, 0);
+    gst_structure_free (stats);
+
+    gst_rga_scheduler_client_free (clients[i].client);
+  }
+
+  g_free (threads);
+}
+
+GST_START_TEST (test_two_windows_of_two)
+{
+  TestClient clients[] = {
+    {NULL, GST_RGA_PRIORITY_NORMAL, 2, FULL_FRAME},
+    {NULL, GST_RGA_PRIORITY_NORMAL, 2, FULL_FRAME},
+  };
+
+  run_clients (clients, G_N_ELEMENTS (clients));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_window_of_four)
+{
+  TestClient clients[] = {
+    {NULL, GST_RGA_PRIORITY_NORMAL, 4, FULL_FRAME},
+  };
+
+  run_clients (clients, G_N_ELEMENTS (clients));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_no_starvation)
+{
+  TestClient clients[] = {
+    {NULL, GST_RGA_PRIORITY_REALTIME, 2, FULL_FRAME},
+    {NULL, GST_RGA_PRIORITY_REALTIME, 4, SMALL_FRAME},
+    {NULL, GST_RGA_PRIORITY_NORMAL, 1, FULL_FRAME},
+    {NULL, GST_RGA_PRIORITY_NORMAL, 3, FULL_FRAME},
+    {NULL, GST_RGA_PRIORITY_NORMAL, 4, SMALL_FRAME},
+    {NULL, GST_RGA_PRIORITY_BACKGROUND, 1, FULL_FRAME},
+    {NULL, GST_RGA_PRIORITY_BACKGROUND, 2, FULL_FRAME},
+  };
+
+  run_clients (clients, G_N_ELEMENTS (clients));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_try_acquire_yields)
+{
+  GstRGASchedulerClient *a, *b;
+
+  a = gst_rga_scheduler_client_new (NULL, GST_RGA_PRIORITY_REALTIME);
+  b = gst_rga_scheduler_client_new (NULL, GST_RGA_PRIORITY_BACKGROUND);
+
+  /* two full frames fill the hardware */
+  fail_unless (gst_rga_scheduler_acquire (a, FULL_FRAME));
+  fail_unless (gst_rga_scheduler_try_acquire (a, FULL_FRAME));
+  fail_if (gst_rga_scheduler_try_acquire (a, FULL_FRAME));
+  fail_if (gst_rga_scheduler_try_acquire (b, SMALL_FRAME));
+
+  gst_rga_scheduler_release (a);
+  fail_unless (gst_rga_scheduler_try_acquire (b, SMALL_FRAME));
+
+  /* flushing drops the jobs and refuses new ones */
+  gst_rga_scheduler_client_set_flushing (a, TRUE);
+  fail_if (gst_rga_scheduler_try_acquire (a, SMALL_FRAME));
+  fail_if (gst_rga_scheduler_acquire (a, SMALL_FRAME));
+
+  gst_rga_scheduler_client_free (a);
+  gst_rga_scheduler_client_free (b);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_acquire_with_jobs)
+{
+  GstRGASchedulerClient *client;
+
+  client = gst_rga_scheduler_client_new (NULL, GST_RGA_PRIORITY_NORMAL);
+
+  fail_unless (gst_rga_scheduler_acquire (client, SMALL_FRAME));
+  /* it would wait for its own job */
+  ASSERT_CRITICAL (gst_rga_scheduler_acquire (client, SMALL_FRAME));
+
+  gst_rga_scheduler_release (client);
+  gst_rga_scheduler_client_free (client);
+}
+
+GST_END_TEST;
+
+static Suite *
+rgascheduler_suite (void)
+{
+  Suite *s = suite_create ("rgascheduler");
+  TCase *tc_chain = tcase_create ("general");
+
+  GST_DEBUG_CATEGORY_INIT (v4l2_debug, "rk_v4l2", 0, "V4L2 API calls");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_two_windows_of_two);
+  tcase_add_test (tc_chain, test_window_of_four);
+  tcase_add_test (tc_chain, test_no_starvation);
+  tcase_add_test (tc_chain, test_try_acquire_yields);
+  tcase_add_test (tc_chain, test_acquire_with_jobs);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rgascheduler);